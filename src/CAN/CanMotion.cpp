@@ -392,10 +392,10 @@ bool CanMotion::InternalStopDriverWhenMoving(DriverId driver, int32_t steps) noe
 	return false;
 }
 
-// This is called from the step ISR with DDA state executing, or from the Move task with DDA state provisional
+// This is called from the step ISR with DDA state executing, or when preparing the move with DDA state provisional or preparing
 void CanMotion::StopDriver(const DDA& dda, size_t axis, DriverId driver) noexcept
 {
-	if (dda.GetState() == DDA::DDAState::provisional)
+	if (dda.IsUnprepared())
 	{
 		InternalStopDriverWhenProvisional(driver);
 	}
@@ -412,14 +412,14 @@ void CanMotion::StopDriver(const DDA& dda, size_t axis, DriverId driver) noexcep
 	}
 }
 
-// This is called from the step ISR with DDA state executing, or from the Move task with DDA state provisional
+// This is called from the step ISR with DDA state executing, or when preparing the move with DDA state provisional or preparing
 void CanMotion::StopAxis(const DDA& dda, size_t axis) noexcept
 {
 	const Platform& p = reprap.GetPlatform();
 	if (axis < reprap.GetGCodes().GetTotalAxes())
 	{
 		const AxisDriversConfig& cfg = p.GetAxisDriversConfig(axis);
-		if (dda.GetState() == DDA::DDAState::provisional)
+		if (dda.IsUnprepared())
 		{
 			for (size_t i = 0; i < cfg.numDrivers; ++i)
 			{
@@ -459,10 +459,10 @@ void CanMotion::StopAxis(const DDA& dda, size_t axis) noexcept
 	}
 }
 
-// This is called from the step ISR with DDA state executing, or from the Move task with DDA state provisional
+// This is called from the step ISR with DDA state executing, or when preparing the move with DDA state provisional or preparing
 void CanMotion::StopAll(const DDA& dda) noexcept
 {
-	if (dda.GetState() == DDA::DDAState::provisional)
+	if (dda.IsUnprepared())
 	{
 		// We still send the messages so that the drives get enabled, but we set the steps to zero
 		for (CanMessageBuffer *buf = movementBufferList; buf != nullptr; buf = buf->next)
@@ -230,6 +230,7 @@ constexpr float MinArcSegmentLength = 0.1;				// G2 and G3 arc movement commands
 constexpr float MaxArcSegmentLength = 1.0;				// G2 and G3 arc movement commands get split into segments at most this long
 constexpr float MinArcSegmentsPerSec = 200.0;
 constexpr float SegmentsPerFulArcCalculation = 8.0;		// we do the full sine/cosine calculation every this number of segments
+constexpr float MaxNativeArcEndpointError = 0.01;		// G2 and G3 moves whose end point is further than this from the arc are split into segments instead of being executed as single moves
 
 constexpr uint32_t DefaultIdleTimeout = 30000;			// Milliseconds
 constexpr float DefaultIdleCurrentFactor = 0.3;			// Proportion of normal motor current that we use for idle hold
@@ -230,11 +230,51 @@
 # define SUPPORT_ACCELEROMETERS	0
 #endif
 
+#ifndef SUPPORT_MOVE_RECORDER
+# define SUPPORT_MOVE_RECORDER	HAS_MASS_STORAGE		// the recorded moves are dumped to a file
+#endif
+
+#ifndef SUPPORT_BICUBIC_MESH
+# define SUPPORT_BICUBIC_MESH	1						// allow M376 to select bicubic interpolation of the height map
+#endif
+
+#ifndef SUPPORT_MESH_Z_PROFILE
+# define SUPPORT_MESH_Z_PROFILE	1						// allow M376 to select applying mesh compensation during moves instead of segmenting them at grid lines
+#endif
+
+#ifndef SUPPORT_SHAPER_PLAN_CACHE
+# define SUPPORT_SHAPER_PLAN_CACHE	1					// reuse input shaping plans for moves with the same speeds, accelerations and length
+#endif
+
+#ifndef SUPPORT_FILE_READ_AHEAD
+# define SUPPORT_FILE_READ_AHEAD	(HAS_MASS_STORAGE && HAS_WRITER_TASK)	// read the file being printed ahead of the parser using the storage task
+#endif
+
+#ifndef SUPPORT_EXPRESSION_CACHE
+# define SUPPORT_EXPRESSION_CACHE	1					// compile meta command expressions in files the first time they are evaluated and cache the compiled code
+#endif
+
+#ifndef SUPPORT_MACRO_FILE_CACHE
+# define SUPPORT_MACRO_FILE_CACHE	HAS_MASS_STORAGE		// keep the contents of small macro files in RAM
+#endif
+
+#ifndef SUPPORT_NATIVE_ARCS
+# define SUPPORT_NATIVE_ARCS	1						// execute G2/G3 moves as single moves when the kinematics allow it
+#endif
+
+#ifndef SUPPORT_TRANSFORM_BATCH
+# define SUPPORT_TRANSFORM_BATCH	1					// transform queued segments of moves in batches when the kinematics segment moves
+#endif
+
 // Optional kinematics support, to allow us to reduce flash memory usage
 #ifndef SUPPORT_LINEAR_DELTA
 # define SUPPORT_LINEAR_DELTA	1
 #endif
 
+#ifndef SUPPORT_DELTA_STEP_PROFILES
+# define SUPPORT_DELTA_STEP_PROFILES	SUPPORT_LINEAR_DELTA	// allow M595 D to select approximating the delta step calculation by precomputed polynomials
+#endif
+
 #ifndef SUPPORT_ROTARY_DELTA
 # define SUPPORT_ROTARY_DELTA	1
 #endif
@@ -0,0 +1,306 @@
+/*
+ * ExpressionCache.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include "ExpressionCache.h"
+
+#if SUPPORT_EXPRESSION_CACHE
+
+#include <Platform/RepRap.h>
+#include <Platform/Platform.h>
+#include <Platform/Tasks.h>
+
+// Static data
+CompiledExpression *_ecv_array _ecv_null ExpressionCache::entries = nullptr;
+uint32_t ExpressionCache::useCounter = 0;
+unsigned int ExpressionCache::numHits = 0;
+unsigned int ExpressionCache::numMisses = 0;
+unsigned int ExpressionCache::numUncompilable = 0;
+unsigned int ExpressionCache::numCompiled = 0;
+unsigned int ExpressionCache::numExecuteTimes = 0;
+unsigned int ExpressionCache::numInterpretTimes = 0;
+uint32_t ExpressionCache::executeClocks = 0;
+uint32_t ExpressionCache::interpretClocks = 0;
+
+void ExpressionCompiler::EmitByte(uint8_t b) noexcept
+{
+	if (length < CompiledExpression::MaxCodeLength)
+	{
+		target.code[length++] = b;
+	}
+	else
+	{
+		failed = true;
+	}
+}
+
+void ExpressionCompiler::EmitBytes(const void *p, size_t n) noexcept
+{
+	if (length + n <= CompiledExpression::MaxCodeLength)
+	{
+		memcpy(target.code + length, p, n);
+		length += n;
+	}
+	else
+	{
+		failed = true;
+	}
+}
+
+void ExpressionCompiler::ChangeDepth(int change) noexcept
+{
+	depth += change;
+	if (depth > maxDepth)
+	{
+		maxDepth = depth;
+		if (maxDepth > CompiledExpression::MaxStackDepth)
+		{
+			failed = true;
+		}
+	}
+}
+
+void ExpressionCompiler::EmitInt(int32_t i) noexcept
+{
+	EmitByte((uint8_t)CompiledOp::pushInt);
+	EmitBytes(&i, sizeof(i));
+	ChangeDepth(1);
+}
+
+void ExpressionCompiler::EmitFloat(float f, uint32_t digits) noexcept
+{
+	EmitByte((uint8_t)CompiledOp::pushFloat);
+	EmitBytes(&f, sizeof(f));
+	EmitByte((uint8_t)digits);
+	ChangeDepth(1);
+}
+
+void ExpressionCompiler::EmitString(const char *_ecv_array s) noexcept
+{
+	const size_t len = strlen(s);
+	if (len > 255)
+	{
+		failed = true;
+		return;
+	}
+	EmitByte((uint8_t)CompiledOp::pushString);
+	EmitByte((uint8_t)len);
+	EmitBytes(s, len + 1);
+	ChangeDepth(1);
+}
+
+void ExpressionCompiler::EmitConstant(unsigned int which) noexcept
+{
+	EmitByte((uint8_t)CompiledOp::constant);
+	EmitByte((uint8_t)which);
+	ChangeDepth(1);
+}
+
+void ExpressionCompiler::EmitUnaryOp(char op) noexcept
+{
+	EmitByte((uint8_t)CompiledOp::unaryOp);
+	EmitByte((uint8_t)op);
+}
+
+void ExpressionCompiler::EmitToBool() noexcept
+{
+	EmitByte((uint8_t)CompiledOp::toBool);
+}
+
+void ExpressionCompiler::EmitBinaryOp(char op, bool invert) noexcept
+{
+	EmitByte((uint8_t)CompiledOp::binaryOp);
+	EmitByte((uint8_t)op);
+	EmitByte((invert) ? 1 : 0);
+	ChangeDepth(-1);
+}
+
+void ExpressionCompiler::EmitUnaryFunction(unsigned int func) noexcept
+{
+	EmitByte((uint8_t)CompiledOp::call1);
+	EmitByte((uint8_t)func);
+}
+
+void ExpressionCompiler::EmitBinaryFunction(unsigned int func) noexcept
+{
+	EmitByte((uint8_t)CompiledOp::call2);
+	EmitByte((uint8_t)func);
+	ChangeDepth(-1);
+}
+
+void ExpressionCompiler::EmitCheckIndex() noexcept
+{
+	EmitByte((uint8_t)CompiledOp::checkIndex);
+}
+
+void ExpressionCompiler::EmitVariable(VariableKind kind, const char *_ecv_array name, bool wantExists) noexcept
+{
+	EmitByte((uint8_t)CompiledOp::variable);
+	EmitByte((uint8_t)kind);
+	EmitByte((wantExists) ? 1 : 0);
+	EmitBytes(name, strlen(name) + 1);
+	ChangeDepth(1);
+}
+
+// Emit an object model lookup. The array indices in the ID string are on the stack.
+void ExpressionCompiler::EmitObjectValue(const char *_ecv_array id, bool wantLength, bool wantExists) noexcept
+{
+	// Count the indices and the number of levels in the path. We look up one table entry for each level.
+	unsigned int numIndices = 0, numLevels = 1;
+	for (const char *_ecv_array p = id; *p != 0; ++p)
+	{
+		if (*p == '^')
+		{
+			++numIndices;
+		}
+		else if (*p == '.')
+		{
+			++numLevels;
+		}
+	}
+
+	const size_t numSlots = min<size_t>(numLevels, CompiledExpression::NumLookupCacheSlots - target.numSlotsUsed);
+	EmitByte((uint8_t)CompiledOp::objectValue);
+	EmitByte(((wantLength) ? CompiledWantLength : 0) | ((wantExists) ? CompiledWantExists : 0));
+	EmitByte((uint8_t)numIndices);
+	EmitByte(target.numSlotsUsed);
+	EmitByte((uint8_t)numSlots);
+	EmitBytes(id, strlen(id) + 1);
+	target.numSlotsUsed += (uint8_t)numSlots;
+	ChangeDepth(1 - (int)numIndices);
+}
+
+size_t ExpressionCompiler::EmitJump(CompiledOp op) noexcept
+{
+	EmitByte((uint8_t)op);
+	const size_t where = length;
+	EmitByte(0);
+	if (op != CompiledOp::jump)
+	{
+		ChangeDepth(-1);								// if we don't jump then the value is popped
+	}
+	return where;
+}
+
+void ExpressionCompiler::PatchJump(size_t where) noexcept
+{
+	if (!failed)
+	{
+		target.code[where] = (uint8_t)length;
+	}
+}
+
+void ExpressionCompiler::DropValue() noexcept
+{
+	ChangeDepth(-1);
+}
+
+// Finish compiling and return true if the code is complete
+bool ExpressionCompiler::Finish() noexcept
+{
+	EmitByte((uint8_t)CompiledOp::end);
+	return !failed && depth == 1;
+}
+
+// Hash the rest of the line using the FNV-1a algorithm, also returning its length
+static uint32_t HashText(const char *_ecv_array text, const char *_ecv_array textLimit, size_t& length) noexcept
+{
+	uint32_t hash = 2166136261u;
+	const char *_ecv_array p = text;
+	while (p < textLimit && *p != 0)
+	{
+		hash = (hash ^ (uint8_t)*p++) * 16777619u;
+	}
+	length = p - text;
+	return hash;
+}
+
+/*static*/ CompiledExpression *_ecv_null ExpressionCache::Lookup(FilePosition pos, int col, const char *_ecv_array text, const char *_ecv_array textLimit) noexcept
+{
+	if (entries == nullptr)
+	{
+		entries = static_cast<CompiledExpression*>(Tasks::AllocPermanent(NumEntries * sizeof(CompiledExpression)));
+		for (size_t i = 0; i < NumEntries; ++i)
+		{
+			entries[i].state = CompiledExpression::State::free;
+		}
+	}
+
+	size_t textLength;
+	const uint32_t hash = HashText(text, textLimit, textLength);
+	++useCounter;
+
+	// Look for a matching entry, at the same time finding the one to replace if there isn't one
+	CompiledExpression *_ecv_null victim = nullptr;
+	for (size_t i = 0; i < NumEntries; ++i)
+	{
+		CompiledExpression& ce = entries[i];
+		if (ce.Matches(pos, col, hash, textLength))
+		{
+			ce.lastUsed = useCounter;
+			if (ce.state == CompiledExpression::State::compiled)
+			{
+				++numHits;
+				return &ce;
+			}
+			++numUncompilable;
+			return nullptr;
+		}
+		if (victim == nullptr || ce.state == CompiledExpression::State::free || (victim->state != CompiledExpression::State::free && ce.lastUsed < victim->lastUsed))
+		{
+			victim = &ce;
+		}
+	}
+
+	// Don't cache expressions that start too far along the line for the entry to record the column, or lines that are too long to record the length of
+	if (col > UINT16_MAX || textLength > UINT16_MAX)
+	{
+		return nullptr;
+	}
+
+	++numMisses;
+	victim->filePos = pos;
+	victim->column = (uint16_t)col;
+	victim->textHash = hash;
+	victim->textLength = (uint16_t)textLength;
+	victim->lastUsed = useCounter;
+	victim->numSlotsUsed = 0;
+	victim->state = CompiledExpression::State::compiling;		// if evaluating the expression throws then the entry is left in this state, which means it is not used
+	for (ObjectModelLookupCacheEntry& slot : victim->lookupCache)
+	{
+		slot.Clear();
+	}
+	return victim;
+}
+
+/*static*/ void ExpressionCache::FinishCompiling(ExpressionCompiler& compiler, CompiledExpression& ce, size_t sourceLength) noexcept
+{
+	if (compiler.Finish() && sourceLength <= UINT16_MAX)
+	{
+		ce.sourceLength = (uint16_t)sourceLength;
+		ce.state = CompiledExpression::State::compiled;
+		++numCompiled;
+	}
+	else
+	{
+		ce.state = CompiledExpression::State::uncompilable;
+	}
+}
+
+/*static*/ void ExpressionCache::Diagnostics(MessageType mtype) noexcept
+{
+	constexpr float StepClocksToMicros = StepClocksToMillis * 1000.0;
+	reprap.GetPlatform().MessageF(mtype, "Expression cache: compiled %u, hits %u, misses %u, uncompilable %u, time per execution %.1fus, per interpretation %.1fus\n",
+									numCompiled, numHits, numMisses, numUncompilable,
+									(double)((numExecuteTimes == 0) ? 0.0 : (float)executeClocks * StepClocksToMicros/numExecuteTimes),
+									(double)((numInterpretTimes == 0) ? 0.0 : (float)interpretClocks * StepClocksToMicros/numInterpretTimes));
+	numHits = numMisses = numUncompilable = numExecuteTimes = numInterpretTimes = 0;
+	executeClocks = interpretClocks = 0;
+}
+
+#endif
+
+// End
@@ -0,0 +1,168 @@
+/*
+ * ExpressionCache.h
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * Cache of compiled expressions from meta commands in files.
+ * The first time an expression at a particular place in a file is evaluated, ExpressionParser interprets it as usual and at the same time
+ * emits a compact postfix code for it, which is stored here. When the same expression is evaluated again (typically in a loop or in a
+ * macro that is run repeatedly) the code is executed instead, which avoids parsing the text, looking up named constants and function names,
+ * and searching the object model tables, because the table entries found are recorded in the cache entry.
+ *
+ * Entries are keyed on the file position and column of the expression, and also on the length and a hash of the rest of the line,
+ * so an entry is never used if the file has been changed or a different file has the same text at the same position.
+ * Compiled code only depends on the text, so a hit on an entry is always safe.
+ * Only the GCodes task evaluates expressions from files, so the cache does not need a lock.
+ */
+
+#ifndef SRC_GCODES_GCODEBUFFER_EXPRESSIONCACHE_H_
+#define SRC_GCODES_GCODEBUFFER_EXPRESSIONCACHE_H_
+
+#include <RepRapFirmware.h>
+
+#if SUPPORT_EXPRESSION_CACHE
+
+#include <ObjectModel/ObjectModel.h>
+
+// Operations in compiled expressions. Operands follow the operation byte.
+enum class CompiledOp : uint8_t
+{
+	end = 0,			// end of code, the result is on the stack
+	pushInt,			// 4-byte integer
+	pushFloat,			// 4-byte float, 1-byte number of decimal digits
+	pushString,			// 1-byte length, characters, null terminator
+	constant,			// 1-byte NamedConstant
+	unaryOp,			// 1-byte operator character
+	toBool,				// convert the top of stack to Boolean or throw
+	binaryOp,			// 1-byte operator character, 1-byte invert flag
+	jumpIfFalse,		// 1-byte target. If the top of stack is false then jump leaving it on the stack, else pop it.
+	jumpIfTrue,			// 1-byte target. If the top of stack is true then jump leaving it on the stack, else pop it.
+	popJumpIfFalse,		// 1-byte target. Pop the top of stack and jump if it was false.
+	jump,				// 1-byte target
+	call1,				// 1-byte Function. Replace the top of stack by the function of it.
+	call2,				// 1-byte Function. Replace the top two stack values by the function of them.
+	checkIndex,			// check that the top of stack is an integer array index
+	variable,			// 1-byte VariableKind, 1-byte wantExists flag, null-terminated name
+	objectValue,		// 1-byte flags, 1-byte number of indices, 1-byte first lookup cache slot, 1-byte number of slots, null-terminated ID string
+};
+
+enum class VariableKind : uint8_t
+{
+	parameter = 0, local, global
+};
+
+// Flags used by the objectValue operation
+constexpr uint8_t CompiledWantLength = 0x01;
+constexpr uint8_t CompiledWantExists = 0x02;
+
+class CompiledExpression
+{
+public:
+	static constexpr size_t MaxCodeLength = 96;					// must not exceed 255 because jump targets are single bytes
+	static constexpr size_t MaxStackDepth = 8;
+	static constexpr size_t NumLookupCacheSlots = 6;
+
+	bool IsCompiled() const noexcept { return state == State::compiled; }
+	const uint8_t *_ecv_array GetCode() const noexcept { return code; }
+	ObjectModelLookupCacheEntry *_ecv_array GetLookupCache(size_t firstSlot) noexcept { return &lookupCache[firstSlot]; }
+	size_t GetSourceLength() const noexcept { return sourceLength; }
+
+private:
+	friend class ExpressionCache;
+	friend class ExpressionCompiler;
+
+	enum class State : uint8_t { free = 0, compiling, compiled, uncompilable };
+
+	bool Matches(FilePosition pos, int col, uint32_t hash, size_t len) const noexcept
+	{
+		return state >= State::compiled && filePos == pos && column == col && textHash == hash && textLength == len;
+	}
+
+	FilePosition filePos;										// the file position of the command containing the expression
+	uint32_t textHash;											// hash of the text from the start of the expression to the end of the line
+	uint32_t lastUsed;											// value of the use counter when this entry was last used, for replacement
+	uint16_t column;											// the column at which the expression starts
+	uint16_t textLength;										// the length of the text from the start of the expression to the end of the line
+	uint16_t sourceLength;										// the number of characters that the expression occupies
+	State state;
+	uint8_t numSlotsUsed;
+	ObjectModelLookupCacheEntry lookupCache[NumLookupCacheSlots];
+	uint8_t code[MaxCodeLength];
+};
+
+// Class to append operations to a compiled expression. If the code or the stack depth would exceed what the cache entry can hold,
+// or the expression uses a feature that we don't compile, the compiler is marked as failed and the remaining operations are ignored.
+class ExpressionCompiler
+{
+public:
+	explicit ExpressionCompiler(CompiledExpression& p_target) noexcept : target(p_target), length(0), depth(0), maxDepth(0), failed(false) { }
+
+	void Fail() noexcept { failed = true; }
+	bool Failed() const noexcept { return failed; }
+
+	void EmitInt(int32_t i) noexcept;
+	void EmitFloat(float f, uint32_t digits) noexcept;
+	void EmitString(const char *_ecv_array s) noexcept;
+	void EmitConstant(unsigned int which) noexcept;
+	void EmitUnaryOp(char op) noexcept;
+	void EmitToBool() noexcept;
+	void EmitBinaryOp(char op, bool invert) noexcept;
+	void EmitUnaryFunction(unsigned int func) noexcept;
+	void EmitBinaryFunction(unsigned int func) noexcept;
+	void EmitCheckIndex() noexcept;
+	void EmitVariable(VariableKind kind, const char *_ecv_array name, bool wantExists) noexcept;
+	void EmitObjectValue(const char *_ecv_array id, bool wantLength, bool wantExists) noexcept;
+
+	size_t EmitJump(CompiledOp op) noexcept;					// emit a jump and return where its target is, for patching later
+	void PatchJump(size_t where) noexcept;						// set the target of a jump to the current end of the code
+	void DropValue() noexcept;									// record that one less value is on the stack at the current point in the code
+
+	bool Finish() noexcept;
+
+private:
+	void EmitByte(uint8_t b) noexcept;
+	void EmitBytes(const void *p, size_t n) noexcept;
+	void ChangeDepth(int change) noexcept;
+
+	CompiledExpression& target;
+	size_t length;
+	unsigned int depth;
+	unsigned int maxDepth;
+	bool failed;
+};
+
+class ExpressionCache
+{
+public:
+	static constexpr size_t NumEntries = 8;
+
+	// Look up the expression starting at 'text' in the command at file position 'pos'. If we have already compiled it then return the entry, which is ready to execute.
+	// If we haven't seen it before then return a newly-allocated entry that is ready to be compiled. Return null if we found that it can't be compiled.
+	static CompiledExpression *_ecv_null Lookup(FilePosition pos, int col, const char *_ecv_array text, const char *_ecv_array textLimit) noexcept;
+
+	// Finish compiling an expression after it has been evaluated successfully
+	static void FinishCompiling(ExpressionCompiler& compiler, CompiledExpression& ce, size_t sourceLength) noexcept;
+
+	// Record the time taken to evaluate an expression by executing its compiled code, or by interpreting it while compiling it
+	static void RecordExecuteTime(uint32_t clocks) noexcept { executeClocks += clocks; ++numExecuteTimes; }
+	static void RecordInterpretTime(uint32_t clocks) noexcept { interpretClocks += clocks; ++numInterpretTimes; }
+
+	static void Diagnostics(MessageType mtype) noexcept;
+
+private:
+	static CompiledExpression *_ecv_array _ecv_null entries;
+	static uint32_t useCounter;
+	static unsigned int numHits;
+	static unsigned int numMisses;
+	static unsigned int numUncompilable;
+	static unsigned int numCompiled;
+	static unsigned int numExecuteTimes;
+	static unsigned int numInterpretTimes;
+	static uint32_t executeClocks;
+	static uint32_t interpretClocks;
+};
+
+#endif
+
+#endif /* SRC_GCODES_GCODEBUFFER_EXPRESSIONCACHE_H_ */
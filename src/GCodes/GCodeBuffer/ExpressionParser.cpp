@@ -8,11 +8,13 @@
 #include "ExpressionParser.h"
 
 #include "GCodeBuffer.h"
+#include "ExpressionCache.h"
 #include <Platform/RepRap.h>
 #include <Platform/Platform.h>
 #include <General/NamedEnum.h>
 #include <General/NumericConverter.h>
 #include <Hardware/ExceptionHandlers.h>
+#include <Movement/StepTimer.h>
 
 #include <limits>
 
@@ -37,8 +39,18 @@ NamedEnum(Function, unsigned int, abs, acos, asin, atan, atan2, cos, datetime, d
 
 const char * const InvalidExistsMessage = "invalid 'exists' expression";
 
+// Macro to emit compiled code for the part of the expression that we have just parsed, if we are compiling it
+#if SUPPORT_EXPRESSION_CACHE
+# define COMPILE(_emit)		do { if (compiler != nullptr) { compiler->_emit; } } while (false)
+#else
+# define COMPILE(_emit)		do { } while (false)
+#endif
+
 ExpressionParser::ExpressionParser(const GCodeBuffer& p_gb, const char *text, const char *textLimit, int p_column) noexcept
 	: currentp(text), startp(text), endp(textLimit), gb(p_gb), column(p_column)
+#if SUPPORT_EXPRESSION_CACHE
+	  , compiler(nullptr)
+#endif
 {
 }
 
@@ -59,7 +71,16 @@ ExpressionValue ExpressionParser::Parse(bool evaluate) THROWS(GCodeException)
 {
 	obsoleteField.Clear();
 	ExpressionValue result;
-	ParseInternal(result, evaluate, 0);
+#if SUPPORT_EXPRESSION_CACHE
+	if (evaluate && column >= 0)
+	{
+		ParseCached(result);
+	}
+	else
+#endif
+	{
+		ParseInternal(result, evaluate, 0);
+	}
 	if (!obsoleteField.IsEmpty())
 	{
 		reprap.GetPlatform().MessageF(WarningMessage, "obsolete object model field %s queried\n", obsoleteField.c_str());
@@ -87,46 +108,13 @@ void ExpressionParser::ParseInternal(ExpressionValue& val, bool evaluate, uint8_
 		break;
 
 	case '-':
-		AdvancePointer();
-		CheckStack(StackUsage::ParseInternal);
-		ParseInternal(val, evaluate, UnaryPriority);
-		switch (val.GetType())
-		{
-		case TypeCode::Int32:
-			val.iVal = -val.iVal;		//TODO overflow check
-			break;
-
-		case TypeCode::Float:
-			val.fVal = -val.fVal;
-			break;
-
-		default:
-			ThrowParseException("expected numeric value after '-'");
-		}
-		break;
-
 	case '+':
+	case '!':
 		AdvancePointer();
 		CheckStack(StackUsage::ParseInternal);
 		ParseInternal(val, evaluate, UnaryPriority);
-		switch (val.GetType())
-		{
-		case TypeCode::Uint32:
-			// Convert enumeration to integer
-			val.SetInt((int32_t)val.uVal);
-			break;
-
-		case TypeCode::Int32:
-		case TypeCode::Float:
-			break;
-
-		case TypeCode::DateTime_tc:					// unary + converts a DateTime to a seconds count
-			val.SetInt((uint32_t)val.Get56BitValue());
-			break;
-
-		default:
-			ThrowParseException("expected numeric or enumeration value after '+'");
-		}
+		ApplyUnaryOperator(c, val, evaluate);
+		COMPILE(EmitUnaryOp(c));
 		break;
 
 	case '#':
@@ -142,18 +130,8 @@ void ExpressionParser::ParseInternal(ExpressionValue& val, bool evaluate, uint8_
 		{
 			CheckStack(StackUsage::ParseInternal);
 			ParseInternal(val, evaluate, UnaryPriority);
-			if (val.GetType() == TypeCode::CString)
-			{
-				val.SetInt((int32_t)strlen(val.sVal));
-			}
-			else if (val.GetType() == TypeCode::HeapString)
-			{
-				val.SetInt((int32_t)val.shVal.GetLength());
-			}
-			else
-			{
-				ThrowParseException("expected object model value or string after '#");
-			}
+			ApplyUnaryOperator(c, val, evaluate);
+			COMPILE(EmitUnaryOp(c));
 		}
 		break;
 
@@ -167,14 +145,6 @@ void ExpressionParser::ParseInternal(ExpressionValue& val, bool evaluate, uint8_
 		ParseExpectKet(val, evaluate, ')');
 		break;
 
-	case '!':
-		AdvancePointer();
-		CheckStack(StackUsage::ParseInternal);
-		ParseInternal(val, evaluate, UnaryPriority);
-		ConvertToBool(val, evaluate);
-		val.bVal = !val.bVal;
-		break;
-
 	default:
 		if (isdigit(c))						// looks like a number
 		{
@@ -247,6 +217,9 @@ void ExpressionParser::ParseInternal(ExpressionValue& val, bool evaluate, uint8_
 		case '&':
 			ConvertToBool(val, evaluate);
 			{
+#if SUPPORT_EXPRESSION_CACHE
+				const size_t jumpFrom = (compiler != nullptr) ? (compiler->EmitToBool(), compiler->EmitJump(CompiledOp::jumpIfFalse)) : 0;
+#endif
 				ExpressionValue val2;
 				CheckStack(StackUsage::ParseInternal);
 				ParseInternal(val2, evaluate && val.bVal, opPrio);		// get the next operand
@@ -255,12 +228,17 @@ void ExpressionParser::ParseInternal(ExpressionValue& val, bool evaluate, uint8_
 					ConvertToBool(val2, evaluate);
 					val.bVal = val2.bVal;
 				}
+				COMPILE(EmitToBool());
+				COMPILE(PatchJump(jumpFrom));
 			}
 			break;
 
 		case '|':
 			ConvertToBool(val, evaluate);
 			{
+#if SUPPORT_EXPRESSION_CACHE
+				const size_t jumpFrom = (compiler != nullptr) ? (compiler->EmitToBool(), compiler->EmitJump(CompiledOp::jumpIfTrue)) : 0;
+#endif
 				ExpressionValue val2;
 				CheckStack(StackUsage::ParseInternal);
 				ParseInternal(val2, evaluate && !val.bVal, opPrio);		// get the next operand
@@ -269,12 +247,17 @@ void ExpressionParser::ParseInternal(ExpressionValue& val, bool evaluate, uint8_
 					ConvertToBool(val2, evaluate);
 					val.bVal = val2.bVal;
 				}
+				COMPILE(EmitToBool());
+				COMPILE(PatchJump(jumpFrom));
 			}
 			break;
 
 		case '?':
 			ConvertToBool(val, evaluate);
 			{
+#if SUPPORT_EXPRESSION_CACHE
+				const size_t jumpToElse = (compiler != nullptr) ? (compiler->EmitToBool(), compiler->EmitJump(CompiledOp::popJumpIfFalse)) : 0;
+#endif
 				const bool b = val.bVal;
 				ExpressionValue val2;
 				CheckStack(StackUsage::ParseInternal);
@@ -284,8 +267,14 @@ void ExpressionParser::ParseInternal(ExpressionValue& val, bool evaluate, uint8_
 					ThrowParseException("expected ':'");
 				}
 				AdvancePointer();
+#if SUPPORT_EXPRESSION_CACHE
+				const size_t jumpToEnd = (compiler != nullptr) ? compiler->EmitJump(CompiledOp::jump) : 0;
+				COMPILE(DropValue());											// the second operand is not on the stack when we execute the third one
+				COMPILE(PatchJump(jumpToElse));
+#endif
 				// We recently checked the stack for a call to ParseInternal, no need to do it again
 				ParseInternal(((b) ? val2 : val), evaluate && !b, opPrio - 1);	// get the third operand, which may be a further conditional expression
+				COMPILE(PatchJump(jumpToEnd));
 				return;
 			}
 
@@ -295,320 +284,394 @@ void ExpressionParser::ParseInternal(ExpressionValue& val, bool evaluate, uint8_
 				ExpressionValue val2;
 				CheckStack(StackUsage::ParseInternal);
 				ParseInternal(val2, evaluate, opPrio);	// get the next operand
-				switch(opChar)
-				{
-				case '+':
-					if (val.GetType() == TypeCode::DateTime_tc)
-					{
-						if (val2.GetType() == TypeCode::Uint32)
-						{
-							val.Set56BitValue(val.Get56BitValue() + val2.uVal);
-						}
-						else if (val2.GetType() == TypeCode::Int32)
-						{
-							val.Set56BitValue((int64_t)val.Get56BitValue() + val2.iVal);
-						}
-						else if (evaluate)
-						{
-							ThrowParseException("invalid operand types");
-						}
-					}
-					else
-					{
-						BalanceNumericTypes(val, val2, evaluate);
-						if (val.GetType() == TypeCode::Float)
-						{
-							val.fVal += val2.fVal;
-							val.param = max(val.param, val2.param);
-						}
-						else
-						{
-							val.iVal += val2.iVal;
-						}
-					}
-					break;
-
-				case '-':
-					if (val.GetType() == TypeCode::DateTime_tc)
-					{
-						if (val2.GetType() == TypeCode::DateTime_tc)
-						{
-							// Difference of two data/times
-							val.SetInt((int32_t)(val.Get56BitValue() - val2.Get56BitValue()));
-						}
-						else if (val2.GetType() == TypeCode::Uint32)
-						{
-							val.Set56BitValue(val.Get56BitValue() - val2.uVal);
-						}
-						else if (val2.GetType() == TypeCode::Int32)
-						{
-							val.Set56BitValue((int64_t)val.Get56BitValue() - val2.iVal);
-						}
-						else if (evaluate)
-						{
-							ThrowParseException("invalid operand types");
-						}
-					}
-					else
-					{
-						BalanceNumericTypes(val, val2, evaluate);
-						if (val.GetType() == TypeCode::Float)
-						{
-							val.fVal -= val2.fVal;
-							val.param = max(val.param, val2.param);
-						}
-						else
-						{
-							val.iVal -= val2.iVal;
-						}
-					}
-					break;
-
-				case '*':
-					BalanceNumericTypes(val, val2, evaluate);
-					if (val.GetType() == TypeCode::Float)
-					{
-						val.fVal *= val2.fVal;
-						val.param = max(val.param, val2.param);
-					}
-					else
-					{
-						val.iVal *= val2.iVal;
-					}
-					break;
-
-				case '/':
-					ConvertToFloat(val, evaluate);
-					ConvertToFloat(val2, evaluate);
-					val.fVal /= val2.fVal;
-					val.param = MaxFloatDigitsDisplayedAfterPoint;
-					break;
-
-				case '>':
-					BalanceTypes(val, val2, evaluate);
-					{
-						bool bResult;
-						switch (val.GetType())
-						{
-						case TypeCode::Int32:
-							bResult = (val.iVal > val2.iVal);
-							break;
-
-						case TypeCode::Float:
-							bResult = (val.fVal > val2.fVal);
-							break;
-
-						case TypeCode::DateTime_tc:
-							bResult = val.Get56BitValue() > val2.Get56BitValue();
-							break;
-
-						case TypeCode::Bool:
-							bResult = (val.bVal && !val2.bVal);
-							break;
-
-						default:
-							if (evaluate)
-							{
-								ThrowParseException("expected numeric or Boolean operands to comparison operator");
-							}
-							bResult = false;
-							break;
-						}
-						val.SetBool((invert) ? !bResult : bResult);
-					}
-					break;
-
-				case '<':
-					BalanceTypes(val, val2, evaluate);
-					{
-						bool bResult;
-						switch (val.GetType())
-						{
-						case TypeCode::Int32:
-							bResult = (val.iVal < val2.iVal);
-							break;
-
-						case TypeCode::Float:
-							bResult = (val.fVal < val2.fVal);
-							break;
-
-						case TypeCode::DateTime_tc:
-							bResult = val.Get56BitValue() < val2.Get56BitValue();
-							break;
-
-						case TypeCode::Bool:
-							bResult = (!val.bVal && val2.bVal);
-							break;
-
-						default:
-							if (evaluate)
-							{
-								ThrowParseException("expected numeric or Boolean operands to comparison operator");
-							}
-							bResult = false;
-							break;
-						}
-						val.SetBool((invert) ? !bResult : bResult);
-					}
-					break;
-
-				case '=':
-					{
-						bool bResult;
-						// Before balancing, handle comparisons with null
-						if (val.GetType() == TypeCode::None)
-						{
-							bResult = (val2.GetType() == TypeCode::None);
-						}
-						else if (val2.GetType() == TypeCode::None)
-						{
-							bResult = false;
-						}
-						else
-						{
-							BalanceTypes(val, val2, evaluate);
-							switch (val.GetType())
-							{
-							case TypeCode::ObjectModel_tc:
-								ThrowParseException("cannot compare objects");
-
-							case TypeCode::Int32:
-								bResult = (val.iVal == val2.iVal);
-								break;
-
-							case TypeCode::Uint32:
-								bResult = (val.uVal == val2.uVal);
-								break;
-
-							case TypeCode::Float:
-								bResult = (val.fVal == val2.fVal);
-								break;
-
-							case TypeCode::DateTime_tc:
-								bResult = val.Get56BitValue() == val2.Get56BitValue();
-								break;
-
-							case TypeCode::Bool:
-								bResult = (val.bVal == val2.bVal);
-								break;
-
-							case TypeCode::CString:
-								bResult = (strcmp(val.sVal, (val2.GetType() == TypeCode::HeapString) ? val2.shVal.Get().Ptr() : val2.sVal) == 0);
-								break;
-
-							case TypeCode::HeapString:
-								bResult = (strcmp(val.shVal.Get().Ptr(), (val2.GetType() == TypeCode::HeapString) ? val2.shVal.Get().Ptr() : val2.sVal) == 0);
-								break;
-
-							default:
-								if (evaluate)
-								{
-									ThrowParseException("unexpected operand type to equality operator");
-								}
-								bResult = false;
-								break;
-							}
-						}
-						val.SetBool((invert) ? !bResult : bResult);
-					}
-					break;
-
-				case '^':
-					StringConcat(val, val2);
-					break;
-				}
+				ApplyBinaryOperator(opChar, invert, val, val2, evaluate);
+				COMPILE(EmitBinaryOp(opChar, invert));
 			}
 		}
 	} while (true);
 }
 
-// Concatenate val1 and val2 and assign the result to val1
-// This is written as a separate function because it needs a temporary string buffer, and its caller is recursive. Its declaration must be declared 'noinline'.
-/*static*/ void  ExpressionParser::StringConcat(ExpressionValue &val, ExpressionValue &val2) noexcept
-{
-    String<MaxStringExpressionLength> str;
-    val.AppendAsString(str.GetRef());
-    val2.AppendAsString(str.GetRef());
-    StringHandle sh(str.c_str());
-    val.SetStringHandle(sh);
-}
-
-bool ExpressionParser::ParseBoolean() THROWS(GCodeException)
+// Apply a unary operator to a value
+void ExpressionParser::ApplyUnaryOperator(char op, ExpressionValue& val, bool evaluate) THROWS(GCodeException)
 {
-	ExpressionValue val = Parse();
-	ConvertToBool(val, true);
-	return val.bVal;
-}
+	switch (op)
+	{
+	case '-':
+		switch (val.GetType())
+		{
+		case TypeCode::Int32:
+			val.iVal = -val.iVal;		//TODO overflow check
+			break;
 
-float ExpressionParser::ParseFloat() THROWS(GCodeException)
-{
-	ExpressionValue val = Parse();
-	ConvertToFloat(val, true);
-	return val.fVal;
-}
+		case TypeCode::Float:
+			val.fVal = -val.fVal;
+			break;
 
-int32_t ExpressionParser::ParseInteger() THROWS(GCodeException)
-{
-	const ExpressionValue val = Parse();
-	switch (val.GetType())
-	{
-	case TypeCode::Int32:
-		return val.iVal;
+		default:
+			ThrowParseException("expected numeric value after '-'");
+		}
+		break;
 
-	case TypeCode::Uint32:
-		if (val.uVal > (uint32_t)std::numeric_limits<int32_t>::max())
+	case '+':
+		switch (val.GetType())
 		{
-			ThrowParseException("unsigned integer too large");
-		}
-		return (int32_t)val.uVal;
+		case TypeCode::Uint32:
+			// Convert enumeration to integer
+			val.SetInt((int32_t)val.uVal);
+			break;
 
-	default:
-		ThrowParseException("expected integer value");
-	}
-}
+		case TypeCode::Int32:
+		case TypeCode::Float:
+			break;
 
-uint32_t ExpressionParser::ParseUnsigned() THROWS(GCodeException)
-{
-	const ExpressionValue val = Parse();
-	switch (val.GetType())
-	{
-	case TypeCode::Uint32:
-		return val.uVal;
+		case TypeCode::DateTime_tc:					// unary + converts a DateTime to a seconds count
+			val.SetInt((uint32_t)val.Get56BitValue());
+			break;
 
-	case TypeCode::Int32:
-		if (val.iVal >= 0)
+		default:
+			ThrowParseException("expected numeric or enumeration value after '+'");
+		}
+		break;
+
+	case '#':
+		if (val.GetType() == TypeCode::CString)
 		{
-			return (uint32_t)val.iVal;
+			val.SetInt((int32_t)strlen(val.sVal));
 		}
-		ThrowParseException("value must be non-negative");
+		else if (val.GetType() == TypeCode::HeapString)
+		{
+			val.SetInt((int32_t)val.shVal.GetLength());
+		}
+		else
+		{
+			ThrowParseException("expected object model value or string after '#");
+		}
+		break;
+
+	case '!':
+		ConvertToBool(val, evaluate);
+		val.bVal = !val.bVal;
+		break;
 
 	default:
-		ThrowParseException("expected non-negative integer value");
+		THROW_INTERNAL_ERROR;
 	}
 }
 
-DriverId ExpressionParser::ParseDriverId() THROWS(GCodeException)
-{
-	ExpressionValue val = Parse();
-	ConvertToDriverId(val, true);
-	return val.GetDriverIdValue();
-}
-
-void ExpressionParser::ParseArray(size_t& length, function_ref<void(size_t index) THROWS(GCodeException)> processElement) THROWS(GCodeException)
+// Apply a binary operator that always evaluates both operands, assigning the result to val
+void ExpressionParser::ApplyBinaryOperator(char opChar, bool invert, ExpressionValue& val, ExpressionValue& val2, bool evaluate) THROWS(GCodeException)
 {
-	size_t numElements = 0;
-	AdvancePointer();					// skip the '{'
-	while (numElements < length)
+	switch (opChar)
 	{
-		processElement(numElements);
-		++numElements;
-		if (CurrentCharacter() != EXPRESSION_LIST_SEPARATOR)
+	case '+':
+		if (val.GetType() == TypeCode::DateTime_tc)
 		{
-			break;
+			if (val2.GetType() == TypeCode::Uint32)
+			{
+				val.Set56BitValue(val.Get56BitValue() + val2.uVal);
+			}
+			else if (val2.GetType() == TypeCode::Int32)
+			{
+				val.Set56BitValue((int64_t)val.Get56BitValue() + val2.iVal);
+			}
+			else if (evaluate)
+			{
+				ThrowParseException("invalid operand types");
+			}
 		}
-		if (numElements == length)
+		else
 		{
-			ThrowParseException("Array too long");
+			BalanceNumericTypes(val, val2, evaluate);
+			if (val.GetType() == TypeCode::Float)
+			{
+				val.fVal += val2.fVal;
+				val.param = max(val.param, val2.param);
+			}
+			else
+			{
+				val.iVal += val2.iVal;
+			}
+		}
+		break;
+
+	case '-':
+		if (val.GetType() == TypeCode::DateTime_tc)
+		{
+			if (val2.GetType() == TypeCode::DateTime_tc)
+			{
+				// Difference of two data/times
+				val.SetInt((int32_t)(val.Get56BitValue() - val2.Get56BitValue()));
+			}
+			else if (val2.GetType() == TypeCode::Uint32)
+			{
+				val.Set56BitValue(val.Get56BitValue() - val2.uVal);
+			}
+			else if (val2.GetType() == TypeCode::Int32)
+			{
+				val.Set56BitValue((int64_t)val.Get56BitValue() - val2.iVal);
+			}
+			else if (evaluate)
+			{
+				ThrowParseException("invalid operand types");
+			}
+		}
+		else
+		{
+			BalanceNumericTypes(val, val2, evaluate);
+			if (val.GetType() == TypeCode::Float)
+			{
+				val.fVal -= val2.fVal;
+				val.param = max(val.param, val2.param);
+			}
+			else
+			{
+				val.iVal -= val2.iVal;
+			}
+		}
+		break;
+
+	case '*':
+		BalanceNumericTypes(val, val2, evaluate);
+		if (val.GetType() == TypeCode::Float)
+		{
+			val.fVal *= val2.fVal;
+			val.param = max(val.param, val2.param);
+		}
+		else
+		{
+			val.iVal *= val2.iVal;
+		}
+		break;
+
+	case '/':
+		ConvertToFloat(val, evaluate);
+		ConvertToFloat(val2, evaluate);
+		val.fVal /= val2.fVal;
+		val.param = MaxFloatDigitsDisplayedAfterPoint;
+		break;
+
+	case '>':
+		BalanceTypes(val, val2, evaluate);
+		{
+			bool bResult;
+			switch (val.GetType())
+			{
+			case TypeCode::Int32:
+				bResult = (val.iVal > val2.iVal);
+				break;
+
+			case TypeCode::Float:
+				bResult = (val.fVal > val2.fVal);
+				break;
+
+			case TypeCode::DateTime_tc:
+				bResult = val.Get56BitValue() > val2.Get56BitValue();
+				break;
+
+			case TypeCode::Bool:
+				bResult = (val.bVal && !val2.bVal);
+				break;
+
+			default:
+				if (evaluate)
+				{
+					ThrowParseException("expected numeric or Boolean operands to comparison operator");
+				}
+				bResult = false;
+				break;
+			}
+			val.SetBool((invert) ? !bResult : bResult);
+		}
+		break;
+
+	case '<':
+		BalanceTypes(val, val2, evaluate);
+		{
+			bool bResult;
+			switch (val.GetType())
+			{
+			case TypeCode::Int32:
+				bResult = (val.iVal < val2.iVal);
+				break;
+
+			case TypeCode::Float:
+				bResult = (val.fVal < val2.fVal);
+				break;
+
+			case TypeCode::DateTime_tc:
+				bResult = val.Get56BitValue() < val2.Get56BitValue();
+				break;
+
+			case TypeCode::Bool:
+				bResult = (!val.bVal && val2.bVal);
+				break;
+
+			default:
+				if (evaluate)
+				{
+					ThrowParseException("expected numeric or Boolean operands to comparison operator");
+				}
+				bResult = false;
+				break;
+			}
+			val.SetBool((invert) ? !bResult : bResult);
+		}
+		break;
+
+	case '=':
+		{
+			bool bResult;
+			// Before balancing, handle comparisons with null
+			if (val.GetType() == TypeCode::None)
+			{
+				bResult = (val2.GetType() == TypeCode::None);
+			}
+			else if (val2.GetType() == TypeCode::None)
+			{
+				bResult = false;
+			}
+			else
+			{
+				BalanceTypes(val, val2, evaluate);
+				switch (val.GetType())
+				{
+				case TypeCode::ObjectModel_tc:
+					ThrowParseException("cannot compare objects");
+
+				case TypeCode::Int32:
+					bResult = (val.iVal == val2.iVal);
+					break;
+
+				case TypeCode::Uint32:
+					bResult = (val.uVal == val2.uVal);
+					break;
+
+				case TypeCode::Float:
+					bResult = (val.fVal == val2.fVal);
+					break;
+
+				case TypeCode::DateTime_tc:
+					bResult = val.Get56BitValue() == val2.Get56BitValue();
+					break;
+
+				case TypeCode::Bool:
+					bResult = (val.bVal == val2.bVal);
+					break;
+
+				case TypeCode::CString:
+					bResult = (strcmp(val.sVal, (val2.GetType() == TypeCode::HeapString) ? val2.shVal.Get().Ptr() : val2.sVal) == 0);
+					break;
+
+				case TypeCode::HeapString:
+					bResult = (strcmp(val.shVal.Get().Ptr(), (val2.GetType() == TypeCode::HeapString) ? val2.shVal.Get().Ptr() : val2.sVal) == 0);
+					break;
+
+				default:
+					if (evaluate)
+					{
+						ThrowParseException("unexpected operand type to equality operator");
+					}
+					bResult = false;
+					break;
+				}
+			}
+			val.SetBool((invert) ? !bResult : bResult);
+		}
+		break;
+
+	case '^':
+		StringConcat(val, val2);
+		break;
+	}
+}
+
+// Concatenate val1 and val2 and assign the result to val1
+// This is written as a separate function because it needs a temporary string buffer, and its caller is recursive. Its declaration must be declared 'noinline'.
+/*static*/ void  ExpressionParser::StringConcat(ExpressionValue &val, ExpressionValue &val2) noexcept
+{
+    String<MaxStringExpressionLength> str;
+    val.AppendAsString(str.GetRef());
+    val2.AppendAsString(str.GetRef());
+    StringHandle sh(str.c_str());
+    val.SetStringHandle(sh);
+}
+
+bool ExpressionParser::ParseBoolean() THROWS(GCodeException)
+{
+	ExpressionValue val = Parse();
+	ConvertToBool(val, true);
+	return val.bVal;
+}
+
+float ExpressionParser::ParseFloat() THROWS(GCodeException)
+{
+	ExpressionValue val = Parse();
+	ConvertToFloat(val, true);
+	return val.fVal;
+}
+
+int32_t ExpressionParser::ParseInteger() THROWS(GCodeException)
+{
+	const ExpressionValue val = Parse();
+	switch (val.GetType())
+	{
+	case TypeCode::Int32:
+		return val.iVal;
+
+	case TypeCode::Uint32:
+		if (val.uVal > (uint32_t)std::numeric_limits<int32_t>::max())
+		{
+			ThrowParseException("unsigned integer too large");
+		}
+		return (int32_t)val.uVal;
+
+	default:
+		ThrowParseException("expected integer value");
+	}
+}
+
+uint32_t ExpressionParser::ParseUnsigned() THROWS(GCodeException)
+{
+	const ExpressionValue val = Parse();
+	switch (val.GetType())
+	{
+	case TypeCode::Uint32:
+		return val.uVal;
+
+	case TypeCode::Int32:
+		if (val.iVal >= 0)
+		{
+			return (uint32_t)val.iVal;
+		}
+		ThrowParseException("value must be non-negative");
+
+	default:
+		ThrowParseException("expected non-negative integer value");
+	}
+}
+
+DriverId ExpressionParser::ParseDriverId() THROWS(GCodeException)
+{
+	ExpressionValue val = Parse();
+	ConvertToDriverId(val, true);
+	return val.GetDriverIdValue();
+}
+
+void ExpressionParser::ParseArray(size_t& length, function_ref<void(size_t index) THROWS(GCodeException)> processElement) THROWS(GCodeException)
+{
+	size_t numElements = 0;
+	AdvancePointer();					// skip the '{'
+	while (numElements < length)
+	{
+		processElement(numElements);
+		++numElements;
+		if (CurrentCharacter() != EXPRESSION_LIST_SEPARATOR)
+		{
+			break;
+		}
+		if (numElements == length)
+		{
+			ThrowParseException("Array too long");
 		}
 		AdvancePointer();				// skip the ','
 	}
@@ -866,10 +929,12 @@ void ExpressionParser::ParseNumber(ExpressionValue& rslt) noexcept
 	if (conv.FitsInInt32())
 	{
 		rslt.SetInt(conv.GetInt32());
+		COMPILE(EmitInt(rslt.iVal));
 	}
 	else
 	{
 		rslt.SetFloat(conv.GetFloat(), constrain<unsigned int>(conv.GetDigitsAfterPoint(), 1, MaxFloatDigitsDisplayedAfterPoint));
+		COMPILE(EmitFloat(rslt.fVal, rslt.param));
 	}
 }
 
@@ -912,6 +977,7 @@ void ExpressionParser::ParseIdentifierExpression(ExpressionValue& rslt, bool eva
 			}
 			AdvancePointer();										// skip the ']'
 			context.ProvideIndex(index.iVal);
+			COMPILE(EmitCheckIndex());
 			c = '^';												// add the marker
 		}
 		if (id.cat(c))
@@ -929,64 +995,9 @@ void ExpressionParser::ParseIdentifierExpression(ExpressionValue& rslt, bool eva
 			ThrowParseException(InvalidExistsMessage);
 		}
 
-		switch (whichConstant.RawValue())
-		{
-		case NamedConstant::_true:
-			rslt.SetBool(true);
-			return;
-
-		case NamedConstant::_false:
-			rslt.SetBool(false);
-			return;
-
-		case NamedConstant::_null:
-			rslt.SetNull(nullptr);
-			return;
-
-		case NamedConstant::pi:
-			rslt.SetFloat(Pi);
-			return;
-
-		case NamedConstant::iterations:
-			{
-				const int32_t v = gb.CurrentFileMachineState().GetIterations();
-				if (v < 0)
-				{
-					ThrowParseException("'iterations' used when not inside a loop");
-				}
-				rslt.SetInt(v);
-			}
-			return;
-
-		case NamedConstant::_result:
-			{
-				int32_t res;
-				switch (gb.GetLastResult())
-				{
-				case GCodeResult::ok:
-					res = 0;
-					break;
-
-				case GCodeResult::warning:
-				case GCodeResult::warningNotSupported:
-					res = 1;
-					break;
-
-				default:
-					res = 2;
-					break;
-				}
-				rslt.SetInt(res);
-			}
-			return;
-
-		case NamedConstant::line:
-			rslt.SetInt((int32_t)gb.GetLineNumber());
-			return;
-
-		default:
-			THROW_INTERNAL_ERROR;
-		}
+		GetNamedConstant(rslt, whichConstant.RawValue());
+		COMPILE(EmitConstant(whichConstant.RawValue()));
+		return;
 	}
 
 	// Check whether it is a function call
@@ -1018,253 +1029,36 @@ void ExpressionParser::ParseIdentifierExpression(ExpressionValue& rslt, bool eva
 
 			switch (func.RawValue())
 			{
-			case Function::abs:
-				switch (rslt.GetType())
+			case Function::atan2:
+			case Function::mod:
+			case Function::max:
+			case Function::min:
+				// These functions take two operands, except that max and min take one or more
+				do
 				{
-				case TypeCode::Int32:
-					rslt.iVal = labs(rslt.iVal);
-					break;
-
-				case TypeCode::Float:
-					rslt.fVal = fabsf(rslt.fVal);
-					break;
-
-				default:
-					if (evaluate)
+					SkipWhiteSpace();
+					if (CurrentCharacter() != ',')
 					{
-						ThrowParseException("expected numeric operand");
+						if (func == Function::atan2 || func == Function::mod)
+						{
+							ThrowParseException("expected ','");
+						}
+						break;
 					}
-					rslt.SetInt(0);
-				}
+					AdvancePointer();
+					SkipWhiteSpace();
+					ExpressionValue nextOperand;
+					// We recently checked the stack for a call to ParseInternal, no need to do it again
+					ParseInternal(nextOperand, evaluate, 0);
+					ApplyBinaryFunction(func.RawValue(), rslt, nextOperand, evaluate);
+					COMPILE(EmitBinaryFunction(func.RawValue()));
+				} while (func == Function::max || func == Function::min);
 				break;
 
-			case Function::sin:
-				ConvertToFloat(rslt, evaluate);
-				rslt.fVal = sinf(rslt.fVal);
-				rslt.param = MaxFloatDigitsDisplayedAfterPoint;
+			default:
+				ApplyUnaryFunction(func.RawValue(), rslt, evaluate);
+				COMPILE(EmitUnaryFunction(func.RawValue()));
 				break;
-
-			case Function::cos:
-				ConvertToFloat(rslt, evaluate);
-				rslt.fVal = cosf(rslt.fVal);
-				rslt.param = MaxFloatDigitsDisplayedAfterPoint;
-				break;
-
-			case Function::tan:
-				ConvertToFloat(rslt, evaluate);
-				rslt.fVal = tanf(rslt.fVal);
-				rslt.param = MaxFloatDigitsDisplayedAfterPoint;
-				break;
-
-			case Function::asin:
-				ConvertToFloat(rslt, evaluate);
-				rslt.fVal = asinf(rslt.fVal);
-				rslt.param = MaxFloatDigitsDisplayedAfterPoint;
-				break;
-
-			case Function::acos:
-				ConvertToFloat(rslt, evaluate);
-				rslt.fVal = acosf(rslt.fVal);
-				rslt.param = MaxFloatDigitsDisplayedAfterPoint;
-				break;
-
-			case Function::atan:
-				ConvertToFloat(rslt, evaluate);
-				rslt.fVal = atanf(rslt.fVal);
-				rslt.param = MaxFloatDigitsDisplayedAfterPoint;
-				break;
-
-			case Function::atan2:
-				{
-					ConvertToFloat(rslt, evaluate);
-					SkipWhiteSpace();
-					if (CurrentCharacter() != ',')
-					{
-						ThrowParseException("expected ','");
-					}
-					AdvancePointer();
-					SkipWhiteSpace();
-					ExpressionValue nextOperand;
-					// We recently checked the stack for a call to ParseInternal, no need to do it again
-					ParseInternal(nextOperand, evaluate, 0);
-					ConvertToFloat(nextOperand, evaluate);
-					rslt.fVal = atan2f(rslt.fVal, nextOperand.fVal);
-					rslt.param = MaxFloatDigitsDisplayedAfterPoint;
-				}
-				break;
-
-			case Function::degrees:
-				ConvertToFloat(rslt, evaluate);
-				rslt.fVal = rslt.fVal * RadiansToDegrees;
-				rslt.param = MaxFloatDigitsDisplayedAfterPoint;
-				break;
-
-			case Function::radians:
-				ConvertToFloat(rslt, evaluate);
-				rslt.fVal = rslt.fVal * DegreesToRadians;
-				rslt.param = MaxFloatDigitsDisplayedAfterPoint;
-				break;
-
-			case Function::sqrt:
-				ConvertToFloat(rslt, evaluate);
-				rslt.fVal = fastSqrtf(rslt.fVal);
-				rslt.param = MaxFloatDigitsDisplayedAfterPoint;
-				break;
-
-			case Function::isnan:
-				ConvertToFloat(rslt, evaluate);
-				rslt.SetBool(std::isnan(rslt.fVal) != 0);
-				break;
-
-			case Function::floor:
-				{
-					ConvertToFloat(rslt, evaluate);
-					const float f = floorf(rslt.fVal);
-					if (f <= (float)std::numeric_limits<int32_t>::max() && f >= (float)std::numeric_limits<int32_t>::min())
-					{
-						rslt.SetInt((int32_t)f);
-					}
-					else
-					{
-						rslt.fVal = f;
-					}
-				}
-				break;
-
-			case Function::mod:
-				{
-					SkipWhiteSpace();
-					if (CurrentCharacter() != ',')
-					{
-						ThrowParseException("expected ','");
-					}
-					AdvancePointer();
-					SkipWhiteSpace();
-					ExpressionValue nextOperand;
-					// We recently checked the stack for a call to ParseInternal, no need to do it again
-					ParseInternal(nextOperand, evaluate, 0);
-					BalanceNumericTypes(rslt, nextOperand, evaluate);
-					if (rslt.GetType() == TypeCode::Float)
-					{
-						rslt.fVal = fmod(rslt.fVal, nextOperand.fVal);
-					}
-					else if (nextOperand.iVal == 0)
-					{
-						rslt.iVal = 0;
-					}
-					else
-					{
-						rslt.iVal %= nextOperand.iVal;
-					}
-				}
-				break;
-
-			case Function::max:
-				for (;;)
-				{
-					SkipWhiteSpace();
-					if (CurrentCharacter() != ',')
-					{
-						break;
-					}
-					AdvancePointer();
-					SkipWhiteSpace();
-					ExpressionValue nextOperand;
-					// We recently checked the stack for a call to ParseInternal, no need to do it again
-					ParseInternal(nextOperand, evaluate, 0);
-					BalanceNumericTypes(rslt, nextOperand, evaluate);
-					if (rslt.GetType() == TypeCode::Float)
-					{
-						rslt.fVal = max<float>(rslt.fVal, nextOperand.fVal);
-						rslt.param = max(rslt.param, nextOperand.param);
-					}
-					else
-					{
-						rslt.iVal = max<int32_t>(rslt.iVal, nextOperand.iVal);
-					}
-				}
-				break;
-
-			case Function::min:
-				for (;;)
-				{
-					SkipWhiteSpace();
-					if (CurrentCharacter() != ',')
-					{
-						break;
-					}
-					AdvancePointer();
-					SkipWhiteSpace();
-					ExpressionValue nextOperand;
-					// We recently checked the stack for a call to ParseInternal, no need to do it again
-					ParseInternal(nextOperand, evaluate, 0);
-					BalanceNumericTypes(rslt, nextOperand, evaluate);
-					if (rslt.GetType() == TypeCode::Float)
-					{
-						rslt.fVal = min<float>(rslt.fVal, nextOperand.fVal);
-						rslt.param = max(rslt.param, nextOperand.param);
-					}
-					else
-					{
-						rslt.iVal = min<int32_t>(rslt.iVal, nextOperand.iVal);
-					}
-				}
-				break;
-
-			case Function::random:
-				{
-					uint32_t limit;
-					if (rslt.GetType() == TypeCode::Uint32)
-					{
-						limit = rslt.uVal;
-					}
-					else if (rslt.GetType() == TypeCode::Int32 && rslt.iVal > 0)
-					{
-						limit = rslt.iVal;
-					}
-					else
-					{
-						ThrowParseException("expected positive integer");
-					}
-					rslt.SetInt((int32_t)random(limit));
-				}
-				break;
-
-			case Function::datetime:
-				{
-					uint64_t val;
-					switch (rslt.GetType())
-					{
-					case TypeCode::Int32:
-						val = (uint64_t)max<uint32_t>(rslt.iVal, 0);
-						break;
-
-					case TypeCode::Uint32:
-						val = (uint64_t)rslt.uVal;
-						break;
-
-					case TypeCode::Uint64:
-					case TypeCode::DateTime_tc:
-						val = rslt.Get56BitValue();
-						break;
-
-					case TypeCode::CString:
-						val = ParseDateTime(rslt.sVal);
-						break;
-
-					case TypeCode::HeapString:
-						val = ParseDateTime(rslt.shVal.Get().Ptr());
-						break;
-
-					default:
-						ThrowParseException("can't convert value to DateTime");
-					}
-					rslt.SetDateTime(val);
-				}
-				break;
-
-			default:
-				THROW_INTERNAL_ERROR;
 			}
 		}
 
@@ -1277,6 +1071,13 @@ void ExpressionParser::ParseIdentifierExpression(ExpressionValue& rslt, bool eva
 		return;
 	}
 
+#if SUPPORT_EXPRESSION_CACHE
+	if (compiler != nullptr)
+	{
+		CompileIdentifier(id.c_str(), applyLengthOperator, applyExists);
+	}
+#endif
+
 	// If we are not evaluating then the object expression doesn't have to exist, so don't retrieve it because that might throw an error
 	if (evaluate)
 	{
@@ -1320,6 +1121,284 @@ void ExpressionParser::ParseIdentifierExpression(ExpressionValue& rslt, bool eva
 	rslt.SetNull(nullptr);
 }
 
+// Apply a function that takes one operand
+void ExpressionParser::ApplyUnaryFunction(unsigned int func, ExpressionValue& rslt, bool evaluate) THROWS(GCodeException)
+{
+	switch (func)
+	{
+	case Function::abs:
+		switch (rslt.GetType())
+		{
+		case TypeCode::Int32:
+			rslt.iVal = labs(rslt.iVal);
+			break;
+
+		case TypeCode::Float:
+			rslt.fVal = fabsf(rslt.fVal);
+			break;
+
+		default:
+			if (evaluate)
+			{
+				ThrowParseException("expected numeric operand");
+			}
+			rslt.SetInt(0);
+		}
+		break;
+
+	case Function::sin:
+		ConvertToFloat(rslt, evaluate);
+		rslt.fVal = sinf(rslt.fVal);
+		rslt.param = MaxFloatDigitsDisplayedAfterPoint;
+		break;
+
+	case Function::cos:
+		ConvertToFloat(rslt, evaluate);
+		rslt.fVal = cosf(rslt.fVal);
+		rslt.param = MaxFloatDigitsDisplayedAfterPoint;
+		break;
+
+	case Function::tan:
+		ConvertToFloat(rslt, evaluate);
+		rslt.fVal = tanf(rslt.fVal);
+		rslt.param = MaxFloatDigitsDisplayedAfterPoint;
+		break;
+
+	case Function::asin:
+		ConvertToFloat(rslt, evaluate);
+		rslt.fVal = asinf(rslt.fVal);
+		rslt.param = MaxFloatDigitsDisplayedAfterPoint;
+		break;
+
+	case Function::acos:
+		ConvertToFloat(rslt, evaluate);
+		rslt.fVal = acosf(rslt.fVal);
+		rslt.param = MaxFloatDigitsDisplayedAfterPoint;
+		break;
+
+	case Function::atan:
+		ConvertToFloat(rslt, evaluate);
+		rslt.fVal = atanf(rslt.fVal);
+		rslt.param = MaxFloatDigitsDisplayedAfterPoint;
+		break;
+
+	case Function::degrees:
+		ConvertToFloat(rslt, evaluate);
+		rslt.fVal = rslt.fVal * RadiansToDegrees;
+		rslt.param = MaxFloatDigitsDisplayedAfterPoint;
+		break;
+
+	case Function::radians:
+		ConvertToFloat(rslt, evaluate);
+		rslt.fVal = rslt.fVal * DegreesToRadians;
+		rslt.param = MaxFloatDigitsDisplayedAfterPoint;
+		break;
+
+	case Function::sqrt:
+		ConvertToFloat(rslt, evaluate);
+		rslt.fVal = fastSqrtf(rslt.fVal);
+		rslt.param = MaxFloatDigitsDisplayedAfterPoint;
+		break;
+
+	case Function::isnan:
+		ConvertToFloat(rslt, evaluate);
+		rslt.SetBool(std::isnan(rslt.fVal) != 0);
+		break;
+
+	case Function::floor:
+		{
+			ConvertToFloat(rslt, evaluate);
+			const float f = floorf(rslt.fVal);
+			if (f <= (float)std::numeric_limits<int32_t>::max() && f >= (float)std::numeric_limits<int32_t>::min())
+			{
+				rslt.SetInt((int32_t)f);
+			}
+			else
+			{
+				rslt.fVal = f;
+			}
+		}
+		break;
+
+	case Function::random:
+		{
+			uint32_t limit;
+			if (rslt.GetType() == TypeCode::Uint32)
+			{
+				limit = rslt.uVal;
+			}
+			else if (rslt.GetType() == TypeCode::Int32 && rslt.iVal > 0)
+			{
+				limit = rslt.iVal;
+			}
+			else
+			{
+				ThrowParseException("expected positive integer");
+			}
+			rslt.SetInt((int32_t)random(limit));
+		}
+		break;
+
+	case Function::datetime:
+		{
+			uint64_t val;
+			switch (rslt.GetType())
+			{
+			case TypeCode::Int32:
+				val = (uint64_t)max<uint32_t>(rslt.iVal, 0);
+				break;
+
+			case TypeCode::Uint32:
+				val = (uint64_t)rslt.uVal;
+				break;
+
+			case TypeCode::Uint64:
+			case TypeCode::DateTime_tc:
+				val = rslt.Get56BitValue();
+				break;
+
+			case TypeCode::CString:
+				val = ParseDateTime(rslt.sVal);
+				break;
+
+			case TypeCode::HeapString:
+				val = ParseDateTime(rslt.shVal.Get().Ptr());
+				break;
+
+			default:
+				ThrowParseException("can't convert value to DateTime");
+			}
+			rslt.SetDateTime(val);
+		}
+		break;
+
+	default:
+		THROW_INTERNAL_ERROR;
+	}
+}
+
+// Apply a function that takes two operands. The max and min functions take one or more operands, so we apply them to each additional operand in turn.
+void ExpressionParser::ApplyBinaryFunction(unsigned int func, ExpressionValue& rslt, ExpressionValue& nextOperand, bool evaluate) THROWS(GCodeException)
+{
+	switch (func)
+	{
+	case Function::atan2:
+		ConvertToFloat(rslt, evaluate);
+		ConvertToFloat(nextOperand, evaluate);
+		rslt.fVal = atan2f(rslt.fVal, nextOperand.fVal);
+		rslt.param = MaxFloatDigitsDisplayedAfterPoint;
+		break;
+
+	case Function::mod:
+		BalanceNumericTypes(rslt, nextOperand, evaluate);
+		if (rslt.GetType() == TypeCode::Float)
+		{
+			rslt.fVal = fmod(rslt.fVal, nextOperand.fVal);
+		}
+		else if (nextOperand.iVal == 0)
+		{
+			rslt.iVal = 0;
+		}
+		else
+		{
+			rslt.iVal %= nextOperand.iVal;
+		}
+		break;
+
+	case Function::max:
+		BalanceNumericTypes(rslt, nextOperand, evaluate);
+		if (rslt.GetType() == TypeCode::Float)
+		{
+			rslt.fVal = max<float>(rslt.fVal, nextOperand.fVal);
+			rslt.param = max(rslt.param, nextOperand.param);
+		}
+		else
+		{
+			rslt.iVal = max<int32_t>(rslt.iVal, nextOperand.iVal);
+		}
+		break;
+
+	case Function::min:
+		BalanceNumericTypes(rslt, nextOperand, evaluate);
+		if (rslt.GetType() == TypeCode::Float)
+		{
+			rslt.fVal = min<float>(rslt.fVal, nextOperand.fVal);
+			rslt.param = max(rslt.param, nextOperand.param);
+		}
+		else
+		{
+			rslt.iVal = min<int32_t>(rslt.iVal, nextOperand.iVal);
+		}
+		break;
+
+	default:
+		THROW_INTERNAL_ERROR;
+	}
+}
+
+// Get the value of a named constant
+void ExpressionParser::GetNamedConstant(ExpressionValue& rslt, unsigned int whichConstant) const THROWS(GCodeException)
+{
+	switch (whichConstant)
+	{
+	case NamedConstant::_true:
+		rslt.SetBool(true);
+		return;
+
+	case NamedConstant::_false:
+		rslt.SetBool(false);
+		return;
+
+	case NamedConstant::_null:
+		rslt.SetNull(nullptr);
+		return;
+
+	case NamedConstant::pi:
+		rslt.SetFloat(Pi);
+		return;
+
+	case NamedConstant::iterations:
+		{
+			const int32_t v = gb.CurrentFileMachineState().GetIterations();
+			if (v < 0)
+			{
+				ThrowParseException("'iterations' used when not inside a loop");
+			}
+			rslt.SetInt(v);
+		}
+		return;
+
+	case NamedConstant::_result:
+		{
+			int32_t res;
+			switch (gb.GetLastResult())
+			{
+			case GCodeResult::ok:
+				res = 0;
+				break;
+
+			case GCodeResult::warning:
+			case GCodeResult::warningNotSupported:
+				res = 1;
+				break;
+
+			default:
+				res = 2;
+				break;
+			}
+			rslt.SetInt(res);
+		}
+		return;
+
+	case NamedConstant::line:
+		rslt.SetInt((int32_t)gb.GetLineNumber());
+		return;
+
+	default:
+		THROW_INTERNAL_ERROR;
+	}
+}
+
 // Parse a string to a DateTime
 time_t ExpressionParser::ParseDateTime(const char *s) const THROWS(GCodeException)
 {
@@ -1350,6 +1429,245 @@ void ExpressionParser::GetVariableValue(ExpressionValue& rslt, const VariableSet
 	ThrowParseException((parameter) ? "unknown parameter '%s'" : "unknown variable '%s'", name);
 }
 
+#if SUPPORT_EXPRESSION_CACHE
+
+// Evaluate an expression from a file. If we have compiled it already then execute the compiled code, else interpret it and compile it at the same time.
+void ExpressionParser::ParseCached(ExpressionValue& result) THROWS(GCodeException)
+{
+	const FilePosition pos = gb.GetFilePosition();
+	CompiledExpression *_ecv_null const ce = (pos == noFilePosition) ? nullptr : ExpressionCache::Lookup(pos, GetColumn(), currentp, endp);
+	if (ce == nullptr)
+	{
+		ParseInternal(result, true, 0);
+		return;
+	}
+
+	const char *_ecv_array const start = currentp;
+	const uint32_t startTime = StepTimer::GetTimerTicks();
+	if (ce->IsCompiled())
+	{
+		try
+		{
+			ExecuteCompiled(*ce, result);
+			currentp = start + ce->GetSourceLength();
+			ExpressionCache::RecordExecuteTime(StepTimer::GetTimerTicks() - startTime);
+			return;
+		}
+		catch (const GCodeException&)
+		{
+			// Interpret the expression instead, so that the error message and column are exactly as they would have been if we hadn't compiled it
+			obsoleteField.Clear();
+		}
+		ParseInternal(result, true, 0);
+		return;
+	}
+
+	ExpressionCompiler comp(*ce);
+	compiler = &comp;
+	try
+	{
+		ParseInternal(result, true, 0);
+	}
+	catch (const GCodeException&)
+	{
+		compiler = nullptr;								// the cache entry is left in the 'compiling' state, so it will not be used
+		throw;
+	}
+	compiler = nullptr;
+	ExpressionCache::RecordInterpretTime(StepTimer::GetTimerTicks() - startTime);		// this includes the small overhead of compiling
+	ExpressionCache::FinishCompiling(comp, *ce, currentp - start);
+}
+
+// Execute a compiled expression. We don't need to handle operands that are not evaluated because the code jumps over them.
+void ExpressionParser::ExecuteCompiled(CompiledExpression& ce, ExpressionValue& result) THROWS(GCodeException)
+{
+	ExpressionValue stack[CompiledExpression::MaxStackDepth];
+	size_t sp = 0;
+	const uint8_t *_ecv_array const code = ce.GetCode();
+	const uint8_t *_ecv_array pc = code;
+	for (;;)
+	{
+		const CompiledOp op = (CompiledOp)*pc++;
+		switch (op)
+		{
+		case CompiledOp::end:
+			result = stack[0];
+			return;
+
+		case CompiledOp::pushInt:
+			{
+				int32_t i;
+				memcpy(&i, pc, sizeof(i));
+				pc += sizeof(i);
+				stack[sp++].SetInt(i);
+			}
+			break;
+
+		case CompiledOp::pushFloat:
+			{
+				float f;
+				memcpy(&f, pc, sizeof(f));
+				stack[sp++].SetFloat(f, pc[sizeof(f)]);
+				pc += sizeof(f) + 1;
+			}
+			break;
+
+		case CompiledOp::pushString:
+			{
+				StringHandle sh((const char *_ecv_array)pc + 1);
+				stack[sp++].SetStringHandle(sh);
+				pc += pc[0] + 2;
+			}
+			break;
+
+		case CompiledOp::constant:
+			GetNamedConstant(stack[sp++], *pc++);
+			break;
+
+		case CompiledOp::unaryOp:
+			ApplyUnaryOperator((char)*pc++, stack[sp - 1], true);
+			break;
+
+		case CompiledOp::toBool:
+			ConvertToBool(stack[sp - 1], true);
+			break;
+
+		case CompiledOp::binaryOp:
+			ApplyBinaryOperator((char)pc[0], pc[1] != 0, stack[sp - 2], stack[sp - 1], true);
+			pc += 2;
+			stack[--sp].SetNull(nullptr);
+			break;
+
+		case CompiledOp::jumpIfFalse:
+		case CompiledOp::jumpIfTrue:
+			if (stack[sp - 1].bVal == (op == CompiledOp::jumpIfTrue))
+			{
+				pc = code + *pc;
+			}
+			else
+			{
+				++pc;
+				--sp;										// the value is Boolean so we don't need to release it
+			}
+			break;
+
+		case CompiledOp::popJumpIfFalse:
+			--sp;
+			pc = (stack[sp].bVal) ? pc + 1 : code + *pc;
+			break;
+
+		case CompiledOp::jump:
+			pc = code + *pc;
+			break;
+
+		case CompiledOp::call1:
+			ApplyUnaryFunction(*pc++, stack[sp - 1], true);
+			break;
+
+		case CompiledOp::call2:
+			ApplyBinaryFunction(*pc++, stack[sp - 2], stack[sp - 1], true);
+			stack[--sp].SetNull(nullptr);
+			break;
+
+		case CompiledOp::checkIndex:
+			if (stack[sp - 1].GetType() != TypeCode::Int32)
+			{
+				ThrowParseException("expected integer expression");
+			}
+			break;
+
+		case CompiledOp::variable:
+			{
+				const VariableKind kind = (VariableKind)pc[0];
+				const bool wantExists = (pc[1] != 0);
+				const char *_ecv_array const name = (const char *_ecv_array)pc + 2;
+				pc += strlen(name) + 3;
+				if (kind == VariableKind::global)
+				{
+					auto vars = reprap.GetGlobalVariablesForReading();
+					GetVariableValue(stack[sp], vars.Ptr(), name, false, wantExists);
+				}
+				else
+				{
+					GetVariableValue(stack[sp], &gb.GetVariables(), name, kind == VariableKind::parameter, wantExists);
+				}
+				++sp;
+			}
+			break;
+
+		case CompiledOp::objectValue:
+			{
+				const uint8_t flags = pc[0];
+				const size_t numIndices = pc[1];
+				ObjectExplorationContext context(&gb, (flags & CompiledWantLength) != 0, (flags & CompiledWantExists) != 0, gb.GetLineNumber(), GetColumn());
+				context.SetLookupCache(ce.GetLookupCache(pc[2]), pc[3]);
+				const char *_ecv_array const id = (const char *_ecv_array)pc + 4;
+				pc += strlen(id) + 5;
+				sp -= numIndices;
+				for (size_t i = 0; i < numIndices; ++i)
+				{
+					context.ProvideIndex(stack[sp + i].iVal);
+				}
+				CheckStack(StackUsage::GetObjectValueUsingTableNumber);
+				stack[sp++] = reprap.GetObjectValueUsingTableNumber(context, nullptr, id, 0);
+				if (context.ObsoleteFieldQueried() && obsoleteField.IsEmpty())
+				{
+					obsoleteField.copy(id);
+				}
+			}
+			break;
+
+		default:
+			THROW_INTERNAL_ERROR;
+		}
+	}
+}
+
+// Emit the code to get the value of an identifier that is not a named constant or a function call
+void ExpressionParser::CompileIdentifier(const char *_ecv_array id, bool applyLengthOperator, bool applyExists) noexcept
+{
+	VariableKind kind;
+	const char *_ecv_array name;
+	if (StringStartsWith(id, "param."))
+	{
+		kind = VariableKind::parameter;
+		name = id + strlen("param.");
+	}
+	else if (StringStartsWith(id, "global."))
+	{
+		kind = VariableKind::global;
+		name = id + strlen("global.");
+	}
+	else if (StringStartsWith(id, "var."))
+	{
+		kind = VariableKind::local;
+		name = id + strlen("var.");
+	}
+	else
+	{
+		if (applyExists && (strcmp(id, "param") == 0 || strcmp(id, "var") == 0))
+		{
+			compiler->EmitConstant(NamedConstant::_true);
+		}
+		else
+		{
+			compiler->EmitObjectValue(id, applyLengthOperator, applyExists);
+		}
+		return;
+	}
+
+	if (strchr(name, '^') != nullptr)
+	{
+		compiler->Fail();								// variables can't be indexed
+	}
+	else
+	{
+		compiler->EmitVariable(kind, name, applyExists);
+	}
+}
+
+#endif
+
 // Parse a quoted string, given that the current character is double-quote
 // This is almost a copy of InternalGetQuotedString in class StringParser
 void ExpressionParser::ParseQuotedString(ExpressionValue& rslt) THROWS(GCodeException)
@@ -1368,6 +1686,7 @@ void ExpressionParser::ParseQuotedString(ExpressionValue& rslt) THROWS(GCodeExce
 		{
 			if (CurrentCharacter() != c)
 			{
+				COMPILE(EmitString(str.c_str()));
 				StringHandle sh(str.c_str());
 				rslt.SetStringHandle(sh);
 				return;
@@ -14,6 +14,11 @@
 
 class VariableSet;
 
+#if SUPPORT_EXPRESSION_CACHE
+class ExpressionCompiler;
+class CompiledExpression;
+#endif
+
 class ExpressionParser
 {
 public:
@@ -49,6 +54,18 @@ private:
 		pre(readPointer >= 0; isalpha(gb.buffer[readPointer]));
 	void __attribute__((noinline)) ParseQuotedString(ExpressionValue& rslt) THROWS(GCodeException);
 
+	void __attribute__((noinline)) ApplyUnaryOperator(char op, ExpressionValue& val, bool evaluate) THROWS(GCodeException);
+	void __attribute__((noinline)) ApplyBinaryOperator(char opChar, bool invert, ExpressionValue& val, ExpressionValue& val2, bool evaluate) THROWS(GCodeException);
+	void __attribute__((noinline)) ApplyUnaryFunction(unsigned int func, ExpressionValue& rslt, bool evaluate) THROWS(GCodeException);
+	void __attribute__((noinline)) ApplyBinaryFunction(unsigned int func, ExpressionValue& rslt, ExpressionValue& nextOperand, bool evaluate) THROWS(GCodeException);
+	void GetNamedConstant(ExpressionValue& rslt, unsigned int whichConstant) const THROWS(GCodeException);
+
+#if SUPPORT_EXPRESSION_CACHE
+	void ParseCached(ExpressionValue& result) THROWS(GCodeException);
+	void ExecuteCompiled(CompiledExpression& ce, ExpressionValue& result) THROWS(GCodeException);
+	void CompileIdentifier(const char *_ecv_array id, bool applyLengthOperator, bool applyExists) noexcept;
+#endif
+
 	void ParseArray(size_t& length, function_ref<void(size_t index) THROWS(GCodeException)> processElement) THROWS(GCodeException);
 	time_t ParseDateTime(const char *s) const THROWS(GCodeException);
 
@@ -78,6 +95,9 @@ private:
 	const GCodeBuffer& gb;
 	int column;
 	String<MaxVariableNameLength> obsoleteField;
+#if SUPPORT_EXPRESSION_CACHE
+	ExpressionCompiler *_ecv_null compiler;				// if not null, the compiler that we emit code to as we parse the expression
+#endif
 };
 
 #endif /* SRC_GCODES_GCODEBUFFER_EXPRESSIONPARSER_H_ */
@@ -255,6 +255,9 @@ void FileGCodeInput::Reset() noexcept
 {
 	lastFileRead.Close();
 	RegularGCodeInput::Reset();
+#if SUPPORT_FILE_READ_AHEAD
+	readAheadBytesLeft = 0;
+#endif
 }
 
 // Reset this input. Should be called when a specific G-code or macro file is closed outside of the reading context
@@ -282,9 +285,30 @@ GCodeInputReadResult FileGCodeInput::ReadFromFile(FileData &file) noexcept
 		}
 
 		RegularGCodeInput::Reset();
+#if SUPPORT_FILE_READ_AHEAD
+		readAheadBytesLeft = 0;
+#endif
 	}
 	lastFileRead.CopyFrom(file);
 
+#if SUPPORT_FILE_READ_AHEAD
+	// If the file is being read ahead then pass the next read-ahead buffer to the GCodeBuffer directly once we have used up the data we hold
+	if (file.IsReadingAhead())
+	{
+		if (BytesCached() != 0)
+		{
+			return GCodeInputReadResult::haveData;
+		}
+		const int bytesRead = file.GetReadAheadData(readAheadData);
+		if (bytesRead < 0)
+		{
+			return GCodeInputReadResult::error;
+		}
+		readAheadBytesLeft = (size_t)bytesRead;
+		return (bytesRead > 0) ? GCodeInputReadResult::haveData : GCodeInputReadResult::noData;
+	}
+#endif
+
 	// Read more from the file
 	if (bytesCached < GCodeInputFileReadThreshold)
 	{
@@ -312,6 +336,26 @@ GCodeInputReadResult FileGCodeInput::ReadFromFile(FileData &file) noexcept
 	return (bytesCached > 0) ? GCodeInputReadResult::haveData : GCodeInputReadResult::noData;
 }
 
+#if SUPPORT_FILE_READ_AHEAD
+
+// Return the bytes in the ring buffer followed by the read-ahead data we hold
+char FileGCodeInput::ReadByte() noexcept
+{
+	if (readAheadBytesLeft != 0 && readingPointer == writingPointer)
+	{
+		--readAheadBytesLeft;
+		return *readAheadData++;
+	}
+	return RegularGCodeInput::ReadByte();
+}
+
+size_t FileGCodeInput::BytesCached() const noexcept
+{
+	return RegularGCodeInput::BytesCached() + readAheadBytesLeft;
+}
+
+#endif
+
 #endif
 
 // End
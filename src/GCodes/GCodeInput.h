@@ -109,15 +109,30 @@ class FileGCodeInput : public RegularGCodeInput
 {
 public:
 
+#if SUPPORT_FILE_READ_AHEAD
+	FileGCodeInput() noexcept : RegularGCodeInput(), readAheadData(nullptr), readAheadBytesLeft(0) { }
+#else
 	FileGCodeInput() noexcept : RegularGCodeInput() { }
+#endif
 
 	void Reset() noexcept override;								// Clears the buffer. Should be called when the associated file is being closed
 	void Reset(const FileData &file) noexcept;					// Clears the buffer of a specific file. Should be called when it is closed or re-opened outside the reading context
 
 	GCodeInputReadResult ReadFromFile(FileData &file) noexcept;	// Read another chunk of G-codes from the file and return true if more data is available
 
+#if SUPPORT_FILE_READ_AHEAD
+	size_t BytesCached() const noexcept override;				// How many bytes have been cached?
+
+protected:
+	char ReadByte() noexcept override;
+#endif
+
 private:
 	FileData lastFileRead;
+#if SUPPORT_FILE_READ_AHEAD
+	const char *_ecv_array readAheadData;						// Data in a read-ahead buffer that we pass to the GCodeBuffer without copying it
+	size_t readAheadBytesLeft;									// How much of that data we have not passed on yet
+#endif
 };
 
 #endif
@@ -26,6 +26,7 @@
 #include "GCodes.h"
 
 #include "GCodeBuffer/GCodeBuffer.h"
+#include "GCodeBuffer/ExpressionCache.h"
 #include "GCodeQueue.h"
 #include <Heating/Heat.h>
 #include <Platform/Platform.h>
@@ -164,6 +165,9 @@ void GCodes::Init() noexcept
 	axisLetters[2] = 'Z';
 
 	numExtruders = 0;
+#if SUPPORT_NATIVE_ARCS
+	numNativeArcs = numSegmentedArcs = numArcSegments = 0;
+#endif
 
 	Reset();
 
@@ -440,6 +444,12 @@ void GCodes::Spin() noexcept
 
 	CheckTriggers();
 
+	// If we are using the raw move queue then the Move task doesn't fetch moves from us, so pass it any remaining segments of the current move
+	if (moveState.segmentsLeft != 0 && reprap.GetMove().GetMainDDARing().UsingRawMoveQueue())
+	{
+		reprap.GetMove().PassRemainingSegments();
+	}
+
 	// The autoPause buffer has priority, so spin that one first. It may have to wait for other buffers to release locks etc.
 	(void)SpinGCodeBuffer(*autoPauseGCode);
 
@@ -1046,10 +1056,15 @@ bool GCodes::DoEmergencyPause() noexcept
 	// Save the resume info, stop movement immediately and run the low voltage pause script to lift the nozzle etc.
 	GrabMovement(*autoPauseGCode);
 
+	// Stop the background move prepare task preparing moves that we may free. We must do this before we start the critical section, because we may need to wait
+	// for the prepare task to finish the move it is preparing. That takes much less time than we have after a power failure is detected.
+	MutexLocker prepareLock(DDARing::GetPrepareMutex());
+
 	// When we use RTOS there is a possible race condition in the following, because we might try to pause when a waiting move has just been added
 	// but before the gcode buffer has been re-initialised ready for the next command. So start a critical section.
 	TaskCriticalSectionLocker lock;
 
+	pauseRestorePoint.feedRate = fileGCode->LatestMachineState().feedRate;				// set up the default
 	const bool movesSkipped = reprap.GetMove().LowPowerOrStallPause(pauseRestorePoint);
 	if (movesSkipped)
 	{
@@ -1396,6 +1411,10 @@ void GCodes::Diagnostics(MessageType mtype) noexcept
 {
 	platform.Message(mtype, "=== GCodes ===\n");
 	platform.MessageF(mtype, "Segments left: %u\n", moveState.segmentsLeft);
+#if SUPPORT_NATIVE_ARCS
+	platform.MessageF(mtype, "Arcs: native %u, segmented %u using %u moves\n", numNativeArcs, numSegmentedArcs, numArcSegments);
+	numNativeArcs = numSegmentedArcs = numArcSegments = 0;
+#endif
 	const GCodeBuffer * const movementOwner = resourceOwners[MoveResource];
 	platform.MessageF(mtype, "Movement lock held by %s\n", (movementOwner == nullptr) ? "null" : movementOwner->GetChannel().ToString());
 
@@ -1408,6 +1427,10 @@ void GCodes::Diagnostics(MessageType mtype) noexcept
 	}
 
 	codeQueue->Diagnostics(mtype);
+	VariableSet::Diagnostics(mtype);
+#if SUPPORT_EXPRESSION_CACHE
+	ExpressionCache::Diagnostics(mtype);
+#endif
 }
 
 // Lock movement and wait for pending moves to finish.
@@ -1888,6 +1911,7 @@ bool GCodes::DoStraightMove(GCodeBuffer& gb, bool isCoordinated, const char *& e
 
 	// Set up the move. We must assign segmentsLeft last, so that when Move runs as a separate task the move won't be picked up by the Move process before it is complete.
 	// Note that if this is an extruder-only move, we don't do axis movements to allow for tool offset changes, we defer those until an axis moves.
+	moveState.followMesh = false;
 	if (moveState.moveType != 0)
 	{
 		// It's a raw motor move, so do it in a single segment and wait for it to complete
@@ -1979,7 +2003,7 @@ bool GCodes::DoStraightMove(GCodeBuffer& gb, bool isCoordinated, const char *& e
 
 		// Apply segmentation if necessary. To speed up simulation on SCARA printers, we don't apply kinematics segmentation when simulating.
 		// As soon as we set segmentsLeft nonzero, the Move process will assume that the move is ready to take, so this must be the last thing we do.
-		const Kinematics& kin = reprap.GetMove().GetKinematics();
+		Kinematics& kin = reprap.GetMove().GetKinematics();
 		const SegmentationType st = kin.GetSegmentationType();
 		if (st.useSegmentation && simulationMode != SimulationMode::normal && (moveState.hasPositiveExtrusion || moveState.isCoordinated || st.useG0Segmentation))
 		{
@@ -1991,7 +2015,7 @@ bool GCodes::DoStraightMove(GCodeBuffer& gb, bool isCoordinated, const char *& e
 			}
 			const float moveLength = fastSqrtf(moveLengthSquared);
 			const float moveTime = moveLength/(moveState.feedRate * StepClockRate);		// this is a best-case time, often the move will take longer
-			moveState.totalSegments = (unsigned int)max<long>(1, lrintf(min<float>(moveLength * kin.GetReciprocalMinSegmentLength(), moveTime * kin.GetSegmentsPerSecond())));
+			moveState.totalSegments = kin.GetNumSegments(moveLength, moveTime, reprap.GetMove().GetRingOccupancy());
 		}
 		else
 		{
@@ -2001,13 +2025,22 @@ bool GCodes::DoStraightMove(GCodeBuffer& gb, bool isCoordinated, const char *& e
 		{
 			const HeightMap& heightMap = reprap.GetMove().AccessHeightMap();
 			const GridDefinition& grid = heightMap.GetGrid();
-			const unsigned int minMeshSegments = max<unsigned int>(
-					1,
-					heightMap.GetMinimumSegments(
-						moveState.currentUserPosition[grid.GetAxisNumber(0)] - initialUserPosition[grid.GetAxisNumber(0)],
-						moveState.currentUserPosition[grid.GetAxisNumber(1)] - initialUserPosition[grid.GetAxisNumber(1)]
-					)
-			);
+			const float deltaAxis0 = moveState.currentUserPosition[grid.GetAxisNumber(0)] - initialUserPosition[grid.GetAxisNumber(0)];
+			const float deltaAxis1 = moveState.currentUserPosition[grid.GetAxisNumber(1)] - initialUserPosition[grid.GetAxisNumber(1)];
+			unsigned int minMeshSegments;
+#if SUPPORT_MESH_Z_PROFILE
+			if (reprap.GetMove().CanApplyMeshInMoves())
+			{
+				// The Z motor follows the height map during each move, so we only need to segment the move if it crosses more grid lines than a profile can hold
+				moveState.followMesh = true;
+				minMeshSegments = (heightMap.GetMaxGridCrossings(deltaAxis0, deltaAxis1) + MeshZProfile::MaxPieces - 2)/(MeshZProfile::MaxPieces - 1);
+			}
+			else
+#endif
+			{
+				minMeshSegments = heightMap.GetMinimumSegments(deltaAxis0, deltaAxis1);
+			}
+			minMeshSegments = max<unsigned int>(minMeshSegments, 1);
 			if (minMeshSegments > moveState.totalSegments)
 			{
 				moveState.totalSegments = minMeshSegments;
@@ -2016,6 +2049,7 @@ bool GCodes::DoStraightMove(GCodeBuffer& gb, bool isCoordinated, const char *& e
 	}
 
 	moveState.doingArcMove = false;
+	moveState.isNativeArc = false;
 	moveState.linearAxesMentioned = axesMentioned.Intersects(reprap.GetPlatform().GetLinearAxes());
 	moveState.rotationalAxesMentioned = axesMentioned.Intersects(reprap.GetPlatform().GetRotationalAxes());
 	FinaliseMove(gb);
@@ -2335,6 +2369,7 @@ bool GCodes::DoArcMove(GCodeBuffer& gb, bool clockwise, const char *& err)
 #endif
 
 	moveState.usePressureAdvance = moveState.hasPositiveExtrusion;
+	moveState.followMesh = false;
 
 	// Calculate the total angle moved, which depends on which way round we are going
 	float totalArc;
@@ -2351,28 +2386,45 @@ bool GCodes::DoArcMove(GCodeBuffer& gb, bool clockwise, const char *& err)
 		}
 	}
 
-	// Compute how many segments to use
-	// For the arc to deviate up to MaxArcDeviation from the ideal, the segment length should be sqrtf(8 * arcRadius * MaxArcDeviation + fsquare(MaxArcDeviation))
-	// We leave out the square term because it is very small
-	// In CNC applications even very small deviations can be visible, so we use a smaller segment length at low speeds
-	const float arcSegmentLength = constrain<float>
-									(	min<float>(fastSqrtf(8 * moveState.arcRadius * MaxArcDeviation), moveState.feedRate * StepClockRate * (1.0/MinArcSegmentsPerSec)),
-										MinArcSegmentLength,
-										MaxArcSegmentLength
-									);
-	moveState.totalSegments = max<unsigned int>((unsigned int)((moveState.arcRadius * totalArc)/arcSegmentLength + 0.8), 1u);
-	moveState.arcAngleIncrement = totalArc/moveState.totalSegments;
-	if (clockwise)
+#if SUPPORT_NATIVE_ARCS
+	// If the kinematics allow it, execute the whole arc as a single move. We don't do this when resuming part way through an arc because we can't skip part of a single move.
+	moveState.isNativeArc = moveFractionToSkip == 0.0 && SetupNativeArc(axis0Mapping, axis1Mapping, totalArc, clockwise);
+	if (moveState.isNativeArc)
+	{
+		moveState.totalSegments = 1;
+		moveState.doingArcMove = false;					// the move is not segmented, so we can pause after it
+		++numNativeArcs;
+	}
+	else
+#endif
 	{
-		moveState.arcAngleIncrement = -moveState.arcAngleIncrement;
+		// Compute how many segments to use
+		// For the arc to deviate up to MaxArcDeviation from the ideal, the segment length should be sqrtf(8 * arcRadius * MaxArcDeviation + fsquare(MaxArcDeviation))
+		// We leave out the square term because it is very small
+		// In CNC applications even very small deviations can be visible, so we use a smaller segment length at low speeds
+		const float arcSegmentLength = constrain<float>
+										(	min<float>(fastSqrtf(8 * moveState.arcRadius * MaxArcDeviation), moveState.feedRate * StepClockRate * (1.0/MinArcSegmentsPerSec)),
+											MinArcSegmentLength,
+											MaxArcSegmentLength
+										);
+		moveState.totalSegments = max<unsigned int>((unsigned int)((moveState.arcRadius * totalArc)/arcSegmentLength + 0.8), 1u);
+		moveState.arcAngleIncrement = totalArc/moveState.totalSegments;
+		if (clockwise)
+		{
+			moveState.arcAngleIncrement = -moveState.arcAngleIncrement;
+		}
+		moveState.angleIncrementSine = sinf(moveState.arcAngleIncrement);
+		moveState.angleIncrementCosine = cosf(moveState.arcAngleIncrement);
+		moveState.segmentsTillNextFullCalc = 0;
+		moveState.doingArcMove = true;
+#if SUPPORT_NATIVE_ARCS
+		++numSegmentedArcs;
+		numArcSegments += moveState.totalSegments;
+#endif
 	}
-	moveState.angleIncrementSine = sinf(moveState.arcAngleIncrement);
-	moveState.angleIncrementCosine = cosf(moveState.arcAngleIncrement);
-	moveState.segmentsTillNextFullCalc = 0;
 
 	moveState.arcAxis0 = axis0;
 	moveState.arcAxis1 = axis1;
-	moveState.doingArcMove = true;
 	moveState.xyPlane = (selectedPlane == 0);
 	moveState.linearAxesMentioned = axesMentioned.Intersects(reprap.GetPlatform().GetLinearAxes());
 	moveState.rotationalAxesMentioned = axesMentioned.Intersects(reprap.GetPlatform().GetRotationalAxes());
@@ -2383,6 +2435,60 @@ bool GCodes::DoArcMove(GCodeBuffer& gb, bool clockwise, const char *& err)
 	return true;
 }
 
+#if SUPPORT_NATIVE_ARCS
+
+// Try to set up the current arc move to be executed as a single move, returning true if successful.
+// This requires the arc to be in the plane of two machine axes that the kinematics can interpolate along an arc, the end point to be on the arc,
+// and the whole arc to be within the machine limits. Otherwise we split the arc into straight segments as usual.
+bool GCodes::SetupNativeArc(AxesBitmap axis0Mapping, AxesBitmap axis1Mapping, float totalArc, bool clockwise) noexcept
+{
+	if (axis0Mapping.CountSetBits() != 1 || axis1Mapping.CountSetBits() != 1)
+	{
+		return false;								// the arc axes are mapped to more than one machine axis each, e.g. IDEX in ditto mode
+	}
+
+	const size_t machineAxis0 = axis0Mapping.LowestSetBit();
+	const size_t machineAxis1 = axis1Mapping.LowestSetBit();
+	if (axisScaleFactors[machineAxis0] != axisScaleFactors[machineAxis1] || !reprap.GetMove().CanDoNativeArc(machineAxis0, machineAxis1))
+	{
+		return false;
+	}
+
+	// Check that the end point is on the arc. If the I and J parameters are inconsistent with the end point then the final segment of a segmented arc absorbs the error.
+	const float radius = moveState.arcRadius * axisScaleFactors[machineAxis0];
+	const float endRadius = sqrtf(fsquare(moveState.coords[machineAxis0] - moveState.arcCentre[machineAxis0]) + fsquare(moveState.coords[machineAxis1] - moveState.arcCentre[machineAxis1]));
+	if (fabsf(endRadius - radius) > MaxNativeArcEndpointError)
+	{
+		return false;
+	}
+
+	// The extreme positions of the arc axes are at the end points and at the multiples of 90 degrees that the arc passes through, so check those against the machine limits
+	constexpr float QuarterTurn = 0.5 * Pi;
+	const float startAngle = moveState.arcCurrentAngle;
+	for (float angle = (clockwise) ? (ceilf(startAngle/QuarterTurn) - 1.0) * QuarterTurn : (floorf(startAngle/QuarterTurn) + 1.0) * QuarterTurn;
+		 fabsf(angle - startAngle) < totalArc;
+		 angle += (clockwise) ? -QuarterTurn : QuarterTurn)
+	{
+		float coords[MaxAxes];
+		memcpyf(coords, moveState.coords, MaxAxes);
+		coords[machineAxis0] = moveState.arcCentre[machineAxis0] + radius * cosf(angle);
+		coords[machineAxis1] = moveState.arcCentre[machineAxis1] + radius * sinf(angle);
+		if (reprap.GetMove().GetKinematics().LimitPosition(coords, nullptr, numVisibleAxes, axesVirtuallyHomed, true, limitAxes) != LimitPositionResult::ok)
+		{
+			return false;							// let the segmented arc code abort the move when it reaches the limit
+		}
+	}
+
+	moveState.arc.radius = radius;
+	moveState.arc.startAngle = startAngle;
+	moveState.arc.totalAngle = (clockwise) ? -totalArc : totalArc;
+	moveState.arc.axis0 = (uint8_t)machineAxis0;
+	moveState.arc.axis1 = (uint8_t)machineAxis1;
+	return true;
+}
+
+#endif
+
 // Adjust the move parameters to account for segmentation and/or part of the move having been done already
 void GCodes::FinaliseMove(GCodeBuffer& gb) noexcept
 {
@@ -2573,6 +2679,8 @@ void GCodes::ClearMove() noexcept
 	moveState.segmentsLeft = 0;
 	moveState.segMoveState = SegmentedMoveState::inactive;
 	moveState.doingArcMove = false;
+	moveState.isNativeArc = false;
+	moveState.followMesh = false;
 	moveState.checkEndstops = false;
 	moveState.reduceAcceleration = false;
 	moveState.moveType = 0;
@@ -2685,7 +2793,7 @@ bool GCodes::DoFileMacro(GCodeBuffer& gb, const char* fileName, bool reportMissi
 #endif
 	{
 #if HAS_MASS_STORAGE || HAS_EMBEDDED_FILES
-		FileStore * const f = platform.OpenSysFile(fileName, OpenMode::read);
+		FileStore * const f = platform.OpenSysFile(fileName, OpenMode::readCached);
 		if (f == nullptr)
 		{
 			if (reportMissing)
@@ -3128,6 +3236,9 @@ bool GCodes::QueueFileToPrint(const char* fileName, const StringRef& reply) noex
 	FileStore * const f = platform.OpenFile(Platform::GetGCodeDir(), fileName, OpenMode::read);
 	if (f != nullptr)
 	{
+# if HAS_MASS_STORAGE && FF_USE_FASTSEEK
+		(void)f->EnableFastSeek();								// so that resuming and starting from a later position don't have to follow the cluster chain
+# endif
 		fileToPrint.Set(f);
 		return true;
 	}
@@ -3168,6 +3279,12 @@ void GCodes::StartPrinting(bool fromStart) noexcept
 #if HAS_MASS_STORAGE || HAS_EMBEDDED_FILES
 		fileGCode->OriginalMachineState().fileState.MoveFrom(fileToPrint);
 		fileGCode->GetFileInput()->Reset(fileGCode->OriginalMachineState().fileState);
+# if SUPPORT_FILE_READ_AHEAD
+		if (fileGCode->OriginalMachineState().fileState.IsLive())
+		{
+			(void)fileGCode->OriginalMachineState().fileState.StartReadAhead();
+		}
+# endif
 #endif
 	}
 	fileGCode->StartNewFile();
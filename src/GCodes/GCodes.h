@@ -112,6 +112,7 @@ public:
 	void Reset() noexcept;														// Reset some parameter to defaults
 	bool ReadMove(RawMove& m) noexcept;											// Called by the Move class to get a movement set by the last G Code
 	void ClearMove() noexcept;
+	bool IsMovePending() const noexcept { return moveState.segmentsLeft != 0; }	// Return true if we have a move that the Move class hasn't fetched yet
 #if HAS_MASS_STORAGE || HAS_EMBEDDED_FILES
 	bool QueueFileToPrint(const char* fileName, const StringRef& reply) noexcept;	// Open a file of G Codes to run
 #endif
@@ -368,6 +369,9 @@ private:
 	bool DoStraightMove(GCodeBuffer& gb, bool isCoordinated, const char *& err) THROWS(GCodeException) SPEED_CRITICAL;	// Execute a straight move
 	bool DoArcMove(GCodeBuffer& gb, bool clockwise, const char *& err) THROWS(GCodeException)				// Execute an arc move
 		pre(segmentsLeft == 0; resourceOwners[MoveResource] == &gb);
+#if SUPPORT_NATIVE_ARCS
+	bool SetupNativeArc(AxesBitmap axis0Mapping, AxesBitmap axis1Mapping, float totalArc, bool clockwise) noexcept;	// Try to set up the current arc move to be executed as a single move
+#endif
 	void FinaliseMove(GCodeBuffer& gb) noexcept;									// Adjust the move parameters to account for segmentation and/or part of the move having been done already
 	bool CheckEnoughAxesHomed(AxesBitmap axesMoved) noexcept;						// Check that enough axes have been homed
 	bool TravelToStartPoint(GCodeBuffer& gb) noexcept;								// Set up a move to travel to the resume point
@@ -583,6 +587,12 @@ private:
 	MovementState moveState;					// Move details
 	GCodeBuffer *null updateUserPositionGb;		// if this is non-null then we need to update the user position from he machine position
 
+#if SUPPORT_NATIVE_ARCS
+	unsigned int numNativeArcs;					// how many G2/G3 moves we executed as single moves, for diagnostics
+	unsigned int numSegmentedArcs;				// how many G2/G3 moves we split into segments, for diagnostics
+	unsigned int numArcSegments;				// how many segments we split them into, for diagnostics
+#endif
+
 	unsigned int segmentsLeftToStartAt;
 	float moveFractionToSkip;
 	float firstSegmentFractionToSkip;
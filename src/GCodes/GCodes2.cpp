@@ -16,6 +16,7 @@
 # include <SBC/SbcInterface.h>
 #endif
 #include <Movement/Move.h>
+#include <Movement/MoveRecorder.h>
 #include <Networking/Network.h>
 #include <Platform/Scanner.h>
 #include <PrintMonitor/PrintMonitor.h>
@@ -65,6 +66,10 @@
 # include <Platform/Logger.h>
 #endif
 
+#if SUPPORT_MACRO_FILE_CACHE
+# include <Storage/MacroFileCache.h>
+#endif
+
 // If the code to act on is completed, this returns true, otherwise false.
 // It is called repeatedly for a given code until it returns true for that code.
 bool GCodes::ActOnCode(GCodeBuffer& gb, const StringRef& reply) noexcept
@@ -2794,17 +2799,53 @@ bool GCodes::HandleMcode(GCodeBuffer& gb, const StringRef& reply) THROWS(GCodeEx
 			case 376: // Set taper height
 				{
 					Move& move = reprap.GetMove();
-					if (gb.Seen('H'))
+					bool seen = false;
+#if SUPPORT_BICUBIC_MESH
+					if (gb.Seen('I'))
 					{
-						move.SetTaperHeight(gb.GetFValue());
+						// Changing the interpolation changes the height correction at the current position, so wait until movement has stopped
+						if (!LockMovementAndWaitForStandstill(gb))
+						{
+							return false;
+						}
+						move.AccessHeightMap().SetBicubic(gb.GetUIValue() != 0);
+						if (move.IsUsingMesh())
+						{
+							ActivateHeightmap(true);
+						}
+						reprap.MoveUpdated();
+						seen = true;
 					}
-					else if (move.GetTaperHeight() > 0.0)
+#endif
+#if SUPPORT_MESH_Z_PROFILE
+					if (gb.Seen('S'))
 					{
-						reply.printf("Bed compensation taper height is %.1fmm", (double)move.GetTaperHeight());
+						// This takes effect from the next move that we read, so there is no need to wait for movement to stop
+						move.SetMeshInMoves(gb.GetUIValue() != 0);
+						reprap.MoveUpdated();
+						seen = true;
 					}
-					else
+#endif
+					if (gb.Seen('H'))
 					{
-						reply.copy("Bed compensation is not tapered");
+						move.SetTaperHeight(gb.GetFValue());
+					}
+					else if (!seen)
+					{
+						if (move.GetTaperHeight() > 0.0)
+						{
+							reply.printf("Bed compensation taper height is %.1fmm", (double)move.GetTaperHeight());
+						}
+						else
+						{
+							reply.copy("Bed compensation is not tapered");
+						}
+#if SUPPORT_BICUBIC_MESH
+						reply.catf(", %s interpolation", (move.AccessHeightMap().IsBicubic()) ? "bicubic" : "bilinear");
+#endif
+#if SUPPORT_MESH_Z_PROFILE
+						reply.catf(", applied %s", (move.IsMeshInMoves()) ? "during moves" : "by segmenting moves");
+#endif
 					}
 				}
 				break;
@@ -3004,6 +3045,12 @@ bool GCodes::HandleMcode(GCodeBuffer& gb, const StringRef& reply) THROWS(GCodeEx
 				break;
 #endif
 
+#if SUPPORT_MACRO_FILE_CACHE
+			case 473: // configure macro file cache
+				result = MacroFileCache::Configure(gb, reply);
+				break;
+#endif
+
 			//case 486: // number object or cancel object
 				//result = buildObjects.HandleM486(gb, reply, outBuf);
 				//break;
@@ -3418,6 +3465,12 @@ bool GCodes::HandleMcode(GCodeBuffer& gb, const StringRef& reply) THROWS(GCodeEx
 						reprap.GetMove().SetJerkPolicy(gb.GetUIValue());
 					}
 
+					if (code == 566 && gb.Seen('J'))
+					{
+						seenAxis = true;
+						reprap.GetMove().SetJunctionDeviation(max<float>(gb.GetDistance(), 0.0));
+					}
+
 					if (seenAxis)
 					{
 						reprap.MoveUpdated();
@@ -3439,6 +3492,10 @@ bool GCodes::HandleMcode(GCodeBuffer& gb, const StringRef& reply) THROWS(GCodeEx
 						if (code == 566)
 						{
 							reply.catf(", jerk policy: %u", reprap.GetMove().GetJerkPolicy());
+							if (reprap.GetMove().GetJunctionDeviation() > 0.0)
+							{
+								reply.catf(", junction deviation %.3fmm", (double)reprap.GetMove().GetJunctionDeviation());
+							}
 						}
 					}
 				}
@@ -3774,6 +3831,12 @@ bool GCodes::HandleMcode(GCodeBuffer& gb, const StringRef& reply) THROWS(GCodeEx
 				result = reprap.GetMove().ConfigureMovementQueue(gb, reply);
 				break;
 
+#if SUPPORT_MOVE_RECORDER
+			case 597:	// Configure or dump the move recorder
+				result = MoveRecorder::Configure(gb, reply);
+				break;
+#endif
+
 			// For cases 600 and 601, see 226
 
 			// M650 (set peel move parameters) and M651 (execute peel move) are no longer handled specially. Use macros to specify what they should do.
@@ -3803,6 +3866,7 @@ bool GCodes::HandleMcode(GCodeBuffer& gb, const StringRef& reply) THROWS(GCodeEx
 					}
 					if (changed || changedMode)
 					{
+						move.KinematicsConfigured();
 						if (move.GetKinematics().LimitPosition(moveState.coords, nullptr, numVisibleAxes, axesVirtuallyHomed, false, false) != LimitPositionResult::ok)
 						{
 							ToolOffsetInverseTransform(moveState.coords, moveState.currentUserPosition);	// make sure the limits are reflected in the user position
@@ -3907,6 +3971,7 @@ bool GCodes::HandleMcode(GCodeBuffer& gb, const StringRef& reply) THROWS(GCodeEx
 					if (seen)
 					{
 						// We changed something significant, so reset the positions and set all axes not homed
+						move.KinematicsConfigured();
 						if (move.GetKinematics().GetKinematicsType() != oldK)
 						{
 							move.GetKinematics().GetAssumedInitialPosition(numVisibleAxes, moveState.coords);
@@ -173,6 +173,11 @@ GCodeResult AxisShaper::Configure(GCodeBuffer& gb, const StringRef& reply) THROW
 			break;
 #endif
 
+		case InputShaperType::scurve:	// ramping the acceleration up and down over one period of the resonant frequency gives zero residual vibration at that frequency
+			durations[0] = dampedPeriod;
+			numExtraImpulses = 0;
+			break;
+
 		case InputShaperType::mzv:		// I can't find any references in the literature to this input shaper type, so the values are taken from Klipper source code
 			{
 				// Klipper gives amplitude steps of [a3 = k^2 * (1 - 1/sqrt(2)), a2 = k * (sqrt(2) - 1), a1 = 1 - 1/sqrt(2)] all divided by (a1 + a2 + a3)
@@ -326,6 +331,9 @@ GCodeResult AxisShaper::Configure(GCodeBuffer& gb, const StringRef& reply) THROW
 			overlappedDeltaVPerA = u;
 		}
 
+#if SUPPORT_SHAPER_PLAN_CACHE
+		planCache.Clear();
+#endif
 		reprap.MoveUpdated();
 	}
 	else if (type == InputShaperType::none)
@@ -336,6 +344,10 @@ GCodeResult AxisShaper::Configure(GCodeBuffer& gb, const StringRef& reply) THROW
 	{
 		reply.printf("Input shaping '%s' at %.1fHz damping factor %.2f, min. acceleration %.1f",
 						type.ToString(), (double)frequency, (double)zeta, (double)InverseConvertAcceleration(minimumAcceleration));
+		if (type == InputShaperType::scurve)
+		{
+			reply.catf(", jerk time %.2fms", (double)(durations[0] * StepClocksToMillis));
+		}
 		if (numExtraImpulses != 0)
 		{
 			reply.cat(", impulses");
@@ -361,11 +373,26 @@ GCodeResult AxisShaper::Configure(GCodeBuffer& gb, const StringRef& reply) THROW
 	return GCodeResult::ok;
 }
 
+#if SUPPORT_SHAPER_PLAN_CACHE
+
+void AxisShaper::Diagnostics(MessageType mtype) noexcept
+{
+	planCache.Diagnostics(mtype);
+}
+
+#endif
+
 // Plan input shaping, generate the MoveSegment, and set up the basic move parameters.
 // On entry, params.shapingPlan is set to 'no shaping'.
 // Currently we use a single input shaper for all axes, so the move segments are attached to the DDA not the DM
 void AxisShaper::PlanShaping(DDA& dda, PrepParams& params, bool shapingEnabled) const noexcept
 {
+	// If the segment pool is too short of segments to shape this move, don't shape it rather than grow the pool
+	if (shapingEnabled && type != InputShaperType::none && !MoveSegment::CanAllocateShaped(GetMaxShapedSegments()))
+	{
+		shapingEnabled = false;
+	}
+
 	switch ((shapingEnabled) ? type.RawValue() : InputShaperType::none)
 	{
 #if SUPPORT_DAA
@@ -499,6 +526,36 @@ void AxisShaper::PlanShaping(DDA& dda, PrepParams& params, bool shapingEnabled)
 		params.SetFromDDA(dda);
 		break;
 
+	// S-curve acceleration replaces the constant acceleration and deceleration phases by segments with limited jerk
+	case InputShaperType::scurve:
+		params.SetFromDDA(dda);															// set up the provisional parameters
+
+		// Delta axes, arc moves and the Z motor of moves that follow the height map calculate step times from the segments in a way that doesn't support cubic segments,
+		// so we only use S-curve acceleration for other moves.
+		// As with input shaping we need a steady speed segment that can be shortened, because the S-curve phases take longer than the constant acceleration phases they replace.
+		if (!dda.flags.isDeltaMovement && !dda.IsArcMove() && !dda.FollowsMesh() && params.unshaped.accelDistance < params.unshaped.decelStartDistance)
+		{
+#if SUPPORT_SHAPER_PLAN_CACHE
+			if (planCache.Lookup(dda, (uint32_t)type.ToBaseType() << ShaperPlanCache::ShaperTypeShift, params))
+			{
+				break;
+			}
+#endif
+			params.shaped = params.unshaped;
+			if (params.unshaped.accelDistance > 0.0)
+			{
+				TryScurveAccel(dda, params);
+			}
+			if (params.unshaped.decelStartDistance < dda.totalDistance)
+			{
+				TryScurveDecel(dda, params);
+			}
+#if SUPPORT_SHAPER_PLAN_CACHE
+			planCache.Store(dda, params);
+#endif
+		}
+		break;
+
 	// The other input shapers all have multiple impulses with varying coefficients
 	case InputShaperType::zvd:
 	case InputShaperType::mzv:
@@ -510,11 +567,25 @@ void AxisShaper::PlanShaping(DDA& dda, PrepParams& params, bool shapingEnabled)
 
 		if (params.unshaped.accelDistance < params.unshaped.decelStartDistance)			// we can't do any shaping unless there is a steady speed segment that can be shortened
 		{
+			const bool shapeAccelEndOnly = params.unshaped.accelDistance > 0.0
+											&& (dda.GetPrevious()->state == DDA::DDAState::frozen || dda.GetPrevious()->state == DDA::DDAState::executing)
+											&& dda.GetPrevious()->flags.wasAccelOnlyMove;
+			const bool shapeDecelStartOnly = params.unshaped.decelStartDistance < dda.totalDistance
+											&& dda.GetNext()->GetState() == DDA::DDAState::provisional && dda.GetNext()->IsDecelerationMove();
+#if SUPPORT_SHAPER_PLAN_CACHE
+			if (planCache.Lookup(dda,
+									((uint32_t)type.ToBaseType() << ShaperPlanCache::ShaperTypeShift)
+										| ((shapeAccelEndOnly) ? ShaperPlanCache::ShapeAccelEndOnly : 0) | ((shapeDecelStartOnly) ? ShaperPlanCache::ShapeDecelStartOnly : 0),
+									params))
+			{
+				break;
+			}
+#endif
 			params.shaped = params.unshaped;
 			//TODO if we want to shape both acceleration and deceleration but the steady distance is zero or too short, we could reduce the top speed
 			if (params.unshaped.accelDistance > 0.0)
 			{
-				if ((dda.GetPrevious()->state != DDA::DDAState::frozen && dda.GetPrevious()->state != DDA::DDAState::executing) || !dda.GetPrevious()->flags.wasAccelOnlyMove)
+				if (!shapeAccelEndOnly)
 				{
 					TryShapeAccelBoth(dda, params);
 				}
@@ -525,7 +596,7 @@ void AxisShaper::PlanShaping(DDA& dda, PrepParams& params, bool shapingEnabled)
 			}
 			if (params.unshaped.decelStartDistance < dda.totalDistance)
 			{
-				if (dda.GetNext()->GetState() != DDA::DDAState::provisional || !dda.GetNext()->IsDecelerationMove())
+				if (!shapeDecelStartOnly)
 				{
 					TryShapeDecelBoth(dda, params);
 				}
@@ -534,6 +605,9 @@ void AxisShaper::PlanShaping(DDA& dda, PrepParams& params, bool shapingEnabled)
 					TryShapeDecelStart(dda, params);
 				}
 			}
+#if SUPPORT_SHAPER_PLAN_CACHE
+			planCache.Store(dda, params);
+#endif
 		}
 		break;
 	}
@@ -617,6 +691,34 @@ void AxisShaper::TryShapeAccelBoth(DDA& dda, PrepParams& params) const noexcept
 	}
 }
 
+// Try to use S-curve acceleration. Ramping the acceleration up and down over the jerk time adds the jerk time to the acceleration time, without changing the average speed.
+void AxisShaper::TryScurveAccel(const DDA& dda, PrepParams& params) const noexcept
+{
+	const float newAccelClocks = params.unshaped.accelClocks + durations[0];
+	if (ImplementAccelShaping(dda, params, (dda.startSpeed + dda.topSpeed) * 0.5 * newAccelClocks, newAccelClocks))
+	{
+		params.shapingPlan.scurveAccel = true;
+	}
+	else if (reprap.Debug(Module::moduleDda))
+	{
+		debugPrintf("Can't use S-curve accel\n");
+	}
+}
+
+// Try to use S-curve deceleration
+void AxisShaper::TryScurveDecel(const DDA& dda, PrepParams& params) const noexcept
+{
+	const float newDecelClocks = params.unshaped.decelClocks + durations[0];
+	if (ImplementDecelShaping(dda, params, dda.totalDistance - (dda.topSpeed + dda.endSpeed) * 0.5 * newDecelClocks, newDecelClocks))
+	{
+		params.shapingPlan.scurveDecel = true;
+	}
+	else if (reprap.Debug(Module::moduleDda))
+	{
+		debugPrintf("Can't use S-curve decel\n");
+	}
+}
+
 // Check whether we can implement acceleration shaping using the proposed parameters; if so then implement it and return true; else return false with nothing changed
 bool AxisShaper::ImplementAccelShaping(const DDA& dda, PrepParams& params, float newAccelDistance, float newAccelClocks) const noexcept
 {
@@ -726,6 +828,11 @@ MoveSegment *AxisShaper::GetAccelerationSegments(const DDA& dda, PrepParams& par
 {
 	if (params.shaped.accelDistance > 0.0)
 	{
+		if (params.shapingPlan.scurveAccel)
+		{
+			return GetScurveSegments(dda.startSpeed, dda.topSpeed, params.shaped.accelClocks);
+		}
+
 		if (params.shapingPlan.shapeAccelOverlapped)
 		{
 			MoveSegment *accelSegs = nullptr;
@@ -831,6 +938,11 @@ MoveSegment *AxisShaper::GetDecelerationSegments(const DDA& dda, PrepParams& par
 {
 	if (params.shaped.decelStartDistance < dda.totalDistance)
 	{
+		if (params.shapingPlan.scurveDecel)
+		{
+			return GetScurveSegments(dda.topSpeed, dda.endSpeed, params.shaped.decelClocks);
+		}
+
 		if (params.shapingPlan.shapeDecelOverlapped)
 		{
 			MoveSegment *decelSegs = nullptr;
@@ -931,6 +1043,43 @@ MoveSegment *AxisShaper::GetDecelerationSegments(const DDA& dda, PrepParams& par
 	return nullptr;
 }
 
+// Generate the segments for an S-curve acceleration or deceleration. This works for both because the acceleration is negative when endSpeed < startSpeed.
+// The original constant acceleration time is totalClocks less the jerk time. The acceleration profile is that constant acceleration convolved with a rectangular window of length the jerk time,
+// so it ramps up linearly for the shorter of the two times, stays constant for the difference between them, then ramps down again.
+MoveSegment *AxisShaper::GetScurveSegments(float startSpeed, float endSpeed, float totalClocks) const noexcept
+{
+	const float rampClocks = min<float>(totalClocks - durations[0], durations[0]);
+	const float constantClocks = totalClocks - 2 * rampClocks;
+	const float peakAcceleration = (endSpeed - startSpeed)/(totalClocks - rampClocks);
+	const float jerk = peakAcceleration/rampClocks;
+
+	// Ramp the acceleration down at the end
+	MoveSegment *segs = MoveSegment::Allocate(nullptr);
+	const float rampDownStartSpeed = endSpeed - 0.5 * peakAcceleration * rampClocks;
+	segs->SetCubic((rampDownStartSpeed + (0.5 * peakAcceleration - jerk * (1.0/6.0) * rampClocks) * rampClocks) * rampClocks, rampClocks, rampDownStartSpeed, peakAcceleration, -jerk);
+
+	// Constant acceleration in the middle, if the original acceleration time was different from the jerk time
+	const float rampUpEndSpeed = startSpeed + 0.5 * peakAcceleration * rampClocks;
+	if (constantClocks > 0.0)
+	{
+		segs = MoveSegment::Allocate(segs);
+		const float b = rampUpEndSpeed/(-peakAcceleration);
+		const float c = 2.0/peakAcceleration;
+		segs->SetNonLinear((rampUpEndSpeed + 0.5 * peakAcceleration * constantClocks) * constantClocks, constantClocks, b, c);
+	}
+
+	// Ramp the acceleration up at the start
+	segs = MoveSegment::Allocate(segs);
+	segs->SetCubic((startSpeed + jerk * (1.0/6.0) * fsquare(rampClocks)) * rampClocks, rampClocks, startSpeed, 0.0, jerk);
+	return segs;
+}
+
+// Return the largest number of shaped segments that a move can need: the shaped start, constant part and shaped end or three S-curve segments for each of acceleration and deceleration, plus steady speed
+unsigned int AxisShaper::GetMaxShapedSegments() const noexcept
+{
+	return 2 * max<unsigned int>(2 * numExtraImpulses + 1, 3) + 1;
+}
+
 // Generate the steady speed segment (if any), tack the segments together, and attach them to the DDA
 // Must set up params.steadyClocks before calling this
 MoveSegment *AxisShaper::FinishShapedSegments(const DDA& dda, const PrepParams& params, MoveSegment *accelSegs, MoveSegment *decelSegs) const noexcept
@@ -14,6 +14,7 @@
 #include <General/NamedEnum.h>
 #include <ObjectModel/ObjectModel.h>
 #include "InputShaperPlan.h"
+#include "ShaperPlanCache.h"
 
 // These names must be in alphabetical order and lowercase
 NamedEnum(InputShaperType, uint8_t,
@@ -25,6 +26,7 @@ NamedEnum(InputShaperType, uint8_t,
 	ei3,
 	mzv,
 	none,
+	scurve,
 	zvd,
 	zvdd,
 	zvddd,
@@ -48,6 +50,10 @@ public:
 
 	static MoveSegment *GetUnshapedSegments(DDA& dda, const PrepParams& params) noexcept;
 
+#if SUPPORT_SHAPER_PLAN_CACHE
+	void Diagnostics(MessageType mtype) noexcept;
+#endif
+
 protected:
 	DECLARE_OBJECT_MODEL
 	OBJECT_MODEL_ARRAY(amplitudes)
@@ -56,6 +62,8 @@ protected:
 private:
 	MoveSegment *GetAccelerationSegments(const DDA& dda, PrepParams& params) const noexcept;
 	MoveSegment *GetDecelerationSegments(const DDA& dda, PrepParams& params) const noexcept;
+	MoveSegment *GetScurveSegments(float startSpeed, float endSpeed, float totalClocks) const noexcept;
+	unsigned int GetMaxShapedSegments() const noexcept;
 	MoveSegment *FinishShapedSegments(const DDA& dda, const PrepParams& params, MoveSegment *accelSegs, MoveSegment *decelSegs) const noexcept;
 	float GetExtraAccelStartDistance(float startSpeed, float acceleration) const noexcept;
 	float GetExtraAccelEndDistance(float topSpeed, float acceleration) const noexcept;
@@ -65,6 +73,8 @@ private:
 	void TryShapeAccelBoth(DDA& dda, PrepParams& params) const noexcept;
 	void TryShapeDecelStart(const DDA& dda, PrepParams& params) const noexcept;
 	void TryShapeDecelBoth(DDA& dda, PrepParams& params) const noexcept;
+	void TryScurveAccel(const DDA& dda, PrepParams& params) const noexcept;
+	void TryScurveDecel(const DDA& dda, PrepParams& params) const noexcept;
 	bool ImplementAccelShaping(const DDA& dda, PrepParams& params, float newAccelDistance, float newAccelClocks) const noexcept;
 	bool ImplementDecelShaping(const DDA& dda, PrepParams& params, float newDecelStartDistance, float newDecelClocks) const noexcept;
 
@@ -79,7 +89,7 @@ private:
 	float zeta;											// the damping ratio, see https://en.wikipedia.org/wiki/Damping. 0 = undamped, 1 = critically damped.
 	float minimumAcceleration;							// the minimum value that we reduce average acceleration to in mm/sec^2
 	float coefficients[MaxExtraImpulses];				// the coefficients of all the impulses
-	float durations[MaxExtraImpulses];					// the duration in step clocks of each impulse
+	float durations[MaxExtraImpulses];					// the duration in step clocks of each impulse, or for S-curve acceleration durations[0] is the jerk time
 	float totalShapingClocks;							// the total input shaping time in step clocks
 	float minimumShapingStartOriginalClocks;			// the minimum acceleration/deceleration time for which we can shape the start, without changing the acceleration/deceleration
 	float minimumShapingEndOriginalClocks;				// the minimum acceleration/deceleration time for which we can shape the start, without changing the acceleration/deceleration
@@ -94,6 +104,9 @@ private:
 	float overlappedDeltaVPerA;							// the effective acceleration time (velocity change per unit acceleration) when we use overlapping, in step clocks
 	float overlappedDistancePerA;						// the distance needed by an overlapped acceleration or deceleration, less the initial velocity contribution
 	InputShaperType type;
+#if SUPPORT_SHAPER_PLAN_CACHE
+	mutable ShaperPlanCache planCache;					// PlanShaping is logically const, the cache only saves it recalculating plans
+#endif
 };
 
 #endif /* SRC_MOVEMENT_AXISSHAPER_H_ */
@@ -327,11 +327,22 @@ void GridDefinition::PrintError(float originalAxis0range, float originalAxis1ran
 // Adding more fields to the header row can be handled in GridDefinition::ReadParameters(), though.
 const char * const HeightMap::HeightMapComment = "RepRapFirmware height map file v2";
 
-HeightMap::HeightMap() noexcept : useMap(false) { }
+HeightMap::HeightMap() noexcept
+	: useMap(false)
+#if SUPPORT_MESH_Z_PROFILE
+	  , maxSlope(0.0)
+#endif
+#if SUPPORT_BICUBIC_MESH
+	  , patches(nullptr), numPatches(0), bicubic(false), usePatches(false)
+#endif
+{ }
 
 void HeightMap::SetGrid(const GridDefinition& gd) noexcept
 {
 	useMap = false;
+#if SUPPORT_BICUBIC_MESH
+	usePatches = false;
+#endif
 	def = gd;
 	ClearGridHeights();
 }
@@ -339,6 +350,9 @@ void HeightMap::SetGrid(const GridDefinition& gd) noexcept
 void HeightMap::ClearGridHeights() noexcept
 {
 	gridHeightSet.ClearAll();
+#if SUPPORT_BICUBIC_MESH
+	usePatches = false;
+#endif
 #if HAS_MASS_STORAGE
 	fileName.Clear();
 #endif
@@ -356,6 +370,9 @@ void HeightMap::SetGridHeight(size_t index, float height) noexcept
 	{
 		gridHeights[index] = height;
 		gridHeightSet.SetBit(index);
+#if SUPPORT_BICUBIC_MESH
+		usePatches = false;							// the patch coefficients are out of date until the map is enabled again
+#endif
 	}
 }
 
@@ -562,9 +579,165 @@ unsigned int HeightMap::GetStatistics(Deviation& deviation, float& minError, flo
 bool HeightMap::UseHeightMap(bool b) noexcept
 {
 	useMap = b && def.IsValid();
+#if SUPPORT_BICUBIC_MESH
+	usePatches = false;
+	if (useMap && bicubic)
+	{
+		CalculatePatches();
+	}
+#endif
+#if SUPPORT_MESH_Z_PROFILE
+	if (useMap)
+	{
+		CalculateMaxSlope();
+	}
+#endif
 	return useMap;
 }
 
+#if SUPPORT_MESH_Z_PROFILE
+
+// Calculate the steepest slope of the height map from the height differences between adjacent grid points.
+// When the Z motor follows the height map during a move, this limits how fast it can move compared to the XY movement.
+void HeightMap::CalculateMaxSlope() noexcept
+{
+	float maxSlope0 = 0.0, maxSlope1 = 0.0;
+	for (uint32_t axis1Index = 0; axis1Index < def.NumAxisPoints(1); ++axis1Index)
+	{
+		for (uint32_t axis0Index = 0; axis0Index < def.NumAxisPoints(0); ++axis0Index)
+		{
+			const uint32_t index = GetMapIndex(axis0Index, axis1Index);
+			if (gridHeightSet.IsBitSet(index))
+			{
+				if (axis0Index + 1 < def.NumAxisPoints(0) && gridHeightSet.IsBitSet(index + 1))
+				{
+					maxSlope0 = max<float>(maxSlope0, fabsf(gridHeights[index + 1] - gridHeights[index]));
+				}
+				const uint32_t nextIndex = GetMapIndex(axis0Index, axis1Index + 1);
+				if (axis1Index + 1 < def.NumAxisPoints(1) && gridHeightSet.IsBitSet(nextIndex))
+				{
+					maxSlope1 = max<float>(maxSlope1, fabsf(gridHeights[nextIndex] - gridHeights[index]));
+				}
+			}
+		}
+	}
+	maxSlope = fastSqrtf(fsquare(maxSlope0 * def.recipAxisSpacings[0]) + fsquare(maxSlope1 * def.recipAxisSpacings[1]));
+}
+
+// Return the maximum number of grid lines that a move by this X or Y amount can cross
+// Note that deltaAxis0 and deltaAxis1 may be negative
+unsigned int HeightMap::GetMaxGridCrossings(float deltaAxis0, float deltaAxis1) const noexcept
+{
+	return (unsigned int)(fabsf(deltaAxis0) * def.recipAxisSpacings[0]) + (unsigned int)(fabsf(deltaAxis1) * def.recipAxisSpacings[1]) + 2;
+}
+
+#endif
+
+#if SUPPORT_BICUBIC_MESH
+
+// Select bicubic or bilinear interpolation. The new setting takes effect when the height map is next enabled.
+void HeightMap::SetBicubic(bool b) noexcept
+{
+	if (!b)
+	{
+		delete[] patches;
+		patches = nullptr;
+		numPatches = 0;
+	}
+	bicubic = b;
+	usePatches = false;
+}
+
+// Calculate the bicubic patch coefficients of every cell of the grid from the heights and the estimated derivatives at its corners.
+// The patches match in height and slope along their common edges, so the interpolated surface is smooth.
+void HeightMap::CalculatePatches() noexcept
+{
+	if (def.nums[0] < 2 || def.nums[1] < 2)
+	{
+		return;
+	}
+
+	// Allocate one patch per grid cell, reallocating them if the grid has changed size
+	const size_t numPatchesNeeded = (def.nums[0] - 1) * (def.nums[1] - 1);
+	if (numPatchesNeeded != numPatches)
+	{
+		delete[] patches;
+		patches = new PatchCoefficients[numPatchesNeeded];
+		numPatches = numPatchesNeeded;
+	}
+
+	// Matrix to convert the heights and derivatives at the corners of a cell to polynomial coefficients
+	static constexpr float HermiteMatrix[4][4] =
+	{
+		{  1.0,  0.0,  0.0,  0.0 },
+		{  0.0,  0.0,  1.0,  0.0 },
+		{ -3.0,  3.0, -2.0, -1.0 },
+		{  2.0, -2.0,  1.0,  1.0 }
+	};
+
+	PatchCoefficients *patch = patches;
+	for (uint32_t axis1Index = 0; axis1Index + 1 < def.nums[1]; ++axis1Index)
+	{
+		for (uint32_t axis0Index = 0; axis0Index + 1 < def.nums[0]; ++axis0Index)
+		{
+			// Build the matrix of corner heights (top left), axis 1 derivatives (top right), axis 0 derivatives (bottom left) and cross derivatives (bottom right)
+			float f[4][4];
+			for (unsigned int i = 0; i < 2; ++i)
+			{
+				for (unsigned int j = 0; j < 2; ++j)
+				{
+					f[i][j] = gridHeights[GetMapIndex(axis0Index + i, axis1Index + j)];
+					f[i][j + 2] = GetHeightDerivative(axis0Index + i, axis1Index + j, false, true);
+					f[i + 2][j] = GetHeightDerivative(axis0Index + i, axis1Index + j, true, false);
+					f[i + 2][j + 2] = GetHeightDerivative(axis0Index + i, axis1Index + j, true, true);
+				}
+			}
+
+			// The coefficients are HermiteMatrix * f * transpose(HermiteMatrix)
+			float t[4][4];
+			for (unsigned int i = 0; i < 4; ++i)
+			{
+				for (unsigned int j = 0; j < 4; ++j)
+				{
+					t[i][j] = HermiteMatrix[i][0] * f[0][j] + HermiteMatrix[i][1] * f[1][j] + HermiteMatrix[i][2] * f[2][j] + HermiteMatrix[i][3] * f[3][j];
+				}
+			}
+			for (unsigned int i = 0; i < 4; ++i)
+			{
+				for (unsigned int j = 0; j < 4; ++j)
+				{
+					patch->a[4 * i + j] = t[i][0] * HermiteMatrix[j][0] + t[i][1] * HermiteMatrix[j][1] + t[i][2] * HermiteMatrix[j][2] + t[i][3] * HermiteMatrix[j][3];
+				}
+			}
+			++patch;
+		}
+	}
+	usePatches = true;
+}
+
+// Estimate the derivative of the height at a grid point with respect to axis 0, axis 1 or both, in units of grid spacings.
+// We use central differences, or one-sided differences at the edges of the grid.
+float HeightMap::GetHeightDerivative(uint32_t axis0Index, uint32_t axis1Index, bool wrtAxis0, bool wrtAxis1) const noexcept
+{
+	const uint32_t low0 = (wrtAxis0 && axis0Index != 0) ? axis0Index - 1 : axis0Index;
+	const uint32_t high0 = (wrtAxis0 && axis0Index + 1 < def.nums[0]) ? axis0Index + 1 : axis0Index;
+	const uint32_t low1 = (wrtAxis1 && axis1Index != 0) ? axis1Index - 1 : axis1Index;
+	const uint32_t high1 = (wrtAxis1 && axis1Index + 1 < def.nums[1]) ? axis1Index + 1 : axis1Index;
+
+	if (wrtAxis0 && wrtAxis1)
+	{
+		return (gridHeights[GetMapIndex(high0, high1)] - gridHeights[GetMapIndex(low0, high1)] - gridHeights[GetMapIndex(high0, low1)] + gridHeights[GetMapIndex(low0, low1)])
+				/(float)((high0 - low0) * (high1 - low1));
+	}
+	if (wrtAxis0)
+	{
+		return (gridHeights[GetMapIndex(high0, axis1Index)] - gridHeights[GetMapIndex(low0, axis1Index)])/(float)(high0 - low0);
+	}
+	return (gridHeights[GetMapIndex(axis0Index, high1)] - gridHeights[GetMapIndex(axis0Index, low1)])/(float)(high1 - low1);
+}
+
+#endif
+
 // Compute the height error at the specified point
 float HeightMap::GetInterpolatedHeightError(float axis0, float axis1) const noexcept
 {
@@ -592,6 +765,21 @@ float HeightMap::GetInterpolatedHeightError(float axis0, float axis1) const noex
 	const float yFloor = floor(yf);
 	const int32_t yIndex = (int32_t)yFloor;
 
+#if SUPPORT_BICUBIC_MESH
+	if (usePatches)
+	{
+		// Evaluate the polynomial of the cell using Horner's method
+		const float * const a = patches[(yIndex * (def.nums[0] - 1)) + xIndex].a;
+		const float u = xf - xFloor;
+		const float v = yf - yFloor;
+		const float p0 = ((a[3] * v + a[2]) * v + a[1]) * v + a[0];
+		const float p1 = ((a[7] * v + a[6]) * v + a[5]) * v + a[4];
+		const float p2 = ((a[11] * v + a[10]) * v + a[9]) * v + a[8];
+		const float p3 = ((a[15] * v + a[14]) * v + a[13]) * v + a[12];
+		return ((p3 * u + p2) * u + p1) * u + p0;
+	}
+#endif
+
 	return InterpolateAxis0Axis1(xIndex, yIndex, xf - xFloor, yf - yFloor);
 }
 
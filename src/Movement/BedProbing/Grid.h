@@ -92,10 +92,19 @@ public:
 #endif
 
 	unsigned int GetMinimumSegments(float deltaAxis0, float deltaAxis1) const noexcept;	// Return the minimum number of segments for a move by this X or Y amount
+#if SUPPORT_MESH_Z_PROFILE
+	unsigned int GetMaxGridCrossings(float deltaAxis0, float deltaAxis1) const noexcept;	// Return the maximum number of grid lines crossed by a move by this X or Y amount
+	float GetMaxSlope() const noexcept { return maxSlope; }								// Return the steepest slope of the height map when it was last enabled
+#endif
 
 	bool UseHeightMap(bool b) noexcept;
 	bool UsingHeightMap() const noexcept { return useMap; }
 
+#if SUPPORT_BICUBIC_MESH
+	void SetBicubic(bool b) noexcept;												// Select bicubic or bilinear interpolation
+	bool IsBicubic() const noexcept { return bicubic; }
+#endif
+
 	unsigned int GetStatistics(Deviation& deviation, float& minError, float& maxError) const noexcept;
 																	// Return number of points probed, mean and RMS deviation, min and max error
 	void ExtrapolateMissing() noexcept;								// Extrapolate missing points to ensure consistency
@@ -114,6 +123,29 @@ private:
 	String<MaxFilenameLength> fileName;								// The name of the file that this height map was loaded from or saved to
 #endif
 	bool useMap;													// True to do bed compensation
+#if SUPPORT_MESH_Z_PROFILE
+	float maxSlope;													// The steepest slope between adjacent grid points, calculated when the map is enabled
+#endif
+
+#if SUPPORT_BICUBIC_MESH
+	// Coefficients of the bicubic patch covering one grid cell. The height at fractional position (u, v) within the cell is sum(a[4*i + j] * u^i * v^j).
+	struct PatchCoefficients
+	{
+		float a[16];
+	};
+
+	PatchCoefficients *patches;										// Coefficients of each grid cell in row order, allocated when they are first calculated for a grid of this size
+	size_t numPatches;												// The number of patches allocated
+	bool bicubic;													// True if bicubic interpolation has been selected
+	bool usePatches;												// True if the patch coefficients are valid for the current height map
+
+	void CalculatePatches() noexcept;
+	float GetHeightDerivative(uint32_t axis0Index, uint32_t axis1Index, bool wrtAxis0, bool wrtAxis1) const noexcept;
+#endif
+
+#if SUPPORT_MESH_Z_PROFILE
+	void CalculateMaxSlope() noexcept;
+#endif
 
 	uint32_t GetMapIndex(uint32_t axis0Index, uint32_t axis1Index) const noexcept { return (axis1Index * def.NumAxisPoints(0)) + axis0Index; }
 	void SetGridHeight(size_t index, float height) noexcept;							// Set the height of a grid point
@@ -14,6 +14,10 @@
 #include "Kinematics/LinearDeltaKinematics.h"
 #include <Tools/Tool.h>
 
+#if SUPPORT_MOVE_RECORDER
+# include "MoveRecorder.h"
+#endif
+
 #if SUPPORT_CAN_EXPANSION
 # include <CAN/CanMotion.h>
 #endif
@@ -39,7 +43,7 @@ struct MoveParameters
 	float endSpeed;
 	float targetNextSpeed;
 	uint32_t endstopChecks;
-	uint16_t flags;
+	uint32_t flags;
 
 	MoveParameters() noexcept
 	{
@@ -50,7 +54,7 @@ struct MoveParameters
 
 	void DebugPrint() const noexcept
 	{
-		reprap.GetPlatform().MessageF(DebugMessage, "%f,%f,%f,%f,%f,%f,%f,%f,%08" PRIX32 ",%04x\n",
+		reprap.GetPlatform().MessageF(DebugMessage, "%f,%f,%f,%f,%f,%f,%f,%f,%08" PRIX32 ",%08" PRIX32 "\n",
 								(double)accelDistance, (double)steadyDistance, (double)decelDistance, (double)requestedSpeed, (double)startSpeed, (double)topSpeed, (double)endSpeed,
 								(double)targetNextSpeed, endstopChecks, flags);
 	}
@@ -144,6 +148,9 @@ DDA::DDA(DDA* n) noexcept : next(n), prev(nullptr), state(empty)
 {
 	activeDMs = completedDMs = nullptr;
 	shapedSegments = unshapedSegments = nullptr;
+#if SUPPORT_MESH_Z_PROFILE
+	meshZProfile = nullptr;
+#endif
 	tool = nullptr;						// needed in case we pause before any moves have been done
 
 	// Set the endpoints to zero, because Move will ask for them.
@@ -185,6 +192,10 @@ void DDA::ReleaseDMs() noexcept
 		MoveSegment::Release(seg);
 		seg = nextSeg;
 	}
+	if (unshapedSegments != nullptr)
+	{
+		MoveSegment::ReleaseShared(afterPrepare.numSegmentsShared);
+	}
 	for (MoveSegment* seg = unshapedSegments; seg != nullptr; )
 	{
 		MoveSegment* const nextSeg = seg->GetNext();
@@ -192,12 +203,20 @@ void DDA::ReleaseDMs() noexcept
 		seg = nextSeg;
 	}
 	shapedSegments = unshapedSegments = nullptr;
+
+#if SUPPORT_MESH_Z_PROFILE
+	if (meshZProfile != nullptr)
+	{
+		MeshZProfile::Release(meshZProfile);
+		meshZProfile = nullptr;
+	}
+#endif
 }
 
 // Return the number of clocks this DDA still needs to execute.
 // This could be slightly negative, if the move is overdue for completion.
 int32_t DDA::GetTimeLeft() const noexcept
-pre(state == executing || state == frozen || state == completed)
+pre(state == executing || state == frozen || state == preparing || state == completed)
 {
 	return (state == completed) ? 0
 			: (state == executing) ? (int32_t)(afterPrepare.moveStartTime + clocksNeeded - StepTimer::GetTimerTicks())
@@ -218,6 +237,24 @@ inline void DDA::InsertDM(DriveMovement *dm) noexcept
 	*dmp = dm;
 }
 
+// Merge a non-empty chain of DMs that is already in step-time order into the list of active DMs
+inline void DDA::MergeDMs(DriveMovement *sortedDMs) noexcept
+{
+	DriveMovement **dmp = &activeDMs;
+	do
+	{
+		DriveMovement * const dmToInsert = sortedDMs;
+		sortedDMs = sortedDMs->nextDM;
+		while (*dmp != nullptr && (*dmp)->nextStepTime < dmToInsert->nextStepTime)
+		{
+			dmp = &((*dmp)->nextDM);
+		}
+		dmToInsert->nextDM = *dmp;
+		*dmp = dmToInsert;
+		dmp = &(dmToInsert->nextDM);								// the next DM to insert is not due before this one, so continue searching from here
+	} while (sortedDMs != nullptr);
+}
+
 // Remove this drive from the list of drives with steps due and put it in the completed list
 // Called from the step ISR only.
 void DDA::DeactivateDM(size_t drive) noexcept
@@ -266,7 +303,13 @@ void DDA::DebugPrint(const char *tag) const noexcept
 
 	debugPrintf(" s=%.4e", (double)totalDistance);
 	DebugPrintVector(" vec", directionVector, MaxAxesPlusExtruders);
-	debugPrintf("\n" "a=%.4e d=%.4e reqv=%.4e startv=%.4e topv=%.4e endv=%.4e cks=%" PRIu32 " fp=%" PRIu32 " fl=%04x\n",
+#if SUPPORT_NATIVE_ARCS
+	if (flags.isArcMove)
+	{
+		debugPrintf(" arc r=%.3f start=%.4f angle=%.4f", (double)arc.radius, (double)arc.startAngle, (double)arc.totalAngle);
+	}
+#endif
+	debugPrintf("\n" "a=%.4e d=%.4e reqv=%.4e startv=%.4e topv=%.4e endv=%.4e cks=%" PRIu32 " fp=%" PRIu32 " fl=%08" PRIx32 "\n",
 				(double)acceleration, (double)deceleration, (double)requestedSpeed, (double)startSpeed, (double)topSpeed, (double)endSpeed, clocksNeeded, (uint32_t)filePos, flags.all);
 	for (const MoveSegment *segs = shapedSegments; segs != nullptr; segs = segs->GetNext())
 	{
@@ -294,7 +337,8 @@ void DDA::DebugPrintAll(const char *tag) const noexcept
 
 // Set up a real move. Return true if it represents real movement, else false.
 // Either way, return the amount of extrusion we didn't do in the extruder coordinates of nextMove
-bool DDA::InitStandardMove(DDARing& ring, const RawMove &nextMove, bool doMotorMapping) noexcept
+// If motorSteps is not null then it holds the motor positions of the axes, which have already been calculated from the coordinates in nextMove.
+bool DDA::InitStandardMove(DDARing& ring, const RawMove &nextMove, bool doMotorMapping, const int32_t *motorSteps) noexcept
 {
 	// 0. If there are more total axes than visible axes, then we must ignore any movement data in nextMove for the invisible axes.
 	// The call to CartesianToMotorSteps may adjust the invisible axis endpoints for architectures such as CoreXYU and delta with >3 towers, so set them up here.
@@ -312,9 +356,32 @@ bool DDA::InitStandardMove(DDARing& ring, const RawMove &nextMove, bool doMotorM
 	const Move& move = reprap.GetMove();
 	if (doMotorMapping)
 	{
-		if (!move.CartesianToMotorSteps(nextMove.coords, endPoint, nextMove.isCoordinated))		// transform the axis coordinates if on a delta or CoreXY printer
+#if SUPPORT_NATIVE_ARCS
+		flags.isArcMove = nextMove.isNativeArc;
+		if (flags.isArcMove)
+		{
+			arc = nextMove.arc;
+		}
+#endif
+		if (motorSteps != nullptr)
+		{
+			for (size_t axis = 0; axis < numTotalAxes; ++axis)
+			{
+				endPoint[axis] = motorSteps[axis];
+			}
+		}
+		else
 		{
-			return false;												// throw away the move if it couldn't be transformed
+#if SUPPORT_TRANSFORM_BATCH
+			const uint32_t transformStartTime = StepTimer::GetTimerTicks();
+#endif
+			if (!move.CartesianToMotorSteps(nextMove.coords, endPoint, nextMove.isCoordinated))		// transform the axis coordinates if on a delta or CoreXY printer
+			{
+				return false;											// throw away the move if it couldn't be transformed
+			}
+#if SUPPORT_TRANSFORM_BATCH
+			ring.RecordTransformTime(StepTimer::GetTimerTicks() - transformStartTime);
+#endif
 		}
 #if SUPPORT_LINEAR_DELTA
 		flags.isDeltaMovement = move.IsDeltaMode()
@@ -343,7 +410,11 @@ bool DDA::InitStandardMove(DDARing& ring, const RawMove &nextMove, bool doMotorM
 				delta = endPoint[drive] - positionNow[drive];
 				const float positionDelta = endCoordinates[drive] - prev->GetEndCoordinate(drive, false);
 				directionVector[drive] = positionDelta;
-				if (positionDelta != 0.0)
+				if (   positionDelta != 0.0
+#if SUPPORT_NATIVE_ARCS
+					|| (flags.isArcMove && (drive == arc.axis0 || drive == arc.axis1))	// the arc axes move even if the arc is a whole circle
+#endif
+				   )
 				{
 					if (reprap.GetPlatform().IsAxisRotational(drive) && nextMove.rotationalAxesMentioned)
 					{
@@ -444,6 +515,9 @@ bool DDA::InitStandardMove(DDARing& ring, const RawMove &nextMove, bool doMotorM
 	flags.isNonPrintingExtruderMove = extrudersMoving && !flags.isPrintingMove;	// flag used by filament monitors - we can ignore Z movement
 	flags.usePressureAdvance = nextMove.usePressureAdvance;
 	flags.controlLaser = nextMove.isCoordinated && nextMove.checkEndstops == 0;
+#if SUPPORT_MESH_Z_PROFILE
+	flags.followsMesh = nextMove.followMesh && doMotorMapping && flags.xyMoving && !nextMove.checkEndstops;
+#endif
 
 	// The end coordinates will be valid at the end of this move if it does not involve endstop checks and is not a raw motor move
 	flags.endCoordinatesValid = !nextMove.checkEndstops && doMotorMapping;
@@ -470,6 +544,14 @@ bool DDA::InitStandardMove(DDARing& ring, const RawMove &nextMove, bool doMotorM
 		// This means that the user gets the feed rate that he asked for. It also makes the delta calculations simpler.
 		// First do the bed tilt compensation for deltas.
 		directionVector[Z_AXIS] += (directionVector[X_AXIS] * k.GetTiltCorrection(X_AXIS)) + (directionVector[Y_AXIS] * k.GetTiltCorrection(Y_AXIS));
+#if SUPPORT_NATIVE_ARCS
+		if (flags.isArcMove)
+		{
+			// The distance moved in the plane of the arc is the arc length, not the chord length
+			directionVector[arc.axis0] = arc.radius * fabsf(arc.totalAngle);
+			directionVector[arc.axis1] = 0.0;
+		}
+#endif
 		totalDistance = NormaliseLinearMotion(reprap.GetPlatform().GetLinearAxes());
 	}
 	else if (rotationalAxesMoving)
@@ -491,10 +573,32 @@ bool DDA::InitStandardMove(DDARing& ring, const RawMove &nextMove, bool doMotorM
 		}
 	}
 
+#if SUPPORT_NATIVE_ARCS
+	float arcPlanarFraction = 0.0;									// the proportion of the total distance that is along the arc
+	if (flags.isArcMove)
+	{
+		// Replace the arc axis components of the direction vector by the direction at the start of the arc, and save the direction at the end for the next move to use
+		arcPlanarFraction = directionVector[arc.axis0];
+		const float tangent = (arc.totalAngle >= 0.0) ? arcPlanarFraction : -arcPlanarFraction;
+		directionVector[arc.axis0] = -tangent * sinf(arc.startAngle);
+		directionVector[arc.axis1] = tangent * cosf(arc.startAngle);
+		const float endAngle = arc.startAngle + arc.totalAngle;
+		arcEndDirection[0] = -tangent * sinf(endAngle);
+		arcEndDirection[1] = tangent * cosf(endAngle);
+	}
+#endif
+
 	// 5. Compute the maximum acceleration available
 	float normalisedDirectionVector[MaxAxesPlusExtruders];			// used to hold a unit-length vector in the direction of motion
 	memcpyf(normalisedDirectionVector, directionVector, ARRAY_SIZE(normalisedDirectionVector));
 	Absolute(normalisedDirectionVector, MaxAxesPlusExtruders);
+#if SUPPORT_NATIVE_ARCS
+	if (flags.isArcMove)
+	{
+		// The direction changes during an arc move, so allow for each arc axis moving in the direction of travel at some point
+		normalisedDirectionVector[arc.axis0] = normalisedDirectionVector[arc.axis1] = arcPlanarFraction;
+	}
+#endif
 	acceleration = beforePrepare.maxAcceleration = VectorBoxIntersection(normalisedDirectionVector, accelerations);
 	if (flags.xyMoving)											// apply M204 acceleration limits to XY moves
 	{
@@ -533,18 +637,48 @@ bool DDA::InitStandardMove(DDARing& ring, const RawMove &nextMove, bool doMotorM
 	// for diagonal moves. On other architectures, this is not OK and any movement in the XY plane should be limited on other ways.
 	if (doMotorMapping)
 	{
+#if SUPPORT_NATIVE_ARCS
+		if (flags.isArcMove)
+		{
+			// The kinematics limits assume straight line motion, so we limit the motors that move the arc axes separately
+			normalisedDirectionVector[arc.axis0] = normalisedDirectionVector[arc.axis1] = 0.0;
+			LimitArcSpeedAndAcceleration(k, arcPlanarFraction);
+		}
+#endif
+#if SUPPORT_MESH_Z_PROFILE
+		if (flags.followsMesh && move.GetMeshMaxSlope() > 0.0)
+		{
+			// The Z motor speed varies during the move as it follows the height map, so allow for the steepest slope in the map
+			const float zFraction = fabsf(directionVector[Z_AXIS]) + move.GetMeshMaxSlope();
+			LimitSpeedAndAcceleration(reprap.GetPlatform().MaxFeedrate(Z_AXIS)/zFraction, reprap.GetPlatform().Acceleration(Z_AXIS)/zFraction);
+		}
+#endif
 		k.LimitSpeedAndAcceleration(*this, normalisedDirectionVector, numVisibleAxes, flags.continuousRotationShortcut);	// give the kinematics the chance to further restrict the speed and acceleration
 	}
 
 	// 7. Calculate the provisional accelerate and decelerate distances and the top speed
 	endSpeed = 0.0;							// until the next move asks us to adjust it
+	beforePrepare.maxStartSpeed = 0.0;		// until we find that we can meld this move to the previous one
 
 	if (prev->state == provisional && (move.GetJerkPolicy() != 0 || (flags.isPrintingMove == prev->flags.isPrintingMove && flags.xyMoving == prev->flags.xyMoving)))
 	{
 		// Try to meld this move to the previous move to avoid stop/start
-		// Assuming that this move ends with zero speed, calculate the maximum possible starting speed: u^2 = v^2 - 2as
-		prev->beforePrepare.targetNextSpeed = min<float>(fastSqrtf(deceleration * totalDistance * 2.0), requestedSpeed);
-		DoLookahead(ring, prev);
+		if (move.GetJunctionDeviation() > 0.0)
+		{
+			beforePrepare.maxStartSpeed = GetJunctionSpeed(move.GetJunctionDeviation());
+			DoJunctionDeviationLookahead(ring, this);
+		}
+		else
+		{
+			// Assuming that this move ends with zero speed, calculate the maximum possible starting speed: u^2 = v^2 - 2as
+			prev->beforePrepare.targetNextSpeed = min<float>(fastSqrtf(deceleration * totalDistance * 2.0), requestedSpeed);
+#if LOOKAHEAD_SELF_CHECK
+			beforePrepare.maxStartSpeed = GetJunctionSpeed(0.0);		// the junction speed allowed by the jerk limits, for the check
+			DoCheckedLookahead(ring, this);
+#else
+			DoLookahead(ring, prev);
+#endif
+		}
 		startSpeed = prev->endSpeed;
 	}
 	else
@@ -620,6 +754,7 @@ bool DDA::InitLeadscrewMove(DDARing& ring, float feedrate, const float adjustmen
 
 	// 7. Calculate the provisional accelerate and decelerate distances and the top speed
 	startSpeed = endSpeed = 0.0;
+	beforePrepare.maxStartSpeed = 0.0;
 
 	RecalculateMove(ring);
 	state = provisional;
@@ -744,12 +879,9 @@ bool DDA::InitFromRemote(const CanMessageMovementLinear& msg) noexcept
 				const int32_t delta = msg.perDrive[drive].iSteps;
 				if (delta != 0)
 				{
-					if (shapedSegments == nullptr)
-					{
-						// Calculate the segments needed for axis movement
-						//TODO the message will include input shaping info
-						shapedSegments = AxisShaper::GetUnshapedSegments(*this, params);
-					}
+					// Until the message includes input shaping info, the axes use the same unshaped segments as the extruders
+					//TODO the message will include input shaping info
+					EnsureUnshapedSegments(params);
 
 					DriveMovement* const pdm = DriveMovement::Allocate(drive, DMState::idle);
 					pdm->totalSteps = labs(delta);				// for now this is the number of net steps, but gets adjusted later if there is a reverse in direction
@@ -787,12 +919,8 @@ bool DDA::InitFromRemote(const CanMessageMovementLinear& msg) noexcept
 
 		case CanMessageMovementLinearShaped::shapedDelta:
 			{
-				if (shapedSegments == nullptr)
-				{
-					// Calculate the segments needed for axis movement
-					//TODO the message will include input shaping info
-					shapedSegments = AxisShaper::GetUnshapedSegments(*this, params);
-				}
+				//TODO the message will include input shaping info
+				EnsureUnshapedSegments(params);
 
 				//TODO
 			}
@@ -803,10 +931,7 @@ bool DDA::InitFromRemote(const CanMessageMovementLinear& msg) noexcept
 			// no break
 		case CanMessageMovementLinearShaped::MoveType::extruderNoPa:
 			{
-				if (unshapedSegments != nullptr)
-				{
-					unshapedSegments = AxisShaper::GetUnshapedSegments(*this, params);
-				}
+				ShareUnshapedSegments(params);
 				if (unshapedSegments != nullptr)
 				{
 					DriveMovement* const pdm = DriveMovement::Allocate(drive, DMState::idle);
@@ -1062,6 +1187,207 @@ LA_DEBUG;
 	}
 }
 
+// Calculate the maximum speed at the junction between the previous move and this one, for the junction deviation planner.
+// We treat the junction as if the tool followed a circular arc that deviates from the corner by the junction deviation, with centripetal acceleration equal to our acceleration.
+// Drives that are not linear axes (i.e. extruders and rotational axes) are still limited by their M566 jerk, as is everything if either move has no linear axis movement.
+// If junctionDeviation is zero then all drives are limited by their jerk, which gives the same junction speed limit that DoLookahead uses.
+float DDA::GetJunctionSpeed(float junctionDeviation) const noexcept
+{
+	const Platform& p = reprap.GetPlatform();
+	const AxesBitmap linearAxes = p.GetLinearAxes();
+	float maxSpeed = min<float>(requestedSpeed, prev->requestedSpeed);
+
+	// If both moves include linear axis movement then the linear parts of their direction vectors have unit length, so we can use their dot product to get the angle between them
+	float dotProduct = 0.0, prevLinearLengthSquared = 0.0, linearLengthSquared = 0.0;
+	linearAxes.Iterate([this, &dotProduct, &prevLinearLengthSquared, &linearLengthSquared](unsigned int axis, unsigned int) noexcept
+						{
+							const float prevDirection = prev->GetEndDirection(axis);
+							dotProduct += directionVector[axis] * prevDirection;
+							prevLinearLengthSquared += fsquare(prevDirection);
+							linearLengthSquared += fsquare(directionVector[axis]);
+						}
+					  );
+	const bool useJunctionDeviation = junctionDeviation > 0.0 && prevLinearLengthSquared > 0.99 && linearLengthSquared > 0.99;
+
+	for (size_t drive = 0; drive < MaxAxesPlusExtruders; ++drive)
+	{
+		if (!(useJunctionDeviation && drive < MaxAxes && linearAxes.IsBitSet(drive)))
+		{
+			const float totalFraction = fabsf(directionVector[drive] - prev->GetEndDirection(drive));
+			if (totalFraction * maxSpeed > p.GetInstantDv(drive))
+			{
+				maxSpeed = p.GetInstantDv(drive)/totalFraction;
+			}
+		}
+	}
+
+	if (useJunctionDeviation)
+	{
+		const float cosTheta = -dotProduct;										// cosine of the angle between the reversed previous direction and the new direction
+		if (cosTheta > -0.999999)												// if the moves are not in a straight line
+		{
+			const float sinHalfTheta = fastSqrtf(0.5 * (1.0 - min<float>(cosTheta, 1.0)));
+			const float maxJunctionSpeed = fastSqrtf(acceleration * junctionDeviation * sinHalfTheta/(1.0 - sinHalfTheta));
+			if (maxJunctionSpeed < maxSpeed)
+			{
+				maxSpeed = maxJunctionSpeed;
+			}
+		}
+	}
+	return maxSpeed;
+}
+
+// Replan the provisional moves when a new move has been added to the ring, using the junction deviation junction speeds instead of the jerk limits.
+// This is used instead of DoLookahead when junction deviation is configured using M566 J.
+// On entry, newDDA is the move being added, its previous move is provisional, and newDDA->beforePrepare.maxStartSpeed is the junction speed limit.
+// The new move must end at zero speed. First we work back through the provisional moves to find the highest speed each one can end at and still allow
+// the following moves to decelerate to zero by the end of the new move, stopping when a move's end speed is already at that limit.
+// Then we work forwards, raising each move's end speed to the highest speed it can reach within that limit by accelerating from its start speed.
+// This gives a time-optimal profile for trapezoidal moves with the given junction speeds and accelerations, without the recursive adjustment in DoLookahead.
+/*static*/ void DDA::DoJunctionDeviationLookahead(DDARing& ring, DDA *newDDA) noexcept
+{
+	// Backward pass. We use targetNextSpeed to hold the highest speed each move can end at.
+	DDA *laDDA = newDDA;
+	float maxEndSpeed = 0.0;													// the highest speed that laDDA can end at
+	for (;;)
+	{
+		const float maxStartSpeed = min<float>(laDDA->beforePrepare.maxStartSpeed, fastSqrtf(fsquare(maxEndSpeed) + (2 * laDDA->deceleration * laDDA->totalDistance)));
+		DDA * const prevDDA = laDDA->prev;
+		if (prevDDA->state != provisional)
+		{
+			if ((prevDDA->state == frozen || prevDDA->state == executing) && prevDDA->endSpeed < 0.99 * maxStartSpeed)
+			{
+				laDDA->flags.hadLookaheadUnderrun = true;						// we would have liked the previous move to end faster, but it's too late to change it
+			}
+			break;
+		}
+		if (maxStartSpeed <= prevDDA->endSpeed)
+		{
+			break;																// the previous move already ends as fast as it can, so the moves before it won't change
+		}
+		prevDDA->beforePrepare.targetNextSpeed = maxStartSpeed;
+		maxEndSpeed = maxStartSpeed;
+		laDDA = prevDDA;
+	}
+
+	// Forward pass. laDDA is the earliest move whose end speed may change.
+	while (laDDA != newDDA)
+	{
+		laDDA->startSpeed = laDDA->prev->endSpeed;
+		const float maxReachableSpeed = fastSqrtf(fsquare(laDDA->startSpeed) + (2 * laDDA->acceleration * laDDA->totalDistance));
+		const float newEndSpeed = min<float>(laDDA->beforePrepare.targetNextSpeed, maxReachableSpeed);
+		if (newEndSpeed >= laDDA->endSpeed)
+		{
+			laDDA->endSpeed = newEndSpeed;
+		}
+		else if (newEndSpeed < 0.99 * laDDA->endSpeed)
+		{
+			// This should not happen, because adding a move only relaxes the constraints on the moves before it. Don't reduce the end speed, because that may make the move infeasible.
+			ring.RecordLookaheadError();
+			if (reprap.Debug(moduleMove))
+			{
+				debugPrintf("DDA.cpp(%d) tn=%f ", __LINE__, (double)newEndSpeed);
+				laDDA->DebugPrint("jd");
+			}
+		}
+		laDDA->RecalculateMove(ring);
+		laDDA = laDDA->next;
+	}
+}
+
+#if LOOKAHEAD_SELF_CHECK
+
+// The values in a move that the lookahead planners may change
+struct DDA::LookaheadState
+{
+	decltype(DDA::beforePrepare) beforePrepare;
+	float startSpeed, endSpeed, topSpeed;
+	float acceleration, deceleration;
+	uint32_t clocksNeeded;
+	uint32_t flags;
+
+	void Save(const DDA& dda) noexcept
+	{
+		beforePrepare = dda.beforePrepare;
+		startSpeed = dda.startSpeed;
+		endSpeed = dda.endSpeed;
+		topSpeed = dda.topSpeed;
+		acceleration = dda.acceleration;
+		deceleration = dda.deceleration;
+		clocksNeeded = dda.clocksNeeded;
+		flags = dda.flags.all;
+	}
+
+	void Restore(DDA& dda) const noexcept
+	{
+		dda.beforePrepare = beforePrepare;
+		dda.startSpeed = startSpeed;
+		dda.endSpeed = endSpeed;
+		dda.topSpeed = topSpeed;
+		dda.acceleration = acceleration;
+		dda.deceleration = deceleration;
+		dda.clocksNeeded = clocksNeeded;
+		dda.flags.all = flags;
+	}
+};
+
+// Run DoLookahead, then run DoJunctionDeviationLookahead on the same moves using the jerk limits as the junction speed limits and compare the end speeds.
+// The junction deviation planner gives the highest end speeds that the limits allow, so DoLookahead should never give a higher end speed than it does.
+// DoLookahead may give a lower one, because it doesn't always adjust moves further back in the queue. We keep the results from DoLookahead.
+// On entry, newDDA is the move being added, its previous move is provisional and newDDA->beforePrepare.maxStartSpeed is the junction speed limit.
+/*static*/ void DDA::DoCheckedLookahead(DDARing& ring, DDA *newDDA) noexcept
+{
+	constexpr unsigned int MaxCheckedMoves = 40;
+	static LookaheadState before[MaxCheckedMoves], after[MaxCheckedMoves];	// static to save stack, which is OK because only the Move task adds moves
+
+	// Save the new move and the provisional moves before it, which are the ones that the planners may change
+	unsigned int numMoves = 0;
+	DDA *dda = newDDA;
+	do
+	{
+		if (numMoves == MaxCheckedMoves)
+		{
+			DoLookahead(ring, newDDA->prev);							// too many moves to check
+			return;
+		}
+		before[numMoves++].Save(*dda);
+		dda = dda->prev;
+	} while (dda->state == provisional);
+
+	DoLookahead(ring, newDDA->prev);
+
+	// Save the results of DoLookahead, restore the moves to how they were, and run the other planner
+	dda = newDDA;
+	for (unsigned int i = 0; i < numMoves; ++i)
+	{
+		after[i].Save(*dda);
+		before[i].Restore(*dda);
+		dda = dda->prev;
+	}
+	DoJunctionDeviationLookahead(ring, newDDA);
+
+	// Compare the end speeds and put back the results of DoLookahead
+	bool mismatch = false;
+	dda = newDDA;
+	for (unsigned int i = 0; i < numMoves; ++i)
+	{
+		if (dda->endSpeed < 0.99 * after[i].endSpeed)
+		{
+			mismatch = true;
+			if (reprap.Debug(moduleMove))
+			{
+				debugPrintf("DDA.cpp(%d) move %u jd=%f la=%f ", __LINE__, i, (double)dda->endSpeed, (double)after[i].endSpeed);
+				dda->DebugPrint("lc");
+			}
+		}
+		after[i].Restore(*dda);
+		dda = dda->prev;
+	}
+	ring.RecordLookaheadCheck(mismatch);
+}
+
+#endif
+
 // Try to push babystepping earlier in the move queue, returning the amount we pushed
 // Caution! Thus is called with scheduling locked, therefore it must make no FreeRTOS calls, or call anything that makes them
 //TODO this won't work for CoreXZ, rotary delta, Kappa, or SCARA with Z crosstalk
@@ -1084,7 +1410,7 @@ float DDA::AdvanceBabyStepping(DDARing& ring, size_t axis, float amount) noexcep
 	while(cdda != this)
 	{
 		float babySteppingToDo = 0.0;
-		if (amount != 0.0 && cdda->flags.xyMoving)
+		if (amount != 0.0 && cdda->flags.xyMoving && !cdda->IsArcMove())		// we can't renormalise the direction vector of an arc move
 		{
 			// Limit the babystepping Z speed to the lower of 0.1 times the original XYZ speed and 0.5 times the Z jerk
 			Platform& platform = reprap.GetPlatform();
@@ -1198,7 +1524,7 @@ void DDA::RecalculateMove(DDARing& ring) noexcept
 		const Platform& p = reprap.GetPlatform();
 		for (size_t drive = 0; drive < MaxAxesPlusExtruders; ++drive)
 		{
-			if (endSpeed * fabsf(directionVector[drive]) > p.GetInstantDv(drive))
+			if (endSpeed * fabsf(GetEndDirection(drive)) > p.GetInstantDv(drive))
 			{
 				flags.canPauseAfter = false;
 				break;
@@ -1220,9 +1546,10 @@ void DDA::MatchSpeeds() noexcept
 {
 	for (size_t drive = 0; drive < MaxAxesPlusExtruders; ++drive)
 	{
-		if (directionVector[drive] != 0.0 || next->directionVector[drive] != 0.0)
+		const float endDirection = GetEndDirection(drive);
+		if (endDirection != 0.0 || next->directionVector[drive] != 0.0)
 		{
-			const float totalFraction = fabsf(directionVector[drive] - next->directionVector[drive]);
+			const float totalFraction = fabsf(endDirection - next->directionVector[drive]);
 			const float jerk = totalFraction * beforePrepare.targetNextSpeed;
 			const float allowedJerk = reprap.GetPlatform().GetInstantDv(drive);
 			if (jerk > allowedJerk)
@@ -1297,212 +1624,342 @@ void DDA::EnsureUnshapedSegments(const PrepParams& params) noexcept
 	if (unshapedSegments == nullptr)
 	{
 		unshapedSegments = AxisShaper::GetUnshapedSegments(*this, params);
+		afterPrepare.numSegmentsShared = 0;
 	}
 }
 
-// Prepare this DDA for execution.
-// This must not be called with interrupts disabled, because it calls Platform::EnableDrive.
-void DDA::Prepare(SimulationMode simMode) noexcept
+// Set up unshapedSegments for an extruder DM. If another DM has already set them up then this one shares them instead of having a chain of its own.
+void DDA::ShareUnshapedSegments(const PrepParams& params) noexcept
 {
-	flags.wasAccelOnlyMove = IsAccelerationMove();			// save this for the next move to look at
+	if (unshapedSegments == nullptr)
+	{
+		EnsureUnshapedSegments(params);
+	}
+	else
+	{
+		const unsigned int numSegments = MoveSegment::CountSegments(unshapedSegments);
+		afterPrepare.numSegmentsShared += numSegments;
+		MoveSegment::NoteShared(numSegments);
+	}
+}
 
-#if SUPPORT_LASER
-	if (topSpeed < requestedSpeed && reprap.GetGCodes().GetMachineType() == MachineType::laser)
+#if SUPPORT_MESH_Z_PROFILE
+
+// Build the profile that the Z motor follows during this move, returning true if the Z motor doesn't just move in a straight line
+bool DDA::BuildMeshZProfile() noexcept
+{
+	meshZProfile = MeshZProfile::Allocate();
+	if (meshZProfile->Build(*this, endPoint[Z_AXIS] - prev->endPoint[Z_AXIS], reprap.GetPlatform().DriveStepsPerUnit(Z_AXIS)))
 	{
-		// Scale back the laser power according to the actual speed
-		laserPwmOrIoBits.laserPwm = (laserPwmOrIoBits.laserPwm * topSpeed)/requestedSpeed;
+		return true;
 	}
+	MeshZProfile::Release(meshZProfile);
+	meshZProfile = nullptr;
+	return false;
+}
+
 #endif
 
-	// Prepare for movement
-	shapedSegments = unshapedSegments = nullptr;
+// Return true if this move needs the generic code to prepare its drives
+inline bool DDA::NeedsGenericPrepare() const noexcept
+{
+	return flags.isLeadscrewAdjustmentMove
+		|| IsArcMove()
+#if SUPPORT_MESH_Z_PROFILE
+		|| flags.followsMesh
+#endif
+		;
+}
 
-	PrepParams params;										// the default constructor clears params.plan to 'no shaping'
-	if (flags.xyMoving)
+// Return true if any axis motor has net movement in this move
+bool DDA::AxisMotorsMoving() const noexcept
+{
+	const size_t numTotalAxes = reprap.GetGCodes().GetTotalAxes();
+	for (size_t drive = 0; drive < numTotalAxes; ++drive)
 	{
-		reprap.GetMove().GetAxisShaper().PlanShaping(*this, params, flags.xyMoving);	// this will set up shapedSegments if we are doing any shaping
+		if (endPoint[drive] != prev->endPoint[drive])
+		{
+			return true;
+		}
 	}
-	else
+	return false;
+}
+
+// On CoreXY and similar architectures, we also need to enable the motors controlling any connected axes
+/*static*/ void DDA::EnableConnectedAxisMotors(AxesBitmap additionalAxisMotorsToEnable, AxesBitmap axisMotorsEnabled, Platform& platform) noexcept
+{
+	additionalAxisMotorsToEnable &= ~axisMotorsEnabled;
+	while (additionalAxisMotorsToEnable.IsNonEmpty())
 	{
-		params.SetFromDDA(*this);
-		params.unshaped.Finalise(topSpeed);
-		clocksNeeded = params.unshaped.TotalClocks();
+		const size_t drive = additionalAxisMotorsToEnable.LowestSetBit();
+		additionalAxisMotorsToEnable.ClearBit(drive);
+		platform.EnableDrivers(drive, false);
 	}
+}
 
-	// Copy the unshaped acceleration and deceleration back to the DDA because ManageLaserPower uses them
-	//TODO change ManageLaserPower to work on the shaped segments instead
-	acceleration = params.unshaped.acceleration;
-	deceleration = params.unshaped.deceleration;
+#if SUPPORT_LINEAR_DELTA
 
-	if (simMode < SimulationMode::normal)
+// Prepare a delta tower for a move in which the head moves
+void DDA::PrepareDeltaTower(size_t drive, PrepParams& params, Platform& platform) noexcept
+{
+	platform.EnableDrivers(drive, false);
+	if (shapedSegments == nullptr)
 	{
-#if SUPPORT_LINEAR_DELTA
-		if (flags.isDeltaMovement)
+		EnsureUnshapedSegments(params);
+	}
+
+	const int32_t delta = endPoint[drive] - prev->endPoint[drive];
+	if (platform.GetDriversBitmap(drive) != 0						// if any of the drives is local
+#if SUPPORT_CAN_EXPANSION
+			|| flags.checkEndstops									// if checking endstops, create a DM even if there are no local drives involved
+#endif
+	   )
+	{
+		DriveMovement* const pdm = DriveMovement::Allocate(drive, DMState::idle);
+		pdm->direction = (delta >= 0);
+		pdm->totalSteps = labs(delta);								// this is net steps for now
+		if (pdm->PrepareDeltaAxis(*this, params))
 		{
-			// This code assumes that the previous move in the DDA ring is the previously-executed move, because it fetches the X and Y end coordinates from that move.
-			// Therefore the Move code must not store a new move in that entry until this one has been prepared! (It took me ages to track this down.)
-			// Ideally we would store the initial X and Y coordinates in the DDA, but we need to be economical with memory
-			params.a2plusb2 = fsquare(directionVector[X_AXIS]) + fsquare(directionVector[Y_AXIS]);
-			params.initialX = prev->GetEndCoordinate(X_AXIS, false);
-			params.initialY = prev->GetEndCoordinate(Y_AXIS, false);
-			params.dparams = static_cast<const LinearDeltaKinematics*>(&(reprap.GetMove().GetKinematics()));
+			pdm->directionChanged = false;
+			// Check for sensible values, print them if they look dubious
+			if (reprap.Debug(moduleDda) && pdm->totalSteps > 1000000)
+			{
+				DebugPrintAll("pr_err2");
+			}
+			InsertDM(pdm);
+		}
+		else
+		{
+			pdm->state = DMState::idle;
+			pdm->nextDM = completedDMs;
+			completedDMs = pdm;
+		}
+	}
+
 # if SUPPORT_CAN_EXPANSION
-			params.finalX = GetEndCoordinate(X_AXIS, false);
-			params.finalY = GetEndCoordinate(Y_AXIS, false);
-			params.zMovement = GetEndCoordinate(Z_AXIS, false) - prev->GetEndCoordinate(Z_AXIS, false);
-# endif
+	afterPrepare.drivesMoving.SetBit(drive);
+	const AxisDriversConfig& config = platform.GetAxisDriversConfig(drive);
+	for (size_t i = 0; i < config.numDrivers; ++i)
+	{
+		const DriverId driver = config.driverNumbers[i];
+		if (driver.IsRemote())
+		{
+			CanMotion::AddMovement(params, driver, delta, false);
 		}
-#endif
+	}
+# endif
+}
 
-		activeDMs = completedDMs = nullptr;
+#endif
 
+// Prepare an axis motor that has net movement in this move and moves in a straight line
+void DDA::PrepareAxisDrive(size_t drive, int32_t delta, PrepParams& params, Platform& platform) noexcept
+{
+	platform.EnableDrivers(drive, false);
+	if (shapedSegments == nullptr)
+	{
+		EnsureUnshapedSegments(params);
+	}
+	if (   platform.GetDriversBitmap(drive) != 0				// if any of the drives is local
 #if SUPPORT_CAN_EXPANSION
-		CanMotion::StartMovement();
+		|| flags.checkEndstops									// if checking endstops, create a DM even if there are no local drives involved
 #endif
+	   )
+	{
+		DriveMovement* const pdm = DriveMovement::Allocate(drive, DMState::idle);
+		pdm->direction = (delta >= 0);
+		pdm->totalSteps = labs(delta);
+		if (pdm->PrepareCartesianAxis(*this, params))
+		{
+			pdm->directionChanged = false;
+			// Check for sensible values, print them if they look dubious
+			if (reprap.Debug(moduleDda) && pdm->totalSteps > 1000000)
+			{
+				DebugPrintAll("pr_err3");
+			}
+			InsertDM(pdm);
+		}
+		else
+		{
+			pdm->state = DMState::idle;
+			pdm->nextDM = completedDMs;
+			completedDMs = pdm;
+		}
+	}
 
-		// Handle all drivers
-		Platform& platform = reprap.GetPlatform();
-		if (flags.isLeadscrewAdjustmentMove)
+#if SUPPORT_CAN_EXPANSION
+	afterPrepare.drivesMoving.SetBit(drive);
+	const AxisDriversConfig& config = platform.GetAxisDriversConfig(drive);
+	for (size_t i = 0; i < config.numDrivers; ++i)
+	{
+		const DriverId driver = config.driverNumbers[i];
+		if (driver.IsRemote())
 		{
-			platform.EnableDrivers(Z_AXIS, false);			// ensure all Z motors are enabled
+			CanMotion::AddMovement(params, driver, delta, false);
 		}
+	}
+#endif
+}
+
+// Prepare an extruder drive that moves in this move
+void DDA::PrepareExtruderDrive(size_t drive, PrepParams& params, Platform& platform) noexcept
+{
+	// Currently, we don't apply input shaping to extruders
+	platform.EnableDrivers(drive, false);
+	const size_t extruder = LogicalDriveToExtruder(drive);
+#if SUPPORT_NONLINEAR_EXTRUSION
+	// Add the nonlinear extrusion correction to totalExtrusion.
+	// If we are given a stupidly short move to execute then clocksNeeded can be zero, which leads to NaNs in this code; so we need to guard against that.
+	if (flags.isPrintingMove && clocksNeeded != 0)
+	{
+		const NonlinearExtrusion& nl = platform.GetExtrusionCoefficients(extruder);
+		float& dv = directionVector[drive];
+		const float averageExtrusionSpeed = (totalDistance * dv * StepClockRate)/clocksNeeded;			// need speed in mm/sec for nonlinear extrusion calculation
+		const float factor = 1.0 + min<float>((averageExtrusionSpeed * nl.A) + (averageExtrusionSpeed * averageExtrusionSpeed * nl.B), nl.limit);
+		dv *= factor;
+	}
+#endif
 
-		AxesBitmap additionalAxisMotorsToEnable, axisMotorsEnabled;
 #if SUPPORT_CAN_EXPANSION
-		afterPrepare.drivesMoving.Clear();
+	afterPrepare.drivesMoving.SetBit(drive);
+	const DriverId driver = platform.GetExtruderDriver(extruder);
+	if (driver.IsRemote())
+	{
+		// This calculation isn't quite right when we use PA and fractional steps accumulate. I will fix it when I change the CAN protocol.
+		// The MovementLinear message requires the raw step count not adjusted for PA to be passed. The remote board adds the PA.
+		ExtruderShaper& shaper = reprap.GetMove().GetExtruderShaper(LogicalDriveToExtruder(drive));
+		float netMovement = (totalDistance * directionVector[drive]) + shaper.GetExtrusionPending();
+		const float stepsPerMm = platform.DriveStepsPerUnit(drive);
+		const int32_t rawSteps = lrintf(netMovement * stepsPerMm);					// we round here instead of truncating to match the old code
+		if (flags.usePressureAdvance)
+		{
+			netMovement += (endSpeed - startSpeed) * directionVector[drive] * shaper.GetKclocks();
+		}
+		if (rawSteps != 0)
+		{
+			CanMotion::AddMovement(params, driver, rawSteps, flags.usePressureAdvance);
+			const int32_t netSteps = (flags.usePressureAdvance)
+										? lrintf(netMovement * stepsPerMm)			// work out how many steps the remote extruder will take
+											: rawSteps;
+			netMovement -= (float)netSteps/stepsPerMm;
+		}
+		shaper.SetExtrusionPending(netMovement);
+	}
+	else
 #endif
-		for (size_t drive = 0; drive < MaxAxesPlusExtruders; ++drive)
+	{
+		ShareUnshapedSegments(params);
+		DriveMovement* const pdm = DriveMovement::Allocate(drive, DMState::idle);
+		pdm->direction = (directionVector[drive] >= 0);
+		if (pdm->PrepareExtruder(*this, params))
 		{
-			if (flags.isLeadscrewAdjustmentMove)
+			pdm->directionChanged = false;
+			if (reprap.Debug(moduleDda) && pdm->totalSteps > 1000000)
 			{
-#if SUPPORT_CAN_EXPANSION
-				afterPrepare.drivesMoving.SetBit(Z_AXIS);
-#endif
-				// For a leadscrew adjustment move, the first N elements of the direction vector are the adjustments to the N Z motors
-				const AxisDriversConfig& config = platform.GetAxisDriversConfig(Z_AXIS);
-				if (drive < config.numDrivers)
-				{
-					const int32_t delta = lrintf(directionVector[drive] * totalDistance * platform.DriveStepsPerUnit(Z_AXIS));
-					const DriverId driver = config.driverNumbers[drive];
-					if (delta != 0)
-					{
-#if SUPPORT_CAN_EXPANSION
-						if (driver.IsRemote())
-						{
-							CanMotion::AddMovement(params, driver, delta, false);
-						}
-						else
-#endif
-						{
-							EnsureUnshapedSegments(params);
-							DriveMovement* const pdm = DriveMovement::Allocate(driver.localDriver + MaxAxesPlusExtruders, DMState::idle);
-							pdm->direction = (delta >= 0);
-							pdm->totalSteps = labs(delta);
-							if (pdm->PrepareCartesianAxis(*this, params))
-							{
-								pdm->directionChanged = false;
-								// Check for sensible values, print them if they look dubious
-								if (reprap.Debug(moduleDda) && pdm->totalSteps > 1000000)
-								{
-									DebugPrintAll("pr_err1");
-								}
-								InsertDM(pdm);
-							}
-							else
-							{
-								pdm->state = DMState::idle;
-								pdm->nextDM = completedDMs;
-								completedDMs = pdm;
-							}
-						}
-					}
-				}
+				DebugPrintAll("pr_err4");
 			}
+			InsertDM(pdm);
+		}
+		else
+		{
+			pdm->state = DMState::idle;
+			pdm->nextDM = completedDMs;
+			completedDMs = pdm;
+		}
+	}
+}
+
+// Prepare the drives of a move that doesn't need special handling.
+// The template parameter lets the compiler leave out the tests and kinematics calls that don't apply to the kinematics, so there is no per-drive type dispatch.
+template<DDA::PrepareKind Kind> void DDA::PrepareDrives(PrepParams& params, Platform& platform) noexcept
+{
+	const size_t numTotalAxes = reprap.GetGCodes().GetTotalAxes();
+	if constexpr (Kind != PrepareKind::extrudersOnly)
+	{
+		AxesBitmap additionalAxisMotorsToEnable, axisMotorsEnabled;
+		size_t firstLinearAxis = 0;
 #if SUPPORT_LINEAR_DELTA
-			else if (flags.isDeltaMovement && reprap.GetMove().GetKinematics().GetMotionType(drive) == MotionType::segmentFreeDelta)
+		if constexpr (Kind == PrepareKind::linearDelta)
+		{
+			if (flags.isDeltaMovement)
 			{
 				// On a delta we need to move all towers even if some of them have no net movement
-				platform.EnableDrivers(drive, false);
-				if (shapedSegments == nullptr)
+				firstLinearAxis = params.dparams->GetNumTowers();
+				for (size_t drive = 0; drive < firstLinearAxis; ++drive)
 				{
-					EnsureUnshapedSegments(params);
+					PrepareDeltaTower(drive, params, platform);
 				}
-
-				const int32_t delta = endPoint[drive] - prev->endPoint[drive];
-				if (platform.GetDriversBitmap(drive) != 0						// if any of the drives is local
-#if SUPPORT_CAN_EXPANSION
-						|| flags.checkEndstops									// if checking endstops, create a DM even if there are no local drives involved
+			}
+		}
 #endif
-				   )
-				{
-					DriveMovement* const pdm = DriveMovement::Allocate(drive, DMState::idle);
-					pdm->direction = (delta >= 0);
-					pdm->totalSteps = labs(delta);								// this is net steps for now
-					if (pdm->PrepareDeltaAxis(*this, params))
-					{
-						pdm->directionChanged = false;
-						// Check for sensible values, print them if they look dubious
-						if (reprap.Debug(moduleDda) && pdm->totalSteps > 1000000)
-						{
-							DebugPrintAll("pr_err2");
-						}
-						InsertDM(pdm);
-					}
-					else
-					{
-						pdm->state = DMState::idle;
-						pdm->nextDM = completedDMs;
-						completedDMs = pdm;
-					}
-				}
 
-# if SUPPORT_CAN_EXPANSION
-				afterPrepare.drivesMoving.SetBit(drive);
-				const AxisDriversConfig& config = platform.GetAxisDriversConfig(drive);
-				for (size_t i = 0; i < config.numDrivers; ++i)
+		for (size_t drive = firstLinearAxis; drive < numTotalAxes; ++drive)
+		{
+			const int32_t delta = endPoint[drive] - prev->endPoint[drive];
+			if (delta != 0)
+			{
+				PrepareAxisDrive(drive, delta, params, platform);
+				if constexpr (Kind == PrepareKind::connectedAxes)
 				{
-					const DriverId driver = config.driverNumbers[i];
-					if (driver.IsRemote())
-					{
-						CanMotion::AddMovement(params, driver, delta, false);
-					}
+					axisMotorsEnabled.SetBit(drive);
+					additionalAxisMotorsToEnable |= reprap.GetMove().GetKinematics().GetConnectedAxes(drive);
 				}
-# endif
-				axisMotorsEnabled.SetBit(drive);
 			}
+		}
+
+		if constexpr (Kind == PrepareKind::connectedAxes)
+		{
+			EnableConnectedAxisMotors(additionalAxisMotorsToEnable, axisMotorsEnabled, platform);
+		}
+	}
+
+	for (size_t drive = numTotalAxes; drive < MaxAxesPlusExtruders; ++drive)
+	{
+		if (directionVector[drive] != 0.0)
+		{
+			PrepareExtruderDrive(drive, params, platform);
+		}
+	}
+}
+
+// Prepare the drives of any move. This handles leadscrew adjustment moves, arc moves and moves that follow the height map,
+// and moves on kinematics that have nonlinear motors or continuous rotation axes.
+template<> void DDA::PrepareDrives<DDA::PrepareKind::generic>(PrepParams& params, Platform& platform) noexcept
+{
+	if (flags.isLeadscrewAdjustmentMove)
+	{
+		platform.EnableDrivers(Z_AXIS, false);			// ensure all Z motors are enabled
+	}
+
+	AxesBitmap additionalAxisMotorsToEnable, axisMotorsEnabled;
+#if SUPPORT_NATIVE_ARCS
+	float arcCoefficient0, arcCoefficient1;
+#endif
+	for (size_t drive = 0; drive < MaxAxesPlusExtruders; ++drive)
+	{
+		if (flags.isLeadscrewAdjustmentMove)
+		{
+#if SUPPORT_CAN_EXPANSION
+			afterPrepare.drivesMoving.SetBit(Z_AXIS);
 #endif
-			else if (drive < reprap.GetGCodes().GetTotalAxes())
+			// For a leadscrew adjustment move, the first N elements of the direction vector are the adjustments to the N Z motors
+			const AxisDriversConfig& config = platform.GetAxisDriversConfig(Z_AXIS);
+			if (drive < config.numDrivers)
 			{
-				// It's a linear axis
-				int32_t delta = endPoint[drive] - prev->endPoint[drive];
+				const int32_t delta = lrintf(directionVector[drive] * totalDistance * platform.DriveStepsPerUnit(Z_AXIS));
+				const DriverId driver = config.driverNumbers[drive];
 				if (delta != 0)
 				{
-					platform.EnableDrivers(drive, false);
-					if (shapedSegments == nullptr)
-					{
-						EnsureUnshapedSegments(params);
-					}
-					if (flags.continuousRotationShortcut && reprap.GetMove().GetKinematics().IsContinuousRotationAxis(drive))
+#if SUPPORT_CAN_EXPANSION
+					if (driver.IsRemote())
 					{
-						// This is a continuous rotation axis, so we may have adjusted the move to cross the 180 degrees position
-						const int32_t stepsPerRotation = lrintf(360.0 * platform.DriveStepsPerUnit(drive));
-						if (delta > stepsPerRotation/2)
-						{
-							delta -= stepsPerRotation;
-						}
-						else if (delta < -stepsPerRotation/2)
-						{
-							delta += stepsPerRotation;
-						}
+						CanMotion::AddMovement(params, driver, delta, false);
 					}
-
-					if (   platform.GetDriversBitmap(drive) != 0				// if any of the drives is local
-#if SUPPORT_CAN_EXPANSION
-						|| flags.checkEndstops									// if checking endstops, create a DM even if there are no local drives involved
+					else
 #endif
-					   )
 					{
-						DriveMovement* const pdm = DriveMovement::Allocate(drive, DMState::idle);
+						EnsureUnshapedSegments(params);
+						DriveMovement* const pdm = DriveMovement::Allocate(driver.localDriver + MaxAxesPlusExtruders, DMState::idle);
 						pdm->direction = (delta >= 0);
 						pdm->totalSteps = labs(delta);
 						if (pdm->PrepareCartesianAxis(*this, params))
@@ -1511,7 +1968,7 @@ void DDA::Prepare(SimulationMode simMode) noexcept
 							// Check for sensible values, print them if they look dubious
 							if (reprap.Debug(moduleDda) && pdm->totalSteps > 1000000)
 							{
-								DebugPrintAll("pr_err3");
+								DebugPrintAll("pr_err1");
 							}
 							InsertDM(pdm);
 						}
@@ -1522,103 +1979,228 @@ void DDA::Prepare(SimulationMode simMode) noexcept
 							completedDMs = pdm;
 						}
 					}
-
-#if SUPPORT_CAN_EXPANSION
-					afterPrepare.drivesMoving.SetBit(drive);
-					const AxisDriversConfig& config = platform.GetAxisDriversConfig(drive);
-					for (size_t i = 0; i < config.numDrivers; ++i)
-					{
-						const DriverId driver = config.driverNumbers[i];
-						if (driver.IsRemote())
-						{
-							CanMotion::AddMovement(params, driver, delta, false);
-						}
-					}
+				}
+			}
+		}
+#if SUPPORT_LINEAR_DELTA
+		else if (flags.isDeltaMovement && reprap.GetMove().GetKinematics().GetMotionType(drive) == MotionType::segmentFreeDelta)
+		{
+			PrepareDeltaTower(drive, params, platform);
+			axisMotorsEnabled.SetBit(drive);
+		}
 #endif
-					axisMotorsEnabled.SetBit(drive);
-					additionalAxisMotorsToEnable |= reprap.GetMove().GetKinematics().GetConnectedAxes(drive);
+#if SUPPORT_NATIVE_ARCS
+		else if (   flags.isArcMove && drive < reprap.GetGCodes().GetTotalAxes()
+				 && reprap.GetMove().GetKinematics().GetArcMotorCoefficients(drive, arc.axis0, arc.axis1, arcCoefficient0, arcCoefficient1)
+				)
+		{
+			// This motor follows the arc, so it may reverse during the move. As with a delta tower, we need a DM even if there is no net movement.
+			// We only do arc moves when all the drivers for these motors are local.
+			platform.EnableDrivers(drive, false);
+			if (shapedSegments == nullptr)
+			{
+				EnsureUnshapedSegments(params);
+			}
+
+			const int32_t delta = endPoint[drive] - prev->endPoint[drive];
+			DriveMovement* const pdm = DriveMovement::Allocate(drive, DMState::idle);
+			pdm->direction = (delta >= 0);
+			pdm->totalSteps = labs(delta);									// this is net steps for now
+			if (pdm->PrepareArcAxis(*this, params, arcCoefficient0, arcCoefficient1))
+			{
+				pdm->directionChanged = false;
+				// Check for sensible values, print them if they look dubious
+				if (reprap.Debug(moduleDda) && pdm->totalSteps > 1000000)
+				{
+					DebugPrintAll("pr_err5");
 				}
+				InsertDM(pdm);
 			}
 			else
 			{
-				// It's an extruder drive
-				if (directionVector[drive] != 0.0)
-				{
-					// Currently, we don't apply input shaping to extruders
-					platform.EnableDrivers(drive, false);
-					const size_t extruder = LogicalDriveToExtruder(drive);
-#if SUPPORT_NONLINEAR_EXTRUSION
-					// Add the nonlinear extrusion correction to totalExtrusion.
-					// If we are given a stupidly short move to execute then clocksNeeded can be zero, which leads to NaNs in this code; so we need to guard against that.
-					if (flags.isPrintingMove && clocksNeeded != 0)
-					{
-						const NonlinearExtrusion& nl = platform.GetExtrusionCoefficients(extruder);
-						float& dv = directionVector[drive];
-						const float averageExtrusionSpeed = (totalDistance * dv * StepClockRate)/clocksNeeded;			// need speed in mm/sec for nonlinear extrusion calculation
-						const float factor = 1.0 + min<float>((averageExtrusionSpeed * nl.A) + (averageExtrusionSpeed * averageExtrusionSpeed * nl.B), nl.limit);
-						dv *= factor;
-					}
+				pdm->state = DMState::idle;
+				pdm->nextDM = completedDMs;
+				completedDMs = pdm;
+			}
+
+# if SUPPORT_CAN_EXPANSION
+			afterPrepare.drivesMoving.SetBit(drive);
+# endif
+			axisMotorsEnabled.SetBit(drive);
+			additionalAxisMotorsToEnable |= reprap.GetMove().GetKinematics().GetConnectedAxes(drive);
+		}
 #endif
+#if SUPPORT_MESH_Z_PROFILE
+		else if (drive == Z_AXIS && flags.followsMesh && BuildMeshZProfile())
+		{
+			// The Z motor follows the height map, so it may reverse during the move. We need a DM even if there is no net movement.
+			// We only follow the height map when all the Z drivers are local.
+			platform.EnableDrivers(drive, false);
+			if (shapedSegments == nullptr)
+			{
+				EnsureUnshapedSegments(params);
+			}
 
-#if SUPPORT_CAN_EXPANSION
-					afterPrepare.drivesMoving.SetBit(drive);
-					const DriverId driver = platform.GetExtruderDriver(extruder);
-					if (driver.IsRemote())
+			const int32_t delta = endPoint[drive] - prev->endPoint[drive];
+			DriveMovement* const pdm = DriveMovement::Allocate(drive, DMState::idle);
+			pdm->direction = (delta >= 0);
+			pdm->totalSteps = labs(delta);									// this is net steps for now
+			if (pdm->PrepareMeshZAxis(*this, params))
+			{
+				pdm->directionChanged = false;
+				// Check for sensible values, print them if they look dubious
+				if (reprap.Debug(moduleDda) && pdm->totalSteps > 1000000)
+				{
+					DebugPrintAll("pr_err6");
+				}
+				InsertDM(pdm);
+			}
+			else
+			{
+				pdm->state = DMState::idle;
+				pdm->nextDM = completedDMs;
+				completedDMs = pdm;
+			}
+
+# if SUPPORT_CAN_EXPANSION
+			afterPrepare.drivesMoving.SetBit(drive);
+# endif
+			axisMotorsEnabled.SetBit(drive);
+		}
+#endif
+		else if (drive < reprap.GetGCodes().GetTotalAxes())
+		{
+			// It's a linear axis
+			int32_t delta = endPoint[drive] - prev->endPoint[drive];
+			if (delta != 0)
+			{
+				if (flags.continuousRotationShortcut && reprap.GetMove().GetKinematics().IsContinuousRotationAxis(drive))
+				{
+					// This is a continuous rotation axis, so we may have adjusted the move to cross the 180 degrees position
+					const int32_t stepsPerRotation = lrintf(360.0 * platform.DriveStepsPerUnit(drive));
+					if (delta > stepsPerRotation/2)
 					{
-						// This calculation isn't quite right when we use PA and fractional steps accumulate. I will fix it when I change the CAN protocol.
-						// The MovementLinear message requires the raw step count not adjusted for PA to be passed. The remote board adds the PA.
-						ExtruderShaper& shaper = reprap.GetMove().GetExtruderShaper(LogicalDriveToExtruder(drive));
-						float netMovement = (totalDistance * directionVector[drive]) + shaper.GetExtrusionPending();
-						const float stepsPerMm = platform.DriveStepsPerUnit(drive);
-						const int32_t rawSteps = lrintf(netMovement * stepsPerMm);					// we round here instead of truncating to match the old code
-						if (flags.usePressureAdvance)
-						{
-							netMovement += (endSpeed - startSpeed) * directionVector[drive] * shaper.GetKclocks();
-						}
-						if (rawSteps != 0)
-						{
-							CanMotion::AddMovement(params, driver, rawSteps, flags.usePressureAdvance);
-							const int32_t netSteps = (flags.usePressureAdvance)
-														? lrintf(netMovement * stepsPerMm)			// work out how many steps the remote extruder will take
-															: rawSteps;
-							netMovement -= (float)netSteps/stepsPerMm;
-						}
-						shaper.SetExtrusionPending(netMovement);
+						delta -= stepsPerRotation;
 					}
-					else
-#endif
+					else if (delta < -stepsPerRotation/2)
 					{
-						EnsureUnshapedSegments(params);
-						DriveMovement* const pdm = DriveMovement::Allocate(drive, DMState::idle);
-						pdm->direction = (directionVector[drive] >= 0);
-						if (pdm->PrepareExtruder(*this, params))
-						{
-							pdm->directionChanged = false;
-							if (reprap.Debug(moduleDda) && pdm->totalSteps > 1000000)
-							{
-								DebugPrintAll("pr_err4");
-							}
-							InsertDM(pdm);
-						}
-						else
-						{
-							pdm->state = DMState::idle;
-							pdm->nextDM = completedDMs;
-							completedDMs = pdm;
-						}
+						delta += stepsPerRotation;
 					}
 				}
+				PrepareAxisDrive(drive, delta, params, platform);
+				axisMotorsEnabled.SetBit(drive);
+				additionalAxisMotorsToEnable |= reprap.GetMove().GetKinematics().GetConnectedAxes(drive);
+			}
+		}
+		else
+		{
+			// It's an extruder drive
+			if (directionVector[drive] != 0.0)
+			{
+				PrepareExtruderDrive(drive, params, platform);
 			}
 		}
+	}
+
+	EnableConnectedAxisMotors(additionalAxisMotorsToEnable, axisMotorsEnabled, platform);
+}
 
-		// On CoreXY and similar architectures, we also need to enable the motors controlling any connected axes
-		additionalAxisMotorsToEnable &= ~axisMotorsEnabled;
-		while (additionalAxisMotorsToEnable.IsNonEmpty())
+// Select the function that prepares the drives of moves that don't need special handling, to suit the kinematics.
+// Move calls this whenever the kinematics or their configuration change.
+/*static*/ DDA::PrepareDrivesFunction DDA::SelectPrepareDrivesFunction(const Kinematics& kin) noexcept
+{
+#if SUPPORT_LINEAR_DELTA
+	if (kin.GetKinematicsType() == KinematicsType::linearDelta)
+	{
+		return &DDA::PrepareDrives<PrepareKind::linearDelta>;
+	}
+#endif
+
+	bool anyConnectedAxes = false;
+	for (size_t axis = 0; axis < MaxAxes; ++axis)
+	{
+		if (kin.GetMotionType(axis) != MotionType::linear || kin.IsContinuousRotationAxis(axis))
 		{
-			const size_t drive = additionalAxisMotorsToEnable.LowestSetBit();
-			additionalAxisMotorsToEnable.ClearBit(drive);
-			platform.EnableDrivers(drive, false);
+			return &DDA::PrepareDrives<PrepareKind::generic>;
 		}
+		if (kin.GetConnectedAxes(axis) != AxesBitmap::MakeFromBits(axis))
+		{
+			anyConnectedAxes = true;
+		}
+	}
+	return (anyConnectedAxes) ? &DDA::PrepareDrives<PrepareKind::connectedAxes> : &DDA::PrepareDrives<PrepareKind::independentAxes>;
+}
+
+// Prepare this DDA for execution.
+// This must not be called with interrupts disabled, because it calls Platform::EnableDrive.
+void DDA::Prepare(SimulationMode simMode) noexcept
+{
+	flags.wasAccelOnlyMove = IsAccelerationMove();			// save this for the next move to look at
+
+#if SUPPORT_LASER
+	if (topSpeed < requestedSpeed && reprap.GetGCodes().GetMachineType() == MachineType::laser)
+	{
+		// Scale back the laser power according to the actual speed
+		laserPwmOrIoBits.laserPwm = (laserPwmOrIoBits.laserPwm * topSpeed)/requestedSpeed;
+	}
+#endif
+
+	// Prepare for movement
+	shapedSegments = unshapedSegments = nullptr;
+
+	PrepParams params;										// the default constructor clears params.plan to 'no shaping'
+	if (flags.xyMoving)
+	{
+		reprap.GetMove().GetAxisShaper().PlanShaping(*this, params, flags.xyMoving);	// this will set up shapedSegments if we are doing any shaping
+	}
+	else
+	{
+		params.SetFromDDA(*this);
+		params.unshaped.Finalise(topSpeed);
+		clocksNeeded = params.unshaped.TotalClocks();
+	}
+
+	// Copy the unshaped acceleration and deceleration back to the DDA because ManageLaserPower uses them
+	//TODO change ManageLaserPower to work on the shaped segments instead
+	acceleration = params.unshaped.acceleration;
+	deceleration = params.unshaped.deceleration;
+
+	if (simMode < SimulationMode::normal)
+	{
+#if SUPPORT_LINEAR_DELTA
+		if (flags.isDeltaMovement)
+		{
+			// This code assumes that the previous move in the DDA ring is the previously-executed move, because it fetches the X and Y end coordinates from that move.
+			// Therefore the Move code must not store a new move in that entry until this one has been prepared! (It took me ages to track this down.)
+			// Ideally we would store the initial X and Y coordinates in the DDA, but we need to be economical with memory
+			params.a2plusb2 = fsquare(directionVector[X_AXIS]) + fsquare(directionVector[Y_AXIS]);
+			params.initialX = prev->GetEndCoordinate(X_AXIS, false);
+			params.initialY = prev->GetEndCoordinate(Y_AXIS, false);
+			params.dparams = static_cast<const LinearDeltaKinematics*>(&(reprap.GetMove().GetKinematics()));
+# if SUPPORT_CAN_EXPANSION
+			params.finalX = GetEndCoordinate(X_AXIS, false);
+			params.finalY = GetEndCoordinate(Y_AXIS, false);
+			params.zMovement = GetEndCoordinate(Z_AXIS, false) - prev->GetEndCoordinate(Z_AXIS, false);
+# endif
+		}
+#endif
+
+		activeDMs = completedDMs = nullptr;
+
+#if SUPPORT_CAN_EXPANSION
+		CanMotion::StartMovement();
+#endif
+
+		// Handle all drivers. Moves that need special handling use the generic code. Other moves use the code that Move selected to suit the kinematics,
+		// so that we don't need to ask the kinematics how to handle each drive.
+		Platform& platform = reprap.GetPlatform();
+#if SUPPORT_CAN_EXPANSION
+		afterPrepare.drivesMoving.Clear();
+#endif
+		const PrepareDrivesFunction prepareDrives = (NeedsGenericPrepare()) ? &DDA::PrepareDrives<PrepareKind::generic>
+													: (!AxisMotorsMoving()) ? &DDA::PrepareDrives<PrepareKind::extrudersOnly>
+														: reprap.GetMove().GetPrepareDrivesFunction();
+		(this->*prepareDrives)(params, platform);
 
 		const DDAState st = prev->state;
 		afterPrepare.moveStartTime = (st == DDAState::executing || st == DDAState::frozen)
@@ -1660,11 +2242,38 @@ void DDA::Prepare(SimulationMode simMode) noexcept
 		m.endSpeed = endSpeed;
 		m.targetNextSpeed = targetNextSpeed;
 		m.endstopChecks = endStopsToCheck;
-		m.flags = flags;
+		m.flags = flags.all;
 		savedMovePointer = (savedMovePointer + 1) % NumSavedMoves;
 #endif
 	}
 
+	if (simMode == SimulationMode::off && state != completed)
+	{
+		MoveTiming& timing = reprap.GetMove().GetTiming();
+		timing.ddaDuration.Add(clocksNeeded);
+		unsigned int numSegments = 0;
+		for (const MoveSegment *seg = shapedSegments; seg != nullptr; seg = seg->GetNext())
+		{
+			++numSegments;
+		}
+		for (const MoveSegment *seg = unshapedSegments; seg != nullptr; seg = seg->GetNext())
+		{
+			++numSegments;
+		}
+		timing.segmentsPerMove.Add(numSegments);
+	}
+
+#if SUPPORT_MOVE_RECORDER
+	if (simMode == SimulationMode::off && state != completed && MoveRecorder::IsRecording())
+	{
+		const MoveRecorder::PreparedMoveParameters recParams =
+		{
+			requestedSpeed, startSpeed, topSpeed, endSpeed, acceleration, deceleration, totalDistance, clocksNeeded, filePos, flags.all
+		};
+		MoveRecorder::RecordPreparedMove(recParams, shapedSegments, unshapedSegments);
+	}
+#endif
+
 	if (state != completed)
 	{
 		state = frozen;					// must do this last so that the ISR doesn't start executing it before we have finished setting it up
@@ -2108,14 +2717,23 @@ void DDA::StepDrivers(Platform& p, uint32_t now) noexcept
 #endif
 
 	// Remove those drives from the list, update the direction pins where necessary, and re-insert them so as to keep the list in step-time order.
+	// When several drivers step together, sort them into a separate chain first and then merge that chain into the remaining list in a single pass,
+	// so that the cost of re-inserting them doesn't depend on the product of the number of drivers stepped and the number of active drivers.
 	DriveMovement *dmToInsert = activeDMs;							// head of the chain we need to re-insert
 	activeDMs = dm;													// remove the chain from the list
+	DriveMovement *sortedDMs = nullptr;								// the drivers to re-insert, in step-time order
 	while (dmToInsert != dm)										// note that both of these may be nullptr
 	{
 		DriveMovement * const nextToInsert = dmToInsert->nextDM;
 		if (dmToInsert->state >= DMState::firstMotionState)
 		{
-			InsertDM(dmToInsert);
+			DriveMovement **dmp = &sortedDMs;
+			while (*dmp != nullptr && (*dmp)->nextStepTime < dmToInsert->nextStepTime)
+			{
+				dmp = &((*dmp)->nextDM);
+			}
+			dmToInsert->nextDM = *dmp;
+			*dmp = dmToInsert;
 			if (dmToInsert->directionChanged)
 			{
 				dmToInsert->directionChanged = false;
@@ -2129,6 +2747,10 @@ void DDA::StepDrivers(Platform& p, uint32_t now) noexcept
 		}
 		dmToInsert = nextToInsert;
 	}
+	if (sortedDMs != nullptr)
+	{
+		MergeDMs(sortedDMs);
+	}
 
 	// If there are no more steps to do and the time for the move has nearly expired, flag the move as complete
 	if (activeDMs == nullptr)
@@ -2325,6 +2947,30 @@ void DDA::LimitSpeedAndAcceleration(float maxSpeed, float maxAcceleration) noexc
 	}
 }
 
+#if SUPPORT_NATIVE_ARCS
+
+// Limit the speed and acceleration of an arc move.
+// Each motor that moves the arc axes moves sinusoidally, so its peak speed and acceleration are the speed and acceleration along the arc
+// multiplied by the proportion of the move that is along the arc and the magnitude of the motor coefficients.
+// We also limit the speed so that the centripetal acceleration does not exceed the acceleration limit.
+void DDA::LimitArcSpeedAndAcceleration(const Kinematics& k, float planarFraction) noexcept
+{
+	const Platform& platform = reprap.GetPlatform();
+	const size_t numTotalAxes = reprap.GetGCodes().GetTotalAxes();
+	for (size_t motor = 0; motor < numTotalAxes; ++motor)
+	{
+		float k0, k1;
+		if (k.GetArcMotorCoefficients(motor, arc.axis0, arc.axis1, k0, k1))
+		{
+			const float amplitude = planarFraction * fastSqrtf(fsquare(k0) + fsquare(k1));
+			LimitSpeedAndAcceleration(platform.MaxFeedrate(motor)/amplitude, platform.Acceleration(motor)/amplitude);
+		}
+	}
+	LimitSpeedAndAcceleration(fastSqrtf(acceleration * arc.radius)/planarFraction, acceleration);
+}
+
+#endif
+
 // Update the movement accumulators to account for the move that has just finished.
 // Only drives that correspond to extruders need to be updated, but it doesn't matter if we update them all.
 // This is called with interrupts disabled.
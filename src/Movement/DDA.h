@@ -13,6 +13,7 @@
 #include "StepTimer.h"
 #include "MoveSegment.h"
 #include "InputShaperPlan.h"
+#include "MeshZProfile.h"
 #include <Platform/Tasks.h>
 #include <GCodes/GCodes.h>			// for class RawMove
 
@@ -22,6 +23,9 @@
 # define DDA_LOG_PROBE_CHANGES	0	// save memory on the wired Duet
 #endif
 
+// Set this nonzero in a debug build to check the results of DoLookahead against the junction deviation planner
+#define LOOKAHEAD_SELF_CHECK	0
+
 class DDARing;
 
 // Struct for passing parameters to the DriveMovement Prepare methods, also accessed by the input shaper
@@ -71,8 +75,14 @@ class DDA
 {
 	friend class DriveMovement;
 	friend class AxisShaper;
+#if SUPPORT_SHAPER_PLAN_CACHE
+	friend class ShaperPlanCache;
+#endif
 	friend class ExtruderShaper;
 	friend class PrepParams;
+#if SUPPORT_MESH_Z_PROFILE
+	friend class MeshZProfile;
+#endif
 
 public:
 
@@ -80,11 +90,24 @@ public:
 	{
 		empty,				// empty or being filled in
 		provisional,		// ready, but could be subject to modifications
+		preparing,			// handed over to the background prepare task, no further modifications allowed by the Move task
 		frozen,				// ready, no further modifications allowed
 		executing,			// steps are currently being generated for this DDA
 		completed			// move has been completed or aborted
 	};
 
+	// The ways in which Prepare can handle the drives of a move. Move selects the one that suits the kinematics when they change.
+	enum class PrepareKind : uint8_t
+	{
+		generic,			// any kinematics and any move
+		independentAxes,	// each axis has its own motors that move linearly, e.g. Cartesian
+		connectedAxes,		// motors move linearly but some are shared between axes, e.g. CoreXY
+		linearDelta,		// linear delta towers followed by independent axes
+		extrudersOnly		// a move in which no axis motors have net movement
+	};
+
+	typedef void (DDA::*PrepareDrivesFunction)(PrepParams& params, Platform& platform) noexcept;
+
 	DDA(DDA* n) noexcept;
 
 	void* operator new(size_t count) { return Tasks::AllocPermanent(count); }
@@ -92,7 +115,7 @@ public:
 	void operator delete(void* ptr) noexcept {}
 	void operator delete(void* ptr, std::align_val_t align) noexcept {}
 
-	bool InitStandardMove(DDARing& ring, const RawMove &nextMove, bool doMotorMapping) noexcept SPEED_CRITICAL;	// Set up a new move, returning true if it represents real movement
+	bool InitStandardMove(DDARing& ring, const RawMove &nextMove, bool doMotorMapping, const int32_t *motorSteps) noexcept SPEED_CRITICAL;	// Set up a new move, returning true if it represents real movement
 	bool InitLeadscrewMove(DDARing& ring, float feedrate, const float amounts[MaxDriversPerAxis]) noexcept;		// Set up a leadscrew motor move
 #if SUPPORT_ASYNC_MOVES
 	bool InitAsyncMove(DDARing& ring, const AsyncMove& nextMove) noexcept;			// Set up an async move
@@ -106,15 +129,28 @@ public:
 	void SetNext(DDA *n) noexcept { next = n; }
 	void SetPrevious(DDA *p) noexcept { prev = p; }
 	void Complete() noexcept { state = completed; }
+	void SetPreparing() noexcept pre(state == provisional) { state = preparing; }
 	bool Free() noexcept;
 	void Prepare(SimulationMode simMode) noexcept SPEED_CRITICAL;					// Calculate all the values and freeze this DDA
+	static PrepareDrivesFunction SelectPrepareDrivesFunction(const Kinematics& kin) noexcept;	// Select how Prepare handles the drives of ordinary moves
 	bool HasStepError() const noexcept;
 	bool CanPauseAfter() const noexcept;
 	bool IsPrintingMove() const noexcept { return flags.isPrintingMove; }			// Return true if this involves both XY movement and extrusion
 	bool UsingStandardFeedrate() const noexcept { return flags.usingStandardFeedrate; }
 	bool IsCheckingEndstops() const noexcept { return flags.checkEndstops; }
+#if SUPPORT_NATIVE_ARCS
+	bool IsArcMove() const noexcept { return flags.isArcMove; }
+#else
+	bool IsArcMove() const noexcept { return false; }
+#endif
+#if SUPPORT_MESH_Z_PROFILE
+	bool FollowsMesh() const noexcept { return flags.followsMesh; }
+#else
+	bool FollowsMesh() const noexcept { return false; }
+#endif
 
 	DDAState GetState() const noexcept { return state; }
+	bool IsUnprepared() const noexcept { return state == provisional || state == preparing; }	// Return true if this move has been set up but has not yet been prepared
 	DDA* GetNext() const noexcept { return next; }
 	DDA* GetPrevious() const noexcept { return prev; }
 	int32_t GetTimeLeft() const noexcept;
@@ -141,6 +177,7 @@ public:
 	bool FetchEndPosition(volatile int32_t ep[MaxAxesPlusExtruders], volatile float endCoords[MaxAxesPlusExtruders]) noexcept;
 	void SetPositions(const float move[]) noexcept;									// Force the endpoints to be these
 	FilePosition GetFilePosition() const noexcept { return filePos; }
+	float GetProportionDoneAtEnd() const noexcept { return proportionDone; }		// Get the proportion of the complete multi-segment move that has been done when this segment is complete
 	float GetRequestedSpeedMmPerClock() const noexcept { return requestedSpeed; }
 	float GetRequestedSpeedMmPerSec() const noexcept { return InverseConvertSpeedToMmPerSec(requestedSpeed); }
 	float GetTopSpeedMmPerSec() const noexcept { return InverseConvertSpeedToMmPerSec(topSpeed); }
@@ -247,11 +284,28 @@ private:
 	void MatchSpeeds() noexcept SPEED_CRITICAL;
 	void StopDrive(size_t drive) noexcept;									// stop movement of a drive and recalculate the endpoint
 	void InsertDM(DriveMovement *dm) noexcept SPEED_CRITICAL;
+	void MergeDMs(DriveMovement *sortedDMs) noexcept SPEED_CRITICAL;
 	void DeactivateDM(size_t drive) noexcept;
 	void ReleaseDMs() noexcept;
 	bool IsDecelerationMove() const noexcept;								// return true if this move is or have been might have been intended to be a deceleration-only move
 	bool IsAccelerationMove() const noexcept;								// return true if this move is or have been might have been intended to be an acceleration-only move
 	void EnsureUnshapedSegments(const PrepParams& params) noexcept;
+	void ShareUnshapedSegments(const PrepParams& params) noexcept;
+	bool NeedsGenericPrepare() const noexcept;
+	bool AxisMotorsMoving() const noexcept;
+	template<PrepareKind Kind> void PrepareDrives(PrepParams& params, Platform& platform) noexcept SPEED_CRITICAL;
+#if SUPPORT_LINEAR_DELTA
+	void PrepareDeltaTower(size_t drive, PrepParams& params, Platform& platform) noexcept SPEED_CRITICAL;
+#endif
+	void PrepareAxisDrive(size_t drive, int32_t delta, PrepParams& params, Platform& platform) noexcept SPEED_CRITICAL;
+	void PrepareExtruderDrive(size_t drive, PrepParams& params, Platform& platform) noexcept SPEED_CRITICAL;
+	static void EnableConnectedAxisMotors(AxesBitmap additionalAxisMotorsToEnable, AxesBitmap axisMotorsEnabled, Platform& platform) noexcept;
+#if SUPPORT_NATIVE_ARCS
+	void LimitArcSpeedAndAcceleration(const Kinematics& k, float planarFraction) noexcept;
+#endif
+#if SUPPORT_MESH_Z_PROFILE
+	bool BuildMeshZProfile() noexcept;
+#endif
 	void DebugPrintVector(const char *name, const float *vec, size_t len) const noexcept;
 
 #if SUPPORT_CAN_EXPANSION
@@ -259,6 +313,13 @@ private:
 #endif
 
 	static void DoLookahead(DDARing& ring, DDA *laDDA) noexcept SPEED_CRITICAL;	// Try to smooth out moves in the queue
+	static void DoJunctionDeviationLookahead(DDARing& ring, DDA *newDDA) noexcept SPEED_CRITICAL;	// Replan the speeds of the provisional moves when a new move is added
+#if LOOKAHEAD_SELF_CHECK
+	struct LookaheadState;
+	static void DoCheckedLookahead(DDARing& ring, DDA *newDDA) noexcept;	// Run DoLookahead and check its results using the junction deviation planner
+#endif
+	float GetJunctionSpeed(float junctionDeviation) const noexcept;			// Get the maximum speed at the junction between the previous move and this one
+	float GetEndDirection(size_t drive) const noexcept;						// Get the component of the direction vector at the end of the move
     static float Normalise(float v[], AxesBitmap unitLengthAxes) noexcept;  // Normalise a vector to unit length over the specified axes
     static float Normalise(float v[]) noexcept; 							// Normalise a vector to unit length over all axes
 	float NormaliseLinearMotion(AxesBitmap linearAxes) noexcept;			// Make the direction vector unit-normal in XYZ
@@ -278,9 +339,15 @@ private:
 	{
 		struct
 		{
-			uint16_t endCoordinatesValid : 1,		// True if endCoordinates can be relied
+			uint32_t endCoordinatesValid : 1,		// True if endCoordinates can be relied
 #if SUPPORT_LINEAR_DELTA
 					 isDeltaMovement : 1,			// True if this is a delta printer movement
+#endif
+#if SUPPORT_NATIVE_ARCS
+					 isArcMove : 1,					// True if the arc axes follow the arc described by 'arc' instead of moving in a straight line
+#endif
+#if SUPPORT_MESH_Z_PROFILE
+					 followsMesh : 1,				// True if the Z motor follows the height map between the end points of this move
 #endif
 					 canPauseAfter : 1,				// True if we can pause at the end of this move
 					 isPrintingMove : 1,			// True if this move includes XY movement and extrusion
@@ -297,7 +364,7 @@ private:
 					 isRemote : 1,					// True if this move was commanded from a remote
 					 wasAccelOnlyMove : 1;			// set by Prepare if this was an acceleration-only move, for the next move to look at
 		};
-		uint16_t all;								// so that we can print all the flags at once for debugging
+		uint32_t all;								// so that we can print all the flags at once for debugging
 	} flags;
 
 #if SUPPORT_LASER || SUPPORT_IOBITS
@@ -324,6 +391,10 @@ private:
 
 	float proportionDone;							// what proportion of the extrusion in the G1 or G0 move of which this is a part has been done after this segment is complete
 	float initialUserC0, initialUserC1;				// if this is a segment of an arc move, the user X and Y coordinates at the start
+#if SUPPORT_NATIVE_ARCS
+	NativeArcParameters arc;						// if this is an arc move, the arc that the arc axes follow
+	float arcEndDirection[2];						// if this is an arc move, the components of the direction vector at the end of the move for the two arc axes
+#endif
 	uint32_t clocksNeeded;
 
 	union
@@ -335,6 +406,7 @@ private:
 			float decelDistance;
 			float targetNextSpeed;					// The speed that the next move would like to start at, used to keep track of the lookahead without making recursive calls
 			float maxAcceleration;					// the maximum allowed acceleration for this move according to the limits set by M201
+			float maxStartSpeed;					// the maximum speed at the junction with the previous move, used only by the junction deviation planner
 		} beforePrepare;
 
 		// Values that are not set or accessed before Prepare is called
@@ -342,6 +414,7 @@ private:
 		{
 			// These are calculated from the above and used in the ISR, so they are set up by Prepare()
 			uint32_t moveStartTime;					// clock count at which the move is due to start (before execution) or was started (during execution)
+			uint8_t numSegmentsShared;				// how many more segments the extruder DMs would have used if they didn't share unshapedSegments
 
 #if SUPPORT_CAN_EXPANSION
 			DriversBitmap drivesMoving;				// bitmap of logical drives moving - needed to keep track of whether remote drives are moving
@@ -361,6 +434,9 @@ private:
 	DriveMovement* completedDMs;					// list of associated DMs that don't need any more steps
 	MoveSegment* shapedSegments;					// linked list of move segments used by axis DMs
 	MoveSegment* unshapedSegments;					// linked list of move segments used by extruder DMs
+#if SUPPORT_MESH_Z_PROFILE
+	MeshZProfile* meshZProfile;						// the profile followed by the Z motor if this move follows the height map, else nullptr
+#endif
 };
 
 // Find the DriveMovement record for a given drive even if it is completed, or return nullptr if there isn't one
@@ -437,6 +513,25 @@ inline bool DDA::IsGoodToPrepare() const noexcept
 	return endSpeed >= topSpeed;							// if it never decelerates, we can't improve it
 }
 
+// Get the component of the direction vector at the end of the move. This differs from the direction vector only for the arc axes of an arc move.
+inline float DDA::GetEndDirection(size_t drive) const noexcept
+{
+#if SUPPORT_NATIVE_ARCS
+	if (flags.isArcMove)
+	{
+		if (drive == arc.axis0)
+		{
+			return arcEndDirection[0];
+		}
+		if (drive == arc.axis1)
+		{
+			return arcEndDirection[1];
+		}
+	}
+#endif
+	return directionVector[drive];
+}
+
 inline bool DDA::CanPauseAfter() const noexcept
 {
 	return flags.canPauseAfter
@@ -12,6 +12,10 @@
 #include <GCodes/GCodeBuffer/GCodeBuffer.h>
 #include <Tools/Tool.h>
 
+#if SUPPORT_MOVE_RECORDER
+# include "MoveRecorder.h"
+#endif
+
 #if SUPPORT_CAN_EXPANSION
 # include "CAN/CanMotion.h"
 #endif
@@ -32,14 +36,27 @@ constexpr ObjectModelTableEntry DDARing::objectModelTable[] =
 	// 0. DDARing members
 	{ "gracePeriod",			OBJECT_MODEL_FUNC(self->gracePeriod * MillisToSeconds, 3),			ObjectModelEntryFlags::none },
 	{ "length",					OBJECT_MODEL_FUNC((int32_t)self->numDdasInRing), 					ObjectModelEntryFlags::none },
+	{ "maxLength",				OBJECT_MODEL_FUNC((int32_t)max<unsigned int>(self->maxDdasInRing, self->numDdasInRing)),	ObjectModelEntryFlags::none },
 };
 
-constexpr uint8_t DDARing::objectModelTableDescriptor[] = { 1, 2 };
+constexpr uint8_t DDARing::objectModelTableDescriptor[] = { 1, 3 };
 
 DEFINE_GET_OBJECT_MODEL_TABLE(DDARing)
 
-DDARing::DDARing() noexcept : gracePeriod(DefaultGracePeriod), scheduledMoves(0), completedMoves(0), numHiccups(0)
+Mutex DDARing::prepareMutex;
+
+DDARing::DDARing() noexcept : maxDdasInRing(0), numRingGrowths(0), ringGrowthStopped(false), gracePeriod(DefaultGracePeriod), backgroundPrepare(false),
+#if SUPPORT_NATIVE_ARCS
+	nativeArcs(true),
+#endif
+	scheduledMoves(0), completedMoves(0), numHiccups(0)
+{
+}
+
+// Create the mutex shared by all DDA rings. Called once by Move::Init.
+/*static*/ void DDARing::CreatePrepareMutex() noexcept
 {
+	prepareMutex.Create("MovePrepare");
 }
 
 // This can be called in the constructor for class Move
@@ -70,6 +87,23 @@ void DDARing::Init2() noexcept
 {
 	stepErrors = 0;
 	numLookaheadUnderruns = numPrepareUnderruns = numNoMoveUnderruns = numLookaheadErrors = 0;
+#if LOOKAHEAD_SELF_CHECK
+	numLookaheadChecks = numLookaheadMismatches = 0;
+#endif
+	maxPrepareClocks = totalPrepareClocks = numMovesPrepared = maxSpinClocks = 0;
+	maxIsrClocks = totalIsrClocks = numStepInterrupts = 0;
+	rawMoveQueueHighWater = 0;
+	producerStallTime = maxProducerStallTime = 0;
+	producerStalled = false;
+#if SUPPORT_TRANSFORM_BATCH
+	transformBatch = nullptr;
+	numMovesTransformed = transformClocks = 0;
+#endif
+	numBackgroundPrepared = numDeadlinesMissed = 0;
+	prepareBacklogHighWater = 0;
+	minDeadlineMargin = INT32_MAX;
+	numMovesInWindow = 0;
+	windowMoveClocks = 0;
 	waitingForRingToEmpty = false;
 
 	// Put the origin on the lookahead ring with default velocity in the previous position to the first one that will be used.
@@ -97,7 +131,10 @@ void DDARing::Exit() noexcept
 {
 	timer.CancelCallback();
 
-	// Clear the DDA ring so that we don't report any moves as pending
+	// Clear the DDA ring and the raw move queue so that we don't report any moves as pending. The prepare task has already been terminated.
+	rawMoveQueue.Clear();
+	ClearTransformBatch();
+	prepareQueue.Clear();
 	currentDda = nullptr;
 	while (getPointer != addPointer)
 	{
@@ -115,17 +152,52 @@ void DDARing::Exit() noexcept
 GCodeResult DDARing::ConfigureMovementQueue(GCodeBuffer& gb, const StringRef& reply) THROWS(GCodeException)
 {
 	bool seen = false;
-	uint32_t numDdasWanted = 0, numDMsWanted = 0;
+	uint32_t numDdasWanted = 0, numDMsWanted = 0, numStepTablesWanted = 0;
 	gb.TryGetUIValue('P', numDdasWanted, seen);
 	gb.TryGetUIValue('S', numDMsWanted, seen);
+	gb.TryGetUIValue('T', numStepTablesWanted, seen);
+#if SUPPORT_DELTA_STEP_PROFILES
+	uint32_t numDeltaProfilesWanted = 0;
+	gb.TryGetUIValue('D', numDeltaProfilesWanted, seen);
+#endif
+	uint32_t segmentBudget = MoveSegment::GetBudget();
+	gb.TryGetUIValue('M', segmentBudget, seen);			// Q selects the ring in Move::ConfigureMovementQueue, so we use M for the segment budget
 	gb.TryGetUIValue('R', gracePeriod, seen);
-	if (seen)
+	if (gb.Seen('A'))
+	{
+		seen = true;
+		maxDdasInRing = gb.GetUIValue();
+		ringGrowthStopped = false;										// a new limit may need less RAM, so try again
+	}
+	bool wantBackgroundPrepare = backgroundPrepare;
+	gb.TryGetBValue('C', wantBackgroundPrepare, seen);
+#if SUPPORT_NATIVE_ARCS
+	gb.TryGetBValue('G', nativeArcs, seen);
+#endif
+	bool seenQueueLength = false;
+	uint32_t rawMoveQueueLength = rawMoveQueue.GetCapacity();
+	gb.TryGetLimitedUIValue('B', rawMoveQueueLength, seenQueueLength, MaxRawMoveQueueLength + 1);
+	if (seen || seenQueueLength)
 	{
 		if (!reprap.GetGCodes().LockMovementAndWaitForStandstill(gb))
 		{
 			return GCodeResult::notFinished;
 		}
 
+		if (seenQueueLength && rawMoveQueueLength != rawMoveQueue.GetCapacity())
+		{
+			const ptrdiff_t queueMemoryNeeded = (rawMoveQueueLength + 1) * sizeof(RawMove) + 1024;
+			if (rawMoveQueueLength > rawMoveQueue.GetCapacity() && queueMemoryNeeded >= Tasks::GetNeverUsedRam())
+			{
+				reply.printf("insufficient RAM (available %d, needed %d)", Tasks::GetNeverUsedRam(), queueMemoryNeeded);
+				return GCodeResult::error;
+			}
+			TaskCriticalSectionLocker lock;				// lock out the Move task while we change the queue
+			rawMoveQueue.SetCapacity(rawMoveQueueLength);
+			ClearTransformBatch();
+			rawMoveQueueHighWater = 0;
+		}
+
 		ptrdiff_t memoryNeeded = 0;
 		if (numDdasWanted > numDdasInRing)
 		{
@@ -135,6 +207,20 @@ GCodeResult DDARing::ConfigureMovementQueue(GCodeBuffer& gb, const StringRef& re
 		{
 			memoryNeeded += (numDMsWanted - DriveMovement::NumCreated()) * (sizeof(DriveMovement) + 8);
 		}
+		if (numStepTablesWanted > StepTimeTable::NumCreated())
+		{
+			memoryNeeded += (numStepTablesWanted - StepTimeTable::NumCreated()) * (sizeof(StepTimeTable) + 8);
+		}
+		if (segmentBudget > MoveSegment::NumCreated())
+		{
+			memoryNeeded += (segmentBudget - MoveSegment::NumCreated()) * (sizeof(MoveSegment) + 8);
+		}
+#if SUPPORT_DELTA_STEP_PROFILES
+		if (numDeltaProfilesWanted > DeltaStepProfile::NumCreated())
+		{
+			memoryNeeded += (numDeltaProfilesWanted - DeltaStepProfile::NumCreated()) * (sizeof(DeltaStepProfile) + 8);
+		}
+#endif
 		if (memoryNeeded != 0)
 		{
 			memoryNeeded += 1024;					// allow some margin
@@ -159,18 +245,70 @@ GCodeResult DDARing::ConfigureMovementQueue(GCodeBuffer& gb, const StringRef& re
 
 			// Allocate the extra DMs
 			DriveMovement::InitialAllocate(numDMsWanted);		// this will only create any extra ones wanted
+
+			// Allocate the extra step time tables
+			StepTimeTable::InitialAllocate(numStepTablesWanted);	// this will only create any extra ones wanted
+
+#if SUPPORT_DELTA_STEP_PROFILES
+			// Allocate the extra delta step profiles
+			DeltaStepProfile::InitialAllocate(numDeltaProfilesWanted);	// this will only create any extra ones wanted
+#endif
+		}
+		MoveSegment::SetBudget(segmentBudget);				// this will only create any extra segments needed to fill the budget
+		if (wantBackgroundPrepare)
+		{
+			Move::CreatePrepareTask();
 		}
+		backgroundPrepare = wantBackgroundPrepare;		// the prepare queue is empty because we are at standstill
 		reprap.MoveUpdated();
 	}
 	else
 	{
-		reply.printf("DDAs %u, DMs %u, GracePeriod %" PRIu32, numDdasInRing, DriveMovement::NumCreated(), gracePeriod);
+		reply.printf("DDAs %u, DMs %u, GracePeriod %" PRIu32 ", step time tables %u, move queue length %u",
+						numDdasInRing, DriveMovement::NumCreated(), gracePeriod, StepTimeTable::NumCreated(), rawMoveQueue.GetCapacity());
+		if (maxDdasInRing > numDdasInRing)
+		{
+			reply.catf(", adaptive DDA limit %u", maxDdasInRing);
+		}
+		if (MoveSegment::GetBudget() != 0)
+		{
+			reply.catf(", segment budget %u", MoveSegment::GetBudget());
+		}
+		if (backgroundPrepare)
+		{
+			reply.cat(", background prepare");
+		}
+#if SUPPORT_DELTA_STEP_PROFILES
+		if (DeltaStepProfile::IsEnabled())
+		{
+			reply.catf(", delta step profiles %u", DeltaStepProfile::NumCreated());
+		}
+#endif
+#if SUPPORT_NATIVE_ARCS
+		if (nativeArcs)
+		{
+			reply.cat(", native arcs");
+		}
+#endif
 	}
 	return GCodeResult::ok;
 }
 
 void DDARing::RecycleDDAs() noexcept
 {
+	if (checkPointer->GetState() != DDA::completed || checkPointer == currentDda)
+	{
+		return;
+	}
+
+	// Freeing a DDA releases its DMs and move segments, so we mustn't do it while the background prepare task is allocating them.
+	// If the prepare task is busy then try again later. It will wake us up when it has finished preparing the move.
+	MutexLocker lock(prepareMutex, 0);
+	if (!lock.IsAcquired())
+	{
+		return;
+	}
+
 	// Recycle the DDAs for completed moves, checking for DDA errors to print if Move debug is enabled
 	while (checkPointer->GetState() == DDA::completed && checkPointer != currentDda)	// we haven't finished with a completed DDA until it is no longer the current DDA!
 	{
@@ -186,18 +324,71 @@ void DDARing::RecycleDDAs() noexcept
 		}
 
 		// Now release the DMs and check for underrun
+		const uint32_t clocksNeeded = checkPointer->GetClocksNeeded();
 		if (checkPointer->Free())
 		{
 			++numLookaheadUnderruns;
 		}
 		checkPointer = checkPointer->GetNext();
+		RecordMoveDuration(clocksNeeded);
+	}
+}
+
+// Record the duration of a move that has completed. When we have seen as many moves as there are DDAs in the ring, if adaptive ring sizing is enabled
+// and the average move is shorter than the time we normally prepare moves ahead, then the ring may not hold enough moves for lookahead to reach
+// the speed that the moves could support, so add some more DDAs to it.
+void DDARing::RecordMoveDuration(uint32_t clocksNeeded) noexcept
+{
+	if (maxDdasInRing > numDdasInRing && !ringGrowthStopped)
+	{
+		windowMoveClocks += clocksNeeded;
+		++numMovesInWindow;
+		if (numMovesInWindow >= numDdasInRing)
+		{
+			if (windowMoveClocks < (uint64_t)numMovesInWindow * DDA::UsualMinimumPreparedTime)
+			{
+				GrowRing(min<unsigned int>(max<unsigned int>(numDdasInRing/4, 1), maxDdasInRing - numDdasInRing));
+			}
+			numMovesInWindow = 0;
+			windowMoveClocks = 0;
+		}
+	}
+}
+
+// Add some more DDAs to the ring, if there is enough RAM. Called by the Move task, so moves may be queued or executing.
+// We insert the new DDAs just after addPointer because the step ISR never looks beyond addPointer, which is always empty.
+// We mustn't do this if the DDA after addPointer is waiting to be prepared or executed, because its previous DDA must remain the one that holds the end of the previous move.
+void DDARing::GrowRing(unsigned int numToAdd) noexcept
+{
+	const DDA::DDAState nextState = addPointer->GetNext()->GetState();
+	if (nextState != DDA::empty && nextState != DDA::completed)
+	{
+		return;
 	}
+
+	if ((ptrdiff_t)(numToAdd * (sizeof(DDA) + 8) + AdaptiveRingRamReserve) >= Tasks::GetNeverUsedRam())
+	{
+		ringGrowthStopped = true;												// don't try again, but leave the configured limit alone
+		return;
+	}
+
+	while (numToAdd != 0)
+	{
+		DDA * const newDda = new DDA(addPointer->GetNext());
+		newDda->SetPrevious(addPointer);
+		addPointer->GetNext()->SetPrevious(newDda);
+		addPointer->SetNext(newDda);
+		++numDdasInRing;
+		--numToAdd;
+	}
+	++numRingGrowths;
+	reprap.MoveUpdated();
 }
 
 bool DDARing::CanAddMove() const noexcept
 {
 	 if (   addPointer->GetState() == DDA::empty
-		 && addPointer->GetNext()->GetState() != DDA::provisional		// function Prepare needs to access the endpoints in the previous move, so don't change them
+		 && !addPointer->GetNext()->IsUnprepared()						// function Prepare needs to access the endpoints in the previous move, so don't change them
 		)
 	 {
 			// In order to react faster to speed and extrusion rate changes, only add more moves if the total duration of
@@ -222,9 +413,12 @@ bool DDARing::CanAddMove() const noexcept
 }
 
 // Add a new move, returning true if it represents real movement
-bool DDARing::AddStandardMove(const RawMove &nextMove, bool doMotorMapping) noexcept
+bool DDARing::AddStandardMove(const RawMove &nextMove, bool doMotorMapping, const int32_t *motorSteps) noexcept
 {
-	if (addPointer->InitStandardMove(*this, nextMove, doMotorMapping))
+#if SUPPORT_MOVE_RECORDER
+	MoveRecorder::RecordRawMove(nextMove);
+#endif
+	if (addPointer->InitStandardMove(*this, nextMove, doMotorMapping, motorSteps))
 	{
 		addPointer = addPointer->GetNext();
 		scheduledMoves++;
@@ -233,6 +427,68 @@ bool DDARing::AddStandardMove(const RawMove &nextMove, bool doMotorMapping) noex
 	return false;
 }
 
+#if SUPPORT_TRANSFORM_BATCH
+
+// Get the motor positions of the oldest move in the raw move queue if the kinematics segment moves, transforming several queued moves in one batch.
+// If successful, nextMove has had the axis and bed transforms applied to it. If we return nullptr then the caller must transform the move itself.
+const int32_t *DDARing::GetBatchedMotorSteps(RawMove& nextMove) noexcept
+{
+	if (&nextMove != rawMoveQueue.GetFirst() || !reprap.GetMove().GetKinematics().GetSegmentationType().useSegmentation)
+	{
+		return nullptr;
+	}
+
+	if (transformBatch == nullptr)
+	{
+		transformBatch = new TransformBatch;
+	}
+	return transformBatch->GetMotorSteps(nextMove, rawMoveQueue, addPointer->GetPrevious()->DriveCoordinates());
+}
+
+#endif
+
+// Move as many moves as we can from GCodes into the raw move queue. Called by GCodes, which is the only producer for the queue.
+void DDARing::FillRawMoveQueue() noexcept
+{
+	for (;;)
+	{
+		RawMove * const slot = rawMoveQueue.GetSlotToFill();
+		if (slot == nullptr)
+		{
+			// The queue is full, so if GCodes has a move waiting then it is stalled until the Move task takes one
+			if (!producerStalled && reprap.GetGCodes().IsMovePending())
+			{
+				producerStalled = true;
+				producerStallStartTime = millis();
+			}
+			return;
+		}
+
+		if (!reprap.GetGCodes().ReadMove(*slot))
+		{
+			return;
+		}
+
+		if (producerStalled)
+		{
+			producerStalled = false;
+			const uint32_t stallTime = millis() - producerStallStartTime;
+			producerStallTime += stallTime;
+			if (stallTime > maxProducerStallTime)
+			{
+				maxProducerStallTime = stallTime;
+			}
+		}
+
+		rawMoveQueue.CommitFill();
+		const size_t numQueued = rawMoveQueue.Count();
+		if (numQueued > rawMoveQueueHighWater)
+		{
+			rawMoveQueueHighWater = numQueued;
+		}
+	}
+}
+
 // Add a leadscrew levelling motor move
 bool DDARing::AddSpecialMove(float feedRate, const float coords[MaxDriversPerAxis]) noexcept
 {
@@ -264,6 +520,19 @@ bool DDARing::AddAsyncMove(const AsyncMove& nextMove) noexcept
 // Try to process moves in the ring. Called by the Move task.
 // Return the maximum time in milliseconds that should elapse before we prepare further unprepared moves that are already in the ring, or TaskBase::TimeoutUnlimited if there are no unprepared moves left.
 uint32_t DDARing::Spin(SimulationMode simulationMode, bool waitingForSpace, bool shouldStartMove) noexcept
+{
+	const uint32_t spinStartTime = StepTimer::GetTimerTicks();
+	const uint32_t ret = DoSpin(simulationMode, waitingForSpace, shouldStartMove);
+	const uint32_t spinClocks = StepTimer::GetTimerTicks() - spinStartTime;
+	if (spinClocks > maxSpinClocks)
+	{
+		maxSpinClocks = spinClocks;
+	}
+	return ret;
+}
+
+// This does the work of Spin
+uint32_t DDARing::DoSpin(SimulationMode simulationMode, bool waitingForSpace, bool shouldStartMove) noexcept
 {
 	DDA *cdda = currentDda;											// capture volatile variable
 	// If we are simulating, simulate completion of the current move.
@@ -338,9 +607,8 @@ uint32_t DDARing::Spin(SimulationMode simulationMode, bool waitingForSpace, bool
 		|| waitingForSpace											// ...or the Move code told us it was waiting for space in the ring...
 		|| waitingForRingToEmpty									// ...or GCodes is waiting for all moves to finish...
 		|| dda->IsCheckingEndstops()								// ...or checking endstops, so we can't schedule the following move
-#if SUPPORT_REMOTE_COMMANDS
-		|| dda->GetState() == DDA::frozen							// ...or the move has already been frozen (it's probably a remote move)
-#endif
+		|| dda->GetState() == DDA::frozen							// ...or the move has already been frozen (it's probably a remote move, or the background prepare task prepared it)
+		|| dda->GetState() == DDA::completed						// ...or the background prepare task found that it needs no movement
 	   )
 	{
 		uint32_t ret = PrepareMoves(dda, 0, 0, simulationMode);
@@ -393,7 +661,7 @@ uint32_t DDARing::Spin(SimulationMode simulationMode, bool waitingForSpace, bool
 		return ret;
 	}
 
-	return (dda->GetState() == DDA::provisional)
+	return (dda->IsUnprepared())
 			? MoveStartPollInterval									// there are moves in the queue but it is not time to prepare them yet
 				: TaskBase::TimeoutUnlimited;						// the queue is empty, nothing to do until new moves arrive
 }
@@ -402,6 +670,19 @@ uint32_t DDARing::Spin(SimulationMode simulationMode, bool waitingForSpace, bool
 // Return the maximum time in milliseconds that should elapse before we prepare further unprepared moves that are already in the ring, or TaskBase::TimeoutUnlimited if there are no unprepared moves left.
 uint32_t DDARing::PrepareMoves(DDA *firstUnpreparedMove, int32_t moveTimeLeft, unsigned int alreadyPrepared, SimulationMode simulationMode) noexcept
 {
+	// Skip any moves that we have already handed over to the background prepare task, including any that it has prepared since our caller looked at them
+	for (;;)
+	{
+		const DDA::DDAState st = firstUnpreparedMove->GetState();
+		if (st != DDA::preparing && st != DDA::frozen)
+		{
+			break;
+		}
+		moveTimeLeft += firstUnpreparedMove->GetTimeLeft();
+		++alreadyPrepared;
+		firstUnpreparedMove = firstUnpreparedMove->GetNext();
+	}
+
 	// If the number of prepared moves will execute in less than the minimum time, prepare another move.
 	// Try to avoid preparing deceleration-only moves too early
 	while (	  firstUnpreparedMove->GetState() == DDA::provisional
@@ -413,7 +694,25 @@ uint32_t DDARing::PrepareMoves(DDA *firstUnpreparedMove, int32_t moveTimeLeft, u
 #endif
 		  )
 	{
-		firstUnpreparedMove->Prepare(simulationMode);
+		if (backgroundPrepare && simulationMode == SimulationMode::off)
+		{
+			if (!HandOverMove(firstUnpreparedMove, moveTimeLeft))
+			{
+				break;												// the prepare task already has as many moves as it can take
+			}
+		}
+		else
+		{
+			MutexLocker lock(prepareMutex);
+			const uint32_t prepareStartTime = StepTimer::GetTimerTicks();
+			firstUnpreparedMove->Prepare(simulationMode);
+			const uint32_t prepareClocks = StepTimer::GetTimerTicks() - prepareStartTime;
+			RecordPrepareTime(prepareClocks);
+			if (moveTimeLeft > 0 && simulationMode == SimulationMode::off)
+			{
+				reprap.GetMove().GetTiming().deadlineMargin.AddMargin(moveTimeLeft - (int32_t)prepareClocks);
+			}
+		}
 		moveTimeLeft += firstUnpreparedMove->GetTimeLeft();
 		++alreadyPrepared;
 		firstUnpreparedMove = firstUnpreparedMove->GetNext();
@@ -432,10 +731,94 @@ uint32_t DDARing::PrepareMoves(DDA *firstUnpreparedMove, int32_t moveTimeLeft, u
 		return (clocksTillWakeup <= 0) ? 2 : min<uint32_t>((uint32_t)clocksTillWakeup/(StepClockRate/1000), 2);		// wake up at that time, but delay for at least 2 ticks
 	}
 
-	// There are no moves waiting to be prepared
+	// There are no moves waiting to be prepared, or the prepare task will wake us up when it has prepared the ones we handed over
 	return TaskBase::TimeoutUnlimited;
 }
 
+// Record the time taken to prepare a move
+void DDARing::RecordPrepareTime(uint32_t prepareClocks) noexcept
+{
+	totalPrepareClocks += prepareClocks;
+	++numMovesPrepared;
+	if (prepareClocks > maxPrepareClocks)
+	{
+		maxPrepareClocks = prepareClocks;
+	}
+	reprap.GetMove().GetTiming().prepareTime.Add(prepareClocks);
+}
+
+// Hand over a move to the background prepare task. moveTimeLeft is the total length remaining of moves ahead of it, so it is the time by which the move should be prepared.
+// Return true if successful, false if the prepare task already has as many moves as it can take.
+bool DDARing::HandOverMove(DDA *dda, int32_t moveTimeLeft) noexcept
+{
+#if SUPPORT_CAN_EXPANSION
+	// CanMotion::CanPrepareMove only checks that there are enough buffers for one move, so only let the prepare task have one move at a time
+	if (!prepareQueue.IsEmpty())
+	{
+		return false;
+	}
+#endif
+
+	PrepareQueue::Item * const item = prepareQueue.GetSlotToFill();
+	if (item == nullptr)
+	{
+		return false;
+	}
+
+	item->dda = dda;
+	item->deadline = StepTimer::GetTimerTicks() + (uint32_t)moveTimeLeft;
+	item->hasDeadline = (moveTimeLeft > 0);
+	dda->SetPreparing();
+	prepareQueue.CommitFill();
+
+	const size_t backlog = prepareQueue.Count();
+	if (backlog > prepareBacklogHighWater)
+	{
+		prepareBacklogHighWater = backlog;
+	}
+	Move::WakePrepareTask();
+	return true;
+}
+
+// Prepare the moves that the Move task has handed over to us. Called by the background prepare task.
+// The DDAs are prepared in the order they were handed over, which is the order they are in the ring. Preparing a DDA sets its state to 'frozen' so that it can be executed.
+void DDARing::PrepareQueuedMoves() noexcept
+{
+	for (;;)
+	{
+		{
+			// Hold the mutex while we access the queue as well as while we prepare the move, so that PauseMoves can discard queued moves safely
+			MutexLocker lock(prepareMutex);
+			const PrepareQueue::Item * const item = prepareQueue.GetFirst();
+			if (item == nullptr)
+			{
+				return;
+			}
+
+			const uint32_t prepareStartTime = StepTimer::GetTimerTicks();
+			item->dda->Prepare(SimulationMode::off);
+			const uint32_t now = StepTimer::GetTimerTicks();
+			RecordPrepareTime(now - prepareStartTime);
+			++numBackgroundPrepared;
+			if (item->hasDeadline)
+			{
+				const int32_t margin = (int32_t)(item->deadline - now);
+				reprap.GetMove().GetTiming().deadlineMargin.AddMargin(margin);
+				if (margin < minDeadlineMargin)
+				{
+					minDeadlineMargin = margin;
+				}
+				if (margin < 0)
+				{
+					++numDeadlinesMissed;
+				}
+			}
+			prepareQueue.RemoveFirst();
+		}
+		Move::WakeMoveTask();										// the Move task may be waiting to start this move, or to recycle DDAs
+	}
+}
+
 // Return true if this DDA ring is idle
 bool DDARing::IsIdle() const noexcept
 {
@@ -461,6 +844,7 @@ void DDARing::Interrupt(Platform& p) noexcept
 		{
 			// Generate a step for the current move
 			cdda->StepDrivers(p, now);							// check endstops if necessary and step the drivers
+			++numStepInterrupts;
 			if (cdda->GetState() == DDA::completed)
 			{
 #if SUPPORT_CAN_EXPANSION
@@ -473,6 +857,7 @@ void DDARing::Interrupt(Platform& p) noexcept
 				cdda = currentDda;
 				if (cdda == nullptr)
 				{
+					RecordIsrTime(isrStartTime);
 					break;
 				}
 			}
@@ -480,6 +865,7 @@ void DDARing::Interrupt(Platform& p) noexcept
 			// Schedule a callback at the time when the next step is due, and quit unless it is due immediately
 			if (!cdda->ScheduleNextStepInterrupt(timer))
 			{
+				RecordIsrTime(isrStartTime);
 				break;
 			}
 
@@ -506,6 +892,10 @@ void DDARing::Interrupt(Platform& p) noexcept
 #if SUPPORT_CAN_EXPANSION
 						CanMotion::InsertHiccup(cumulativeHiccupTime);
 #endif
+#if SUPPORT_MOVE_RECORDER
+						MoveRecorder::RecordHiccup(hiccupTime, cdda->GetFilePosition());
+#endif
+						RecordIsrTime(isrStartTime);
 						return;
 					}
 					// We probably had an interrupt that delayed us further. Recalculate the hiccup length, also we increase the hiccup time on each iteration.
@@ -516,6 +906,18 @@ void DDARing::Interrupt(Platform& p) noexcept
 	}
 }
 
+// Record the time taken by the step ISR. Called from the ISR just before it returns.
+inline void DDARing::RecordIsrTime(uint32_t isrStartTime) noexcept
+{
+	const uint32_t isrClocks = StepTimer::GetTimerTicks() - isrStartTime;
+	totalIsrClocks += isrClocks;
+	if (isrClocks > maxIsrClocks)
+	{
+		maxIsrClocks = isrClocks;
+	}
+	reprap.GetMove().GetTiming().isrTime.Add(isrClocks);
+}
+
 // DDARing timer callback function
 /*static*/ void DDARing::TimerCallback(CallbackParameter p) noexcept
 {
@@ -545,7 +947,7 @@ void DDARing::OnMoveCompleted(DDA *cdda, Platform& p) noexcept
 	}
 	else
 	{
-		if (st == DDA::provisional)
+		if (st == DDA::provisional || st == DDA::preparing)
 		{
 			++numPrepareUnderruns;					// there are more moves available, but they are not prepared yet. Signal an underrun.
 		}
@@ -795,6 +1197,7 @@ bool DDARing::PauseMoves(RestorePoint& rp) noexcept
 	// We can pause before a move if it is the first segment in that move.
 	// The caller should set up rp.feedrate to the default feed rate for the file gcode source before calling this.
 
+	MutexLocker prepareLock(prepareMutex);				// prevent the background prepare task preparing moves that we may free
 	TaskCriticalSectionLocker lock;						// prevent the Move task changing data while we look at it
 
 	const DDA * const savedDdaRingAddPointer = addPointer;
@@ -843,9 +1246,12 @@ bool DDARing::PauseMoves(RestorePoint& rp) noexcept
 
 	if (addPointer == savedDdaRingAddPointer)
 	{
-		return false;									// we can't skip any moves
+		return PauseQueuedMoves(rp, pauseOkHere, prevDda);	// we can't skip any moves in the ring, but we may be able to skip some in the raw move queue
 	}
 
+	rawMoveQueue.Clear();								// we are skipping moves in the ring, so we must skip all the moves that are queued after them too
+	ClearTransformBatch();
+
 	dda = addPointer;
 	rp.proportionDone = dda->GetProportionDone(false);	// get the proportion of the current multi-segment move that has been completed
 	rp.initialUserC0 = dda->GetInitialUserC0();
@@ -866,6 +1272,62 @@ bool DDARing::PauseMoves(RestorePoint& rp) noexcept
 	}
 	while (dda != savedDdaRingAddPointer);
 
+	prepareQueue.DiscardFreed();						// don't let the prepare task prepare the moves we freed
+	return true;
+}
+
+// Try to pause before one of the moves in the raw move queue, discarding that move and the ones after it. Called by PauseMoves when it couldn't skip any moves in the ring.
+// On entry, pauseOkHere is true if we can pause after the last move in the ring, and rp.moveCoords holds the end coordinates of that move.
+// Returns true if we skipped any moves, in which case 'rp' has been updated to the first move we skipped.
+bool DDARing::PauseQueuedMoves(RestorePoint& rp, bool pauseOkHere, const DDA *lastDda) noexcept
+{
+	const size_t numQueued = rawMoveQueue.Count();
+	size_t numToKeep = 0;
+	while (!pauseOkHere && numToKeep < numQueued)
+	{
+		pauseOkHere = rawMoveQueue.GetItem(numToKeep)->canPauseAfter;
+		++numToKeep;
+	}
+
+	const RawMove * const lastKept = (numToKeep == 0) ? nullptr : rawMoveQueue.GetItem(numToKeep - 1);
+	if (lastKept != nullptr)
+	{
+		// The queued moves we keep will be executed, so the restore point is at the end of the last of them.
+		// The coordinates in the raw move have not yet been through the axis and bed transform, so we don't need to apply the inverse transform.
+		const size_t numVisibleAxes = reprap.GetGCodes().GetVisibleAxes();
+		for (size_t axis = 0; axis < numVisibleAxes; ++axis)
+		{
+			rp.moveCoords[axis] = lastKept->coords[axis];
+		}
+#if SUPPORT_LASER || SUPPORT_IOBITS
+		rp.laserPwmOrIoBits = lastKept->laserPwmOrIoBits;
+#endif
+	}
+
+	if (numToKeep == numQueued)
+	{
+		return false;									// we can't skip any moves
+	}
+
+	const RawMove& firstSkipped = *rawMoveQueue.GetItem(numToKeep);
+	const FilePosition prevFilePos = (lastKept != nullptr) ? lastKept->filePos : lastDda->GetFilePosition();
+	rp.proportionDone = (firstSkipped.filePos != noFilePosition && firstSkipped.filePos == prevFilePos)
+						? ((lastKept != nullptr) ? lastKept->proportionDone : lastDda->GetProportionDoneAtEnd())
+							: 0.0;
+	rp.initialUserC0 = firstSkipped.initialUserC0;
+	rp.initialUserC1 = firstSkipped.initialUserC1;
+	if (firstSkipped.usingStandardFeedrate)
+	{
+		rp.feedRate = firstSkipped.feedRate;
+	}
+	rp.virtualExtruderPosition = firstSkipped.virtualExtruderPosition;
+	rp.filePos = firstSkipped.filePos;
+#if SUPPORT_LASER || SUPPORT_IOBITS
+	rp.laserPwmOrIoBits = firstSkipped.laserPwmOrIoBits;
+#endif
+
+	rawMoveQueue.Truncate(numToKeep);
+	ClearTransformBatch();
 	return true;
 }
 
@@ -874,6 +1336,8 @@ bool DDARing::PauseMoves(RestorePoint& rp) noexcept
 // Pause the print immediately, returning true if we were able to
 bool DDARing::LowPowerOrStallPause(RestorePoint& rp) noexcept
 {
+	// We are called with the scheduler suspended, so we can't wait for the background prepare task to finish preparing a move.
+	// The caller takes the prepare mutex before it suspends the scheduler, so the prepare task can't be part way through preparing one of the moves we free.
 	TaskCriticalSectionLocker lock;						// prevent the Move task changing data while we look at it
 
 	const DDA * const savedDdaRingAddPointer = addPointer;
@@ -918,9 +1382,25 @@ bool DDARing::LowPowerOrStallPause(RestorePoint& rp) noexcept
 
 	if (dda == savedDdaRingAddPointer)
 	{
-		return false;									// we can't skip any moves
+		if (rawMoveQueue.IsEmpty())
+		{
+			return false;								// we can't skip any moves
+		}
+
+		// We can't skip any moves in the ring, but we may be able to skip some in the raw move queue
+		DDA * const lastDda = addPointer->GetPrevious();
+		const size_t numVisibleAxes = reprap.GetGCodes().GetVisibleAxes();
+		for (size_t axis = 0; axis < numVisibleAxes; ++axis)
+		{
+			rp.moveCoords[axis] = lastDda->GetEndCoordinate(axis, false);
+		}
+		reprap.GetMove().InverseAxisAndBedTransform(rp.moveCoords, lastDda->GetTool());
+		return PauseQueuedMoves(rp, lastDda->CanPauseAfter(), lastDda);
 	}
 
+	rawMoveQueue.Clear();								// we are skipping moves in the ring, so we must skip all the moves that are queued after them too
+	ClearTransformBatch();
+
 	// We are going to skip some moves, or part of a move.
 	// Store the parameters of the first move we are going to execute when we resume
 	rp.feedRate = dda->GetRequestedSpeedMmPerClock();
@@ -953,6 +1433,7 @@ bool DDARing::LowPowerOrStallPause(RestorePoint& rp) noexcept
 		scheduledMoves--;
 	}
 
+	prepareQueue.DiscardFreed();						// don't let the prepare task prepare the moves we freed
 	return true;
 }
 
@@ -966,6 +1447,68 @@ void DDARing::Diagnostics(MessageType mtype, const char *prefix) noexcept
 									prefix, scheduledMoves, completedMoves, numHiccups, stepErrors, numLookaheadErrors, numLookaheadUnderruns, numPrepareUnderruns, numNoMoveUnderruns,
 									(cdda == nullptr) ? -1 : (int)cdda->GetState());
 	numHiccups = stepErrors = numLookaheadUnderruns = numPrepareUnderruns = numNoMoveUnderruns = numLookaheadErrors = 0;
+#if LOOKAHEAD_SELF_CHECK
+	reprap.GetPlatform().MessageF(mtype, "Lookahead checks %u, mismatches %u\n", numLookaheadChecks, numLookaheadMismatches);
+	numLookaheadChecks = numLookaheadMismatches = 0;
+#endif
+
+	if (maxDdasInRing != 0)
+	{
+		reprap.GetPlatform().MessageF(mtype, "Adaptive DDA ring length %u, limit %u, times grown %u%s\n",
+										numDdasInRing, maxDdasInRing, numRingGrowths, (ringGrowthStopped) ? ", stopped by low RAM" : "");
+	}
+
+	if (rawMoveQueue.IsEnabled())
+	{
+		reprap.GetPlatform().MessageF(mtype, "Move queue length %u, queued %u, max %u, producer stall time %" PRIu32 "ms, longest %" PRIu32 "ms\n",
+										rawMoveQueue.GetCapacity(), rawMoveQueue.Count(), rawMoveQueueHighWater, producerStallTime, maxProducerStallTime);
+		rawMoveQueueHighWater = rawMoveQueue.Count();
+		producerStallTime = maxProducerStallTime = 0;
+#if SUPPORT_TRANSFORM_BATCH
+		if (transformBatch != nullptr)
+		{
+			transformBatch->Diagnostics(mtype);
+		}
+#endif
+	}
+
+	if (backgroundPrepare)
+	{
+		reprap.GetPlatform().MessageF(mtype, "Background prepare: moves %" PRIu32 ", backlog %u, max %u, min deadline margin %.1fms, deadlines missed %u\n",
+										numBackgroundPrepared, prepareQueue.Count(), prepareBacklogHighWater,
+										(double)((minDeadlineMargin == INT32_MAX) ? 0.0 : (float)minDeadlineMargin * StepClocksToMillis), numDeadlinesMissed);
+		numBackgroundPrepared = numDeadlinesMissed = 0;
+		prepareBacklogHighWater = prepareQueue.Count();
+		minDeadlineMargin = INT32_MAX;
+	}
+
+	// Report the planner and step generator timings in microseconds
+	constexpr float StepClocksToMicros = StepClocksToMillis * 1000.0;
+	const uint32_t locTotalIsrClocks = totalIsrClocks;				// capture volatile variables
+	const uint32_t locNumStepInterrupts = numStepInterrupts;
+	reprap.GetPlatform().MessageF(mtype,
+									"Prepare time max %.1f avg %.1fus (%" PRIu32 " moves), spin max %.1fus, step ISR max %.1fus, avg per step %.2fus (%" PRIu32 " steps)\n",
+									(double)(maxPrepareClocks * StepClocksToMicros),
+									(double)((numMovesPrepared == 0) ? 0.0 : (float)totalPrepareClocks * StepClocksToMicros/numMovesPrepared),
+									numMovesPrepared,
+									(double)(maxSpinClocks * StepClocksToMicros),
+									(double)(maxIsrClocks * StepClocksToMicros),
+									(double)((locNumStepInterrupts == 0) ? 0.0 : (float)locTotalIsrClocks * StepClocksToMicros/locNumStepInterrupts),
+									locNumStepInterrupts);
+	maxPrepareClocks = totalPrepareClocks = numMovesPrepared = maxSpinClocks = 0;
+#if SUPPORT_TRANSFORM_BATCH
+	if (numMovesTransformed != 0 && reprap.GetMove().GetKinematics().GetSegmentationType().useSegmentation)
+	{
+		// Moves that were transformed one at a time, for comparison with the transform batch figures
+		reprap.GetPlatform().MessageF(mtype, "Unbatched transforms %" PRIu32 ", time per move %.2fus\n",
+										numMovesTransformed, (double)((float)transformClocks * StepClocksToMicros/numMovesTransformed));
+	}
+	numMovesTransformed = transformClocks = 0;
+#endif
+	{
+		AtomicCriticalSectionLocker lock;
+		maxIsrClocks = totalIsrClocks = numStepInterrupts = 0;
+	}
 }
 
 #if SUPPORT_LASER
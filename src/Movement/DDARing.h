@@ -11,6 +11,9 @@
 #define SRC_MOVEMENT_DDARING_H_
 
 #include "DDA.h"
+#include "RawMoveQueue.h"
+#include "PrepareQueue.h"
+#include "TransformBatch.h"
 
 class DDARing INHERIT_OBJECT_MODEL
 {
@@ -23,13 +26,29 @@ public:
 
 	void RecycleDDAs() noexcept;
 	bool CanAddMove() const noexcept;
-	bool AddStandardMove(const RawMove &nextMove, bool doMotorMapping) noexcept SPEED_CRITICAL;	// Set up a new move, returning true if it represents real movement
+	bool AddStandardMove(const RawMove &nextMove, bool doMotorMapping, const int32_t *motorSteps = nullptr) noexcept SPEED_CRITICAL;	// Set up a new move, returning true if it represents real movement
 	bool AddSpecialMove(float feedRate, const float coords[MaxDriversPerAxis]) noexcept;
+
+	bool UsingRawMoveQueue() const noexcept { return rawMoveQueue.IsEnabled(); }
+	void FillRawMoveQueue() noexcept;													// Called by GCodes to move as many moves as possible from GCodes to the raw move queue
+	RawMove *GetQueuedRawMove() const noexcept { return rawMoveQueue.GetFirst(); }		// Called by the Move task to get the oldest move in the raw move queue, or nullptr
+	void RemoveQueuedRawMove() noexcept { rawMoveQueue.RemoveFirst(); }					// Called by the Move task when it has finished with the move returned by GetQueuedRawMove
+	bool IsRawMoveQueueEmpty() const noexcept { return rawMoveQueue.IsEmpty(); }
+	size_t GetNumQueuedRawMoves() const noexcept { return rawMoveQueue.Count(); }
+#if SUPPORT_TRANSFORM_BATCH
+	const int32_t *GetBatchedMotorSteps(RawMove& nextMove) noexcept;				// Called by the Move task to transform the oldest move in the raw move queue as part of a batch
+#endif
 #if SUPPORT_ASYNC_MOVES
 	bool AddAsyncMove(const AsyncMove& nextMove) noexcept;
 #endif
 
 	uint32_t Spin(SimulationMode simulationMode, bool waitingForSpace, bool shouldStartMove) noexcept SPEED_CRITICAL;	// Try to process moves in the ring
+	void PrepareQueuedMoves() noexcept;													// Prepare the moves that the Move task has handed over, called by the prepare task
+	bool UsingBackgroundPrepare() const noexcept { return backgroundPrepare; }
+#if SUPPORT_NATIVE_ARCS
+	bool UsingNativeArcs() const noexcept { return nativeArcs; }
+#endif
+	static void CreatePrepareMutex() noexcept;											// Create the mutex that protects preparing moves, called once at startup
 	bool IsIdle() const noexcept;														// Return true if this DDA ring is idle
 	uint32_t GetGracePeriod() const noexcept { return gracePeriod; }					// Return the minimum idle time, before we should start a move. Better to have a few moves in the queue so that we can do lookahead
 
@@ -45,6 +64,8 @@ public:
 
 	uint32_t GetScheduledMoves() const noexcept { return scheduledMoves; }				// How many moves have been scheduled?
 	uint32_t GetCompletedMoves() const noexcept { return completedMoves; }				// How many moves have been completed?
+	float GetOccupancy() const noexcept;												// Return the fraction of the DDAs in the ring that hold moves that have not completed
+	DDA *GetLastAddedMove() const noexcept { return addPointer->GetPrevious(); }			// Return the move that was added to the ring most recently
 	void ResetMoveCounters() noexcept { scheduledMoves = completedMoves = 0; }
 
 	float GetSimulationTime() const noexcept { return simulationTime; }
@@ -72,14 +93,21 @@ public:
 
 	bool PauseMoves(RestorePoint& rp) noexcept;											// Pause the print as soon as we can, returning true if we were able to skip any
 #if HAS_VOLTAGE_MONITOR || HAS_STALL_DETECT
-	bool LowPowerOrStallPause(RestorePoint& rp) noexcept;								// Pause the print immediately, returning true if we were able to
+	bool LowPowerOrStallPause(RestorePoint& rp) noexcept;								// Pause the print immediately, returning true if we were able to. The caller must hold the prepare mutex.
 #endif
+	static Mutex& GetPrepareMutex() noexcept { return prepareMutex; }
 
 #if SUPPORT_LASER
 	uint32_t ManageLaserPower() const noexcept;											// Manage the laser power
 #endif
 
 	void RecordLookaheadError() noexcept { ++numLookaheadErrors; }						// Record a lookahead error
+#if SUPPORT_TRANSFORM_BATCH
+	void RecordTransformTime(uint32_t clocks) noexcept { transformClocks += clocks; ++numMovesTransformed; }	// Record the time taken to transform a move that wasn't batched
+#endif
+#if LOOKAHEAD_SELF_CHECK
+	void RecordLookaheadCheck(bool mismatch) noexcept { ++numLookaheadChecks; if (mismatch) { ++numLookaheadMismatches; } }	// Record the result of a lookahead check
+#endif
 	void Diagnostics(MessageType mtype, const char *prefix) noexcept;
 
 	bool SetWaitingToEmpty() noexcept;
@@ -103,11 +131,21 @@ protected:
 	DECLARE_OBJECT_MODEL
 
 private:
+	bool PauseQueuedMoves(RestorePoint& rp, bool pauseOkHere, const DDA *lastDda) noexcept;	// Try to pause before one of the moves in the raw move queue
+	bool HandOverMove(DDA *dda, int32_t moveTimeLeft) noexcept;				// Hand over a move to the background prepare task, returning true if successful
+	void RecordPrepareTime(uint32_t prepareClocks) noexcept;				// Record the time taken to prepare a move
 	bool StartNextMove(Platform& p, uint32_t startTime) noexcept SPEED_CRITICAL;		// Start the next move, returning true if laser or IObits need to be controlled
 	uint32_t PrepareMoves(DDA *firstUnpreparedMove, int32_t moveTimeLeft, unsigned int alreadyPrepared, SimulationMode simulationMode) noexcept;
+	uint32_t DoSpin(SimulationMode simulationMode, bool waitingForSpace, bool shouldStartMove) noexcept SPEED_CRITICAL;
+	void RecordIsrTime(uint32_t isrStartTime) noexcept SPEED_CRITICAL;
+	void RecordMoveDuration(uint32_t clocksNeeded) noexcept;					// Record the duration of a completed move and grow the ring if moves are short
+	void GrowRing(unsigned int numToAdd) noexcept;								// Add DDAs to the ring while moves may be in progress
+	void ClearTransformBatch() noexcept;										// Discard any moves we have transformed in advance, called when we clear or truncate the raw move queue
 
 	static void TimerCallback(CallbackParameter p) noexcept;
 
+	static Mutex prepareMutex;													// Held while preparing a move or freeing DDAs, because those use the free lists of DMs, move segments and step time tables
+
 	DDA* volatile currentDda;
 	DDA* addPointer;
 	DDA* volatile getPointer;
@@ -119,8 +157,35 @@ private:
 	volatile int32_t liveEndPoints[MaxAxesPlusExtruders];						// The XYZ endpoints of the last completed move in motor coordinates
 
 	unsigned int numDdasInRing;
+	unsigned int maxDdasInRing;													// The length that we may grow the ring to automatically when moves are short, or 0 if we don't grow it
+	unsigned int numMovesInWindow;												// How many completed moves we have totalled the durations of
+	unsigned int numRingGrowths;												// How many times we have grown the ring automatically, for diagnostics
+	bool ringGrowthStopped;														// True if we stopped growing the ring automatically because RAM was short
+	uint64_t windowMoveClocks;													// The total duration of those moves
 	uint32_t gracePeriod;														// The minimum idle time in milliseconds, before we should start a move. Better to have a few moves in the queue so that we can do lookahead
 
+	RawMoveQueue rawMoveQueue;													// Moves that GCodes has passed to us but we haven't yet added to the ring
+	size_t rawMoveQueueHighWater;												// The maximum number of moves in the raw move queue
+	uint32_t producerStallStartTime;											// When GCodes had a move for us but found the raw move queue full
+	uint32_t producerStallTime;													// The total time in milliseconds that GCodes had a move for us but the raw move queue was full
+	uint32_t maxProducerStallTime;												// The longest single time that GCodes had a move for us but the raw move queue was full
+	bool producerStalled;														// True if GCodes has a move for us but the raw move queue was full
+#if SUPPORT_TRANSFORM_BATCH
+	TransformBatch *transformBatch;												// Moves from the raw move queue that we have transformed in advance, or nullptr if we haven't needed it yet
+	uint32_t numMovesTransformed;												// How many moves we transformed one at a time, for diagnostics
+	uint32_t transformClocks;													// The step clocks taken by the kinematics to transform them, for diagnostics
+#endif
+
+	PrepareQueue prepareQueue;													// Moves that we have handed over to the background prepare task
+	uint32_t numBackgroundPrepared;												// How many moves the background prepare task has prepared
+	size_t prepareBacklogHighWater;												// The maximum number of moves waiting for the background prepare task
+	int32_t minDeadlineMargin;													// The smallest time in step clocks between the background prepare task finishing a move and that move being due
+	unsigned int numDeadlinesMissed;											// How many moves the background prepare task finished after they were due
+	bool backgroundPrepare;														// True if we hand moves over to the background prepare task instead of preparing them in the Move task
+#if SUPPORT_NATIVE_ARCS
+	bool nativeArcs;															// True if we may execute G2/G3 moves as single moves instead of splitting them into segments
+#endif
+
 	uint32_t scheduledMoves;													// Move counters for the code queue
 	volatile uint32_t completedMoves;											// This one is modified by an ISR, hence volatile
 	volatile int32_t numHiccups;												// Modified in the ISR
@@ -129,8 +194,21 @@ private:
 	unsigned int numPrepareUnderruns;											// How many times we wanted a new move but there were only un-prepared moves in the queue
 	unsigned int numNoMoveUnderruns;											// How many times we wanted a new move but there were none
 	unsigned int numLookaheadErrors;											// How many times our lookahead algorithm failed
+#if LOOKAHEAD_SELF_CHECK
+	unsigned int numLookaheadChecks;											// How many times we checked the results of DoLookahead
+	unsigned int numLookaheadMismatches;										// How many times DoLookahead gave a higher end speed than the junction deviation planner
+#endif
 	unsigned int stepErrors;													// count of step errors, for diagnostics
 
+	// Timing statistics for the motion planner and step generator, all in step clocks. These are reported and reset by Diagnostics.
+	uint32_t maxPrepareClocks;													// longest time taken by DDA::Prepare
+	uint32_t totalPrepareClocks;												// total time taken by DDA::Prepare
+	uint32_t numMovesPrepared;													// how many moves DDA::Prepare was called for
+	uint32_t maxSpinClocks;														// longest time taken by Spin
+	volatile uint32_t maxIsrClocks;												// longest time spent in the step ISR, modified in the ISR
+	volatile uint32_t totalIsrClocks;											// total time spent in the step ISR, modified in the ISR
+	volatile uint32_t numStepInterrupts;										// how many times the ISR called DDA::StepDrivers, modified in the ISR
+
 	float simulationTime;														// Print time since we started simulating
 #if SUPPORT_REMOTE_COMMANDS
 	volatile int32_t lastMoveStepsTaken[NumDirectDrivers];						// how many steps were taken in the last move we did
@@ -168,6 +246,22 @@ pre(getPointer->GetState() == DDA::frozen)
 #endif
 }
 
+inline float DDARing::GetOccupancy() const noexcept
+{
+	const uint32_t movesInRing = scheduledMoves - completedMoves;
+	return (movesInRing >= numDdasInRing) ? 1.0 : (float)movesInRing/(float)numDdasInRing;
+}
+
+inline void DDARing::ClearTransformBatch() noexcept
+{
+#if SUPPORT_TRANSFORM_BATCH
+	if (transformBatch != nullptr)
+	{
+		transformBatch->Clear();
+	}
+#endif
+}
+
 #if HAS_SMART_DRIVERS
 inline uint32_t DDARing::GetStepInterval(size_t axis, uint32_t microstepShift) const noexcept
 {
@@ -0,0 +1,212 @@
+/*
+ * DeltaStepProfile.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include "DeltaStepProfile.h"
+
+#if SUPPORT_DELTA_STEP_PROFILES
+
+#include <Platform/RepRap.h>
+#include <Platform/Platform.h>
+#include <Movement/StepTimer.h>
+
+// Static members
+
+DeltaStepProfile *DeltaStepProfile::freeList = nullptr;
+unsigned int DeltaStepProfile::numCreated = 0;
+unsigned int DeltaStepProfile::numInUse = 0;
+unsigned int DeltaStepProfile::maxInUse = 0;
+unsigned int DeltaStepProfile::numExhausted = 0;
+unsigned int DeltaStepProfile::numBuildFailures = 0;
+unsigned int DeltaStepProfile::numBuilt = 0;
+uint32_t DeltaStepProfile::buildClocks = 0;
+
+void DeltaStepProfile::InitialAllocate(unsigned int num) noexcept
+{
+	while (num > numCreated)
+	{
+		freeList = new DeltaStepProfile(freeList);
+		++numCreated;
+	}
+}
+
+// Allocate a profile from the freelist. As with step time tables we never create new ones here, because the caller can fall back to the exact calculation.
+DeltaStepProfile *DeltaStepProfile::Allocate() noexcept
+{
+	DeltaStepProfile * const profile = freeList;
+	if (profile == nullptr)
+	{
+		++numExhausted;
+		return nullptr;
+	}
+
+	freeList = profile->next;
+	++numInUse;
+	if (numInUse > maxInUse)
+	{
+		maxInUse = numInUse;
+	}
+	return profile;
+}
+
+void DeltaStepProfile::Diagnostics(MessageType mtype) noexcept
+{
+	if (numCreated != 0)
+	{
+		reprap.GetPlatform().MessageF(mtype, "Delta step profiles %u (%u bytes), in use %u, max %u, exhausted %u, built %u, too complex %u, build time %.1fus\n",
+										numCreated, numCreated * (unsigned int)sizeof(DeltaStepProfile), numInUse, maxInUse, numExhausted, numBuilt, numBuildFailures,
+										(double)((numBuilt + numBuildFailures == 0) ? 0.0 : (float)buildClocks * StepClocksToMillis * 1000.0/(numBuilt + numBuildFailures)));
+		maxInUse = numInUse;
+		numExhausted = numBuilt = numBuildFailures = 0;
+		buildClocks = 0;
+	}
+}
+
+// Build the profile. The carriage height is in steps and is relative to the start of the move, multiplied by the Z movement fraction, in the same way as DriveMovement::mp.delta.fHmz0s.
+// If the carriage starts by moving up and reverseStartStep <= totalSteps then it moves up by (reverseStartStep - 1) steps and then down by the remaining steps.
+bool DeltaStepProfile::Build(float minusAaPlusBbTimesS, float dSquaredMinusAsquaredMinusBsquaredTimesSsquared, float dirZ,
+								float startHeight, bool startsUp, uint32_t reverseStartStep, uint32_t totalSteps) noexcept
+{
+	const uint32_t startTime = StepTimer::GetTimerTicks();
+	k = minusAaPlusBbTimesS;
+	q = dSquaredMinusAsquaredMinusBsquaredTimesSsquared;
+	dz = dirZ;
+	numPieces = currentPiece = 0;
+
+	bool ok;
+	if (!startsUp)
+	{
+		ok = AddRun(startHeight, startHeight - (float)totalSteps, false);
+	}
+	else if (reverseStartStep > totalSteps)
+	{
+		ok = AddRun(startHeight, startHeight + (float)totalSteps, true);
+	}
+	else
+	{
+		const float peakHeight = startHeight + (float)(reverseStartStep - 1);
+		ok = AddRun(startHeight, peakHeight, true) && AddRun(peakHeight, peakHeight - (float)(totalSteps - (reverseStartStep - 1)), false);
+	}
+
+	if (ok)
+	{
+		++numBuilt;
+	}
+	else
+	{
+		++numBuildFailures;
+	}
+	buildClocks += StepTimer::GetTimerTicks() - startTime;
+	return ok;
+}
+
+// Add the pieces for a run of carriage heights in one direction, returning false if we run out of pieces.
+// We try to approximate the rest of the run by a single piece. If the error is too large we shrink the piece and try again.
+// The error is roughly proportional to the fourth power of the height of the piece, so we use the error to estimate how much to shrink it.
+// Near a reversal the distance changes too fast with height to approximate, so when the piece gets too small we mark it as exact.
+bool DeltaStepProfile::AddRun(float startHeight, float endHeight, bool up) noexcept
+{
+	float pieceStart = startHeight;
+	float pieceEnd = endHeight;
+	while (pieceStart != endHeight)
+	{
+		Piece piece;
+		const float errorRatio = FitPiece(piece, pieceStart, pieceEnd, up);
+		if (!(errorRatio <= 1.0))										// this is also true if the error is NaN
+		{
+			if (fabsf(pieceEnd - pieceStart) > MinPieceHeight)
+			{
+				const float scale = (errorRatio < 256.0) ? 0.9/fastSqrtf(fastSqrtf(errorRatio)) : 0.5;
+				pieceEnd = pieceStart + (pieceEnd - pieceStart) * scale;
+				continue;
+			}
+
+			if (numPieces != 0 && pieces[numPieces - 1].exact && pieces[numPieces - 1].up == up)
+			{
+				pieces[numPieces - 1].endHeight = pieceEnd;				// extend the previous exact piece
+				pieceStart = pieceEnd;
+				pieceEnd = endHeight;
+				continue;
+			}
+
+			piece.startHeight = pieceStart;
+			piece.endHeight = pieceEnd;
+			piece.up = up;
+			piece.exact = true;
+		}
+
+		if (numPieces == MaxPieces)
+		{
+			return false;
+		}
+		pieces[numPieces++] = piece;
+		pieceStart = pieceEnd;
+		pieceEnd = endHeight;
+	}
+	return true;
+}
+
+// Fit the cubic that interpolates the exact distance at the Chebyshev nodes of the range of carriage heights.
+// Return the ratio of the largest error that we find to the allowed error, or NaN if the exact distance can't be calculated.
+float DeltaStepProfile::FitPiece(Piece& piece, float startHeight, float endHeight, bool up) const noexcept
+{
+	constexpr float Nodes[4] = { 0.03806023, 0.30865828, 0.69134172, 0.96193977 };		// the Chebyshev nodes of the interval [0, 1]
+
+	const float height = endHeight - startHeight;
+	float y[4];
+	for (size_t i = 0; i < 4; ++i)
+	{
+		y[i] = ExactDistance(startHeight + Nodes[i] * height, up);
+	}
+
+	// Calculate the divided differences and convert the Newton form of the cubic to powers of the fraction of the piece
+	const float f01 = (y[1] - y[0])/(Nodes[1] - Nodes[0]);
+	const float f12 = (y[2] - y[1])/(Nodes[2] - Nodes[1]);
+	const float f23 = (y[3] - y[2])/(Nodes[3] - Nodes[2]);
+	const float f012 = (f12 - f01)/(Nodes[2] - Nodes[0]);
+	const float f123 = (f23 - f12)/(Nodes[3] - Nodes[1]);
+	piece.c3 = (f123 - f012)/(Nodes[3] - Nodes[0]);
+	piece.c2 = f012 - piece.c3 * (Nodes[0] + Nodes[1] + Nodes[2]);
+	piece.c1 = f01 - f012 * (Nodes[0] + Nodes[1]) + piece.c3 * (Nodes[0] * Nodes[1] + Nodes[0] * Nodes[2] + Nodes[1] * Nodes[2]);
+	piece.c0 = y[0] - f01 * Nodes[0] + f012 * Nodes[0] * Nodes[1] - piece.c3 * Nodes[0] * Nodes[1] * Nodes[2];
+
+	// Check the error in the carriage position, using the slope of the cubic to convert the distance error to steps
+	float errorRatio = 0.0;
+	for (unsigned int i = 0; i <= NumCheckPoints; ++i)
+	{
+		const float u = (float)i * (1.0/NumCheckPoints);
+		const float error = fabsf(piece.c0 + u * (piece.c1 + u * (piece.c2 + u * piece.c3)) - ExactDistance(startHeight + u * height, up));
+		const float distancePerStep = fabsf((piece.c1 + u * (2.0 * piece.c2 + u * 3.0 * piece.c3))/height);
+		const float ratio = error/(MaxError * distancePerStep);
+		if (std::isnan(ratio))
+		{
+			return ratio;
+		}
+		if (ratio > errorRatio)
+		{
+			errorRatio = ratio;
+		}
+	}
+
+	piece.startHeight = startHeight;
+	piece.endHeight = endHeight;
+	piece.recipHeight = 1.0/height;
+	piece.up = up;
+	piece.exact = false;
+	return errorRatio;
+}
+
+// Calculate the distance in the same way as DriveMovement::CalcNextStepTimeFull
+float DeltaStepProfile::ExactDistance(float height, bool up) const noexcept
+{
+	const float t1 = k + height * dz;
+	const float t2 = fastLimSqrtf(q - fsquare(height) + fsquare(t1));
+	return (up) ? t1 - t2 : t1 + t2;
+}
+
+#endif
+
+// End
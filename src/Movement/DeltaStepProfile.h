@@ -0,0 +1,128 @@
+/*
+ * DeltaStepProfile.h
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * This class holds a piecewise cubic approximation of the distance moved along the path against the carriage height for one tower of a linear delta move.
+ * Without it, the step ISR calculates the distance at each step (or double/quad/octal step) from the carriage height using a square root,
+ * as in DriveMovement::CalcNextStepTimeFull. With it, the ISR evaluates a cubic polynomial instead.
+ *
+ * The profile is built by DriveMovement::PrepareDeltaAxis. It covers the carriage heights that the tower moves through, in the order that it moves through them,
+ * so there are separate pieces for the upwards and downwards runs if the tower reverses. Each piece is the cubic that interpolates the exact distance
+ * at the Chebyshev nodes of the piece, which we check against the exact distance at several points in the piece. The allowed error is a fraction of a step
+ * in the carriage position at the time the head reaches the calculated distance, so it is the distance error divided by the distance moved per carriage step.
+ * Close to a reversal the distance changes too fast to approximate, so we mark the piece as exact and the ISR uses the exact calculation for it.
+ *
+ * The profiles are allocated from a fixed-size pool configured by M595 D. If the pool is exhausted or the profile needs too many pieces, the DM uses the exact calculation.
+ * Profiles are only allocated and released by the Move task or prepare task while holding the prepare mutex. The step ISR reads them and updates the current piece.
+ */
+
+#ifndef SRC_MOVEMENT_DELTASTEPPROFILE_H_
+#define SRC_MOVEMENT_DELTASTEPPROFILE_H_
+
+#include <RepRapFirmware.h>
+
+#if SUPPORT_DELTA_STEP_PROFILES
+
+#include <Platform/Tasks.h>
+
+class DeltaStepProfile
+{
+public:
+	static constexpr size_t MaxPieces = 16;								// the maximum number of pieces in a profile
+	static constexpr float MaxError = 0.1;								// the maximum error in the carriage position in steps
+	static constexpr float MinPieceHeight = 4.0;						// the smallest piece in steps that we try to approximate before we give up and use the exact calculation
+	static constexpr uint32_t MinSteps = 32;							// moves with fewer steps than this are not worth building a profile for
+	static constexpr unsigned int NumCheckPoints = 8;					// the number of intervals at which we check the error in each piece
+
+	DeltaStepProfile(DeltaStepProfile *p_next) noexcept : next(p_next), numPieces(0), currentPiece(0) { }
+
+	void* operator new(size_t count) { return Tasks::AllocPermanent(count); }
+	void* operator new(size_t count, std::align_val_t align) { return Tasks::AllocPermanent(count, align); }
+	void operator delete(void* ptr) noexcept {}
+	void operator delete(void* ptr, std::align_val_t align) noexcept {}
+
+	// Build the profile for a delta tower. The parameters are those that DriveMovement::CalcNextStepTimeFull uses to calculate the distance from the carriage height.
+	// Return true if successful, false if we need too many pieces.
+	bool Build(float minusAaPlusBbTimesS, float dSquaredMinusAsquaredMinusBsquaredTimesSsquared, float dirZ,
+				float startHeight, bool startsUp, uint32_t reverseStartStep, uint32_t totalSteps) noexcept;
+
+	// Return the distance multiplied by steps/mm at which the carriage reaches the specified height when moving in the specified direction,
+	// or NaN if the caller must calculate it exactly. The heights passed to successive calls must follow the movement of the carriage.
+	float GetDistance(float height, bool up) noexcept SPEED_CRITICAL;
+
+	// Allocate a profile from the pool, returning nullptr if the pool is exhausted. Not thread-safe.
+	static DeltaStepProfile *Allocate() noexcept;
+
+	// Release a profile back to the pool. Not thread-safe.
+	static void Release(DeltaStepProfile *item) noexcept;
+
+	static void InitialAllocate(unsigned int num) noexcept;
+	static bool IsEnabled() noexcept { return numCreated != 0; }
+	static unsigned int NumCreated() noexcept { return numCreated; }
+	static void Diagnostics(MessageType mtype) noexcept;
+
+private:
+	struct Piece
+	{
+		float startHeight;												// the carriage height in steps at the start of the piece
+		float endHeight;												// the carriage height in steps at the end of the piece
+		float recipHeight;												// the reciprocal of (endHeight - startHeight)
+		float c0, c1, c2, c3;											// the coefficients of the cubic in the fraction of the piece
+		bool up;														// true if the carriage moves up during this piece
+		bool exact;														// true if the distance must be calculated exactly in this piece
+	};
+
+	bool AddRun(float startHeight, float endHeight, bool up) noexcept;
+	float FitPiece(Piece& piece, float startHeight, float endHeight, bool up) const noexcept;
+	float ExactDistance(float height, bool up) const noexcept;
+
+	static DeltaStepProfile *freeList;
+	static unsigned int numCreated;
+	static unsigned int numInUse;
+	static unsigned int maxInUse;
+	static unsigned int numExhausted;
+	static unsigned int numBuildFailures;
+	static unsigned int numBuilt;
+	static uint32_t buildClocks;										// the step clocks taken to build the profiles, for diagnostics
+
+	DeltaStepProfile *next;												// link to the next profile in the free list
+	float k, q, dz;														// the parameters of the exact calculation, only used while building the profile
+	Piece pieces[MaxPieces];
+	uint8_t numPieces;
+	uint8_t currentPiece;												// the piece that the carriage is in, updated by the ISR
+};
+
+// Find the piece that contains the height and evaluate it
+inline float DeltaStepProfile::GetDistance(float height, bool up) noexcept
+{
+	while (currentPiece < numPieces)
+	{
+		const Piece& piece = pieces[currentPiece];
+		if (piece.up == up && ((up) ? height <= piece.endHeight : height >= piece.endHeight))
+		{
+			if (piece.exact)
+			{
+				break;
+			}
+			const float u = (height - piece.startHeight) * piece.recipHeight;
+			const float distance = piece.c0 + u * (piece.c1 + u * (piece.c2 + u * piece.c3));
+			return (distance > 0.0) ? distance : 0.0;					// the approximation may be very slightly negative at the start of the move
+		}
+		++currentPiece;
+	}
+	return std::numeric_limits<float>::quiet_NaN();
+}
+
+// Release a profile. Not thread-safe.
+inline void DeltaStepProfile::Release(DeltaStepProfile *item) noexcept
+{
+	item->next = freeList;
+	freeList = item;
+	--numInUse;
+}
+
+#endif
+
+#endif /* SRC_MOVEMENT_DELTASTEPPROFILE_H_ */
@@ -47,8 +47,9 @@ DriveMovement *DriveMovement::Allocate(size_t p_drive, DMState st) noexcept
 }
 
 // Constructors
-DriveMovement::DriveMovement(DriveMovement *next) noexcept : nextDM(next)
+DriveMovement::DriveMovement(DriveMovement *next) noexcept : nextDM(next), stepTable(nullptr)
 {
+	isDelta = false;							// so that Release doesn't look for a delta step profile in a DM that has never been prepared
 }
 
 // Non static members
@@ -63,13 +64,33 @@ void DriveMovement::DebugPrint() const noexcept
 							(double)pA, (double)pB, (double)pC, (double)distanceSoFar, (double)timeSoFar);
 		if (isDelta)
 		{
-			debugPrintf(" hmz0s=%.4e minusAaPlusBbTimesS=%.4e dSquaredMinusAsquaredMinusBsquared=%.4e drev=%.4e\n",
-							(double)mp.delta.fHmz0s, (double)mp.delta.fMinusAaPlusBbTimesS, (double)mp.delta.fDSquaredMinusAsquaredMinusBsquaredTimesSsquared, (double)mp.delta.reverseStartDistance);
+			debugPrintf(" hmz0s=%.4e minusAaPlusBbTimesS=%.4e dSquaredMinusAsquaredMinusBsquared=%.4e drev=%.4e%s\n",
+							(double)mp.delta.fHmz0s, (double)mp.delta.fMinusAaPlusBbTimesS, (double)mp.delta.fDSquaredMinusAsquaredMinusBsquaredTimesSsquared, (double)mp.delta.reverseStartDistance,
+#if SUPPORT_DELTA_STEP_PROFILES
+								(mp.delta.profile != nullptr) ? " profile" :
+#endif
+									"");
 		}
 		else if (isExtruder)
 		{
 			debugPrintf(" pa=%" PRIu32 " eed=%.4e ebf=%.4e\n", (uint32_t)mp.cart.pressureAdvanceK, (double)mp.cart.extraExtrusionDistance, (double)mp.cart.extrusionBroughtForwards);
 		}
+#if SUPPORT_NATIVE_ARCS
+		else if (isArc)
+		{
+			debugPrintf(" ht=%d rl=%u ns=%" PRIi32 " fns=%" PRIi32 " rr=%.4e csa=%.4e sa=%.4e mpr=%.4e\n",
+							(int)mp.arc.halfTurn, (unsigned int)mp.arc.reversalsLeft, mp.arc.netSteps, mp.arc.finalNetSteps,
+								(double)mp.arc.recipRadiusSteps, (double)mp.arc.cosStartAngle, (double)mp.arc.startAngle, (double)mp.arc.mmPerRadian);
+		}
+#endif
+#if SUPPORT_MESH_Z_PROFILE
+		else if (isMeshZ)
+		{
+			debugPrintf(" piece=%u run=%u rl=%u ns=%" PRIi32 " fns=%" PRIi32 " np=%u\n",
+							(unsigned int)mp.meshZ.piece, (unsigned int)mp.meshZ.run, (unsigned int)mp.meshZ.reversalsLeft, mp.meshZ.netSteps, mp.meshZ.finalNetSteps,
+								(unsigned int)mp.meshZ.profile->numPoints);
+		}
+#endif
 		else
 		{
 			debugPrintf("\n");
@@ -92,16 +113,27 @@ bool DriveMovement::NewCartesianSegment() noexcept
 		}
 
 		// Work out the movement limit in steps
-		pC = currentSegment->CalcC(mp.cart.effectiveMmPerStep);
-		if (currentSegment->IsLinear())
+		if (currentSegment->IsCubic())
+		{
+			// Set up pA, pB, pC such that for forward motion, stepNumber = cubicStartSteps + t' * (pA + t' * (pB + t' * pC)) where t' = time - cubicStartTime
+			pA = currentSegment->GetCubicB() * mp.cart.effectiveStepsPerMm;
+			pB = currentSegment->GetCubicC() * mp.cart.effectiveStepsPerMm;
+			pC = currentSegment->GetCubicD() * mp.cart.effectiveStepsPerMm;
+			mp.cart.cubicStartSteps = distanceSoFar * mp.cart.effectiveStepsPerMm;
+			mp.cart.cubicStartTime = timeSoFar;
+			state = DMState::cartCubic;
+		}
+		else if (currentSegment->IsLinear())
 		{
 			// Set up pB, pC such that for forward motion, time = pB + pC * stepNumber
+			pC = currentSegment->CalcC(mp.cart.effectiveMmPerStep);
 			pB = currentSegment->CalcLinearB(distanceSoFar, timeSoFar);
 			state = DMState::cartLinear;
 		}
 		else
 		{
 			// Set up pA, pB, pC such that for forward motion, time = pB + sqrt(pA + pC * stepNumber)
+			pC = currentSegment->CalcC(mp.cart.effectiveMmPerStep);
 			pA = currentSegment->CalcNonlinearA(distanceSoFar);
 			pB = currentSegment->CalcNonlinearB(timeSoFar);
 			state = (currentSegment->IsAccelerating()) ? DMState::cartAccel : DMState::cartDecelNoReverse;
@@ -213,6 +245,57 @@ bool DriveMovement::NewDeltaSegment(const DDA& dda) noexcept
 
 #endif // SUPPORT_LINEAR_DELTA
 
+#if SUPPORT_NATIVE_ARCS || SUPPORT_MESH_Z_PROFILE
+
+// This is called when currentSegment has just been changed to a new segment of an arc move or of a move in which the Z motor follows the height map.
+// These motors can reverse several times in a segment, so unlike the other motion types we don't work out a step limit for the segment.
+// Instead the step time calculation moves on to the next segment when the distance moved reaches the end of the current one.
+void DriveMovement::NewPathSegment() noexcept
+{
+	// Set up pA, pB, pC such that time = pB + pC * distanceMoved for a linear segment, or pB +/- sqrt(pA + pC * distanceMoved) for an accelerating or decelerating segment
+	pC = currentSegment->GetC();
+	if (currentSegment->IsLinear())
+	{
+		pB = currentSegment->CalcLinearB(distanceSoFar, timeSoFar);
+	}
+	else
+	{
+		pA = currentSegment->CalcNonlinearA(distanceSoFar);
+		pB = currentSegment->CalcNonlinearB(timeSoFar);
+	}
+
+	distanceSoFar += currentSegment->GetSegmentLength();
+	timeSoFar += currentSegment->GetSegmentTime();
+}
+
+#endif
+
+#if SUPPORT_NATIVE_ARCS
+
+// Return the number of whole steps from the specified net step position to the extreme motor position reached at the end of the specified half turn.
+// This must give identical results when called from PrepareArcAxis and from the step ISR, so don't allow it to be inlined in case the compiler evaluates it differently.
+__attribute__((noinline)) uint32_t DriveMovement::ArcStepsToPeak(int32_t position, int32_t halfTurn) const noexcept
+{
+	const float peak = (((ArcEndsAtPositivePeak(halfTurn)) ? 1.0 : -1.0) - mp.arc.cosStartAngle)/mp.arc.recipRadiusSteps;
+	const float steps = (ArcEndsAtPositivePeak(halfTurn)) ? peak - (float)position : (float)position - peak;
+	return (steps > 0.0) ? (uint32_t)steps : 0;
+}
+
+#endif
+
+#if SUPPORT_MESH_Z_PROFILE
+
+// Return the number of whole steps from the specified net step position to the motor position at the end of the specified run of the height map profile.
+// This must give identical results when called from PrepareMeshZAxis and from the step ISR, so don't allow it to be inlined in case the compiler evaluates it differently.
+__attribute__((noinline)) uint32_t DriveMovement::MeshZStepsToPeak(int32_t position, uint32_t run) const noexcept
+{
+	const float peak = mp.meshZ.profile->positions[mp.meshZ.profile->runEnds[run]];
+	const float steps = (MeshZRunIsUp(run)) ? peak - (float)position : (float)position - peak;
+	return (steps > 0.0) ? (uint32_t)steps : 0;
+}
+
+#endif
+
 // This is called when currentSegment has just been changed to a new segment. Return true if there is a new segment to execute.
 bool DriveMovement::NewExtruderSegment() noexcept
 {
@@ -281,6 +364,8 @@ bool DriveMovement::PrepareCartesianAxis(const DDA& dda, const PrepParams& param
 	mp.cart.effectiveMmPerStep = 1.0/mp.cart.effectiveStepsPerMm;
 	isDelta = false;
 	isExtruder = false;
+	isArc = false;
+	isMeshZ = false;
 	currentSegment = (dda.shapedSegments != nullptr) ? dda.shapedSegments : dda.unshapedSegments;
 	nextStep = 0;									// must do this before calling NewCartesianSegment
 
@@ -294,7 +379,92 @@ bool DriveMovement::PrepareCartesianAxis(const DDA& dda, const PrepParams& param
 	stepsTakenThisSegment = 0;						// no steps taken yet since the start of the segment
 	stepsTillRecalc = 0;							// so that we don't skip the calculation
 	reverseStartStep = totalSteps + 1;				// no reverse phase
-	return CalcNextStepTime(dda);
+	if (!CalcNextStepTime(dda))
+	{
+		return false;
+	}
+
+	// If the move starts with acceleration and step time tables are enabled, precompute the fastest accelerating step times so that the step ISR doesn't need to
+	if (stepTable == nullptr && totalSteps > StepTimeTable::MinSteps && StepTimeTable::IsEnabled() && SegmentAccelerates(currentSegment))
+	{
+		FillStepTimeTable(dda);
+	}
+	return true;
+}
+
+// Return true if the speed of a Cartesian axis increases over the segment
+/*static*/ bool DriveMovement::SegmentAccelerates(const MoveSegment *seg) noexcept
+{
+	if (seg->IsLinear())
+	{
+		return false;
+	}
+	if (seg->IsCubic())
+	{
+		// The speed is b + 2ct + 3dt^2, so it is higher at the end of the segment than at the start if 2c + 3dT > 0
+		return 2.0 * seg->GetCubicC() + 3.0 * seg->GetCubicD() * seg->GetSegmentTime() > 0.0;
+	}
+	return seg->IsAccelerating();
+}
+
+// Calculate the times of the last steps of the accelerating phase at the start of this move and store them in a step time table.
+// The table only covers steps in the last accelerating segment and never the first step of that segment, so when the step ISR reaches the table
+// it is already executing that segment, and when it has used the table it moves on to the next segment in the usual way.
+// On entry the time of the first step has been calculated. We work on a copy of this DM, so apart from attaching the table its state is unchanged.
+// If the pool of tables is exhausted, or the calculation fails, or there are too few steps to bother with, then we don't attach a table.
+void DriveMovement::FillStepTimeTable(const DDA& dda) noexcept
+pre(nextStep == 1)
+{
+	// Find the last segment of the accelerating phase
+	DriveMovement dm(*this);
+	uint32_t segmentFirstStep = 1;
+	while (dm.segmentStepLimit <= totalSteps && SegmentAccelerates(dm.currentSegment->GetNext()))
+	{
+		MoveSegment * const nextSegment = dm.currentSegment->GetNext();
+		DriveMovement nextDm(dm);
+		nextDm.nextStep = dm.segmentStepLimit;						// the number of the first step in the next segment
+		nextDm.currentSegment = nextSegment;
+		if (!nextDm.NewCartesianSegment() || nextDm.currentSegment != nextSegment)
+		{
+			break;													// the next segment has no steps, so stop at this one
+		}
+		segmentFirstStep = nextDm.nextStep;
+		dm = nextDm;
+	}
+
+	const uint32_t lastStep = min<uint32_t>(dm.segmentStepLimit - 1, totalSteps);
+	const uint32_t firstStep = max<uint32_t>(segmentFirstStep + 1, (lastStep > StepTimeTable::TableLength) ? lastStep + 1 - StepTimeTable::TableLength : 1);
+	if (lastStep + 1 < firstStep + StepTimeTable::MinSteps)
+	{
+		return;
+	}
+
+	StepTimeTable * const table = StepTimeTable::Allocate();
+	if (table != nullptr)
+	{
+		// Calculate the step times from the start of the table. We have no previous step time, so make the calculation start from scratch.
+		dm.nextStep = firstStep - 1;
+		dm.nextStepTime = 0;
+		dm.stepsTakenThisSegment = 0;								// so that we use single stepping until we know the step interval
+		dm.stepsTillRecalc = 0;
+		for (uint32_t stepNumber = firstStep; stepNumber <= lastStep; ++stepNumber)
+		{
+			if (!dm.CalcNextStepTime(dda))
+			{
+				// Don't use a table, so that the step ISR finds and reports the step error when it gets to this step
+				StepTimeTable::Release(table);
+				return;
+			}
+			table->stepTimes[stepNumber - firstStep] = dm.nextStepTime;
+			if (stepNumber == firstStep)
+			{
+				dm.stepInterval = 0;								// the interval was calculated from the start of the move, so it is no use for estimating the next step time
+			}
+		}
+		table->firstStep = firstStep;
+		table->numSteps = lastStep + 1 - firstStep;
+		stepTable = table;
+	}
 }
 
 #if SUPPORT_LINEAR_DELTA
@@ -396,8 +566,22 @@ bool DriveMovement::PrepareDeltaAxis(const DDA& dda, const PrepParams& params) n
 	timeSoFar = 0.0;
 
 	isDelta = true;
+	isArc = false;
+	isMeshZ = false;
 	currentSegment = (dda.shapedSegments != nullptr) ? dda.shapedSegments : dda.unshapedSegments;
 
+#if SUPPORT_DELTA_STEP_PROFILES
+	// If we can, precompute an approximation to the distance against carriage height so that the ISR doesn't need to take a square root at each step
+	mp.delta.profile = (totalSteps >= DeltaStepProfile::MinSteps && DeltaStepProfile::IsEnabled()) ? DeltaStepProfile::Allocate() : nullptr;
+	if (mp.delta.profile != nullptr
+		&& !mp.delta.profile->Build(mp.delta.fMinusAaPlusBbTimesS, mp.delta.fDSquaredMinusAsquaredMinusBsquaredTimesSsquared, dda.directionVector[Z_AXIS],
+									mp.delta.fHmz0s, direction, reverseStartStep, totalSteps))
+	{
+		DeltaStepProfile::Release(mp.delta.profile);
+		mp.delta.profile = nullptr;
+	}
+#endif
+
 	nextStep = 0;									// must do this before calling NewDeltaSegment
 	if (!NewDeltaSegment(dda))
 	{
@@ -413,6 +597,185 @@ bool DriveMovement::PrepareDeltaAxis(const DDA& dda, const PrepParams& params) n
 
 #endif	// SUPPORT_LINEAR_DELTA
 
+#if SUPPORT_NATIVE_ARCS
+
+// Prepare this DM for a motor that follows an arc, returning true if there are steps to do.
+// On entry, direction and totalSteps describe the net movement of the motor.
+// The motor position is coefficient0 * axis0 + coefficient1 * axis1 where axis0 and axis1 are the arc axes, so relative to the arc centre it is R * cos(angle - phase)
+// where R is the arc radius multiplied by the magnitude of the coefficients and phase depends on the ratio of the coefficients.
+// Within each half turn of (angle - phase) the motor moves in one direction only, so there is a direction reversal at each multiple of 180 degrees.
+bool DriveMovement::PrepareArcAxis(const DDA& dda, const PrepParams& params, float coefficient0, float coefficient1) noexcept
+{
+	const float radiusSteps = dda.arc.radius * fastSqrtf(fsquare(coefficient0) + fsquare(coefficient1)) * reprap.GetPlatform().DriveStepsPerUnit(drive);
+	const float startAngle = dda.arc.startAngle - atan2f(coefficient1, coefficient0);
+	const float endAngle = startAngle + dda.arc.totalAngle;
+	mp.arc.recipRadiusSteps = 1.0/radiusSteps;
+	mp.arc.cosStartAngle = cosf(startAngle);
+	mp.arc.startAngle = startAngle;
+	mp.arc.mmPerRadian = dda.totalDistance/fabsf(dda.arc.totalAngle);
+	mp.arc.angleIncreasing = (dda.arc.totalAngle >= 0.0);
+	mp.arc.netSteps = 0;
+	mp.arc.finalNetSteps = (direction) ? (int32_t)totalSteps : -(int32_t)totalSteps;
+
+	// Find the first and last half turns of the arc. Half turn N runs from angle N * pi to angle (N + 1) * pi.
+	int32_t firstHalfTurn, numReversals;
+	if (mp.arc.angleIncreasing)
+	{
+		firstHalfTurn = (int32_t)floorf(startAngle * (1.0/Pi));
+		numReversals = (int32_t)ceilf(endAngle * (1.0/Pi)) - 1 - firstHalfTurn;
+	}
+	else
+	{
+		firstHalfTurn = (int32_t)ceilf(startAngle * (1.0/Pi)) - 1;
+		numReversals = firstHalfTurn - (int32_t)floorf(endAngle * (1.0/Pi));
+	}
+	if (numReversals < 0)
+	{
+		numReversals = 0;							// rounding error in a very short arc
+	}
+
+	// Work out how many steps we take in each half turn. If rounding of the final motor position means that the motor would have to move backwards
+	// after the last reversal, then the last reversal is too small to do, so we remove it and repeat the calculation.
+	uint32_t stepsBeforeFinalHalfTurn;
+	int32_t finalHalfTurnSteps;
+	for (;;)
+	{
+		stepsBeforeFinalHalfTurn = 0;
+		int32_t position = 0;
+		int32_t halfTurn = firstHalfTurn;
+		for (int32_t i = 0; i < numReversals; ++i)
+		{
+			const uint32_t steps = ArcStepsToPeak(position, halfTurn);
+			stepsBeforeFinalHalfTurn += steps;
+			position += (ArcEndsAtPositivePeak(halfTurn)) ? (int32_t)steps : -(int32_t)steps;
+			halfTurn += (mp.arc.angleIncreasing) ? 1 : -1;
+		}
+		finalHalfTurnSteps = (ArcEndsAtPositivePeak(halfTurn)) ? mp.arc.finalNetSteps - position : position - mp.arc.finalNetSteps;
+		if (finalHalfTurnSteps >= 0 || numReversals == 0)
+		{
+			break;
+		}
+		--numReversals;
+	}
+
+	mp.arc.halfTurn = (int16_t)firstHalfTurn;
+	mp.arc.reversalsLeft = (uint8_t)numReversals;
+	if (numReversals == 0)
+	{
+		// No reversal, so direction and totalSteps are already correct
+		reverseStartStep = totalSteps + 1;
+	}
+	else
+	{
+		direction = ArcEndsAtPositivePeak(firstHalfTurn);
+		totalSteps = stepsBeforeFinalHalfTurn + (uint32_t)finalHalfTurnSteps;
+		reverseStartStep = ArcStepsToPeak(0, firstHalfTurn) + 1;
+	}
+
+	if (totalSteps == 0)
+	{
+		nextStep = 0;
+		return false;
+	}
+
+	distanceSoFar = 0.0;
+	timeSoFar = 0.0;
+	isDelta = false;
+	isExtruder = false;
+	isArc = true;
+	isMeshZ = false;
+	currentSegment = (dda.shapedSegments != nullptr) ? dda.shapedSegments : dda.unshapedSegments;
+	NewPathSegment();
+	segmentStepLimit = totalSteps + 1;				// we never change segment on a step count
+	state = DMState::arcMotion;
+
+	// Prepare for the first step
+	nextStep = 0;
+	nextStepTime = 0;
+	stepsTakenThisSegment = 0;						// no steps taken yet since the start of the segment
+	stepsTillRecalc = 0;							// so that we don't skip the calculation
+	return CalcNextStepTime(dda);
+}
+
+#endif
+
+#if SUPPORT_MESH_Z_PROFILE
+
+// Prepare this DM for a Z motor that follows the height map, returning true if there are steps to do.
+// On entry, direction and totalSteps describe the net movement of the motor.
+// The profile is made of straight pieces grouped into runs in which the motor moves in one direction only, so there is a direction reversal at the end of each run except the last.
+bool DriveMovement::PrepareMeshZAxis(const DDA& dda, const PrepParams& params) noexcept
+{
+	const MeshZProfile& profile = *dda.meshZProfile;
+	mp.meshZ.profile = &profile;
+	mp.meshZ.netSteps = 0;
+	mp.meshZ.finalNetSteps = (direction) ? (int32_t)totalSteps : -(int32_t)totalSteps;
+
+	// Work out how many steps we take in each run. If rounding of the final motor position means that the motor would have to move backwards
+	// after the last reversal, then the last reversal is too small to do, so we remove it and repeat the calculation.
+	int32_t numReversals = (int32_t)profile.numRuns - 1;
+	uint32_t stepsBeforeFinalRun;
+	int32_t finalRunSteps;
+	for (;;)
+	{
+		stepsBeforeFinalRun = 0;
+		int32_t position = 0;
+		for (int32_t run = 0; run < numReversals; ++run)
+		{
+			const uint32_t steps = MeshZStepsToPeak(position, run);
+			stepsBeforeFinalRun += steps;
+			position += (MeshZRunIsUp(run)) ? (int32_t)steps : -(int32_t)steps;
+		}
+		finalRunSteps = (MeshZRunIsUp(numReversals)) ? mp.meshZ.finalNetSteps - position : position - mp.meshZ.finalNetSteps;
+		if (finalRunSteps >= 0 || numReversals == 0)
+		{
+			break;
+		}
+		--numReversals;
+	}
+
+	mp.meshZ.piece = 0;
+	mp.meshZ.run = 0;
+	mp.meshZ.reversalsLeft = (uint8_t)numReversals;
+	if (numReversals == 0)
+	{
+		// No reversal, so direction and totalSteps are already correct
+		reverseStartStep = totalSteps + 1;
+	}
+	else
+	{
+		direction = MeshZRunIsUp(0);
+		totalSteps = stepsBeforeFinalRun + (uint32_t)finalRunSteps;
+		reverseStartStep = MeshZStepsToPeak(0, 0) + 1;
+	}
+
+	if (totalSteps == 0)
+	{
+		nextStep = 0;
+		return false;
+	}
+
+	distanceSoFar = 0.0;
+	timeSoFar = 0.0;
+	isDelta = false;
+	isExtruder = false;
+	isArc = false;
+	isMeshZ = true;
+	currentSegment = (dda.shapedSegments != nullptr) ? dda.shapedSegments : dda.unshapedSegments;
+	NewPathSegment();
+	segmentStepLimit = totalSteps + 1;				// we never change segment on a step count
+	state = DMState::meshZMotion;
+
+	// Prepare for the first step
+	nextStep = 0;
+	nextStepTime = 0;
+	stepsTakenThisSegment = 0;						// no steps taken yet since the start of the segment
+	stepsTillRecalc = 0;							// so that we don't skip the calculation
+	return CalcNextStepTime(dda);
+}
+
+#endif
+
 // Prepare this DM for an extruder move, returning true if there are steps to do
 // If there are no steps to do, set nextStep = 0 so that DDARing::CurrentMoveCompleted doesn't add any steps to the movement accumulator
 // We have already generated the extruder segments and we know that there are some
@@ -625,6 +988,8 @@ bool DriveMovement::PrepareExtruder(const DDA& dda, const PrepParams& params) no
 	currentSegment = dda.unshapedSegments;
 	isDelta = false;
 	isExtruder = true;
+	isArc = false;
+	isMeshZ = false;
 
 	nextStep = 0;									// must do this before calling NewExtruderSegment
 	if (!NewExtruderSegment())
@@ -645,6 +1010,88 @@ static inline float fastLimSqrtf(float f) noexcept
 	return (f > 0.0) ? fastSqrtf(f) : 0.0;
 }
 
+// Calculate the time at which the specified step is due in a cubic segment, using Newton-Raphson iteration safeguarded by bisection.
+// If we have already calculated a step time for this move then we start from the time of the previous step plus the previous interval per step,
+// even if that step was in an earlier segment. This normally converges in one or two iterations.
+// Otherwise this is the first step of the move, which is calculated when the move is prepared rather than in the step ISR, so we can afford to start from
+// a closed-form estimate that needs a cube root. For a move that starts with a segment that accelerates from rest pA and pB are zero, so the estimate is exact.
+// The step count increases monotonically with time in the segment, so we keep a bracket around the solution and bisect it if a Newton step would leave it,
+// which happens where the derivative is zero at the start of a segment that accelerates from rest or at the end of one that decelerates to rest.
+// Return false if the iteration didn't converge, in which case the step time is not valid.
+bool DriveMovement::CalcCubicStepTime(uint32_t stepNumber, float& stepTime) const noexcept
+{
+	constexpr unsigned int MaxIterations = 8;
+	constexpr float Tolerance = 0.1;									// stop iterating when the time changes by less than this number of step clocks
+	constexpr float StepTolerance = 0.001;								// or when the position is within this fraction of a step
+
+	const float segmentClocks = timeSoFar - mp.cart.cubicStartTime;	// timeSoFar is the end time of this segment
+	const float stepsToDo = (float)stepNumber - mp.cart.cubicStartSteps;
+	if (stepsToDo <= 0.0)
+	{
+		stepTime = mp.cart.cubicStartTime;
+		return true;
+	}
+	if (stepsToDo >= segmentClocks * (pA + segmentClocks * (pB + segmentClocks * pC)))
+	{
+		stepTime = timeSoFar;											// the step is due at the end of the segment, allowing for rounding error
+		return true;
+	}
+
+	float t;
+	if (nextStepTime != 0)
+	{
+		t = (float)nextStepTime - mp.cart.cubicStartTime + (float)((stepNumber - (nextStep - 1)) * stepInterval);
+	}
+	else
+	{
+		// Each term of the cubic on its own that has a positive coefficient gives an upper bound on the time, so use the smallest of them
+		t = segmentClocks;
+		if (pC > 0.0)
+		{
+			t = min<float>(t, cbrtf(stepsToDo/pC));
+		}
+		if (pB > 0.0)
+		{
+			t = min<float>(t, fastLimSqrtf(stepsToDo/pB));
+		}
+		if (pA > 0.0)
+		{
+			t = min<float>(t, stepsToDo/pA);
+		}
+	}
+
+	float low = 0.0, high = segmentClocks;
+	t = constrain<float>(t, low, high);
+	for (unsigned int i = 0; i < MaxIterations; ++i)
+	{
+		const float error = t * (pA + t * (pB + t * pC)) - stepsToDo;
+		if (fabsf(error) < StepTolerance)
+		{
+			stepTime = mp.cart.cubicStartTime + t;						// close enough, and Newton converges slowly near the end of a segment that decelerates to rest
+			return true;
+		}
+		if (error < 0.0)
+		{
+			low = t;
+		}
+		else
+		{
+			high = t;
+		}
+
+		const float derivative = pA + t * (2.0 * pB + t * 3.0 * pC);
+		const float newT = (derivative > 0.0) ? t - error/derivative : -1.0;
+		const float correction = (newT >= low && newT <= high) ? t - newT : t - 0.5 * (low + high);
+		t -= correction;
+		if (fabsf(correction) < Tolerance || high - low < Tolerance)
+		{
+			stepTime = mp.cart.cubicStartTime + t;
+			return true;
+		}
+	}
+	return false;
+}
+
 // Calculate and store the time since the start of the move when the next step for the specified DriveMovement is due.
 // We have already incremented nextStep and checked that it does not exceed totalSteps, so at least one more step is due
 // Return true if all OK, false to abort this move because the calculation has gone wrong
@@ -724,6 +1171,15 @@ pre(nextStep <= totalSteps; stepsTillRecalc == 0)
 		nextCalcStepTime = pB + fastLimSqrtf(pA + pC * (float)(nextStep + stepsTillRecalc));
 		break;
 
+	case DMState::cartCubic:									// Cartesian with constant jerk
+		if (!CalcCubicStepTime(nextStep + stepsTillRecalc, nextCalcStepTime))
+		{
+			state = DMState::stepError;
+			nextStep += 150000000 + stepsTillRecalc;			// so we can tell what happened in the debug print
+			return false;
+		}
+		break;
+
 	case DMState::cartDecelForwardsReversing:
 		if (nextStep + stepsTillRecalc < reverseStartStep)
 		{
@@ -764,28 +1220,114 @@ pre(nextStep <= totalSteps; stepsTillRecalc == 0)
 				mp.delta.fHmz0s -= steps;						// get new carriage height above Z in steps
 			}
 
-			const float hmz0sc = mp.delta.fHmz0s * dda.directionVector[Z_AXIS];
-			const float t1 = mp.delta.fMinusAaPlusBbTimesS + hmz0sc;
-			const float t2a = mp.delta.fDSquaredMinusAsquaredMinusBsquaredTimesSsquared - fsquare(mp.delta.fHmz0s) + fsquare(t1);
-			// Due to rounding error we can end up trying to take the square root of a negative number if we do not take precautions here
-			const float t2 = fastLimSqrtf(t2a);
-			const float ds = (direction) ? t1 - t2 : t1 + t2;
+			float ds;
+#if SUPPORT_DELTA_STEP_PROFILES
+			if (mp.delta.profile == nullptr || std::isnan(ds = mp.delta.profile->GetDistance(mp.delta.fHmz0s, direction)))
+#endif
+			{
+				const float hmz0sc = mp.delta.fHmz0s * dda.directionVector[Z_AXIS];
+				const float t1 = mp.delta.fMinusAaPlusBbTimesS + hmz0sc;
+				const float t2a = mp.delta.fDSquaredMinusAsquaredMinusBsquaredTimesSsquared - fsquare(mp.delta.fHmz0s) + fsquare(t1);
+				// Due to rounding error we can end up trying to take the square root of a negative number if we do not take precautions here
+				const float t2 = fastLimSqrtf(t2a);
+				ds = (direction) ? t1 - t2 : t1 + t2;
+				if (ds < 0.0)
+				{
+					state = DMState::stepError;
+					nextStep += 110000000;						// so that we can tell what happened in the debug print
+					return false;
+				}
+			}
 
 			// Now feed ds into the step algorithm for Cartesian motion
-			if (ds < 0.0)
+
+			const float pCds = pC * ds;
+			nextCalcStepTime = (currentSegment->IsLinear()) ? pB + pCds
+								: (currentSegment->IsAccelerating()) ? pB + fastLimSqrtf(pA + pCds)
+									 : pB - fastLimSqrtf(pA + pCds);
+			//if (currentSegment->IsLinear()) { pA = ds; }	//DEBUG
+		}
+		break;
+
+#if SUPPORT_NATIVE_ARCS
+	case DMState::arcMotion:
+		{
+			// Do any direction reversals due at this step. The loop handles the case of a half turn in which we take no steps.
+			while (nextStep == reverseStartStep)
 			{
-				state = DMState::stepError;
-				nextStep += 110000000;							// so that we can tell what happened in the debug print
-				return false;
+				direction = !direction;
+				directionChanged = true;
+				mp.arc.halfTurn += (mp.arc.angleIncreasing) ? 1 : -1;
+				--mp.arc.reversalsLeft;
+				reverseStartStep = (mp.arc.reversalsLeft == 0) ? totalSteps + 1 : nextStep + ArcStepsToPeak(mp.arc.netSteps, mp.arc.halfTurn);
+			}
+
+			// Calculate the angle at which the motor reaches the position after these steps, then the distance moved along the path at that angle
+			const int32_t steps = (int32_t)(1u << shiftFactor);
+			mp.arc.netSteps += (direction) ? steps : -steps;
+			const float cosAngle = constrain<float>(mp.arc.cosStartAngle + (float)mp.arc.netSteps * mp.arc.recipRadiusSteps, -1.0, 1.0);
+			const float angle = (float)mp.arc.halfTurn * Pi + (((mp.arc.halfTurn & 1) != 0) ? Pi - acosf(cosAngle) : acosf(cosAngle));
+			const float ds = max<float>(((mp.arc.angleIncreasing) ? angle - mp.arc.startAngle : mp.arc.startAngle - angle) * mp.arc.mmPerRadian, 0.0);
+			while (ds > distanceSoFar && currentSegment->GetNext() != nullptr)
+			{
+				currentSegment = currentSegment->GetNext();
+				NewPathSegment();
 			}
 
+			// Now feed ds into the step algorithm for Cartesian motion
 			const float pCds = pC * ds;
 			nextCalcStepTime = (currentSegment->IsLinear()) ? pB + pCds
 								: (currentSegment->IsAccelerating()) ? pB + fastLimSqrtf(pA + pCds)
 									 : pB - fastLimSqrtf(pA + pCds);
-			//if (currentSegment->IsLinear()) { pA = ds; }	//DEBUG
 		}
 		break;
+#endif
+
+#if SUPPORT_MESH_Z_PROFILE
+	case DMState::meshZMotion:
+		{
+			const MeshZProfile& profile = *mp.meshZ.profile;
+
+			// Do any direction reversals due at this step. The loop handles the case of a run in which we take no steps.
+			while (nextStep == reverseStartStep)
+			{
+				direction = !direction;
+				directionChanged = true;
+				mp.meshZ.piece = profile.runEnds[mp.meshZ.run];
+				++mp.meshZ.run;
+				--mp.meshZ.reversalsLeft;
+				reverseStartStep = (mp.meshZ.reversalsLeft == 0) ? totalSteps + 1 : nextStep + MeshZStepsToPeak(mp.meshZ.netSteps, mp.meshZ.run);
+			}
+
+			const int32_t steps = (int32_t)(1u << shiftFactor);
+			mp.meshZ.netSteps += (direction) ? steps : -steps;
+
+			// Find the piece of the current run that contains the motor position after these steps, then the distance moved along the path at that position
+			const float position = (float)mp.meshZ.netSteps;
+			const unsigned int lastPiece = (mp.meshZ.reversalsLeft == 0) ? profile.numPoints - 2 : profile.runEnds[mp.meshZ.run] - 1;
+			while (   mp.meshZ.piece < lastPiece
+				   && ((direction) ? position > profile.positions[mp.meshZ.piece + 1] : position < profile.positions[mp.meshZ.piece + 1])
+				  )
+			{
+				++mp.meshZ.piece;
+			}
+			const unsigned int piece = mp.meshZ.piece;
+			const float ds = constrain<float>(profile.distances[piece] + (position - profile.positions[piece]) * profile.mmPerStep[piece],
+												profile.distances[piece], profile.distances[piece + 1]);
+			while (ds > distanceSoFar && currentSegment->GetNext() != nullptr)
+			{
+				currentSegment = currentSegment->GetNext();
+				NewPathSegment();
+			}
+
+			// Now feed ds into the step algorithm for Cartesian motion
+			const float pCds = pC * ds;
+			nextCalcStepTime = (currentSegment->IsLinear()) ? pB + pCds
+								: (currentSegment->IsAccelerating()) ? pB + fastLimSqrtf(pA + pCds)
+									 : pB - fastLimSqrtf(pA + pCds);
+		}
+		break;
+#endif
 
 	default:
 		return false;
@@ -11,6 +11,9 @@
 #include <RepRapFirmware.h>
 #include <Platform/Tasks.h>
 #include "MoveSegment.h"
+#include "StepTimeTable.h"
+#include "MeshZProfile.h"
+#include "DeltaStepProfile.h"
 
 class LinearDeltaKinematics;
 class PrepParams;
@@ -30,9 +33,13 @@ enum class DMState : uint8_t
 	cartDecelNoReverse,
 	cartDecelForwardsReversing,						// linear decelerating motion, expect reversal
 	cartDecelReverse,								// linear decelerating motion, reversed
+	cartCubic,										// linear motion with constant jerk
 
 	deltaNormal,									// moving forwards without reversing in this segment, or in reverse
 	deltaForwardsReversing,							// moving forwards to start with, reversing before the end of this segment
+
+	arcMotion,										// following an arc, reversing direction at each extreme of the motor position
+	meshZMotion,									// following the height map, reversing direction at each peak and trough of the profile
 };
 
 // This class describes a single movement of one drive
@@ -54,6 +61,12 @@ public:
 	bool PrepareDeltaAxis(const DDA& dda, const PrepParams& params) noexcept SPEED_CRITICAL;
 #endif
 	bool PrepareExtruder(const DDA& dda, const PrepParams& params) noexcept SPEED_CRITICAL;
+#if SUPPORT_NATIVE_ARCS
+	bool PrepareArcAxis(const DDA& dda, const PrepParams& params, float coefficient0, float coefficient1) noexcept SPEED_CRITICAL;
+#endif
+#if SUPPORT_MESH_Z_PROFILE
+	bool PrepareMeshZAxis(const DDA& dda, const PrepParams& params) noexcept SPEED_CRITICAL;
+#endif
 
 	void DebugPrint() const noexcept;
 	int32_t GetNetStepsLeft() const noexcept;
@@ -71,10 +84,24 @@ public:
 private:
 	bool CalcNextStepTimeFull(const DDA &dda) noexcept SPEED_CRITICAL;
 	bool NewCartesianSegment() noexcept SPEED_CRITICAL;
+	bool CalcCubicStepTime(uint32_t stepNumber, float& stepTime) const noexcept SPEED_CRITICAL;
 	bool NewExtruderSegment() noexcept SPEED_CRITICAL;
 #if SUPPORT_LINEAR_DELTA
 	bool NewDeltaSegment(const DDA& dda) noexcept SPEED_CRITICAL;
 #endif
+#if SUPPORT_NATIVE_ARCS || SUPPORT_MESH_Z_PROFILE
+	void NewPathSegment() noexcept SPEED_CRITICAL;
+#endif
+#if SUPPORT_NATIVE_ARCS
+	uint32_t ArcStepsToPeak(int32_t position, int32_t halfTurn) const noexcept SPEED_CRITICAL;
+	bool ArcEndsAtPositivePeak(int32_t halfTurn) const noexcept { return ((halfTurn & 1) != 0) == mp.arc.angleIncreasing; }
+#endif
+#if SUPPORT_MESH_Z_PROFILE
+	uint32_t MeshZStepsToPeak(int32_t position, uint32_t run) const noexcept SPEED_CRITICAL;
+	bool MeshZRunIsUp(uint32_t run) const noexcept { return ((run & 1) == 0) == mp.meshZ.profile->firstRunUp; }
+#endif
+	void FillStepTimeTable(const DDA& dda) noexcept;
+	static bool SegmentAccelerates(const MoveSegment *seg) noexcept;
 
 	static DriveMovement *freeList;
 	static unsigned int numCreated;
@@ -83,6 +110,7 @@ private:
 
 	DriveMovement *nextDM;								// link to next DM that needs a step
 	MoveSegment *currentSegment;
+	StepTimeTable *stepTable;							// precomputed times for the fastest accelerating steps of this move, or nullptr
 
 	DMState state;										// whether this is active or not
 	uint8_t drive;										// the drive that this DM controls
@@ -90,7 +118,8 @@ private:
 			directionChanged : 1,						// set by CalcNextStepTime if the direction is changed
 			isDelta : 1,								// true if this DM uses segment-free delta kinematics
 			isExtruder : 1,								// true if this DM is for an extruder (only matters if !isDelta)
-					: 2,								// padding to make the next field last
+			isArc : 1,									// true if this DM is for a motor that follows an arc
+			isMeshZ : 1,								// true if this DM is for a Z motor that follows the height map
 			stepsTakenThisSegment : 2;					// how many steps we have taken this phase, counts from 0 to 2. Last field in the byte so that we can increment it efficiently.
 	uint8_t stepsTillRecalc;							// how soon we need to recalculate
 
@@ -107,7 +136,7 @@ private:
 	float timeSoFar;
 	float pA, pB, pC;
 
-	// Parameters unique to a style of move (Cartesian, delta or extruder). Currently, extruders and Cartesian moves use the same parameters.
+	// Parameters unique to a style of move (Cartesian, delta, arc or extruder). Currently, extruders and Cartesian moves use the same parameters.
 	union
 	{
 		struct DeltaParameters							// Parameters for delta movement
@@ -120,6 +149,9 @@ private:
 			float fHmz0s;								// the starting height less the starting Z height, multiplied by the Z movement fraction (can go negative)
 			float fMinusAaPlusBbTimesS;
 			float reverseStartDistance;					// the overall move distance at which movement reversal occurs
+#if SUPPORT_DELTA_STEP_PROFILES
+			DeltaStepProfile *profile;					// the approximation of the distance against carriage height, or nullptr
+#endif
 		} delta;
 
 		struct CartesianParameters
@@ -129,7 +161,36 @@ private:
 			float effectiveMmPerStep;					// reciprocal of [the steps/mm multiplied by the movement fraction]
 			float extraExtrusionDistance;				// the extra extrusion distance in the acceleration phase
 			float extrusionBroughtForwards;				// the amount of extrusion brought forwards from previous moves. Only needed for debug output.
+			float cubicStartSteps;						// the step position at the start of the current cubic segment
+			float cubicStartTime;						// the time at which the current cubic segment started
 		} cart;
+
+#if SUPPORT_NATIVE_ARCS
+		struct ArcParameters							// Parameters for a motor following an arc. The motor position relative to the arc centre is R * cos(angle).
+		{
+			float recipRadiusSteps;						// the reciprocal of R, where R is the amplitude of the motor movement in steps
+			float cosStartAngle;						// the cosine of the angle at the start of the move
+			float startAngle;							// the angle at the start of the move, allowing for the phase of the motor
+			float mmPerRadian;							// the distance moved along the path of the move per radian of arc
+			int32_t netSteps;							// the net steps taken so far including those in the current group of steps
+			int32_t finalNetSteps;						// the net steps at the end of the move
+			int16_t halfTurn;							// the number of half turns from zero angle to the start of the half turn we are in
+			uint8_t reversalsLeft;						// the number of direction reversals still to do
+			bool angleIncreasing;						// true if the angle increases during the move
+		} arc;
+#endif
+
+#if SUPPORT_MESH_Z_PROFILE
+		struct MeshZParameters							// Parameters for a Z motor following the height map
+		{
+			const MeshZProfile *profile;				// the profile of the Z motor position against distance moved, owned by the DDA
+			int32_t netSteps;							// the net steps taken so far including those in the current group of steps
+			int32_t finalNetSteps;						// the net steps at the end of the move
+			uint8_t piece;								// the piece of the profile that we are in
+			uint8_t run;								// the run of pieces in the same direction that we are in
+			uint8_t reversalsLeft;						// the number of direction reversals still to do
+		} meshZ;
+#endif
 	} mp;
 };
 
@@ -142,6 +203,22 @@ inline bool DriveMovement::CalcNextStepTime(const DDA &dda) noexcept
 	++nextStep;
 	if (nextStep <= totalSteps)
 	{
+		if (stepTable != nullptr && stepTable->Covers(nextStep))
+		{
+			const uint32_t tabledStepTime = stepTable->GetStepTime(nextStep);	// the step time was calculated when the move was prepared
+			stepInterval = (tabledStepTime > nextStepTime) ? tabledStepTime - nextStepTime : 0;	// keep this up to date for the calculation after the table
+			nextStepTime = tabledStepTime;
+			stepsTillRecalc = 0;									// the table overrides any double/quad/octal stepping
+#if defined(DUET3_MB6HC) || STM32H7				// we need to increase the minimum step pulse length to be long enough for the TMC5160
+			asm volatile("nop");
+			asm volatile("nop");
+			asm volatile("nop");
+			asm volatile("nop");
+			asm volatile("nop");
+			asm volatile("nop");
+#endif
+			return true;
+		}
 		if (stepsTillRecalc != 0)
 		{
 			--stepsTillRecalc;				// we are doing double/quad/octal stepping
@@ -177,6 +254,19 @@ inline bool DriveMovement::CalcNextStepTime(const DDA &dda) noexcept
 // We have already taken nextSteps - 1 steps, unless nextStep is zero.
 inline int32_t DriveMovement::GetNetStepsLeft() const noexcept
 {
+#if SUPPORT_NATIVE_ARCS
+	if (isArc)
+	{
+		return mp.arc.finalNetSteps - GetNetStepsTaken();
+	}
+#endif
+#if SUPPORT_MESH_Z_PROFILE
+	if (isMeshZ)
+	{
+		return mp.meshZ.finalNetSteps - GetNetStepsTaken();
+	}
+#endif
+
 	int32_t netStepsLeft;
 	if (reverseStartStep > totalSteps)		// if no reverse phase
 	{
@@ -198,6 +288,22 @@ inline int32_t DriveMovement::GetNetStepsLeft() const noexcept
 // We have already taken nextSteps - 1 steps, unless nextStep is zero.
 inline int32_t DriveMovement::GetNetStepsTaken() const noexcept
 {
+#if SUPPORT_NATIVE_ARCS
+	if (isArc)
+	{
+		// The net steps include the steps in the current group that we haven't taken yet
+		const int32_t stepsPending = (nextStep <= totalSteps) ? (int32_t)stepsTillRecalc + 1 : 0;
+		return (direction) ? mp.arc.netSteps - stepsPending : mp.arc.netSteps + stepsPending;
+	}
+#endif
+#if SUPPORT_MESH_Z_PROFILE
+	if (isMeshZ)
+	{
+		const int32_t stepsPending = (nextStep <= totalSteps) ? (int32_t)stepsTillRecalc + 1 : 0;
+		return (direction) ? mp.meshZ.netSteps - stepsPending : mp.meshZ.netSteps + stepsPending;
+	}
+#endif
+
 	int32_t netStepsTaken;
 	if (nextStep < reverseStartStep || reverseStartStep > totalSteps)				// if no reverse phase, or not started it yet
 	{
@@ -213,6 +319,18 @@ inline int32_t DriveMovement::GetNetStepsTaken() const noexcept
 // This is inlined because it is only called from one place
 inline void DriveMovement::Release(DriveMovement *item) noexcept
 {
+	if (item->stepTable != nullptr)
+	{
+		StepTimeTable::Release(item->stepTable);
+		item->stepTable = nullptr;
+	}
+#if SUPPORT_DELTA_STEP_PROFILES
+	if (item->isDelta && item->mp.delta.profile != nullptr)
+	{
+		DeltaStepProfile::Release(item->mp.delta.profile);
+		item->mp.delta.profile = nullptr;
+	}
+#endif
 	item->nextDM = freeList;
 	freeList = item;
 }
@@ -20,6 +20,8 @@ union InputShaperPlan
 				 shapeDecelStart : 1,
 				 shapeDecelEnd : 1,
 				 shapeDecelOverlapped : 1,
+				 scurveAccel : 1,
+				 scurveDecel : 1,
 				 debugPrint : 1;
 	};
 	uint32_t all;
@@ -28,7 +30,7 @@ union InputShaperPlan
 
 	void Clear() noexcept { all = 0; }
 
-	bool IsShaped() const noexcept { return shapeAccelStart || shapeAccelEnd || shapeAccelOverlapped || shapeDecelStart || shapeDecelEnd || shapeDecelOverlapped; }
+	bool IsShaped() const noexcept { return shapeAccelStart || shapeAccelEnd || shapeAccelOverlapped || shapeDecelStart || shapeDecelEnd || shapeDecelOverlapped || scurveAccel || scurveDecel; }
 };
 
 
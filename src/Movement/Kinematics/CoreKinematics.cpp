@@ -463,4 +463,36 @@ AxesBitmap CoreKinematics::GetLinearAxes() const noexcept
 	return AxesBitmap::MakeLowestNBits(reprap.GetGCodes().GetVisibleAxes());	// we can babystep all axes
 }
 
+#if SUPPORT_NATIVE_ARCS
+
+// Return true if a circular arc in the plane of the specified axes can be executed as a single move.
+// This is true unless a motor that moves either of those axes also moves another axis, as on CoreXZ and CoreXYU machines.
+bool CoreKinematics::SupportsNativeArcs(size_t axis0, size_t axis1) const noexcept
+{
+	for (size_t motor = 0; motor < MaxAxes; ++motor)
+	{
+		if (inverseMatrix(axis0, motor) != 0.0 || inverseMatrix(axis1, motor) != 0.0)
+		{
+			for (size_t axis = 0; axis < MaxAxes; ++axis)
+			{
+				if (axis != axis0 && axis != axis1 && inverseMatrix(axis, motor) != 0.0)
+				{
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+// If the specified motor is moved by either of the specified axes, return true and the contribution of each axis to the motor position
+bool CoreKinematics::GetArcMotorCoefficients(size_t motor, size_t axis0, size_t axis1, float& coefficient0, float& coefficient1) const noexcept
+{
+	coefficient0 = inverseMatrix(axis0, motor);
+	coefficient1 = inverseMatrix(axis1, motor);
+	return coefficient0 != 0.0 || coefficient1 != 0.0;
+}
+
+#endif
+
 // End
@@ -766,6 +766,34 @@ bool FiveBarScaraKinematics::CartesianToMotorSteps(const float machinePos[], con
 	return true;
 }
 
+// Convert a batch of Cartesian positions to motor positions, returning the number converted
+size_t FiveBarScaraKinematics::CartesianToMotorStepsBatch(const float machinePos[][MaxAxes], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes,
+															int32_t motorPos[][MaxAxes], size_t numPoints, bool isCoordinated) const noexcept
+{
+	const float leftStepsPerDegree = stepsPerMm[X_AXIS];
+	const float rightStepsPerDegree = stepsPerMm[Y_AXIS];
+	size_t i = 0;
+	for (; i < numPoints; ++i)
+	{
+		const float * const pos = machinePos[i];
+		const float coords[2] = { pos[X_AXIS], pos[Y_AXIS] };
+		getInverse(coords);
+		if (!constraintsOk(coords))
+		{
+			break;
+		}
+
+		int32_t * const motors = motorPos[i];
+		motors[X_AXIS] = lrintf(cachedThetaL * leftStepsPerDegree);
+		motors[Y_AXIS] = lrintf(cachedThetaR * rightStepsPerDegree);
+		for (size_t axis = Z_AXIS; axis < numVisibleAxes; ++axis)
+		{
+			motors[axis] = lrintf(pos[axis] * stepsPerMm[axis]);
+		}
+	}
+	return i;
+}
+
 // Convert motor coordinates to machine coordinates. Used after homing and after individual motor moves.
 // For Scara, the X and Y components of stepsPerMm are actually steps per degree angle.
 void FiveBarScaraKinematics::MotorStepsToCartesian(const int32_t motorPos[], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes, float machinePos[]) const noexcept
@@ -294,6 +294,25 @@ bool HangprinterKinematics::CartesianToMotorSteps(const float machinePos[], cons
 	return true;
 }
 
+// Convert a batch of Cartesian positions to motor positions, returning the number converted.
+// We do one anchor at a time so that the constants for that anchor stay in registers.
+size_t HangprinterKinematics::CartesianToMotorStepsBatch(const float machinePos[][MaxAxes], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes,
+															int32_t motorPos[][MaxAxes], size_t numPoints, bool isCoordinated) const noexcept
+{
+	for (size_t anchor = 0; anchor < HANGPRINTER_AXES; ++anchor)
+	{
+		const float anchorX = anchors[anchor][X_AXIS], anchorY = anchors[anchor][Y_AXIS], anchorZ = anchors[anchor][Z_AXIS];
+		const float origin = lineLengthsOrigin[anchor];
+		const float motorK0 = k0[anchor], motorK2 = k2[anchor], spoolRadius = spoolRadii[anchor], spoolRadiusSquared = spoolRadiiSq[anchor];
+		for (size_t i = 0; i < numPoints; ++i)
+		{
+			const float * const pos = machinePos[i];
+			const float linePos = fastSqrtf(fsquare(anchorZ - pos[Z_AXIS]) + fsquare(anchorY - pos[Y_AXIS]) + fsquare(anchorX - pos[X_AXIS])) - origin;
+			motorPos[i][anchor] = lrintf(motorK0 * (fastSqrtf(spoolRadiusSquared + linePos * motorK2) - spoolRadius));
+		}
+	}
+	return numPoints;
+}
 
 inline float HangprinterKinematics::MotorPosToLinePos(const int32_t motorPos, size_t axis) const noexcept
 {
@@ -22,6 +22,8 @@ public:
 	const char *GetName(bool forStatusReport) const noexcept override;
 	bool Configure(unsigned int mCode, GCodeBuffer& gb, const StringRef& reply, bool& error) THROWS(GCodeException) override;
 	bool CartesianToMotorSteps(const float machinePos[], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes, int32_t motorPos[], bool isCoordinated) const noexcept override;
+	size_t CartesianToMotorStepsBatch(const float machinePos[][MaxAxes], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes,
+										int32_t motorPos[][MaxAxes], size_t numPoints, bool isCoordinated) const noexcept override;
 	void MotorStepsToCartesian(const int32_t motorPos[], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes, float machinePos[]) const noexcept override;
 	bool SupportsAutoCalibration() const noexcept override { return true; }
 	bool IsReachable(float axesCoords[MaxAxes], AxesBitmap axes) const noexcept override;
@@ -40,11 +40,14 @@ constexpr ObjectModelTableEntry Kinematics::objectModelTable[] =
 	{ "segmentation",		OBJECT_MODEL_FUNC_IF(self->segmentationType.useSegmentation, self, 1), 	ObjectModelEntryFlags::none },
 
 	// 1. segmentation members
+	{ "chordError",			OBJECT_MODEL_FUNC_IF(self->UseAdaptiveSegmentation(), self->chordError, 4), ObjectModelEntryFlags::none },
+	{ "maxChordError",		OBJECT_MODEL_FUNC(self->maxChordError, 3), 								ObjectModelEntryFlags::none },
 	{ "minSegLength",		OBJECT_MODEL_FUNC(self->minSegmentLength, 2), 							ObjectModelEntryFlags::none },
+	{ "segmentRate",		OBJECT_MODEL_FUNC(self->segmentRate, 1), 								ObjectModelEntryFlags::none },
 	{ "segmentsPerSec",		OBJECT_MODEL_FUNC(self->segmentsPerSecond, 1), 							ObjectModelEntryFlags::none },
 };
 
-constexpr uint8_t Kinematics::objectModelTableDescriptor[] = { 2, 1, 2 };
+constexpr uint8_t Kinematics::objectModelTableDescriptor[] = { 2, 1, 5 };
 
 DEFINE_GET_OBJECT_MODEL_TABLE(Kinematics)
 
@@ -53,6 +56,8 @@ DEFINE_GET_OBJECT_MODEL_TABLE(Kinematics)
 // Constructor. Pass segsPerSecond <= 0.0 to get non-segmented kinematics.
 Kinematics::Kinematics(KinematicsType t, SegmentationType segType) noexcept
 	: segmentsPerSecond(DefaultSegmentsPerSecond), minSegmentLength(DefaultMinSegmentLength), reciprocalMinSegmentLength(1.0/DefaultMinSegmentLength),
+	  maxChordError(0.0), pathCurvature(-1.0),
+	  windowChordError(0.0), windowMoveTime(0.0), windowSegments(0), windowStartTime(0), chordError(0.0), segmentRate(0.0),
 	  segmentationType(segType), type(t)
 {
 }
@@ -69,6 +74,10 @@ bool Kinematics::Configure(unsigned int mCode, GCodeBuffer& gb, const StringRef&
 			if (segmentationType.useSegmentation)
 			{
 				reply.catf("%d segments/sec, min. segment length %.2fmm", (int)segmentsPerSecond, (double)minSegmentLength);
+				if (UseAdaptiveSegmentation())
+				{
+					reply.catf(", adaptive with max. chord error %.3fmm", (double)maxChordError);
+				}
 			}
 			else
 			{
@@ -90,6 +99,7 @@ bool Kinematics::TryConfigureSegmentation(GCodeBuffer& gb) noexcept
 	bool seen = false;
 	gb.TryGetFValue('S', segmentsPerSecond, seen);
 	gb.TryGetFValue('T', minSegmentLength, seen);
+	gb.TryGetFValue('V', maxChordError, seen);
 	if (seen)
 	{
 		segmentationType.useSegmentation = minSegmentLength > 0.0 && segmentsPerSecond > 0.0;
@@ -97,10 +107,65 @@ bool Kinematics::TryConfigureSegmentation(GCodeBuffer& gb) noexcept
 		{
 			reciprocalMinSegmentLength = 1.0 / minSegmentLength;
 		}
+		maxChordError = max<float>(maxChordError, 0.0);
+		pathCurvature = -1.0;										// we need to measure the curvature again
 	}
 	return seen;
 }
 
+// Return the number of segments to split a move into and update the segmentation statistics.
+// In fixed mode we use the configured number of segments per second, limited by the minimum segment length.
+// In adaptive mode we choose the segment length so that the chord error, which is L^2 * curvature/8 for segment length L, doesn't exceed the limit.
+// Then we limit the segment rate according to how full the DDA ring is. When the ring is nearly empty the Move task is struggling to keep up,
+// so we allow only half the configured number of segments per second. When it is full we allow up to twice the configured number.
+// Until the Move task has measured the curvature we use the fixed mode calculation.
+unsigned int Kinematics::GetNumSegments(float moveLength, float moveTime, float ringOccupancy) noexcept
+{
+	const float curvature = pathCurvature;
+	float numSegments;
+	if (UseAdaptiveSegmentation() && curvature >= 0.0)
+	{
+		const float segmentLength = (curvature > 0.0) ? max<float>(fastSqrtf(8.0 * maxChordError/curvature), minSegmentLength) : moveLength;
+		numSegments = min<float>(ceilf(moveLength/segmentLength), moveTime * segmentsPerSecond * (0.5 + 1.5 * constrain<float>(ringOccupancy, 0.0, 1.0)));
+	}
+	else
+	{
+		numSegments = min<float>(moveLength * reciprocalMinSegmentLength, moveTime * segmentsPerSecond);
+	}
+	const unsigned int ret = (unsigned int)max<long>(1, lrintf(numSegments));
+
+	if (curvature >= 0.0)
+	{
+		const float chordErrorThisMove = fsquare(moveLength/ret) * curvature * 0.125;
+		if (chordErrorThisMove > windowChordError)
+		{
+			windowChordError = chordErrorThisMove;
+		}
+	}
+	windowSegments += ret;
+	windowMoveTime += moveTime;
+
+	const uint32_t now = millis();
+	if (now - windowStartTime >= SegmentationStatsInterval)
+	{
+		chordError = windowChordError;
+		segmentRate = (windowMoveTime > 0.0) ? (float)windowSegments/windowMoveTime : 0.0;
+		windowChordError = windowMoveTime = 0.0;
+		windowSegments = 0;
+		windowStartTime = now;
+	}
+	return ret;
+}
+
+// Record the deviation of the path from a straight chord, measured by the Move task, and update the estimated curvature.
+// We track increases in curvature immediately but let the estimate decay gradually, so that the segments stay short for a while after we pass close to a singularity.
+void Kinematics::RecordPathDeviation(float deviation, float chordLength) noexcept
+{
+	const float measuredCurvature = 8.0 * deviation/fsquare(chordLength);
+	const float decayedCurvature = pathCurvature * CurvatureDecayFactor;
+	pathCurvature = max<float>(measuredCurvature, decayedCurvature);
+}
+
 // Return true if the specified XY position is reachable by the print head reference point.
 // This default implementation assumes a rectangular reachable area, so it just uses the bed dimensions give in the M208 command.
 bool Kinematics::IsReachable(float axesCoords[MaxAxes], AxesBitmap axes) const noexcept
@@ -204,6 +269,20 @@ AxesBitmap Kinematics::GetHomingFileName(AxesBitmap toBeHomed, AxesBitmap alread
 	return homeFirst & ~alreadyHomed;
 }
 
+// Convert a batch of Cartesian positions to motor positions, returning the number converted
+size_t Kinematics::CartesianToMotorStepsBatch(const float machinePos[][MaxAxes], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes,
+												int32_t motorPos[][MaxAxes], size_t numPoints, bool isCoordinated) const noexcept
+{
+	for (size_t i = 0; i < numPoints; ++i)
+	{
+		if (!CartesianToMotorSteps(machinePos[i], stepsPerMm, numVisibleAxes, numTotalAxes, motorPos[i], isCoordinated))
+		{
+			return i;
+		}
+	}
+	return numPoints;
+}
+
 // Return a bitmap of the motors that affect this axis or tower. Used for implementing stall detection endstops and energising additional motors.
 // Usually it is just the corresponding motor (hence this default implementation), but CoreXY and similar kinematics move multiple motors to home an individual axis.
 AxesBitmap Kinematics::GetConnectedAxes(size_t axis) const noexcept
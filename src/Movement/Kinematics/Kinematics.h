@@ -105,6 +105,19 @@ public:
 	// Return true if successful, false if we were unable to convert
 	virtual bool CartesianToMotorSteps(const float machinePos[], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes, int32_t motorPos[], bool isCoordinated) const noexcept = 0;
 
+	// Convert a batch of Cartesian positions to motor positions, in order, as if CartesianToMotorSteps were called for each one in turn.
+	// 'machinePos' holds 'numPoints' sets of axis positions and 'motorPos' receives the corresponding motor positions.
+	// Return the number of positions converted, which is less than numPoints if a position could not be converted.
+	// The default implementation just calls CartesianToMotorSteps for each position. Kinematics that segment moves override it to avoid repeating the work that is common to all the positions.
+	virtual size_t CartesianToMotorStepsBatch(const float machinePos[][MaxAxes], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes,
+												int32_t motorPos[][MaxAxes], size_t numPoints, bool isCoordinated) const noexcept;
+
+	// Get and set the state that CartesianToMotorSteps carries over from one position to the next, such as the SCARA arm mode.
+	// The Move task converts positions in advance in batches, so it saves this state before a batch and restores it if it discards moves that it converted in advance.
+	// The default is for kinematics that have no such state.
+	virtual uint32_t GetTransformState() const noexcept { return 0; }
+	virtual void SetTransformState(uint32_t state) const noexcept { }
+
 	// Convert motor positions (measured in steps from reference position) to Cartesian coordinates
 	// 'motorPos' is the input vector of motor positions
 	// 'stepsPerMm' is as configured in M92. On a Scara or polar machine this would actually be steps per degree.
@@ -192,6 +205,16 @@ public:
 	// many types of kinematics, but not for Cartesian.
 	virtual void LimitSpeedAndAcceleration(DDA& dda, const float *normalisedDirectionVector, size_t numVisibleAxes, bool continuousRotationShortcut) const noexcept;
 
+#if SUPPORT_NATIVE_ARCS
+	// Return true if a circular arc in the plane of the specified axes can be executed as a single move. This is possible if the position of every motor that
+	// moves either axis is a linear combination of the coordinates of those two axes only, because then each motor position is a sinusoidal function of the arc angle.
+	virtual bool SupportsNativeArcs(size_t axis0, size_t axis1) const noexcept { return false; }
+
+	// If the specified motor is moved by either of the specified axes, return true and the contribution of each axis to the motor position.
+	// This is only called if SupportsNativeArcs returned true for the same axes.
+	virtual bool GetArcMotorCoefficients(size_t motor, size_t axis0, size_t axis1, float& coefficient0, float& coefficient1) const noexcept { return false; }
+#endif
+
 	// Return true if the specified axis is a continuous rotational axis and G0 commands may choose which direction to move it in
 	virtual bool IsContinuousRotationAxis(size_t axis) const noexcept;
 
@@ -218,6 +241,14 @@ public:
 	float GetSegmentsPerSecond() const noexcept pre(UseSegmentation()) { return segmentsPerSecond; }
 	float GetMinSegmentLength() const noexcept pre(UseSegmentation()) { return minSegmentLength; }
 	float GetReciprocalMinSegmentLength() const noexcept pre(UseSegmentation()) { return reciprocalMinSegmentLength; }
+	bool UseAdaptiveSegmentation() const noexcept { return maxChordError > 0.0; }
+
+	// Return the number of segments to split a move into, given its length in mm, its best-case duration in seconds and the fraction of the DDA ring that is in use.
+	// Also record the statistics that we report in the object model. Called by GCodes.
+	unsigned int GetNumSegments(float moveLength, float moveTime, float ringOccupancy) noexcept pre(UseSegmentation());
+
+	// Record how far the path deviates from a straight chord of the given length when the motors move linearly between its ends. Called by the Move task.
+	void RecordPathDeviation(float deviation, float chordLength) noexcept;
 
 protected:
 	DECLARE_OBJECT_MODEL
@@ -243,10 +274,22 @@ private:
 	// Default values for those kinematics that always use segmentation
 	static constexpr float DefaultSegmentsPerSecond = 100.0;
 	static constexpr float DefaultMinSegmentLength = 0.2;
+	static constexpr float CurvatureDecayFactor = 0.9;		// how much we reduce the estimated path curvature each time we measure a smaller one
+	static constexpr uint32_t SegmentationStatsInterval = 1000;	// how often we update the segmentation statistics in milliseconds
 
 	float segmentsPerSecond;				// if we are using segmentation, the target number of segments/second
 	float minSegmentLength;					// if we are using segmentation, the minimum segment size
 	float reciprocalMinSegmentLength;		// if we are using segmentation, the reciprocal of minimum segment size
+	float maxChordError;					// if we are using adaptive segmentation, the maximum deviation of the path from a straight line in mm, else zero
+	volatile float pathCurvature;			// the estimated curvature of the path in 1/mm, or negative if we haven't measured it yet
+
+	// Segmentation statistics
+	float windowChordError;					// the largest estimated chord error of the moves we segmented in the current interval
+	float windowMoveTime;					// the total duration of the moves we segmented in the current interval
+	unsigned int windowSegments;			// the total number of segments in those moves
+	uint32_t windowStartTime;				// when the current interval started
+	float chordError;						// the largest estimated chord error in the last complete interval
+	float segmentRate;						// the average number of segments per second of segmented moves in the last complete interval
 
 	SegmentationType segmentationType;		// the type of segmentation we are using
 	KinematicsType type;
@@ -56,6 +56,7 @@ public:
 	float GetDiagonalSquared(size_t tower) const noexcept { return D2[tower]; }
     float GetTowerX(size_t axis) const noexcept { return towerX[axis]; }
     float GetTowerY(size_t axis) const noexcept { return towerY[axis]; }
+    size_t GetNumTowers() const noexcept { return numTowers; }
 
 protected:
 	DECLARE_OBJECT_MODEL
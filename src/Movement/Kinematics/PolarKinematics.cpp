@@ -138,6 +138,26 @@ bool PolarKinematics::CartesianToMotorSteps(const float machinePos[], const floa
 	return true;
 }
 
+// Convert a batch of Cartesian positions to motor positions, returning the number converted
+size_t PolarKinematics::CartesianToMotorStepsBatch(const float machinePos[][MaxAxes], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes,
+													int32_t motorPos[][MaxAxes], size_t numPoints, bool isCoordinated) const noexcept
+{
+	const float radiusStepsPerMm = stepsPerMm[0];
+	const float turntableStepsPerDegree = stepsPerMm[1];
+	for (size_t i = 0; i < numPoints; ++i)
+	{
+		const float * const pos = machinePos[i];
+		int32_t * const motors = motorPos[i];
+		motors[0] = lrintf(fastSqrtf(fsquare(pos[0]) + fsquare(pos[1])) * radiusStepsPerMm);
+		motors[1] = (motors[0] == 0) ? 0 : lrintf(atan2f(pos[1], pos[0]) * RadiansToDegrees * turntableStepsPerDegree);
+		for (size_t axis = Z_AXIS; axis < numVisibleAxes; ++axis)
+		{
+			motors[axis] = lrintf(pos[axis] * stepsPerMm[axis]);
+		}
+	}
+	return numPoints;
+}
+
 // Convert motor positions (measured in steps from reference position) to Cartesian coordinates
 // 'motorPos' is the input vector of motor positions
 // 'stepsPerMm' is as configured in M92. On a Scara or polar machine this would actually be steps per degree.
@@ -231,6 +231,50 @@ bool RotaryDeltaKinematics::CartesianToMotorSteps(const float machinePos[], cons
 	return ok;
 }
 
+// Convert a batch of Cartesian positions to motor positions, returning the number converted.
+// We do one tower at a time so that the constants for that tower stay in registers. The calculation is the same as in Transform.
+size_t RotaryDeltaKinematics::CartesianToMotorStepsBatch(const float machinePos[][MaxAxes], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes,
+															int32_t motorPos[][MaxAxes], size_t numPoints, bool isCoordinated) const noexcept
+{
+	size_t numConverted = numPoints;
+	for (size_t axis = 0; axis < min<size_t>(numVisibleAxes, DELTA_AXES); ++axis)
+	{
+		const float cosAngle = armAngleCosines[axis], sinAngle = armAngleSines[axis];
+		const float bearingHeight = bearingHeights[axis];
+		const float twiceArmU = twiceU[axis];
+		const float rodSquaredMinusArmSquaredThis = rodSquaredMinusArmSquared[axis];
+		const float stepsPerDegree = stepsPerMm[axis];
+		for (size_t i = 0; i < numConverted; ++i)
+		{
+			const float * const pos = machinePos[i];
+			const float x = pos[X_AXIS] * cosAngle + pos[Y_AXIS] * sinAngle;
+			const float y = pos[Y_AXIS] * cosAngle - pos[X_AXIS] * sinAngle;
+			const float rMinusX = radius - x;
+			const float hMinusZ = bearingHeight - pos[Z_AXIS];
+			const float a = twiceArmU * rMinusX;
+			const float b = twiceArmU * hMinusZ;
+			const float c = rodSquaredMinusArmSquaredThis - (fsquare(hMinusZ) + fsquare(rMinusX) + fsquare(y));
+			const float sinTheta = (b * c - a * fastSqrtf(fsquare(a) + fsquare(b) - fsquare(c)))/(fsquare(a) + fsquare(b));
+			const float angle = asinf(sinTheta) * RadiansToDegrees;
+			if (std::isnan(angle) || std::isinf(angle))
+			{
+				numConverted = i;							// this position and the ones after it can't be converted
+				break;
+			}
+			motorPos[i][axis] = lrintf(angle * stepsPerDegree);
+		}
+	}
+
+	for (size_t i = 0; i < numConverted; ++i)
+	{
+		for (size_t axis = DELTA_AXES; axis < numVisibleAxes; ++axis)
+		{
+			motorPos[i][axis] = lrintf(machinePos[i][axis] * stepsPerMm[axis]);
+		}
+	}
+	return numConverted;
+}
+
 // Convert motor positions (measured in steps from reference position) to Cartesian coordinates
 // 'motorPos' is the input vector of motor positions
 // 'stepsPerMm' is as configured in M92. On a Scara or polar machine this would actually be steps per degree.
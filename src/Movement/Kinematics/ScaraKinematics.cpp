@@ -167,6 +167,47 @@ bool ScaraKinematics::CartesianToMotorSteps(const float machinePos[], const floa
 	return true;
 }
 
+// Convert a batch of Cartesian positions to motor positions, returning the number converted.
+// The arm mode carries over from one position to the next in the same way as when converting them one at a time.
+size_t ScaraKinematics::CartesianToMotorStepsBatch(const float machinePos[][MaxAxes], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes,
+													int32_t motorPos[][MaxAxes], size_t numPoints, bool isCoordinated) const noexcept
+{
+	const float thetaStepsPerDegree = stepsPerMm[X_AXIS];
+	const float psiStepsPerDegree = stepsPerMm[Y_AXIS];
+	const float zStepsPerMm = stepsPerMm[Z_AXIS];
+	const float thetaToPsiCrosstalk = crosstalk[0], thetaToZCrosstalk = crosstalk[1], psiToZCrosstalk = crosstalk[2];
+
+	bool armMode = currentArmMode;
+	size_t i = 0;
+	for (; i < numPoints; ++i)
+	{
+		const float * const pos = machinePos[i];
+		float theta, psi;
+		if (pos[X_AXIS] == cachedX && pos[Y_AXIS] == cachedY)
+		{
+			theta = cachedTheta;
+			psi = cachedPsi;
+			armMode = cachedArmMode;
+		}
+		else if (!CalculateThetaAndPsi(pos, isCoordinated, theta, psi, armMode))
+		{
+			break;
+		}
+
+		int32_t * const motors = motorPos[i];
+		motors[X_AXIS] = lrintf(theta * thetaStepsPerDegree);
+		motors[Y_AXIS] = lrintf((psi - (thetaToPsiCrosstalk * theta)) * psiStepsPerDegree);
+		motors[Z_AXIS] = lrintf((pos[Z_AXIS] - (thetaToZCrosstalk * theta) - (psiToZCrosstalk * psi)) * zStepsPerMm);
+		for (size_t axis = XYZ_AXES; axis < numVisibleAxes; ++axis)
+		{
+			motors[axis] = lrintf(pos[axis] * stepsPerMm[axis]);
+		}
+	}
+
+	currentArmMode = armMode;
+	return i;
+}
+
 // Convert motor coordinates to machine coordinates. Used after homing and after individual motor moves.
 // For Scara, the X and Y components of stepsPerMm are actually steps per degree angle.
 void ScaraKinematics::MotorStepsToCartesian(const int32_t motorPos[], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes, float machinePos[]) const noexcept
@@ -0,0 +1,218 @@
+/*
+ * MeshZProfile.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include "MeshZProfile.h"
+
+#if SUPPORT_MESH_Z_PROFILE
+
+#include "DDA.h"
+#include "Move.h"
+#include <Platform/RepRap.h>
+#include <Platform/Platform.h>
+#include <Tools/Tool.h>
+
+// Static members
+
+MeshZProfile *MeshZProfile::freeList = nullptr;
+unsigned int MeshZProfile::numCreated = 0;
+unsigned int MeshZProfile::numInUse = 0;
+unsigned int MeshZProfile::maxInUse = 0;
+
+// Allocate a profile, from the freelist if possible, else create a new one
+MeshZProfile *MeshZProfile::Allocate() noexcept
+{
+	MeshZProfile *profile = freeList;
+	if (profile != nullptr)
+	{
+		freeList = profile->next;
+	}
+	else
+	{
+		profile = new MeshZProfile(nullptr);
+		++numCreated;
+	}
+	profile->next = nullptr;
+	++numInUse;
+	if (numInUse > maxInUse)
+	{
+		maxInUse = numInUse;
+	}
+	return profile;
+}
+
+void MeshZProfile::Diagnostics(MessageType mtype) noexcept
+{
+	if (numCreated != 0)
+	{
+		reprap.GetPlatform().MessageF(mtype, "Mesh Z profiles %u (%u bytes), in use %u, max %u\n",
+										numCreated, numCreated * (unsigned int)sizeof(MeshZProfile), numInUse, maxInUse);
+		maxInUse = numInUse;
+	}
+}
+
+// Find where a move along one axis of the grid crosses the grid lines, where u0 and u1 are the start and end coordinates in units of grid spacings.
+// Store the crossings as fractions of the move in increasing order and return the number of them, or return a number greater than maxCrossings if there are too many to store.
+static unsigned int FindGridCrossings(float u0, float u1, uint32_t numLines, float crossings[], unsigned int maxCrossings) noexcept
+{
+	int32_t first, last;
+	if (u1 > u0)
+	{
+		first = max<int32_t>((int32_t)floorf(u0) + 1, 0);
+		last = min<int32_t>((int32_t)ceilf(u1) - 1, (int32_t)numLines - 1);
+	}
+	else
+	{
+		first = min<int32_t>((int32_t)ceilf(u0) - 1, (int32_t)numLines - 1);
+		last = max<int32_t>((int32_t)floorf(u1) + 1, 0);
+	}
+
+	const int32_t count = (u1 > u0) ? last - first + 1 : first - last + 1;
+	if (count <= 0)
+	{
+		return 0;
+	}
+	if ((unsigned int)count > maxCrossings)
+	{
+		return (unsigned int)count;
+	}
+
+	const float recipLength = 1.0/(u1 - u0);
+	const int32_t increment = (u1 > u0) ? 1 : -1;
+	for (int32_t i = 0; i < count; ++i)
+	{
+		crossings[i] = ((float)(first + i * increment) - u0) * recipLength;
+	}
+	return (unsigned int)count;
+}
+
+// Build the profile for the Z motor of a DDA, returning true if it has any points between the start and end of the move.
+// The end coordinates of the DDA and of the previous DDA have already had mesh compensation applied, so the profile is the straight line between them
+// plus the difference between the height correction at each point and the straight line between the height corrections at the ends.
+bool MeshZProfile::Build(DDA& dda, int32_t netSteps, float stepsPerMm) noexcept
+{
+	const Move& move = reprap.GetMove();
+	const GridDefinition& grid = move.GetGrid();
+	const size_t numVisibleAxes = reprap.GetGCodes().GetVisibleAxes();
+
+	float startCoords[MaxAxes], movement[MaxAxes];
+	for (size_t axis = 0; axis < MaxAxes; ++axis)
+	{
+		if (axis < numVisibleAxes)
+		{
+			startCoords[axis] = dda.prev->GetEndCoordinate(axis, false);
+			movement[axis] = dda.endCoordinates[axis] - startCoords[axis];
+		}
+		else
+		{
+			startCoords[axis] = movement[axis] = 0.0;
+		}
+	}
+
+	// Find the fractions of the move at which we cross grid lines along each grid axis
+	constexpr unsigned int MaxCrossings = MaxPieces - 1;
+	float crossings[2][MaxCrossings];
+	unsigned int numCrossings[2];
+	for (size_t i = 0; i < 2; ++i)
+	{
+		const size_t axis = grid.GetAxisNumber(i);
+		const float u0 = (startCoords[axis] + Tool::GetOffset(dda.tool, axis) - grid.GetMin(i))/grid.GetSpacing(i);
+		numCrossings[i] = FindGridCrossings(u0, u0 + movement[axis]/grid.GetSpacing(i), grid.NumAxisPoints(i), crossings[i], MaxCrossings);
+	}
+
+	// Merge the crossings into a single list of fractions, leaving out any that are too close to the previous one or to the ends of the move.
+	// If there are too many crossings, fall back to sampling at equal intervals.
+	constexpr float MinFractionIncrement = 0.001;
+	float fractions[MaxPoints];
+	numPoints = 0;
+	fractions[numPoints++] = 0.0;
+	if (numCrossings[0] + numCrossings[1] > MaxCrossings)
+	{
+		for (unsigned int i = 1; i < MaxPieces; ++i)
+		{
+			fractions[numPoints++] = (float)i * (1.0/MaxPieces);
+		}
+	}
+	else
+	{
+		unsigned int i0 = 0, i1 = 0;
+		while (i0 < numCrossings[0] || i1 < numCrossings[1])
+		{
+			const float f = (i1 == numCrossings[1] || (i0 < numCrossings[0] && crossings[0][i0] <= crossings[1][i1])) ? crossings[0][i0++] : crossings[1][i1++];
+			if (f >= fractions[numPoints - 1] + MinFractionIncrement && f <= 1.0 - MinFractionIncrement)
+			{
+				fractions[numPoints++] = f;
+			}
+		}
+	}
+	fractions[numPoints++] = 1.0;
+
+	if (numPoints == 2)
+	{
+		return false;												// the move is within a single grid cell, so the Z motor moves in a straight line
+	}
+
+	// Calculate the motor position at each point
+	float corrections[MaxPoints];
+	for (size_t i = 0; i < numPoints; ++i)
+	{
+		float coords[MaxAxes];
+		for (size_t axis = 0; axis < MaxAxes; ++axis)
+		{
+			coords[axis] = startCoords[axis] + fractions[i] * movement[axis];
+		}
+		corrections[i] = move.GetMeshCorrection(coords, dda.tool);
+	}
+
+	for (size_t i = 0; i < numPoints; ++i)
+	{
+		const float f = fractions[i];
+		const float correctionDifference = corrections[i] - (corrections[0] + f * (corrections[numPoints - 1] - corrections[0]));
+		distances[i] = f * dda.totalDistance;
+		positions[i] = ((float)netSteps * f) + (correctionDifference * stepsPerMm);
+	}
+	positions[0] = 0.0;
+	positions[numPoints - 1] = (float)netSteps;						// avoid rounding error at the end
+
+	for (size_t i = 0; i + 1 < numPoints; ++i)
+	{
+		const float stepsMoved = positions[i + 1] - positions[i];
+		mmPerStep[i] = (stepsMoved != 0.0) ? (distances[i + 1] - distances[i])/stepsMoved : 0.0;
+	}
+
+	SetRuns();
+	return true;
+}
+
+// Divide the pieces into runs in which the motor moves in one direction only. Pieces in which the motor doesn't move join the current run.
+void MeshZProfile::SetRuns() noexcept
+{
+	firstRunUp = positions[numPoints - 1] >= 0.0;					// in case the motor doesn't move at all
+	for (size_t i = 0; i + 1 < numPoints; ++i)
+	{
+		if (positions[i + 1] != positions[i])
+		{
+			firstRunUp = positions[i + 1] > positions[i];
+			break;
+		}
+	}
+
+	numRuns = 0;
+	bool up = firstRunUp;
+	for (size_t i = 0; i + 1 < numPoints; ++i)
+	{
+		if ((up && positions[i + 1] < positions[i]) || (!up && positions[i + 1] > positions[i]))
+		{
+			runEnds[numRuns++] = (uint8_t)i;						// this piece starts a run in the opposite direction
+			up = !up;
+		}
+	}
+	runEnds[numRuns++] = (uint8_t)(numPoints - 1);
+}
+
+#endif
+
+// End
@@ -0,0 +1,79 @@
+/*
+ * MeshZProfile.h
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * This class holds the path that the Z motor follows during a move when mesh bed compensation is applied during the move instead of by segmenting it.
+ * The move end points are compensated in the usual way. Within the move, the height correction is sampled where the path crosses the grid lines
+ * and the Z motor position is interpolated linearly between those points, so a single DDA follows the mesh across as many grid cells as the profile has pieces.
+ *
+ * A profile is built by DDA::Prepare and owned by the DDA until the DDA is freed. The step ISR only ever reads it.
+ * Profiles are allocated from a free list, which is extended when it is empty in the same way as the free lists of DMs and move segments.
+ * They are only allocated and released while holding the DDARing prepare mutex.
+ */
+
+#ifndef SRC_MOVEMENT_MESHZPROFILE_H_
+#define SRC_MOVEMENT_MESHZPROFILE_H_
+
+#include <RepRapFirmware.h>
+
+#if SUPPORT_MESH_Z_PROFILE
+
+#include <Platform/Tasks.h>
+
+class DDA;
+
+class MeshZProfile
+{
+public:
+	static constexpr size_t MaxPieces = 16;								// the maximum number of straight pieces in a profile
+	static constexpr size_t MaxPoints = MaxPieces + 1;
+
+	MeshZProfile(MeshZProfile *p_next) noexcept : next(p_next), numPoints(0), numRuns(0) { }
+
+	void* operator new(size_t count) { return Tasks::AllocPermanent(count); }
+	void* operator new(size_t count, std::align_val_t align) { return Tasks::AllocPermanent(count, align); }
+	void operator delete(void* ptr) noexcept {}
+	void operator delete(void* ptr, std::align_val_t align) noexcept {}
+
+	// Build the profile for the Z motor of a DDA, returning true if it has any points between the start and end of the move
+	bool Build(DDA& dda, int32_t netSteps, float stepsPerMm) noexcept;
+
+	static MeshZProfile *Allocate() noexcept;
+	static void Release(MeshZProfile *item) noexcept;
+
+	static unsigned int NumCreated() noexcept { return numCreated; }
+	static void Diagnostics(MessageType mtype) noexcept;
+
+private:
+	friend class DriveMovement;
+
+	void SetRuns() noexcept;
+
+	static MeshZProfile *freeList;
+	static unsigned int numCreated;
+	static unsigned int numInUse;
+	static unsigned int maxInUse;
+
+	MeshZProfile *next;													// link to the next profile in the free list
+	float distances[MaxPoints];											// the distance along the move of each point, in the same units as the DDA total distance
+	float positions[MaxPoints];											// the Z motor position in steps relative to the start of the move at each point
+	float mmPerStep[MaxPieces];											// the distance moved along the path per Z motor step in each piece, or zero if the piece is flat
+	uint8_t runEnds[MaxPieces];											// the index of the point at which each run of pieces in the same direction ends
+	uint8_t numPoints;													// the number of points including the start and end of the move
+	uint8_t numRuns;													// the number of runs, so the number of direction reversals is one less than this
+	bool firstRunUp;													// true if the motor moves in the positive direction in the first run
+};
+
+// Release a profile. Not thread-safe.
+inline void MeshZProfile::Release(MeshZProfile *item) noexcept
+{
+	item->next = freeList;
+	freeList = item;
+	--numInUse;
+}
+
+#endif
+
+#endif /* SRC_MOVEMENT_MESHZPROFILE_H_ */
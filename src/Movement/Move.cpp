@@ -40,6 +40,11 @@
 #include <Tools/Tool.h>
 #include <Endstops/ZProbe.h>
 #include <Platform/TaskPriorities.h>
+#include <Platform/Tasks.h>
+
+#if SUPPORT_MOVE_RECORDER
+# include "MoveRecorder.h"
+#endif
 
 #if SUPPORT_IOBITS
 # include <Platform/PortControl.h>
@@ -104,16 +109,19 @@ constexpr ObjectModelTableEntry Move::objectModelTable[] =
 	{ "currentMove",			OBJECT_MODEL_FUNC(self, 2),																		ObjectModelEntryFlags::live },
 	{ "extruders",				OBJECT_MODEL_FUNC_NOSELF(&extrudersArrayDescriptor),											ObjectModelEntryFlags::live },
 	{ "idle",					OBJECT_MODEL_FUNC(self, 1),																		ObjectModelEntryFlags::none },
+	{ "junctionDeviation",		OBJECT_MODEL_FUNC(self->junctionDeviation, 3),													ObjectModelEntryFlags::none },
 	{ "kinematics",				OBJECT_MODEL_FUNC(self->kinematics),															ObjectModelEntryFlags::none },
 	{ "limitAxes",				OBJECT_MODEL_FUNC_NOSELF(reprap.GetGCodes().LimitAxes()),										ObjectModelEntryFlags::none },
 	{ "noMovesBeforeHoming",	OBJECT_MODEL_FUNC_NOSELF(reprap.GetGCodes().NoMovesBeforeHoming()),								ObjectModelEntryFlags::none },
 	{ "printingAcceleration",	OBJECT_MODEL_FUNC(InverseConvertAcceleration(self->maxPrintingAcceleration), 1),				ObjectModelEntryFlags::none },
 	{ "queue",					OBJECT_MODEL_FUNC_NOSELF(&queueArrayDescriptor),												ObjectModelEntryFlags::none },
 #if SUPPORT_COORDINATE_ROTATION
-	{ "rotation",				OBJECT_MODEL_FUNC(self, 44),																	ObjectModelEntryFlags::none },
+	{ "rotation",				OBJECT_MODEL_FUNC(self, 11),																	ObjectModelEntryFlags::none },
 #endif
+	{ "segments",				OBJECT_MODEL_FUNC(self, 10),																	ObjectModelEntryFlags::live },
 	{ "shaping",				OBJECT_MODEL_FUNC(&self->axisShaper, 0),														ObjectModelEntryFlags::none },
 	{ "speedFactor",			OBJECT_MODEL_FUNC_NOSELF(reprap.GetGCodes().GetSpeedFactor(), 2),								ObjectModelEntryFlags::none },
+	{ "timing",					OBJECT_MODEL_FUNC(self, 9),																		ObjectModelEntryFlags::live },
 	{ "travelAcceleration",		OBJECT_MODEL_FUNC(InverseConvertAcceleration(self->maxTravelAcceleration), 1),					ObjectModelEntryFlags::none },
 	{ "virtualEPos",			OBJECT_MODEL_FUNC_NOSELF(reprap.GetGCodes().GetVirtualExtruderPosition(), 5),					ObjectModelEntryFlags::live },
 	{ "workplaceNumber",		OBJECT_MODEL_FUNC_NOSELF((int32_t)reprap.GetGCodes().GetWorkplaceCoordinateSystemNumber() - 1),	ObjectModelEntryFlags::none },
@@ -153,6 +161,12 @@ constexpr ObjectModelTableEntry Move::objectModelTable[] =
 #endif
 	{ "liveGrid",				OBJECT_MODEL_FUNC_IF(self->usingMesh, (const GridDefinition *)&self->GetGrid()),				ObjectModelEntryFlags::none },
 	{ "meshDeviation",			OBJECT_MODEL_FUNC_IF(self->usingMesh, self, 7),													ObjectModelEntryFlags::none },
+#if SUPPORT_MESH_Z_PROFILE
+	{ "meshInMoves",			OBJECT_MODEL_FUNC(self->meshInMoves),															ObjectModelEntryFlags::none },
+#endif
+#if SUPPORT_BICUBIC_MESH
+	{ "meshInterpolation",		OBJECT_MODEL_FUNC((self->heightMap.IsBicubic()) ? "bicubic" : "bilinear"),						ObjectModelEntryFlags::none },
+#endif
 	{ "probeGrid",				OBJECT_MODEL_FUNC_NOSELF((const GridDefinition *)&reprap.GetGCodes().GetDefaultGrid()),			ObjectModelEntryFlags::none },
 	{ "skew",					OBJECT_MODEL_FUNC(self, 8),																		ObjectModelEntryFlags::none },
 	{ "type",					OBJECT_MODEL_FUNC(self->GetCompensationTypeString()),											ObjectModelEntryFlags::none },
@@ -167,8 +181,23 @@ constexpr ObjectModelTableEntry Move::objectModelTable[] =
 	{ "tanXZ",					OBJECT_MODEL_FUNC(self->tanXZ(), 4),															ObjectModelEntryFlags::none },
 	{ "tanYZ",					OBJECT_MODEL_FUNC(self->tanYZ(), 4),															ObjectModelEntryFlags::none },
 
+	// 9. move.timing members
+	{ "ddaDuration",			OBJECT_MODEL_FUNC(&self->timing.ddaDuration, 0),												ObjectModelEntryFlags::live },
+	{ "deadlineMargin",			OBJECT_MODEL_FUNC(&self->timing.deadlineMargin, 0),												ObjectModelEntryFlags::live },
+	{ "isrTime",				OBJECT_MODEL_FUNC(&self->timing.isrTime, 0),													ObjectModelEntryFlags::live },
+	{ "prepareTime",			OBJECT_MODEL_FUNC(&self->timing.prepareTime, 0),												ObjectModelEntryFlags::live },
+	{ "segmentsPerMove",		OBJECT_MODEL_FUNC(&self->timing.segmentsPerMove, 0),											ObjectModelEntryFlags::live },
+
+	// 10. move.segments members
+	{ "allocationFailures",		OBJECT_MODEL_FUNC_NOSELF((int32_t)MoveSegment::NumAllocationFailures()),						ObjectModelEntryFlags::live },
+	{ "budget",					OBJECT_MODEL_FUNC_NOSELF((int32_t)MoveSegment::GetBudget()),									ObjectModelEntryFlags::none },
+	{ "created",				OBJECT_MODEL_FUNC_NOSELF((int32_t)MoveSegment::NumCreated()),									ObjectModelEntryFlags::live },
+	{ "degradations",			OBJECT_MODEL_FUNC_NOSELF((int32_t)MoveSegment::NumDegradations()),								ObjectModelEntryFlags::live },
+	{ "inUse",					OBJECT_MODEL_FUNC_NOSELF((int32_t)MoveSegment::NumInUse()),										ObjectModelEntryFlags::live },
+	{ "peakInUse",				OBJECT_MODEL_FUNC_NOSELF((int32_t)MoveSegment::MaxInUse()),										ObjectModelEntryFlags::live },
+
 #if SUPPORT_COORDINATE_ROTATION
-	// 8. move.rotation members
+	// 11. move.rotation members
 	{ "angle",					OBJECT_MODEL_FUNC_NOSELF(reprap.GetGCodes().GetRotationAngle()),								ObjectModelEntryFlags::none },
 	{ "centre",					OBJECT_MODEL_FUNC_NOSELF(&rotationCentreArrayDescriptor),										ObjectModelEntryFlags::none },
 #endif
@@ -176,16 +205,18 @@ constexpr ObjectModelTableEntry Move::objectModelTable[] =
 
 constexpr uint8_t Move::objectModelTableDescriptor[] =
 {
-	9 + SUPPORT_COORDINATE_ROTATION,
-	17 + SUPPORT_WORKPLACE_COORDINATES,
+	11 + SUPPORT_COORDINATE_ROTATION,
+	20 + SUPPORT_WORKPLACE_COORDINATES,
 	2,
 	4 + SUPPORT_LASER,
 	3,
 	2,
 	2,
-	6 + (HAS_MASS_STORAGE || HAS_SBC_INTERFACE),
+	6 + (HAS_MASS_STORAGE || HAS_SBC_INTERFACE) + SUPPORT_MESH_Z_PROFILE + SUPPORT_BICUBIC_MESH,
 	2,
 	4,
+	5,
+	6,
 #if SUPPORT_COORDINATE_ROTATION
 	2
 #endif
@@ -205,11 +236,12 @@ Move::Move() noexcept
 	  heightController(nullptr),
 #endif
 	  maxPrintingAcceleration(ConvertAcceleration(DefaultPrintingAcceleration)), maxTravelAcceleration(ConvertAcceleration(DefaultTravelAcceleration)),
-	  jerkPolicy(0),
+	  jerkPolicy(0), junctionDeviation(0.0),
 	  numCalibratedFactors(0)
 {
 	// Kinematics must be set up here because GCodes::Init asks the kinematics for the assumed initial position
 	kinematics = Kinematics::Create(KinematicsType::cartesian);		// default to Cartesian
+	KinematicsConfigured();
 	mainDDARing.Init1(InitialDdaRingLength);
 #if SUPPORT_ASYNC_MOVES
 	auxDDARing.Init1(AuxDdaRingLength);
@@ -219,6 +251,7 @@ Move::Move() noexcept
 
 void Move::Init() noexcept
 {
+	DDARing::CreatePrepareMutex();
 	mainDDARing.Init2();
 
 #if SUPPORT_ASYNC_MOVES
@@ -233,6 +266,9 @@ void Move::Init() noexcept
 	tangents[0] = tangents[1] = tangents[2] = 0.0;
 
 	usingMesh = useTaper = false;
+#if SUPPORT_MESH_Z_PROFILE
+	meshInMoves = false;
+#endif
 	zShift = 0.0;
 
 	idleTimeout = DefaultIdleTimeout;
@@ -241,6 +277,7 @@ void Move::Init() noexcept
 
 	simulationMode = SimulationMode::off;
 	longestGcodeWaitInterval = 0;
+	distanceSinceCurvatureProbe = 0.0;
 	bedLevellingMoveAvailable = false;
 
 	moveTask.Create(MoveStart, "Move", this, TaskPriority::MovePriority);
@@ -249,6 +286,11 @@ void Move::Init() noexcept
 void Move::Exit() noexcept
 {
 	StepTimer::DisableTimerInterrupt();
+#if SUPPORT_MOVE_RECORDER
+	MoveRecorder::Exit();
+#endif
+	delete prepareTask;									// do this first so that the rings can discard any moves that it hasn't prepared
+	prepareTask = nullptr;
 	mainDDARing.Exit();
 #if SUPPORT_ASYNC_MOVES
 	auxDDARing.Exit();
@@ -295,6 +337,21 @@ void Move::Exit() noexcept
 				}
 				bedLevellingMoveAvailable = false;
 			}
+			else if (mainDDARing.UsingRawMoveQueue())
+			{
+				// If GCodes has queued a move, add it to the DDA ring for processing. Don't remove it from the queue until we have done that,
+				// so that GCodes never sees both the queue and the DDA ring empty while we are processing it.
+				RawMove * const nextMove = mainDDARing.GetQueuedRawMove();
+				if (nextMove != nullptr)
+				{
+					moveRead = true;
+					if (simulationMode < SimulationMode::partial)		// in simulation mode partial, we don't process incoming moves beyond this point
+					{
+						AddRawMove(*nextMove);
+					}
+					mainDDARing.RemoveQueuedRawMove();
+				}
+			}
 			else
 			{
 				// If there's a G Code move available, add it to the DDA ring for processing.
@@ -304,22 +361,7 @@ void Move::Exit() noexcept
 					moveRead = true;
 					if (simulationMode < SimulationMode::partial)		// in simulation mode partial, we don't process incoming moves beyond this point
 					{
-						if (nextMove.moveType == 0)
-						{
-							AxisAndBedTransform(nextMove.coords, nextMove.tool, true);
-						}
-
-						if (mainDDARing.AddStandardMove(nextMove, !IsRawMotorMove(nextMove.moveType)))
-						{
-							const uint32_t now = millis();
-							const uint32_t timeWaiting = now - whenLastMoveAdded;
-							if (timeWaiting > longestGcodeWaitInterval)
-							{
-								longestGcodeWaitInterval = timeWaiting;
-							}
-							whenLastMoveAdded = now;
-							moveState = MoveState::collecting;
-						}
+						AddRawMove(nextMove);
 					}
 				}
 			}
@@ -390,18 +432,149 @@ void Move::Exit() noexcept
 	}
 }
 
-// This is called from GCodes to tell the Move task that a move is available
+// Transform a move that we have received from GCodes and add it to the main DDA ring
+void Move::AddRawMove(RawMove& nextMove) noexcept
+{
+	const int32_t *motorSteps = nullptr;
+	if (nextMove.moveType == 0)
+	{
+#if SUPPORT_TRANSFORM_BATCH
+		motorSteps = mainDDARing.GetBatchedMotorSteps(nextMove);		// if this succeeds then it has done the axis and bed transform too
+		if (motorSteps == nullptr)
+#endif
+		{
+			AxisAndBedTransform(nextMove.coords, nextMove.tool, true);
+		}
+	}
+
+	if (mainDDARing.AddStandardMove(nextMove, !IsRawMotorMove(nextMove.moveType), motorSteps))
+	{
+		if (nextMove.moveType == 0 && kinematics->UseAdaptiveSegmentation() && kinematics->GetSegmentationType().useSegmentation)
+		{
+			ProbePathCurvature(*mainDDARing.GetLastAddedMove());
+		}
+
+		const uint32_t now = millis();
+		const uint32_t timeWaiting = now - whenLastMoveAdded;
+		if (timeWaiting > longestGcodeWaitInterval)
+		{
+			longestGcodeWaitInterval = timeWaiting;
+		}
+		whenLastMoveAdded = now;
+		moveState = MoveState::collecting;
+	}
+}
+
+// Measure the curvature of the motor-space path ahead of the start of a move, for adaptive segmentation.
+// The motors move linearly during each segment, so the path deviates from a straight line where the kinematics are nonlinear.
+// We transform a point a fixed distance ahead in the direction of the move to motor positions, transform the midpoint of the motor positions back,
+// and measure how far that is from the midpoint of the straight line. We probe a longer distance than a segment so that the deviation is large compared
+// with the rounding of the motor positions to whole steps, and so that we see increasing curvature before we reach it.
+// To limit the extra work we only probe after the head has moved a certain distance since the last probe.
+void Move::ProbePathCurvature(DDA& dda) noexcept
+{
+	constexpr float ProbeLength = 10.0;
+	constexpr float ProbeSpacing = 2.5;
+
+	DDA& prev = *dda.GetPrevious();
+	float probePos[MaxAxes];
+	float moveLengthSquared = 0.0;
+	for (size_t axis = 0; axis < XYZ_AXES; ++axis)
+	{
+		probePos[axis] = prev.GetEndCoordinate(axis, false);
+		moveLengthSquared += fsquare(dda.GetEndCoordinate(axis, false) - probePos[axis]);
+	}
+	const float moveLength = fastSqrtf(moveLengthSquared);
+	distanceSinceCurvatureProbe += moveLength;
+	if (moveLength < 0.001 || distanceSinceCurvatureProbe < ProbeSpacing)
+	{
+		return;
+	}
+	distanceSinceCurvatureProbe = 0.0;
+
+	// Set up the probe position. The axes other than X, Y and Z stay where they are.
+	const size_t numVisibleAxes = reprap.GetGCodes().GetVisibleAxes();
+	const size_t numTotalAxes = reprap.GetGCodes().GetTotalAxes();
+	const float scale = ProbeLength/moveLength;
+	float midPos[MaxAxes];
+	for (size_t axis = 0; axis < numVisibleAxes; ++axis)
+	{
+		if (axis < XYZ_AXES)
+		{
+			const float startPos = probePos[axis];
+			probePos[axis] = startPos + (dda.GetEndCoordinate(axis, false) - startPos) * scale;
+			midPos[axis] = 0.5 * (startPos + probePos[axis]);
+		}
+		else
+		{
+			probePos[axis] = prev.GetEndCoordinate(axis, false);
+		}
+	}
+
+	const int32_t * const startSteps = prev.DriveCoordinates();
+	int32_t probeSteps[MaxAxes];
+	for (size_t axis = numVisibleAxes; axis < numTotalAxes; ++axis)
+	{
+		probeSteps[axis] = startSteps[axis];
+	}
+	if (!CartesianToMotorSteps(probePos, probeSteps, true))
+	{
+		return;																// the probe position isn't reachable, so don't use it
+	}
+
+	for (size_t axis = 0; axis < numTotalAxes; ++axis)
+	{
+		probeSteps[axis] = (int32_t)(((int64_t)startSteps[axis] + probeSteps[axis])/2);
+	}
+	MotorStepsToCartesian(probeSteps, numVisibleAxes, numTotalAxes, probePos);
+
+	float deviationSquared = 0.0;
+	for (size_t axis = 0; axis < XYZ_AXES; ++axis)
+	{
+		deviationSquared += fsquare(probePos[axis] - midPos[axis]);
+	}
+	kinematics->RecordPathDeviation(fastSqrtf(deviationSquared), ProbeLength);
+}
+
+// This is called from GCodes to tell the Move task that a move is available, and from elsewhere when a leadscrew adjustment or aux move is ready.
+// The raw move queue has a single producer, so we only fill it when called from the task that GCodes runs on. We always wake the Move task,
+// because the caller may have something for it other than a move from GCodes.
 void Move::MoveAvailable() noexcept
 {
 	if (moveTask.IsRunning())
 	{
+		if (mainDDARing.UsingRawMoveQueue() && RTOSIface::GetCurrentTask() == Tasks::GetMainTask())
+		{
+			mainDDARing.FillRawMoveQueue();
+		}
 		moveTask.Give();
 	}
 }
 
+// This is called regularly by GCodes when we are using the raw move queue, to pass us the remaining segments of segmented moves.
+// Unlike MoveAvailable it only wakes the Move task if it added something to the queue, because it is called on every pass of the GCodes spin loop.
+void Move::PassRemainingSegments() noexcept
+{
+	if (moveTask.IsRunning())
+	{
+		const size_t numQueued = mainDDARing.GetNumQueuedRawMoves();
+		mainDDARing.FillRawMoveQueue();
+		if (mainDDARing.GetNumQueuedRawMoves() != numQueued)
+		{
+			moveTask.Give();
+		}
+	}
+}
+
 // Tell the lookahead ring we are waiting for it to empty and return true if it is
 bool Move::WaitingForAllMovesFinished() noexcept
 {
+	// Check the raw move queue first. The Move task doesn't remove a move from it until it has added that move to the DDA ring.
+	if (!mainDDARing.IsRawMoveQueueEmpty())
+	{
+		(void)mainDDARing.SetWaitingToEmpty();				// so that the DDA ring doesn't wait for the grace period before starting moves
+		return false;
+	}
 	return mainDDARing.SetWaitingToEmpty();
 }
 
@@ -435,6 +608,7 @@ bool Move::SetKinematics(KinematicsType k) noexcept
 		}
 		delete kinematics;
 		kinematics = nk;
+		KinematicsConfigured();
 		reprap.MoveUpdated();
 	}
 	return true;
@@ -446,6 +620,43 @@ bool Move::IsRawMotorMove(uint8_t moveType) const noexcept
 	return moveType == 2 || ((moveType == 1 || moveType == 3) && kinematics->GetHomingMode() != HomingMode::homeCartesianAxes);
 }
 
+#if SUPPORT_NATIVE_ARCS
+
+// Return true if we can execute an arc in the plane of these two machine axes as a single move.
+// The motors must move in proportion to the two axes, which rules out mesh and axis skew compensation because they make the motor positions nonlinear functions of the arc axes.
+// Arc motor step generation is done locally, so the motors must not have any drivers on CAN-connected boards.
+bool Move::CanDoNativeArc(size_t axis0, size_t axis1) const noexcept
+{
+	if (!mainDDARing.UsingNativeArcs() || usingMesh || tanXY() != 0.0 || tanXZ() != 0.0 || tanYZ() != 0.0 || !kinematics->SupportsNativeArcs(axis0, axis1))
+	{
+		return false;
+	}
+
+#if SUPPORT_CAN_EXPANSION
+	const Platform& platform = reprap.GetPlatform();
+	const size_t numTotalAxes = reprap.GetGCodes().GetTotalAxes();
+	for (size_t motor = 0; motor < numTotalAxes; ++motor)
+	{
+		float k0, k1;
+		if (kinematics->GetArcMotorCoefficients(motor, axis0, axis1, k0, k1))
+		{
+			const AxisDriversConfig& config = platform.GetAxisDriversConfig(motor);
+			for (size_t i = 0; i < config.numDrivers; ++i)
+			{
+				if (!config.driverNumbers[i].IsLocal())
+				{
+					return false;
+				}
+			}
+		}
+	}
+#endif
+
+	return true;
+}
+
+#endif
+
 // Return true if the specified point is accessible to the Z probe
 bool Move::IsAccessibleProbePoint(float axesCoords[MaxAxes], AxesBitmap axes) const noexcept
 {
@@ -482,6 +693,21 @@ void Move::Diagnostics(MessageType mtype) noexcept
 	p.MessageF(mtype, "=== Move ===\nDMs created %u, segments created %u, maxWait %" PRIu32 "ms, bed compensation in use: %s, comp offset %.3f\n",
 						DriveMovement::NumCreated(), MoveSegment::NumCreated(), longestGcodeWaitInterval, scratchString.c_str(), (double)zShift);
 	longestGcodeWaitInterval = 0;
+	timing.Reset();
+	MoveSegment::Diagnostics(mtype);
+#if SUPPORT_SHAPER_PLAN_CACHE
+	axisShaper.Diagnostics(mtype);
+#endif
+	StepTimeTable::Diagnostics(mtype);
+#if SUPPORT_DELTA_STEP_PROFILES
+	DeltaStepProfile::Diagnostics(mtype);
+#endif
+#if SUPPORT_MESH_Z_PROFILE
+	MeshZProfile::Diagnostics(mtype);
+#endif
+#if SUPPORT_MOVE_RECORDER
+	MoveRecorder::Diagnostics(mtype);
+#endif
 
 #if 0	// debug only
 	scratchString.copy("Steps requested/done:");
@@ -701,6 +927,44 @@ void Move::BedTransform(float xyzPoint[MaxAxes], const Tool *tool) const noexcep
 	}
 }
 
+#if SUPPORT_MESH_Z_PROFILE
+
+// Return true if the Z motor can follow the height map during moves instead of the moves being segmented at the grid lines.
+// The Z motor must move Z alone and by the Z axis steps/mm, which rules out delta and CoreXZ kinematics.
+// The Z motor steps are generated locally, so it must not have any drivers on CAN-connected boards.
+bool Move::CanApplyMeshInMoves() const noexcept
+{
+	if (!meshInMoves || !usingMesh || kinematics->GetConnectedAxes(Z_AXIS).Intersects(~AxesBitmap::MakeFromBits(Z_AXIS)))
+	{
+		return false;
+	}
+
+#if SUPPORT_CAN_EXPANSION
+	const AxisDriversConfig& config = reprap.GetPlatform().GetAxisDriversConfig(Z_AXIS);
+	for (size_t i = 0; i < config.numDrivers; ++i)
+	{
+		if (!config.driverNumbers[i].IsLocal())
+		{
+			return false;
+		}
+	}
+#endif
+
+	return true;
+}
+
+// Return the Z correction that the bed transform applies at these machine coordinates.
+// The coordinates have already been bed compensated, so when the compensation is tapered this is an approximation.
+float Move::GetMeshCorrection(const float coords[MaxAxes], const Tool *tool) const noexcept
+{
+	float xyzPoint[MaxAxes];
+	memcpyf(xyzPoint, coords, ARRAY_SIZE(xyzPoint));
+	BedTransform(xyzPoint, tool);
+	return xyzPoint[Z_AXIS] - coords[Z_AXIS];
+}
+
+#endif
+
 // Invert the bed transform BEFORE the axis transform
 void Move::InverseBedTransform(float xyzPoint[MaxAxes], const Tool *tool) const noexcept
 {
@@ -1226,6 +1490,56 @@ void Move::WakeMoveTaskFromISR() noexcept
 	}
 }
 
+void Move::WakeMoveTask() noexcept
+{
+	if (moveTask.IsRunning())
+	{
+		moveTask.Give();
+	}
+}
+
+// Background move preparation
+
+Task<Move::MoveTaskStackWords> *Move::prepareTask = nullptr;		// the task used to prepare moves in the background
+
+extern "C" [[noreturn]] void PrepareTaskStart(void * pvParameters) noexcept
+{
+	reprap.GetMove().PrepareTaskRun();
+}
+
+// This is called when background preparation is enabled by M595
+void Move::CreatePrepareTask() noexcept
+{
+	TaskCriticalSectionLocker lock;
+	if (prepareTask == nullptr)
+	{
+		prepareTask = new Task<MoveTaskStackWords>;
+		prepareTask->Create(PrepareTaskStart, "MovePrep", nullptr, TaskPriority::MovePreparePriority);
+	}
+}
+
+// Wake up the prepare task. It always exists when the Move task hands over a move, but check anyway.
+void Move::WakePrepareTask() noexcept
+{
+	if (prepareTask != nullptr)
+	{
+		prepareTask->Give();
+	}
+}
+
+void Move::PrepareTaskRun() noexcept
+{
+	for (;;)
+	{
+		// Sleep until the Move task hands over a move, then prepare all the moves waiting in each ring
+		(void)TaskBase::Take();
+		for (DDARing& ring : rings)
+		{
+			ring.PrepareQueuedMoves();
+		}
+	}
+}
+
 #if SUPPORT_LASER || SUPPORT_IOBITS
 
 // Laser and IOBits support
@@ -11,6 +11,7 @@
 #include <RepRapFirmware.h>
 #include "AxisShaper.h"
 #include "ExtruderShaper.h"
+#include "TimingHistogram.h"
 #include "DDARing.h"
 #include "DDA.h"								// needed because of our inline functions
 #include "BedProbing/RandomProbePointSet.h"
@@ -47,6 +48,9 @@ const unsigned int InitialNumDms = (InitialDdaRingLength/2 * 4) + AuxDdaRingLeng
 
 #endif
 
+constexpr size_t AdaptiveRingRamReserve = 4096;		// the amount of never-used RAM that we leave free when growing the DDA ring automatically
+constexpr unsigned int MaxRawMoveQueueLength = 50;		// the maximum length of the queue of moves between GCodes and the main DDA ring, set by M595 B
+
 // This is the master movement class.  It controls all movement in the machine.
 class Move INHERIT_OBJECT_MODEL
 {
@@ -63,6 +67,7 @@ public:
 	int32_t GetEndPoint(size_t drive) const noexcept;					 	// Get the current position of a motor
 	float LiveCoordinate(unsigned int axisOrExtruder, const Tool *tool) noexcept; // Gives the last point at the end of the last complete DDA
 	void MoveAvailable() noexcept;											// Called from GCodes to tell the Move task that a move is available
+	void PassRemainingSegments() noexcept;									// Called by GCodes to pass the remaining segments of a segmented move to the raw move queue
 	bool WaitingForAllMovesFinished() noexcept;								// Tell the lookahead ring we are waiting for it to empty and return true if it is
 	void DoLookAhead() noexcept SPEED_CRITICAL;			// Run the look-ahead procedure
 	void SetNewPosition(const float positionNow[MaxAxesPlusExtruders], bool doBedCompensation) noexcept; // Set the current position to be this
@@ -85,6 +90,13 @@ public:
 	void SetTaperHeight(float h) noexcept;
 	bool UseMesh(bool b) noexcept;											// Try to enable mesh bed compensation and report the final state
 	bool IsUsingMesh() const noexcept { return usingMesh; }					// Return true if we are using mesh compensation
+#if SUPPORT_MESH_Z_PROFILE
+	void SetMeshInMoves(bool b) noexcept { meshInMoves = b; }				// Select whether the Z motor follows the height map during moves
+	bool IsMeshInMoves() const noexcept { return meshInMoves; }
+	bool CanApplyMeshInMoves() const noexcept;								// Return true if the Z motor can follow the height map during moves instead of them being segmented
+	float GetMeshCorrection(const float coords[MaxAxes], const Tool *tool) const noexcept;	// Return the Z correction that the bed transform applies at these machine coordinates
+	float GetMeshMaxSlope() const noexcept { return heightMap.GetMaxSlope(); }	// Return the steepest slope of the height map
+#endif
 	unsigned int GetNumProbedProbePoints() const noexcept;					// Return the number of actually probed probe points
 	void SetLatestCalibrationDeviation(const Deviation& d, uint8_t numFactors) noexcept;
 	void SetInitialCalibrationDeviation(const Deviation& d) noexcept;
@@ -105,6 +117,7 @@ public:
 	float GetMaxPrintingAcceleration() const noexcept { return maxPrintingAcceleration; }
 	float GetMaxTravelAcceleration() const noexcept { return maxTravelAcceleration; }
 	AxisShaper& GetAxisShaper() noexcept { return axisShaper; }
+	MoveTiming& GetTiming() noexcept { return timing; }
 	ExtruderShaper& GetExtruderShaper(size_t extruder) noexcept { return extruderShapers[extruder]; }
 
 	void Diagnostics(MessageType mtype) noexcept;							// Report useful stuff
@@ -112,6 +125,8 @@ public:
 	// Kinematics and related functions
 	Kinematics& GetKinematics() const noexcept { return *kinematics; }
 	bool SetKinematics(KinematicsType k) noexcept;											// Set kinematics, return true if successful
+	void KinematicsConfigured() noexcept { prepareDrivesFunction = DDA::SelectPrepareDrivesFunction(*kinematics); }	// Call this when the kinematics configuration may have changed
+	DDA::PrepareDrivesFunction GetPrepareDrivesFunction() const noexcept { return prepareDrivesFunction; }
 	bool CartesianToMotorSteps(const float machinePos[MaxAxes], int32_t motorPos[MaxAxes], bool isCoordinated) const noexcept;
 																							// Convert Cartesian coordinates to delta motor coordinates, return true if successful
 	void MotorStepsToCartesian(const int32_t motorPos[], size_t numVisibleAxes, size_t numTotalAxes, float machinePos[]) const noexcept;
@@ -127,6 +142,9 @@ public:
 	// End temporary functions
 
 	bool IsRawMotorMove(uint8_t moveType) const noexcept;									// Return true if this is a raw motor move
+#if SUPPORT_NATIVE_ARCS
+	bool CanDoNativeArc(size_t axis0, size_t axis1) const noexcept;						// Return true if we can execute an arc in the plane of these two machine axes as a single move
+#endif
 
 	float IdleTimeout() const noexcept;														// Returns the idle timeout in seconds
 	void SetIdleTimeout(float timeout) noexcept;											// Set the idle timeout in seconds
@@ -136,13 +154,15 @@ public:
 
 	bool PausePrint(RestorePoint& rp) noexcept;												// Pause the print as soon as we can, returning true if we were able to
 #if HAS_VOLTAGE_MONITOR || HAS_STALL_DETECT
-	bool LowPowerOrStallPause(RestorePoint& rp) noexcept;									// Pause the print immediately, returning true if we were able to
+	bool LowPowerOrStallPause(RestorePoint& rp) noexcept;									// Pause the print immediately, returning true if we were able to. The caller must hold the prepare mutex.
 #endif
 
-	bool NoLiveMovement() const noexcept { return mainDDARing.IsIdle(); }					// Is a move running, or are there any queued?
+	bool NoLiveMovement() const noexcept { return mainDDARing.IsRawMoveQueueEmpty() && mainDDARing.IsIdle(); }	// Is a move running, or are there any queued?
 
-	uint32_t GetScheduledMoves() const noexcept { return mainDDARing.GetScheduledMoves(); }	// How many moves have been scheduled?
+	uint32_t GetScheduledMoves() const noexcept																	// How many moves have been scheduled?
+		{ return mainDDARing.GetScheduledMoves() + mainDDARing.GetNumQueuedRawMoves(); }
 	uint32_t GetCompletedMoves() const noexcept { return mainDDARing.GetCompletedMoves(); }	// How many moves have been completed?
+	float GetRingOccupancy() const noexcept { return mainDDARing.GetOccupancy(); }			// Return the fraction of the main DDA ring that is in use
 	void ResetMoveCounters() noexcept { mainDDARing.ResetMoveCounters(); }
 
 	HeightMap& AccessHeightMap() noexcept { return heightMap; }								// Access the bed probing grid
@@ -173,6 +193,8 @@ public:
 
 	unsigned int GetJerkPolicy() const noexcept { return jerkPolicy; }
 	void SetJerkPolicy(unsigned int jp) noexcept { jerkPolicy = jp; }
+	float GetJunctionDeviation() const noexcept { return junctionDeviation; }				// Get the junction deviation in mm, or zero if we use the jerk limits and the standard lookahead
+	void SetJunctionDeviation(float jd) noexcept { junctionDeviation = jd; }
 
 #if HAS_SMART_DRIVERS
 	uint32_t GetStepInterval(size_t axis, uint32_t microstepShift) const noexcept;			// Get the current step interval for this axis or extruder
@@ -196,6 +218,11 @@ public:
 	static void WakeLaserTaskFromISR() noexcept;											// wake up the laser task, called at the start of a new move
 #endif
 
+	[[noreturn]] void PrepareTaskRun() noexcept;
+
+	static void CreatePrepareTask() noexcept;												// create the background move prepare task if we haven't already
+	static void WakePrepareTask() noexcept;													// wake up the prepare task, called when the Move task hands over a move
+	static void WakeMoveTask() noexcept;													// wake up the Move task, called by the prepare task when it has prepared a move
 	static void WakeMoveTaskFromISR() noexcept;
 
 	static const TaskBase *GetMoveTaskHandle() noexcept { return &moveTask; }
@@ -247,6 +274,8 @@ private:
 	float ComputeHeightCorrection(float xyzPoint[MaxAxes], const Tool *tool) const noexcept;	// Compute the height correction needed at a point, ignoring taper
 
 	const char *GetCompensationTypeString() const noexcept;
+	void AddRawMove(RawMove& nextMove) noexcept;													// Transform a move from GCodes and add it to the main DDA ring
+	void __attribute__((noinline)) ProbePathCurvature(DDA& dda) noexcept;							// Measure the curvature of the path ahead of a move for adaptive segmentation
 
 	// Move task stack size
 	// 250 is not enough when Move and DDA debug are enabled
@@ -278,6 +307,7 @@ private:
 	float maxTravelAcceleration;
 
 	unsigned int jerkPolicy;							// When we allow jerk
+	float junctionDeviation;							// The junction deviation in mm used by the time-optimal lookahead planner, or zero to use the jerk limits
 	unsigned int idleCount;								// The number of times Spin was called and had no new moves to process
 
 	uint32_t whenLastMoveAdded;							// The time when we last added a move to the main DDA ring
@@ -285,6 +315,7 @@ private:
 
 	uint32_t idleTimeout;								// How long we wait with no activity before we reduce motor currents to idle, in milliseconds
 	uint32_t longestGcodeWaitInterval;					// the longest we had to wait for a new GCode
+	float distanceSinceCurvatureProbe;					// how far we have moved since we last measured the path curvature for adaptive segmentation
 
 	float tangents[3]; 									// Axis compensation - 90 degrees + angle gives angle between axes
 	bool compensateXY;									// If true then we compensate for XY skew by adjusting the Y coordinate; else we adjust the X coordinate
@@ -305,8 +336,10 @@ private:
 
 
 	Kinematics *kinematics;								// What kinematics we are using
+	DDA::PrepareDrivesFunction prepareDrivesFunction;	// How DDA::Prepare handles the drives of moves on these kinematics
 
 	AxisShaper axisShaper;
+	MoveTiming timing;									// histograms of planner and step generator timings
 	ExtruderShaper extruderShapers[MaxExtruders];
 
 	float latestLiveCoordinates[MaxAxesPlusExtruders];
@@ -316,6 +349,11 @@ private:
 	bool bedLevellingMoveAvailable;						// True if a leadscrew adjustment move is pending
 	bool usingMesh;										// True if we are using the height map, false if we are using the random probe point set
 	bool useTaper;										// True to taper off the compensation
+#if SUPPORT_MESH_Z_PROFILE
+	bool meshInMoves;									// True if the Z motor should follow the height map during moves when it can, set by M376 S1
+#endif
+
+	static Task<MoveTaskStackWords> *prepareTask;		// the task used to prepare moves in the background, if enabled by M595 C1
 
 #if SUPPORT_LASER || SUPPORT_IOBITS
 	static constexpr size_t LaserTaskStackWords = 100;	// stack size in dwords for the laser and IOBits task
@@ -0,0 +1,319 @@
+/*
+ * MoveRecorder.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include "MoveRecorder.h"
+
+#if SUPPORT_MOVE_RECORDER
+
+#include "RawMove.h"
+#include "MoveSegment.h"
+#include "StepTimer.h"
+#include <Platform/Platform.h>
+#include <Platform/RepRap.h>
+#include <GCodes/GCodes.h>
+#include <GCodes/GCodeBuffer/GCodeBuffer.h>
+#include <Storage/MassStorage.h>
+#include <Platform/Tasks.h>
+
+constexpr uint32_t DefaultBufferKb = 16;
+constexpr uint32_t MaxBufferKb = 256;
+constexpr size_t MaxRecordWords = 255;							// the length field in the record header is 8 bits
+constexpr size_t PreparedMoveFixedWords = 2 + 10;				// header, timestamp and the fixed parameters
+constexpr size_t WordsPerSegment = 6;
+constexpr size_t MaxSegmentsRecorded = (MaxRecordWords - PreparedMoveFixedWords)/WordsPerSegment;
+
+static uint32_t *buffer = nullptr;								// the ring buffer of records
+static size_t bufferWords = 0;									// the size of the buffer in 32-bit words
+static size_t getIndex = 0;										// the index of the oldest record
+static size_t putIndex = 0;										// the index at which the next record will be written
+static size_t wordsUsed = 0;									// how many words of the buffer are in use
+static uint32_t numRecordsWritten = 0;
+static uint32_t numRecordsOverwritten = 0;
+static volatile bool recording = false;
+static bool stopOnHiccup = false;								// if true we stop recording after the first hiccup, so that the capture ends with the problem
+
+// Write a record to the buffer, overwriting the oldest records if necessary. The record is in 'words' and its length is given in the header word.
+// This may be called from the Move task, the background prepare task and the step ISR, so we disable interrupts while we write to the buffer.
+static void WriteRecord(const uint32_t *words) noexcept
+{
+	const size_t length = (words[0] >> 16) & 0xFF;
+	AtomicCriticalSectionLocker lock;
+	if (!recording || length > bufferWords)
+	{
+		return;
+	}
+
+	// Discard the oldest records until there is room for this one
+	while (bufferWords - wordsUsed < length)
+	{
+		const size_t oldLength = (buffer[getIndex] >> 16) & 0xFF;
+		getIndex = (getIndex + oldLength) % bufferWords;
+		wordsUsed -= oldLength;
+		++numRecordsOverwritten;
+	}
+
+	for (size_t i = 0; i < length; ++i)
+	{
+		buffer[putIndex] = words[i];
+		putIndex = (putIndex == bufferWords - 1) ? 0 : putIndex + 1;
+	}
+	wordsUsed += length;
+	++numRecordsWritten;
+}
+
+static inline uint32_t MakeHeader(uint8_t type, size_t length, uint16_t extra) noexcept
+{
+	return ((uint32_t)type << 24) | ((uint32_t)length << 16) | extra;
+}
+
+static inline uint32_t FloatWord(float f) noexcept
+{
+	uint32_t w;
+	memcpy(&w, &f, sizeof(w));
+	return w;
+}
+
+// Discard all records. Must be called with recording disabled.
+static void ClearBuffer() noexcept
+{
+	getIndex = putIndex = wordsUsed = 0;
+	numRecordsWritten = numRecordsOverwritten = 0;
+}
+
+// Write the buffer contents to a file. Must be called with recording disabled.
+static bool DumpToFile(const char *fileName, const StringRef& reply) noexcept
+{
+	FileStore * const f = MassStorage::OpenFile(fileName, OpenMode::write, (wordsUsed + 4) * sizeof(uint32_t));
+	if (f == nullptr)
+	{
+		reply.printf("Failed to create move recorder file %s", fileName);
+		return false;
+	}
+
+	const uint32_t fileHeader[4] = { FileMagic, FileFormatVersion, StepClockRate, numRecordsOverwritten };
+	bool ok = f->Write(reinterpret_cast<const uint8_t*>(fileHeader), sizeof(fileHeader));
+	if (ok && wordsUsed != 0)
+	{
+		// The records may wrap round the end of the buffer
+		const size_t firstChunk = min<size_t>(wordsUsed, bufferWords - getIndex);
+		ok = f->Write(reinterpret_cast<const uint8_t*>(buffer + getIndex), firstChunk * sizeof(uint32_t));
+		if (ok && firstChunk < wordsUsed)
+		{
+			ok = f->Write(reinterpret_cast<const uint8_t*>(buffer), (wordsUsed - firstChunk) * sizeof(uint32_t));
+		}
+	}
+	if (!f->Close())
+	{
+		ok = false;
+	}
+	if (!ok)
+	{
+		reply.printf("Failed to write move recorder file %s", fileName);
+		return false;
+	}
+
+	reply.printf("%" PRIu32 " records written to %s", numRecordsWritten - numRecordsOverwritten, fileName);
+	return true;
+}
+
+// Configure the move recorder. Parameters:
+//  S1 start recording, S0 stop recording
+//  R<n> buffer size in Kb
+//  H1 stop recording at the first hiccup, H0 don't
+//  P"filename" dump the recorded moves to the file, then clear the buffer
+GCodeResult MoveRecorder::Configure(GCodeBuffer& gb, const StringRef& reply) THROWS(GCodeException)
+{
+	bool seen = false;
+	gb.TryGetBValue('H', stopOnHiccup, seen);
+
+	if (gb.Seen('P'))
+	{
+		String<MaxFilenameLength> fileName;
+		String<StringLength50> temp;
+		gb.GetQuotedString(temp.GetRef(), false);
+		MassStorage::CombineName(fileName.GetRef(), "0:/sys/", temp.c_str());
+
+		const bool wasRecording = recording;
+		{
+			AtomicCriticalSectionLocker lock;
+			recording = false;
+		}
+		const bool ok = DumpToFile(fileName.c_str(), reply);
+		ClearBuffer();
+		recording = wasRecording;
+		return (ok) ? GCodeResult::ok : GCodeResult::error;
+	}
+
+	uint32_t bufferKb = (bufferWords == 0) ? DefaultBufferKb : (bufferWords * sizeof(uint32_t))/1024;
+	bool seenSize = false;
+	gb.TryGetLimitedUIValue('R', bufferKb, seenSize, MaxBufferKb + 1);
+	if (gb.Seen('S'))
+	{
+		seen = true;
+		const bool wantRecording = (gb.GetUIValue() != 0);
+		{
+			AtomicCriticalSectionLocker lock;
+			recording = false;
+		}
+		if (wantRecording)
+		{
+			const size_t newBufferWords = (bufferKb * 1024)/sizeof(uint32_t);
+			if (newBufferWords != bufferWords)
+			{
+				// This violates our rule on no dynamic memory allocation after the initialisation phase, however the recorder is only used for diagnosis
+				delete[] buffer;
+				buffer = nullptr;
+				bufferWords = 0;
+				if ((ptrdiff_t)(newBufferWords * sizeof(uint32_t)) + 1024 >= Tasks::GetNeverUsedRam())
+				{
+					reply.printf("insufficient RAM for move recorder buffer of %" PRIu32 "Kb", bufferKb);
+					return GCodeResult::error;
+				}
+				buffer = new uint32_t[newBufferWords];
+				bufferWords = newBufferWords;
+			}
+			ClearBuffer();
+			recording = true;
+		}
+	}
+	else if (seenSize)
+	{
+		reply.copy("Buffer size can only be changed when starting the recorder");
+		return GCodeResult::error;
+	}
+
+	if (!seen)
+	{
+		reply.printf("Move recorder is %s, buffer %uKb, %" PRIu32 " records held, %" PRIu32 " overwritten%s",
+						(recording) ? "recording" : "stopped", (unsigned int)((bufferWords * sizeof(uint32_t))/1024),
+						numRecordsWritten - numRecordsOverwritten, numRecordsOverwritten, (stopOnHiccup) ? ", stop on hiccup" : "");
+	}
+	return GCodeResult::ok;
+}
+
+void MoveRecorder::Diagnostics(MessageType mtype) noexcept
+{
+	if (bufferWords != 0)
+	{
+		reprap.GetPlatform().MessageF(mtype, "Move recorder: %s, %" PRIu32 " records held, %" PRIu32 " overwritten, %u of %u words used\n",
+										(recording) ? "recording" : "stopped", numRecordsWritten - numRecordsOverwritten, numRecordsOverwritten,
+										(unsigned int)wordsUsed, (unsigned int)bufferWords);
+	}
+}
+
+void MoveRecorder::Exit() noexcept
+{
+	recording = false;
+}
+
+bool MoveRecorder::IsRecording() noexcept
+{
+	return recording;
+}
+
+// Record a move that is about to be added to a DDA ring. Only the total axes and the extruders in use are recorded, to save space.
+void MoveRecorder::RecordRawMove(const RawMove& move) noexcept
+{
+	if (!recording)
+	{
+		return;
+	}
+
+	const GCodes& gc = reprap.GetGCodes();
+	const size_t numAxes = gc.GetTotalAxes();
+	const size_t numExtruders = gc.GetNumExtruders();
+	const size_t length = 2 + 5 + numAxes + numExtruders;
+	uint32_t words[2 + 5 + MaxAxesPlusExtruders];
+	words[0] = MakeHeader(RecordTypeRawMove, length, (uint16_t)((numAxes << 8) | numExtruders));
+	words[1] = StepTimer::GetTimerTicks();
+	words[2] = FloatWord(move.feedRate);
+	words[3] = FloatWord(move.virtualExtruderPosition);
+	words[4] = (uint32_t)move.filePos;
+	words[5] = FloatWord(move.cosXyAngle);
+	words[6] =   (uint32_t)move.moveType
+			  | ((uint32_t)move.applyM220M221 << 3)
+			  | ((uint32_t)move.usePressureAdvance << 4)
+			  | ((uint32_t)move.canPauseAfter << 5)
+			  | ((uint32_t)move.hasPositiveExtrusion << 6)
+			  | ((uint32_t)move.isCoordinated << 7)
+			  | ((uint32_t)move.usingStandardFeedrate << 8)
+			  | ((uint32_t)move.checkEndstops << 9)
+			  | ((uint32_t)move.reduceAcceleration << 10)
+			  | ((uint32_t)move.linearAxesMentioned << 11)
+			  | ((uint32_t)move.rotationalAxesMentioned << 12);
+	size_t n = 7;
+	for (size_t axis = 0; axis < numAxes; ++axis)
+	{
+		words[n++] = FloatWord(move.coords[axis]);
+	}
+	for (size_t extruder = 0; extruder < numExtruders; ++extruder)
+	{
+		words[n++] = FloatWord(move.coords[ExtruderToLogicalDrive(extruder)]);
+	}
+	WriteRecord(words);
+}
+
+// Record a DDA that has just been prepared, with its axis and extruder move segments. Each segment is recorded as flags, length, duration and coefficients b, c, d.
+void MoveRecorder::RecordPreparedMove(const PreparedMoveParameters& params, const MoveSegment *shapedSegments, const MoveSegment *unshapedSegments) noexcept
+{
+	if (!recording)
+	{
+		return;
+	}
+
+	uint32_t words[MaxRecordWords];
+	size_t n = PreparedMoveFixedWords;
+	size_t numSegments[2] = { 0, 0 };
+	const MoveSegment *segLists[2] = { shapedSegments, unshapedSegments };
+	for (size_t list = 0; list < 2; ++list)
+	{
+		for (const MoveSegment *seg = segLists[list]; seg != nullptr && numSegments[0] + numSegments[1] < MaxSegmentsRecorded; seg = seg->GetNext())
+		{
+			float b, c, d;
+			seg->GetCoefficients(b, c, d);
+			words[n++] = (seg->IsLinear()) ? 1 : (seg->IsCubic()) ? 2 : 0;
+			words[n++] = FloatWord(seg->GetSegmentLength());
+			words[n++] = FloatWord(seg->GetSegmentTime());
+			words[n++] = FloatWord(b);
+			words[n++] = FloatWord(c);
+			words[n++] = FloatWord((seg->IsCubic()) ? d : 0.0);
+			++numSegments[list];
+		}
+	}
+
+	words[0] = MakeHeader(RecordTypePreparedMove, n, (uint16_t)((numSegments[0] << 8) | numSegments[1]));
+	words[1] = StepTimer::GetTimerTicks();
+	words[2] = FloatWord(params.requestedSpeed);
+	words[3] = FloatWord(params.startSpeed);
+	words[4] = FloatWord(params.topSpeed);
+	words[5] = FloatWord(params.endSpeed);
+	words[6] = FloatWord(params.acceleration);
+	words[7] = FloatWord(params.deceleration);
+	words[8] = FloatWord(params.totalDistance);
+	words[9] = params.clocksNeeded;
+	words[10] = (uint32_t)params.filePos;
+	words[11] = params.flags;
+	WriteRecord(words);
+}
+
+// Record a hiccup. Called from the step ISR.
+void MoveRecorder::RecordHiccup(uint32_t hiccupClocks, FilePosition filePos) noexcept
+{
+	if (recording)
+	{
+		const uint32_t words[4] = { MakeHeader(RecordTypeHiccup, 4, 0), StepTimer::GetTimerTicks(), hiccupClocks, (uint32_t)filePos };
+		WriteRecord(words);
+		if (stopOnHiccup)
+		{
+			recording = false;
+		}
+	}
+}
+
+#endif
+
+// End
@@ -0,0 +1,66 @@
+/*
+ * MoveRecorder.h
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * The move recorder keeps a record of the most recent moves in a RAM ring buffer so that speed dips and hiccups seen in production can be analysed offline.
+ * For each move it records the RawMove passed to DDARing::AddStandardMove, the parameters of the DDA after it has been prepared, and any hiccups inserted by the step ISR.
+ * When the buffer is full the oldest records are overwritten. M597 configures the recorder and dumps the buffer to a file, which can be fetched over HTTP like any other file.
+ * The format of the file is given below so that captures can be decoded offline.
+ *
+ * File format (all values little-endian 32-bit words):
+ *  Header: magic 'RRMR', format version, step clock rate, number of records overwritten
+ *  Each record: header word (type << 24 | length in words << 16 | type-specific 16 bits), step clock timestamp, then the payload
+ */
+
+#ifndef SRC_MOVEMENT_MOVERECORDER_H_
+#define SRC_MOVEMENT_MOVERECORDER_H_
+
+#include <RepRapFirmware.h>
+
+#if SUPPORT_MOVE_RECORDER
+
+#include <GCodes/GCodeException.h>
+
+struct RawMove;
+class MoveSegment;
+
+namespace MoveRecorder
+{
+	// Record types
+	constexpr uint8_t RecordTypeRawMove = 1;
+	constexpr uint8_t RecordTypePreparedMove = 2;
+	constexpr uint8_t RecordTypeHiccup = 3;
+
+	constexpr uint32_t FileMagic = 0x524D5252;						// 'RRMR' when read as little-endian bytes
+	constexpr uint32_t FileFormatVersion = 1;
+
+	// Parameters of a DDA after it has been prepared
+	struct PreparedMoveParameters
+	{
+		float requestedSpeed;
+		float startSpeed;
+		float topSpeed;
+		float endSpeed;
+		float acceleration;
+		float deceleration;
+		float totalDistance;
+		uint32_t clocksNeeded;
+		FilePosition filePos;
+		uint32_t flags;
+	};
+
+	GCodeResult Configure(GCodeBuffer& gb, const StringRef& reply) THROWS(GCodeException);		// M597
+	void Diagnostics(MessageType mtype) noexcept;
+	void Exit() noexcept;
+
+	bool IsRecording() noexcept;
+	void RecordRawMove(const RawMove& move) noexcept;
+	void RecordPreparedMove(const PreparedMoveParameters& params, const MoveSegment *shapedSegments, const MoveSegment *unshapedSegments) noexcept;
+	void RecordHiccup(uint32_t hiccupClocks, FilePosition filePos) noexcept;	// called from the step ISR
+}
+
+#endif
+
+#endif /* SRC_MOVEMENT_MOVERECORDER_H_ */
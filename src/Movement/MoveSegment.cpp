@@ -6,11 +6,21 @@
  */
 
 #include "MoveSegment.h"
+#include <Platform/RepRap.h>
+#include <Platform/Platform.h>
 
 // Static members
 
 MoveSegment *MoveSegment::freeList = nullptr;
 unsigned int MoveSegment::numCreated = 0;
+unsigned int MoveSegment::budget = 0;
+unsigned int MoveSegment::numInUse = 0;
+unsigned int MoveSegment::maxInUse = 0;
+unsigned int MoveSegment::numDegradations = 0;
+unsigned int MoveSegment::numAllocationFailures = 0;
+unsigned int MoveSegment::numSharedInUse = 0;
+unsigned int MoveSegment::maxSharedInUse = 0;
+unsigned int MoveSegment::numAllocationsSaved = 0;
 
 void MoveSegment::InitialAllocate(unsigned int num) noexcept
 {
@@ -32,12 +42,43 @@ MoveSegment *MoveSegment::Allocate(MoveSegment *next) noexcept
 	}
 	else
 	{
+		// If we have a budget then the pool was allocated up front, so we only get here if the unshaped segments of the queued moves didn't fit.
+		// We can't leave the move without segments, so create another one and count it.
+		if (budget != 0)
+		{
+			++numAllocationFailures;
+		}
 		ms = new MoveSegment(next);
 		++numCreated;
 	}
+	++numInUse;
+	if (numInUse > maxInUse)
+	{
+		maxInUse = numInUse;
+	}
 	return ms;
 }
 
+// Set the segment budget and allocate the pool up to that size. Segments already created are never freed, so the budget only limits further growth.
+/*static*/ void MoveSegment::SetBudget(unsigned int num) noexcept
+{
+	budget = num;
+	InitialAllocate(num);
+	maxInUse = numInUse;
+}
+
+// Return true if the pool has room for the shaped segments of a move as well as its unshaped segments, else count the move as degraded to no shaping.
+// This is only called when preparing a move, so if it returns true then no other move can take the segments before we allocate them.
+/*static*/ bool MoveSegment::CanAllocateShaped(unsigned int numShapedSegments) noexcept
+{
+	if (budget == 0 || numInUse + numShapedSegments + MaxUnshapedSegments <= budget)
+	{
+		return true;
+	}
+	++numDegradations;
+	return false;
+}
+
 void MoveSegment::AddToTail(MoveSegment *tail) noexcept
 {
 	MoveSegment *seg = this;
@@ -48,6 +89,34 @@ void MoveSegment::AddToTail(MoveSegment *tail) noexcept
 	seg->SetNext(tail);
 }
 
+/*static*/ unsigned int MoveSegment::CountSegments(const MoveSegment *seg) noexcept
+{
+	unsigned int count = 0;
+	while (seg != nullptr)
+	{
+		++count;
+		seg = seg->GetNext();
+	}
+	return count;
+}
+
+// Report how many segments sharing the unshaped chain between extruders has saved. Without sharing, the pool would need up to the maximum saved more than the number created.
+/*static*/ void MoveSegment::Diagnostics(MessageType mtype) noexcept
+{
+	if (numAllocationsSaved != 0)
+	{
+		reprap.GetPlatform().MessageF(mtype, "Shared extruder segments: allocations saved %u, max saved at once %u (%u bytes)\n",
+										numAllocationsSaved, maxSharedInUse, maxSharedInUse * (unsigned int)sizeof(MoveSegment));
+		numAllocationsSaved = 0;
+		maxSharedInUse = numSharedInUse;
+	}
+	if (budget != 0)
+	{
+		reprap.GetPlatform().MessageF(mtype, "Segment budget %u, in use %u, max %u, shaping disabled %u, over budget %u\n",
+										budget, numInUse, maxInUse, numDegradations, numAllocationFailures);
+	}
+}
+
 void MoveSegment::DebugPrint(char ch) const noexcept
 {
 	debugPrintf("%c d=%.4e t=%.1f ", ch, (double)segLength, (double)segTime);
@@ -55,6 +124,10 @@ void MoveSegment::DebugPrint(char ch) const noexcept
 	{
 		debugPrintf("c=%.4e\n", (double)c);
 	}
+	else if (IsCubic())
+	{
+		debugPrintf("b=%.4e c=%.4e d=%.4e\n", (double)b, (double)c, (double)d);
+	}
 	else
 	{
 		debugPrintf("b=%.4e c=%.4e\n", (double)b, (double)c);
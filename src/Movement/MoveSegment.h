@@ -108,6 +108,9 @@
  *   B' = -(Dprev + p/f)*C + ts
  *   C' = C * 1/(f*m)
  *
+ * This is what we do: all extruder DMs of a move share the DDA's chain of unshaped segments, and each DM applies its own k, p and EAD when it starts a segment.
+ * Where axes are not input shaped they share the same chain. The number of segment allocations saved by sharing is reported by M122.
+ *
  * When preparing a move we need to:
  *   Set up the axis and extruder move segments
  *   For each linear axis and extruder, calculate and store 1/(f*m) and store in the DM
@@ -126,6 +129,14 @@
  *   C for accel/decel is in step clocks^2/mm so it can probably be stored directly in 64 bits (check - does this work for very low f ?)
  *   C for linear motion is in step clocks/mm so can be stored directly in 32 bits
  *   1/(f*m) is in mm/step. We will have to store it multiplied by e.g. 2^24 as 32 bits, and after multiplying it by C to get a 64-bit result, shift it right to divide by 2^24.
+ *
+ * Jerk-limited (S-curve) acceleration uses a third type of segment in which the acceleration changes linearly with time, so that position is a cubic function of time.
+ * Measuring distance S and time T from the start of the segment:
+ *   S = u*T + (a0/2)*T^2 + (j/6)*T^3
+ * where u is the initial speed, a0 is the initial acceleration and j is the jerk, all relating to the move as a whole. The segment stores b = u, c = a0/2 and d = j/6.
+ * There is no closed form for T in terms of S that is cheap enough to use in the step ISR, so when starting a cubic segment for an axis we multiply these coefficients by f*m
+ * to get the step count as a cubic function of time, and the step ISR solves it using Newton-Raphson iteration starting from the previous step time plus the previous step interval.
+ * Cubic segments are only generated for Cartesian axes. Extruders use the unshaped segments, and delta axes don't use S-curve acceleration.
  */
 
 #ifndef SRC_MOVEMENT_MOVESEGMENT_H_
@@ -153,14 +164,20 @@ public:
 	float CalcLinearB(float startDistance, float startTime) const noexcept;
 	float CalcC(float mmPerStep) const noexcept;
 	float GetC() const noexcept { return c; }
+	float GetCubicB() const noexcept pre(IsCubic()) { return b; }
+	float GetCubicC() const noexcept pre(IsCubic()) { return c; }
+	float GetCubicD() const noexcept pre(IsCubic()) { return d; }
+	void GetCoefficients(float& p_b, float& p_c, float& p_d) const noexcept { p_b = b; p_c = c; p_d = d; }	// for recording moves, d is only valid for cubic segments
 
 	void SetLinear(float pSegmentLength, float p_segTime, float p_c) noexcept;
 	void SetNonLinear(float pSegmentLength, float p_segTime, float p_b, float p_c) noexcept;
+	void SetCubic(float pSegmentLength, float p_segTime, float p_u, float p_a0, float p_jerk) noexcept;
 	void SetReverse() noexcept;
 
 	MoveSegment *GetNext() const noexcept;
 	bool IsLinear() const noexcept;
-	bool IsAccelerating() const noexcept pre(!IsLinear());
+	bool IsCubic() const noexcept;
+	bool IsAccelerating() const noexcept pre(!IsLinear(); !IsCubic());
 	bool IsLast() const noexcept;
 
 	void SetNext(MoveSegment *p_next) noexcept;
@@ -176,6 +193,23 @@ public:
 	static void InitialAllocate(unsigned int num) noexcept;
 	static unsigned int NumCreated() noexcept { return numCreated; }
 
+	// Segment pool budget, set by M595 M. When the budget is nonzero the pool is allocated up front and moves are not input shaped if the pool doesn't have room for their shaped segments.
+	static void SetBudget(unsigned int num) noexcept;
+	static unsigned int GetBudget() noexcept { return budget; }
+	static bool CanAllocateShaped(unsigned int numShapedSegments) noexcept;
+	static unsigned int NumInUse() noexcept { return numInUse; }
+	static unsigned int MaxInUse() noexcept { return maxInUse; }
+	static unsigned int NumDegradations() noexcept { return numDegradations; }
+	static unsigned int NumAllocationFailures() noexcept { return numAllocationFailures; }
+
+	// Count the segments in a chain
+	static unsigned int CountSegments(const MoveSegment *seg) noexcept;
+
+	// Record that a DM is sharing a chain instead of having its own, and that the DDA that owned the shared segments has released them
+	static void NoteShared(unsigned int numSegments) noexcept;
+	static void ReleaseShared(unsigned int numSegments) noexcept;
+	static void Diagnostics(MessageType mtype) noexcept;
+
 	static constexpr unsigned int SFdistance = 10;
 	static constexpr unsigned int SFstepsPerMm = 16;
 	static constexpr unsigned int SFmmPerStep = 31;
@@ -189,11 +223,22 @@ public:
 	static constexpr uint32_t Kdelta = 1u << SFdelta;						// a power of 2 for scaling delta motion calculations to reduce rounding error (but too high makes things worse)
 
 private:
+	static constexpr unsigned int MaxUnshapedSegments = 3;	// acceleration, steady speed and deceleration
+
 	static constexpr uint32_t LinearFlag = 0x01;
+	static constexpr uint32_t CubicFlag = 0x02;
 	static constexpr uint32_t AllFlags = 0x03;
 
 	static MoveSegment *freeList;
 	static unsigned int numCreated;
+	static unsigned int budget;								// the maximum number of segments we want to create, or zero if there is no limit
+	static unsigned int numInUse;
+	static unsigned int maxInUse;
+	static unsigned int numDegradations;					// the number of moves that we didn't input shape because the pool was short of segments
+	static unsigned int numAllocationFailures;				// the number of segments we had to create beyond the budget
+	static unsigned int numSharedInUse;						// the number of segments that extruder DMs of queued moves would have used if they didn't share chains
+	static unsigned int maxSharedInUse;
+	static unsigned int numAllocationsSaved;				// the number of segment allocations avoided by sharing chains since the last diagnostics report
 
 	static_assert(sizeof(MoveSegment*) == sizeof(uint32_t));
 
@@ -202,6 +247,7 @@ private:
 	float segLength;										// the length of this segment before applying the movement fraction
 	float segTime;											// the time in step clocks at which this move ends
 	float b, c;												// the move parameters (b is not needed for linear moves)
+	float d;												// the cubic coefficient, only used by cubic segments
 };
 
 // Create a new one, leaving the flags clear
@@ -226,6 +272,11 @@ inline bool MoveSegment::IsLinear() const noexcept
 	return nextAndFlags & LinearFlag;
 }
 
+inline bool MoveSegment::IsCubic() const noexcept
+{
+	return nextAndFlags & CubicFlag;
+}
+
 
 inline bool MoveSegment::IsLast() const noexcept
 {
@@ -281,6 +332,17 @@ inline void MoveSegment::SetNonLinear(float pSegmentLength, float p_segTime, flo
 	c = p_c;
 }
 
+// Set up a segment with constant jerk. We assume that the 'linear' flag is already clear.
+inline void MoveSegment::SetCubic(float pSegmentLength, float p_segTime, float p_u, float p_a0, float p_jerk) noexcept
+{
+	segLength = pSegmentLength;
+	segTime = p_segTime;
+	b = p_u;
+	c = 0.5 * p_a0;
+	d = p_jerk * (1.0/6.0);
+	nextAndFlags |= CubicFlag;
+}
+
 // Given that this is an accelerating or decelerating move, return true if it is accelerating
 inline bool MoveSegment::IsAccelerating() const noexcept
 {
@@ -292,6 +354,22 @@ inline void MoveSegment::Release(MoveSegment *item) noexcept
 {
 	item->nextAndFlags = reinterpret_cast<uint32_t>(freeList);
 	freeList = item;
+	--numInUse;
+}
+
+inline void MoveSegment::NoteShared(unsigned int numSegments) noexcept
+{
+	numAllocationsSaved += numSegments;
+	numSharedInUse += numSegments;
+	if (numSharedInUse > maxSharedInUse)
+	{
+		maxSharedInUse = numSharedInUse;
+	}
+}
+
+inline void MoveSegment::ReleaseShared(unsigned int numSegments) noexcept
+{
+	numSharedInUse -= numSegments;
 }
 
 #endif /* SRC_MOVEMENT_MOVESEGMENT_H_ */
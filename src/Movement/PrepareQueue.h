@@ -0,0 +1,104 @@
+/*
+ * PrepareQueue.h
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * This is a lock-free single-producer single-consumer queue of DDAs waiting to be prepared by the background prepare task.
+ * The producer is the Move task, which hands over DDAs in ring order after it has finished doing lookahead on them and sets their state to 'preparing'.
+ * The consumer is the prepare task, which calls DDA::Prepare on them in the same order. Preparing a DDA changes its state to 'frozen' (or 'completed' if no movement is needed),
+ * which is how the prepared DDAs are passed back to the Move task and the step ISR, so there is no separate queue of prepared DDAs.
+ *
+ * The producer only writes putIndex and the consumer only writes getIndex, except that DiscardFreed may be called when both tasks are locked out.
+ * The consumer only accesses the queue while it holds the DDARing prepare mutex, so holding that mutex and locking out the Move task is sufficient.
+ */
+
+#ifndef SRC_MOVEMENT_PREPAREQUEUE_H_
+#define SRC_MOVEMENT_PREPAREQUEUE_H_
+
+#include "DDA.h"
+
+class PrepareQueue
+{
+public:
+	static constexpr size_t Capacity = 8;					// the maximum number of DDAs waiting to be prepared
+
+	struct Item
+	{
+		DDA *dda;											// the DDA to prepare
+		uint32_t deadline;									// the step clock time by which the DDA should have been prepared
+		bool hasDeadline;									// false if no move was executing or prepared when the DDA was handed over
+	};
+
+	PrepareQueue() noexcept : getIndex(0), putIndex(0) { }
+
+	bool IsEmpty() const noexcept { return getIndex == putIndex; }
+	size_t Count() const noexcept;
+
+	// Functions called by the producer only
+	Item *GetSlotToFill() noexcept;							// return a pointer to the slot that the next item should be written to, or nullptr if the queue is full
+	void CommitFill() noexcept;								// add the item written to the slot to the queue
+
+	// Functions called by the consumer only
+	const Item *GetFirst() const noexcept;					// return a pointer to the oldest item in the queue, or nullptr if the queue is empty
+	void RemoveFirst() noexcept pre(!IsEmpty());			// remove the oldest item from the queue after we have finished with it
+
+	// Functions that may only be called when both the Move task and the prepare task are locked out
+	void Clear() noexcept { getIndex = putIndex = 0; }
+	void DiscardFreed() noexcept;							// discard items at the end of the queue whose DDAs have been freed
+
+private:
+	static size_t Next(size_t index) noexcept { return (index == Capacity) ? 0 : index + 1; }
+	static size_t Previous(size_t index) noexcept { return (index == 0) ? Capacity : index - 1; }
+
+	Item items[Capacity + 1];								// one more slot than the capacity so that we can tell a full queue from an empty one
+	volatile size_t getIndex;								// the index of the oldest item, only changed by the consumer
+	volatile size_t putIndex;								// the index of the next slot to fill, only changed by the producer
+};
+
+inline size_t PrepareQueue::Count() const noexcept
+{
+	const size_t locGetIndex = getIndex, locPutIndex = putIndex;		// capture volatile variables
+	return (locPutIndex >= locGetIndex) ? locPutIndex - locGetIndex : locPutIndex + Capacity + 1 - locGetIndex;
+}
+
+inline PrepareQueue::Item *PrepareQueue::GetSlotToFill() noexcept
+{
+	const size_t locPutIndex = putIndex;
+	return (Next(locPutIndex) == getIndex) ? nullptr : &items[locPutIndex];
+}
+
+inline void PrepareQueue::CommitFill() noexcept
+{
+	__DMB();												// make sure that the item and the DDA state have been written before we make it visible to the consumer
+	putIndex = Next(putIndex);
+}
+
+inline const PrepareQueue::Item *PrepareQueue::GetFirst() const noexcept
+{
+	const size_t locGetIndex = getIndex;
+	if (locGetIndex == putIndex)
+	{
+		return nullptr;
+	}
+	__DMB();												// make sure we don't read the item before we have read putIndex
+	return &items[locGetIndex];
+}
+
+inline void PrepareQueue::RemoveFirst() noexcept
+{
+	__DMB();												// make sure that we have finished preparing the DDA before we release the slot to the producer
+	getIndex = Next(getIndex);
+}
+
+// Discard items at the end of the queue whose DDAs have been freed because we paused. The DDAs are in ring order and we only ever free the newest DDAs in the ring,
+// so the items to discard are always at the end of the queue.
+inline void PrepareQueue::DiscardFreed() noexcept
+{
+	while (putIndex != getIndex && items[Previous(putIndex)].dda->GetState() == DDA::empty)
+	{
+		putIndex = Previous(putIndex);
+	}
+}
+
+#endif /* SRC_MOVEMENT_PREPAREQUEUE_H_ */
@@ -20,6 +20,8 @@ void RawMove::SetDefaults(size_t firstDriveToZero) noexcept
 	hasPositiveExtrusion = false;
 	linearAxesMentioned = false;
 	rotationalAxesMentioned = false;
+	isNativeArc = false;
+	followMesh = false;
 	filePos = noFilePosition;
 	tool = nullptr;
 	cosXyAngle = 1.0;
@@ -10,6 +10,21 @@
 
 #include "RepRapFirmware.h"
 
+#if SUPPORT_NATIVE_ARCS
+
+// Parameters of an arc move that is executed as a single move instead of being split into straight segments.
+// The angles are measured from the +axis0 direction towards the +axis1 direction in machine coordinates, so a positive total angle is anticlockwise.
+struct NativeArcParameters
+{
+	float radius;													// the arc radius in machine coordinates
+	float startAngle;												// the angle of the start point relative to the arc centre
+	float totalAngle;												// the angle turned through, positive for anticlockwise
+	uint8_t axis0, axis1;											// the machine axes in the plane of the arc
+	uint16_t padding;
+};
+
+#endif
+
 // Details of a move that are passed from GCodes to Move
 struct RawMove
 {
@@ -31,12 +46,17 @@ struct RawMove
 			checkEndstops : 1,										// true if any endstops or the Z probe can terminate the move
 			reduceAcceleration : 1,									// true if Z probing so we should limit the Z acceleration
 			linearAxesMentioned : 1,								// true if any linear axes were mentioned in the movement command
-			rotationalAxesMentioned: 1;								// true if any rotational axes were mentioned in the movement command
+			rotationalAxesMentioned: 1,								// true if any rotational axes were mentioned in the movement command
+			isNativeArc : 1,										// true if this is an arc move to be executed as a single move, in which case 'arc' is valid
+			followMesh : 1;											// true if the Z motor should follow the height map during the move instead of the move being segmented
 
 #if SUPPORT_LASER || SUPPORT_IOBITS
 	LaserPwmOrIoBits laserPwmOrIoBits;								// the laser PWM or port bit settings required
 #else
 	uint16_t padding;
+#endif
+#if SUPPORT_NATIVE_ARCS
+	NativeArcParameters arc;										// the arc parameters if isNativeArc is set
 #endif
 	// If adding any more fields, keep the total size a multiple of 4 bytes so that we can use our optimised assignment operator
 
@@ -0,0 +1,23 @@
+/*
+ * RawMoveQueue.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include "RawMoveQueue.h"
+
+// Change the capacity of the queue. The queue must be empty and the Move task must be locked out.
+// This violates our rule on no dynamic memory allocation after the initialisation phase, however it is normally only done when M595 in config.g is processed.
+void RawMoveQueue::SetCapacity(size_t newCapacity) noexcept
+{
+	if (newCapacity != capacity)
+	{
+		delete[] moves;
+		moves = (newCapacity == 0) ? nullptr : new RawMove[newCapacity + 1];
+		capacity = newCapacity;
+	}
+	Clear();
+}
+
+// End
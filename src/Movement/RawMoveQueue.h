@@ -0,0 +1,97 @@
+/*
+ * RawMoveQueue.h
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * This is a lock-free single-producer single-consumer queue of RawMoves. The producer is the task that runs GCodes, which fills it by calling GCodes::ReadMove.
+ * The consumer is the Move task, which takes moves from it and adds them to the main DDA ring. This allows GCodes to carry on parsing commands and
+ * splitting segmented moves while the DDA ring is full, instead of waiting for the Move task to take each move.
+ *
+ * The producer only writes putIndex and the consumer only writes getIndex, except that the queue may be cleared or resized when the Move task is locked out.
+ * GetItem and Truncate may only be called by the producer when the Move task is locked out, e.g. when pausing the print.
+ * A capacity of zero means that the queue is not used and the Move task fetches moves directly from GCodes.
+ */
+
+#ifndef SRC_MOVEMENT_RAWMOVEQUEUE_H_
+#define SRC_MOVEMENT_RAWMOVEQUEUE_H_
+
+#include "RawMove.h"
+
+class RawMoveQueue
+{
+public:
+	RawMoveQueue() noexcept : moves(nullptr), capacity(0), getIndex(0), putIndex(0) { }
+
+	bool IsEnabled() const noexcept { return capacity != 0; }
+	size_t GetCapacity() const noexcept { return capacity; }
+	bool IsEmpty() const noexcept { return getIndex == putIndex; }
+	size_t Count() const noexcept;
+
+	// Functions called by the producer only
+	RawMove *GetSlotToFill() noexcept;						// return a pointer to the slot that the next move should be written to, or nullptr if the queue is full
+	void CommitFill() noexcept;								// add the move written to the slot to the queue
+	const RawMove *GetItem(size_t n) const noexcept pre(n < Count()) { return &moves[(getIndex + n) % (capacity + 1)]; }	// get the nth oldest move
+	void Truncate(size_t numToKeep) noexcept pre(numToKeep <= Count()) { putIndex = (getIndex + numToKeep) % (capacity + 1); }	// discard all but the oldest moves
+
+	// Functions called by the consumer only
+	RawMove *GetFirst() const noexcept;						// return a pointer to the oldest move in the queue, or nullptr if the queue is empty
+	const RawMove *Peek(size_t n) const noexcept pre(n < Count());	// return a pointer to the nth oldest move in the queue without removing it
+	void RemoveFirst() noexcept pre(!IsEmpty());			// remove the oldest move from the queue after we have finished with it
+
+	// Functions that may only be called when the Move task is locked out or not running
+	void Clear() noexcept { getIndex = putIndex = 0; }
+	void SetCapacity(size_t newCapacity) noexcept pre(IsEmpty());
+
+private:
+	size_t Next(size_t index) const noexcept { return (index == capacity) ? 0 : index + 1; }
+
+	RawMove *moves;											// the storage for the queue, which has one more slot than the capacity so that we can tell a full queue from an empty one
+	size_t capacity;										// the maximum number of moves in the queue
+	volatile size_t getIndex;								// the index of the oldest move, only changed by the consumer
+	volatile size_t putIndex;								// the index of the next slot to fill, only changed by the producer
+};
+
+inline size_t RawMoveQueue::Count() const noexcept
+{
+	const size_t locGetIndex = getIndex, locPutIndex = putIndex;		// capture volatile variables
+	return (locPutIndex >= locGetIndex) ? locPutIndex - locGetIndex : locPutIndex + capacity + 1 - locGetIndex;
+}
+
+inline RawMove *RawMoveQueue::GetSlotToFill() noexcept
+{
+	const size_t locPutIndex = putIndex;
+	return (capacity == 0 || Next(locPutIndex) == getIndex) ? nullptr : &moves[locPutIndex];
+}
+
+inline void RawMoveQueue::CommitFill() noexcept
+{
+	__DMB();												// make sure that the move has been written before we make it visible to the consumer
+	putIndex = Next(putIndex);
+}
+
+inline RawMove *RawMoveQueue::GetFirst() const noexcept
+{
+	const size_t locGetIndex = getIndex;
+	if (locGetIndex == putIndex)
+	{
+		return nullptr;
+	}
+	__DMB();												// make sure we don't read the move before we have read putIndex
+	return &moves[locGetIndex];
+}
+
+inline const RawMove *RawMoveQueue::Peek(size_t n) const noexcept
+{
+	const size_t locGetIndex = getIndex;
+	__DMB();												// make sure we don't read the move before the caller read putIndex to find out how many moves there are
+	return &moves[(locGetIndex + n) % (capacity + 1)];
+}
+
+inline void RawMoveQueue::RemoveFirst() noexcept
+{
+	__DMB();												// make sure that we have finished reading the move before we release the slot to the producer
+	getIndex = Next(getIndex);
+}
+
+#endif /* SRC_MOVEMENT_RAWMOVEQUEUE_H_ */
@@ -0,0 +1,149 @@
+/*
+ * ShaperPlanCache.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include "ShaperPlanCache.h"
+
+#if SUPPORT_SHAPER_PLAN_CACHE
+
+#include "DDA.h"
+#include <Platform/RepRap.h>
+#include <Platform/Platform.h>
+#include <Platform/Tasks.h>
+#include "StepTimer.h"
+
+struct ShaperPlanCache::Entry
+{
+	static constexpr uint32_t NoConditions = 0xFFFFFFFF;				// value of 'conditions' in an empty entry
+
+	// The parameters of the move that determine the plan
+	float startSpeed, topSpeed, endSpeed, totalDistance;
+	float acceleration, deceleration, accelDistance, decelDistance;
+	uint32_t conditions;
+	uint32_t generation;
+
+	// The plan
+	InputShaperPlan plan;
+	PrepParams::PrepParamSet unshaped;
+	PrepParams::PrepParamSet shaped;
+
+	bool Matches(const DDA& dda, uint32_t p_conditions, uint32_t p_generation) const noexcept;
+	void SetKey(const DDA& dda, uint32_t p_conditions, uint32_t p_generation) noexcept;
+};
+
+inline bool ShaperPlanCache::Entry::Matches(const DDA& dda, uint32_t p_conditions, uint32_t p_generation) const noexcept
+{
+	return conditions == p_conditions && generation == p_generation
+		&& startSpeed == dda.startSpeed && topSpeed == dda.topSpeed && endSpeed == dda.endSpeed && totalDistance == dda.totalDistance
+		&& acceleration == dda.acceleration && deceleration == dda.deceleration
+		&& accelDistance == dda.beforePrepare.accelDistance && decelDistance == dda.beforePrepare.decelDistance;
+}
+
+inline void ShaperPlanCache::Entry::SetKey(const DDA& dda, uint32_t p_conditions, uint32_t p_generation) noexcept
+{
+	startSpeed = dda.startSpeed;
+	topSpeed = dda.topSpeed;
+	endSpeed = dda.endSpeed;
+	totalDistance = dda.totalDistance;
+	acceleration = dda.acceleration;
+	deceleration = dda.deceleration;
+	accelDistance = dda.beforePrepare.accelDistance;
+	decelDistance = dda.beforePrepare.decelDistance;
+	conditions = p_conditions;
+	generation = p_generation;
+}
+
+// Add a value to a hash, keeping only the sign, exponent and top 10 bits of the mantissa so that nearly equal values usually hash to the same slot
+static inline uint32_t AddToHash(uint32_t hash, float f) noexcept
+{
+	uint32_t bits;
+	memcpy(&bits, &f, sizeof(bits));
+	return (hash ^ (bits >> 13)) * 16777619u;							// FNV-1a step
+}
+
+bool ShaperPlanCache::Lookup(const DDA& dda, uint32_t conditions, PrepParams& params) noexcept
+{
+	if (entries == nullptr)
+	{
+		entries = static_cast<Entry*>(Tasks::AllocPermanent(NumEntries * sizeof(Entry)));
+		Clear();
+	}
+
+	const uint32_t startTime = StepTimer::GetTimerTicks();
+	uint32_t hash = 2166136261u ^ conditions;
+	hash = AddToHash(hash, dda.startSpeed);
+	hash = AddToHash(hash, dda.topSpeed);
+	hash = AddToHash(hash, dda.endSpeed);
+	hash = AddToHash(hash, dda.totalDistance);
+	hash = AddToHash(hash, dda.acceleration);
+	hash = AddToHash(hash, dda.deceleration);
+	Entry& e = entries[(hash ^ (hash >> 16)) & (NumEntries - 1)];
+
+	const uint32_t currentGeneration = generation;
+	++numLookups;
+	if (e.Matches(dda, conditions, currentGeneration))
+	{
+		++numHits;
+		params.shapingPlan = e.plan;
+		params.unshaped = e.unshaped;
+		params.shaped = e.shaped;
+		lastEntry = nullptr;
+		hitClocks += StepTimer::GetTimerTicks() - startTime;
+		return true;
+	}
+
+	e.conditions = Entry::NoConditions;								// so that the entry can't match until Store has filled it
+	lastEntry = &e;
+	lastConditions = conditions;
+	lastGeneration = currentGeneration;
+	lastLookupTime = startTime;
+	return false;
+}
+
+void ShaperPlanCache::Store(const DDA& dda, const PrepParams& params) noexcept
+{
+	if (lastEntry != nullptr)
+	{
+		lastEntry->SetKey(dda, lastConditions, lastGeneration);
+		lastEntry->plan = params.shapingPlan;
+		lastEntry->unshaped = params.unshaped;
+		lastEntry->shaped = params.shaped;
+		lastEntry = nullptr;
+		++numStored;
+		missClocks += StepTimer::GetTimerTicks() - lastLookupTime;
+	}
+}
+
+void ShaperPlanCache::Clear() noexcept
+{
+	++generation;														// do this first so that a plan being worked out now is stored under the old generation
+	if (entries != nullptr)
+	{
+		for (size_t i = 0; i < NumEntries; ++i)
+		{
+			entries[i].conditions = Entry::NoConditions;
+		}
+	}
+	lastEntry = nullptr;
+}
+
+void ShaperPlanCache::Diagnostics(MessageType mtype) noexcept
+{
+	if (numLookups != 0)
+	{
+		// The time for a miss includes working out the plan, so comparing it with the time for a hit shows what the cache saves
+		constexpr float StepClocksToMicros = StepClocksToMillis * 1000.0;
+		reprap.GetPlatform().MessageF(mtype, "Shaper plan cache: lookups %" PRIu32 ", hits %" PRIu32 " (%.1f%%), time per hit %.1fus, per miss %.1fus\n",
+										numLookups, numHits, (double)((float)numHits * 100.0/(float)numLookups),
+										(double)((numHits == 0) ? 0.0 : (float)hitClocks * StepClocksToMicros/numHits),
+										(double)((numStored == 0) ? 0.0 : (float)missClocks * StepClocksToMicros/numStored));
+		numLookups = numHits = numStored = hitClocks = missClocks = 0;
+	}
+}
+
+#endif
+
+// End
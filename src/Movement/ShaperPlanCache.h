@@ -0,0 +1,70 @@
+/*
+ * ShaperPlanCache.h
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * A small cache of input shaping plans. Infill and perimeters repeat the same move profile many times, so AxisShaper::PlanShaping looks up the plan here before working it out.
+ * The cache is indexed by a hash of the start, top and end speeds, acceleration, deceleration and length of the move, quantised so that very similar moves share a slot.
+ * An entry is only used if those values and the neighbouring move conditions that affect the plan match exactly, because the plan fixes the distances of the shaped segments
+ * and they must add up to the length of the move.
+ * M593 doesn't wait for the moves being prepared to finish, so each entry also records the shaper type and the configuration generation, which Clear increments.
+ * A plan that was being worked out when the shaper was changed is stored under the old generation, so it can never be returned after the change.
+ *
+ * The entries are allocated when the cache is first used, so it uses no RAM unless input shaping is in use. It is only accessed while preparing moves.
+ */
+
+#ifndef SRC_MOVEMENT_SHAPERPLANCACHE_H_
+#define SRC_MOVEMENT_SHAPERPLANCACHE_H_
+
+#include <RepRapFirmware.h>
+
+#if SUPPORT_SHAPER_PLAN_CACHE
+
+class DDA;
+struct PrepParams;
+
+class ShaperPlanCache
+{
+public:
+	// Conditions that affect the plan as well as the move parameters
+	static constexpr uint32_t ShapeAccelEndOnly = 0x01;				// the previous move was an acceleration-only move that is already executing
+	static constexpr uint32_t ShapeDecelStartOnly = 0x02;				// the next move is a deceleration-only move
+	static constexpr unsigned int ShaperTypeShift = 8;					// the shaper type is included in the conditions shifted left by this amount
+
+	ShaperPlanCache() noexcept : entries(nullptr), lastEntry(nullptr), lastConditions(0), lastGeneration(0), generation(0), numLookups(0), numHits(0),
+										numStored(0), lastLookupTime(0), hitClocks(0), missClocks(0) { }
+
+	// Look up the plan for a DDA. If found then copy it to params and return true, else return false and remember the slot so that Store can fill it.
+	// params must already have been set up from the DDA. The DDA must not be changed between calling Lookup and Store.
+	bool Lookup(const DDA& dda, uint32_t conditions, PrepParams& params) noexcept;
+
+	// Store the plan just worked out for the DDA passed to the last call to Lookup
+	void Store(const DDA& dda, const PrepParams& params) noexcept;
+
+	// Forget all plans, e.g. because the input shaper has been changed. This may be called while a move is being prepared.
+	void Clear() noexcept;
+
+	void Diagnostics(MessageType mtype) noexcept;
+
+private:
+	struct Entry;
+
+	static constexpr size_t NumEntries = 16;							// must be a power of 2
+
+	Entry *entries;
+	Entry *lastEntry;													// the slot that the last unsuccessful lookup chose
+	uint32_t lastConditions;											// the conditions passed to the last unsuccessful lookup
+	uint32_t lastGeneration;											// the configuration generation when the last unsuccessful lookup was made
+	volatile uint32_t generation;										// incremented each time the cache is cleared
+	uint32_t numLookups;
+	uint32_t numHits;
+	uint32_t numStored;
+	uint32_t lastLookupTime;											// when the last unsuccessful lookup started
+	uint32_t hitClocks;													// the step clocks taken by successful lookups, for diagnostics
+	uint32_t missClocks;												// the step clocks from the start of each unsuccessful lookup to storing the plan, for diagnostics
+};
+
+#endif
+
+#endif /* SRC_MOVEMENT_SHAPERPLANCACHE_H_ */
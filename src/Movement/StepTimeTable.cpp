@@ -0,0 +1,60 @@
+/*
+ * StepTimeTable.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include "StepTimeTable.h"
+#include <Platform/RepRap.h>
+#include <Platform/Platform.h>
+
+// Static members
+
+StepTimeTable *StepTimeTable::freeList = nullptr;
+unsigned int StepTimeTable::numCreated = 0;
+unsigned int StepTimeTable::numInUse = 0;
+unsigned int StepTimeTable::maxInUse = 0;
+unsigned int StepTimeTable::numExhausted = 0;
+
+void StepTimeTable::InitialAllocate(unsigned int num) noexcept
+{
+	while (num > numCreated)
+	{
+		freeList = new StepTimeTable(freeList);
+		++numCreated;
+	}
+}
+
+// Allocate a table from the freelist. Unlike DMs and MoveSegments we never create new ones here, because the caller can fall back to calculating the step times.
+StepTimeTable *StepTimeTable::Allocate() noexcept
+{
+	StepTimeTable * const table = freeList;
+	if (table == nullptr)
+	{
+		++numExhausted;
+		return nullptr;
+	}
+
+	freeList = table->next;
+	table->numSteps = 0;
+	++numInUse;
+	if (numInUse > maxInUse)
+	{
+		maxInUse = numInUse;
+	}
+	return table;
+}
+
+void StepTimeTable::Diagnostics(MessageType mtype) noexcept
+{
+	if (numCreated != 0)
+	{
+		reprap.GetPlatform().MessageF(mtype, "Step time tables %u (%u bytes), in use %u, max %u, exhausted %u\n",
+										numCreated, numCreated * (unsigned int)sizeof(StepTimeTable), numInUse, maxInUse, numExhausted);
+		maxInUse = numInUse;
+		numExhausted = 0;
+	}
+}
+
+// End
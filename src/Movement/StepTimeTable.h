@@ -0,0 +1,75 @@
+/*
+ * StepTimeTable.h
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * This class holds a table of precomputed step times for part of a DriveMovement.
+ * Calculating the step times for accelerating and decelerating motion needs a square root per step (or per double/quad/octal step),
+ * which limits the maximum step rate that the step ISR can sustain. The shortest step intervals in a move that starts by accelerating are
+ * at the end of the accelerating phase, so when step time tables are enabled, DDA::Prepare calculates the times of the last steps of that phase
+ * for each Cartesian axis in the Move task and stores the results here. The tabled steps all lie within one segment and exclude its first step.
+ * The step ISR calculates the steps before the table as normal, reads the table entries instead of calculating those steps,
+ * then moves on to the next segment as normal.
+ *
+ * The tables are allocated from a fixed-size pool configured by M595 T. If the pool is exhausted, the DM uses the normal calculation for the whole move.
+ * Tables are only allocated and released by the Move task. The step ISR only ever reads them.
+ */
+
+#ifndef SRC_MOVEMENT_STEPTIMETABLE_H_
+#define SRC_MOVEMENT_STEPTIMETABLE_H_
+
+#include <RepRapFirmware.h>
+#include <Platform/Tasks.h>
+
+class StepTimeTable
+{
+public:
+	static constexpr size_t TableLength = 64;							// the maximum number of step times in each table
+	static constexpr uint32_t MinSteps = 8;								// don't use a table for fewer steps than this
+
+	StepTimeTable(StepTimeTable *p_next) noexcept : next(p_next), firstStep(0), numSteps(0) { }
+
+	void* operator new(size_t count) { return Tasks::AllocPermanent(count); }
+	void* operator new(size_t count, std::align_val_t align) { return Tasks::AllocPermanent(count, align); }
+	void operator delete(void* ptr) noexcept {}
+	void operator delete(void* ptr, std::align_val_t align) noexcept {}
+
+	bool Covers(uint32_t stepNumber) const noexcept { return stepNumber - firstStep < numSteps; }		// relies on unsigned arithmetic wrapping round
+	uint32_t GetStepTime(uint32_t stepNumber) const noexcept pre(Covers(stepNumber)) { return stepTimes[stepNumber - firstStep]; }
+
+	// Allocate a table from the pool, returning nullptr if the pool is exhausted. Not thread-safe.
+	static StepTimeTable *Allocate() noexcept;
+
+	// Release a table back to the pool. Not thread-safe.
+	static void Release(StepTimeTable *item) noexcept;
+
+	static void InitialAllocate(unsigned int num) noexcept;
+	static bool IsEnabled() noexcept { return numCreated != 0; }
+	static unsigned int NumCreated() noexcept { return numCreated; }
+	static void Diagnostics(MessageType mtype) noexcept;
+
+private:
+	friend class DriveMovement;
+
+	static StepTimeTable *freeList;
+	static unsigned int numCreated;
+	static unsigned int numInUse;
+	static unsigned int maxInUse;
+	static unsigned int numExhausted;
+
+	StepTimeTable *next;												// link to the next table in the free list
+	uint32_t firstStep;													// the step number of the first step time stored
+	uint32_t numSteps;													// how many step times are stored
+	uint32_t stepTimes[TableLength];									// the step times in step clocks since the start of the move, for step numbers firstStep upwards
+};
+
+// Release a table. Not thread-safe.
+inline void StepTimeTable::Release(StepTimeTable *item) noexcept
+{
+	item->next = freeList;
+	freeList = item;
+	--numInUse;
+}
+
+#endif /* SRC_MOVEMENT_STEPTIMETABLE_H_ */
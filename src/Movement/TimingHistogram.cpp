@@ -0,0 +1,96 @@
+/*
+ * TimingHistogram.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include "TimingHistogram.h"
+
+// Object model table and functions
+// Note: if using GCC version 7.3.1 20180622 and lambda functions are used in this table, you must compile this file with option -std=gnu++17.
+// Otherwise the table will be allocated in RAM instead of flash, which wastes too much RAM.
+
+// Macro to build a standard lambda function that includes the necessary type conversions
+#define OBJECT_MODEL_FUNC(...) OBJECT_MODEL_FUNC_BODY(TimingHistogram, __VA_ARGS__)
+#define OBJECT_MODEL_FUNC_IF(...) OBJECT_MODEL_FUNC_IF_BODY(TimingHistogram, __VA_ARGS__)
+
+constexpr ObjectModelArrayDescriptor TimingHistogram::countsArrayDescriptor =
+{
+	nullptr,					// no lock needed
+	[] (const ObjectModel *self, const ObjectExplorationContext& context) noexcept -> size_t { return NumBuckets; },
+	[] (const ObjectModel *self, ObjectExplorationContext& context) noexcept
+										-> ExpressionValue { return ExpressionValue((int32_t)((const TimingHistogram*)self)->counts[context.GetIndex(0)]); }
+};
+
+constexpr ObjectModelArrayDescriptor TimingHistogram::limitsArrayDescriptor =
+{
+	nullptr,					// no lock needed
+	[] (const ObjectModel *self, const ObjectExplorationContext& context) noexcept -> size_t { return NumBuckets - 1; },
+	[] (const ObjectModel *self, ObjectExplorationContext& context) noexcept
+										-> ExpressionValue { return ExpressionValue(((const TimingHistogram*)self)->GetLimit(context.GetIndex(0)), ((const TimingHistogram*)self)->decimals); }
+};
+
+constexpr ObjectModelTableEntry TimingHistogram::objectModelTable[] =
+{
+	// Within each group, these entries must be in alphabetical order
+	// 0. TimingHistogram members
+	{ "counts",					OBJECT_MODEL_FUNC_NOSELF(&countsArrayDescriptor), 								ObjectModelEntryFlags::live },
+	{ "limits",					OBJECT_MODEL_FUNC_NOSELF(&limitsArrayDescriptor), 								ObjectModelEntryFlags::none },
+	{ "max",					OBJECT_MODEL_FUNC((float)self->maxClocks * self->unitsPerClock, self->decimals),	ObjectModelEntryFlags::live },
+	{ "missed",					OBJECT_MODEL_FUNC((int32_t)self->numMissed),									ObjectModelEntryFlags::live },
+	{ "total",					OBJECT_MODEL_FUNC((int32_t)self->GetTotal()),									ObjectModelEntryFlags::live },
+};
+
+constexpr uint8_t TimingHistogram::objectModelTableDescriptor[] = { 1, 5 };
+
+DEFINE_GET_OBJECT_MODEL_TABLE(TimingHistogram)
+
+TimingHistogram::TimingHistogram(uint32_t p_bucketClocks, float p_unitsPerClock, uint8_t p_decimals) noexcept
+	: bucketClocks(max<uint32_t>(p_bucketClocks, 1)), unitsPerClock(p_unitsPerClock), decimals(p_decimals)
+{
+	Reset();
+}
+
+void TimingHistogram::Reset() noexcept
+{
+	AtomicCriticalSectionLocker lock;
+	for (volatile uint32_t& c : counts)
+	{
+		c = 0;
+	}
+	maxClocks = 0;
+	numMissed = 0;
+}
+
+// Get the total number of values added, including missed deadlines. The counts may be changing while we do this, so the total may not quite match them.
+uint32_t TimingHistogram::GetTotal() const noexcept
+{
+	uint32_t total = numMissed;
+	for (uint32_t c : counts)
+	{
+		total += c;
+	}
+	return total;
+}
+
+MoveTiming::MoveTiming() noexcept
+	: ddaDuration(StepClockRate/4000, StepClocksToMillis, 2),
+	  deadlineMargin(StepClockRate/1000, StepClocksToMillis, 0),
+	  isrTime(StepClockRate/1000000, StepClocksToMillis * 1000.0, 1),
+	  prepareTime(StepClockRate/100000, StepClocksToMillis * 1000.0, 0),
+	  segmentsPerMove(1, 1.0, 0)
+{
+}
+
+// Reset all the histograms. Called when M122 reports the move diagnostics.
+void MoveTiming::Reset() noexcept
+{
+	ddaDuration.Reset();
+	deadlineMargin.Reset();
+	isrTime.Reset();
+	prepareTime.Reset();
+	segmentsPerMove.Reset();
+}
+
+// End
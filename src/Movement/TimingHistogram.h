@@ -0,0 +1,88 @@
+/*
+ * TimingHistogram.h
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * Histograms of motion planner and step generator timings, reported in the object model under move.timing so that they can be monitored remotely.
+ * The histograms accumulate from one M122 report to the next, so a client should read them just after sending M122 if it wants counts over a known interval.
+ * Each histogram has buckets whose widths double, so that adding a value takes just a division and a count-leading-zeros instruction.
+ * Values are added from the step ISR as well as from the Move and prepare tasks, so each update is done with interrupts disabled.
+ */
+
+#ifndef SRC_MOVEMENT_TIMINGHISTOGRAM_H_
+#define SRC_MOVEMENT_TIMINGHISTOGRAM_H_
+
+#include <RepRapFirmware.h>
+#include <ObjectModel/ObjectModel.h>
+
+class TimingHistogram INHERIT_OBJECT_MODEL
+{
+public:
+	static constexpr size_t NumBuckets = 12;
+
+	// Bucket 0 holds values less than bucketClocks, bucket n holds values less than (bucketClocks << n), and the last bucket holds all larger values.
+	// unitsPerClock converts step clocks to the units that the limits are reported in.
+	TimingHistogram(uint32_t p_bucketClocks, float p_unitsPerClock, uint8_t p_decimals) noexcept;
+
+	void Add(uint32_t clocks) noexcept SPEED_CRITICAL;
+	void AddMargin(int32_t clocks) noexcept;				// add a value that is negative if a deadline was missed
+	void Reset() noexcept;
+
+protected:
+	DECLARE_OBJECT_MODEL
+	OBJECT_MODEL_ARRAY(counts)
+	OBJECT_MODEL_ARRAY(limits)
+
+private:
+	float GetLimit(size_t bucket) const noexcept { return (float)(bucketClocks << bucket) * unitsPerClock; }
+	uint32_t GetTotal() const noexcept;
+
+	uint32_t bucketClocks;
+	float unitsPerClock;
+	uint8_t decimals;
+	volatile uint32_t maxClocks;
+	volatile uint32_t counts[NumBuckets];
+	volatile uint32_t numMissed;							// the number of negative values passed to AddMargin, which are not included in the buckets
+};
+
+inline void TimingHistogram::Add(uint32_t clocks) noexcept
+{
+	const uint32_t units = clocks/bucketClocks;
+	const size_t bucket = (units == 0) ? 0 : min<size_t>(32 - __builtin_clz(units), NumBuckets - 1);
+	AtomicCriticalSectionLocker lock;
+	counts[bucket] = counts[bucket] + 1;
+	if (clocks > maxClocks)
+	{
+		maxClocks = clocks;
+	}
+}
+
+inline void TimingHistogram::AddMargin(int32_t clocks) noexcept
+{
+	if (clocks >= 0)
+	{
+		Add((uint32_t)clocks);
+	}
+	else
+	{
+		AtomicCriticalSectionLocker lock;
+		numMissed = numMissed + 1;
+	}
+}
+
+// The histograms reported under move.timing
+struct MoveTiming
+{
+	MoveTiming() noexcept;
+
+	TimingHistogram ddaDuration;							// the duration of each move, in milliseconds
+	TimingHistogram deadlineMargin;							// the time between finishing preparing a move and when it is due to start, in milliseconds, with missed deadlines counted separately
+	TimingHistogram isrTime;								// the time spent in each step interrupt, in microseconds
+	TimingHistogram prepareTime;							// the time taken by DDA::Prepare, in microseconds
+	TimingHistogram segmentsPerMove;						// the number of move segments used by each move
+
+	void Reset() noexcept;
+};
+
+#endif /* SRC_MOVEMENT_TIMINGHISTOGRAM_H_ */
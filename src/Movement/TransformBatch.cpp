@@ -0,0 +1,116 @@
+/*
+ * TransformBatch.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include "TransformBatch.h"
+
+#if SUPPORT_TRANSFORM_BATCH
+
+#include "RawMoveQueue.h"
+#include "Move.h"
+#include <Platform/RepRap.h>
+#include <Platform/Platform.h>
+#include <GCodes/GCodes.h>
+
+// Get the motor positions for the move that the Move task is about to add to the DDA ring, which must be the oldest move in the raw move queue
+const int32_t *TransformBatch::GetMotorSteps(RawMove& move, RawMoveQueue& queue, const int32_t positionNow[]) noexcept
+{
+	if (nextMove == numMoves || moves[nextMove] != &move)
+	{
+		Build(queue, positionNow);
+		if (numMoves == 0 || moves[0] != &move)
+		{
+			return nullptr;
+		}
+	}
+
+	memcpyf(move.coords, coords[nextMove], reprap.GetGCodes().GetVisibleAxes());
+	++numMovesBatched;
+	return motorSteps[nextMove++];
+}
+
+// Transform as many of the moves at the start of the queue as we can in one batch.
+// We stop at the first move that isn't a standard move or that differs from the first one in whether it is coordinated, because the kinematics handle those differently.
+void TransformBatch::Build(RawMoveQueue& queue, const int32_t positionNow[]) noexcept
+{
+	Clear();
+	const size_t numQueued = queue.Count();
+	if (numQueued < 2)
+	{
+		return;															// not worth batching
+	}
+
+	const Move& move = reprap.GetMove();
+	const size_t numVisibleAxes = reprap.GetGCodes().GetVisibleAxes();
+	const size_t numTotalAxes = reprap.GetGCodes().GetTotalAxes();
+	isCoordinated = false;
+	size_t numToTransform = 0;
+	while (numToTransform < min<size_t>(numQueued, MaxMoves))
+	{
+		const RawMove * const item = queue.Peek(numToTransform);
+		if (item->moveType != 0 || (numToTransform != 0 && item->isCoordinated != isCoordinated))
+		{
+			break;
+		}
+		isCoordinated = item->isCoordinated;
+		moves[numToTransform] = item;
+		memcpyf(coords[numToTransform], item->coords, numVisibleAxes);
+		move.AxisAndBedTransform(coords[numToTransform], item->tool, true);
+
+		// The kinematics may set the positions of invisible axes, so start them off at the current positions as DDA::InitStandardMove does
+		for (size_t axis = numVisibleAxes; axis < numTotalAxes; ++axis)
+		{
+			motorSteps[numToTransform][axis] = positionNow[axis];
+		}
+		++numToTransform;
+	}
+
+	if (numToTransform >= 2)
+	{
+		kinematicsStateBefore = move.GetKinematics().GetTransformState();
+		const uint32_t startTime = StepTimer::GetTimerTicks();
+		numMoves = move.GetKinematics().CartesianToMotorStepsBatch(coords, reprap.GetPlatform().GetDriveStepsPerUnit(), numVisibleAxes, numTotalAxes,
+																	motorSteps, numToTransform, isCoordinated);
+		transformClocks += StepTimer::GetTimerTicks() - startTime;
+		numMovesTransformed += numToTransform;
+		++numBatches;
+	}
+}
+
+// Discard the batch. If some of the moves haven't been handed out then the kinematics transform state is as it was after the last move in the batch,
+// so put it back to what it was after the last move we handed out.
+void TransformBatch::Clear() noexcept
+{
+	if (nextMove < numMoves)
+	{
+		const Kinematics& kin = reprap.GetMove().GetKinematics();
+		kin.SetTransformState(kinematicsStateBefore);
+		if (nextMove != 0)
+		{
+			const size_t numVisibleAxes = reprap.GetGCodes().GetVisibleAxes();
+			const size_t numTotalAxes = reprap.GetGCodes().GetTotalAxes();
+			const float * const stepsPerMm = reprap.GetPlatform().GetDriveStepsPerUnit();
+			int32_t scratchSteps[MaxAxes];
+			for (size_t i = 0; i < nextMove; ++i)
+			{
+				(void)kin.CartesianToMotorSteps(coords[i], stepsPerMm, numVisibleAxes, numTotalAxes, scratchSteps, isCoordinated);
+			}
+		}
+	}
+	numMoves = nextMove = 0;
+}
+
+void TransformBatch::Diagnostics(MessageType mtype) noexcept
+{
+	reprap.GetPlatform().MessageF(mtype, "Transform batches %" PRIu32 ", moves %" PRIu32 ", time per move %.2fus\n",
+									numBatches, numMovesBatched,
+									(double)((numMovesTransformed == 0) ? 0.0 : (float)transformClocks * StepClocksToMillis * 1000.0/numMovesTransformed));
+	numBatches = numMovesBatched = numMovesTransformed = transformClocks = 0;
+}
+
+#endif
+
+// End
@@ -0,0 +1,67 @@
+/*
+ * TransformBatch.h
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * When the kinematics segment moves, GCodes passes us many short moves that all need the same axis, bed and kinematic transforms.
+ * This class lets the Move task transform several moves from the raw move queue in one call to Kinematics::CartesianToMotorStepsBatch,
+ * so that the terms that are common to all of them are only calculated once. The moves stay in the queue untransformed, because the pause code
+ * relies on that, so we keep the transformed coordinates and motor positions here until the Move task adds each move to the DDA ring.
+ *
+ * The batch is only used by the Move task. It must be cleared whenever the raw move queue is cleared, truncated or resized.
+ * Converting the batch leaves any state that the kinematics carries from one position to the next, such as the SCARA arm mode, as it is after the last move in the batch.
+ * So if we discard moves that we converted but haven't handed out, we restore the state from before the batch and convert the moves we did hand out again.
+ */
+
+#ifndef SRC_MOVEMENT_TRANSFORMBATCH_H_
+#define SRC_MOVEMENT_TRANSFORMBATCH_H_
+
+#include <RepRapFirmware.h>
+
+#if SUPPORT_TRANSFORM_BATCH
+
+#include <Platform/Tasks.h>
+
+struct RawMove;
+class RawMoveQueue;
+
+class TransformBatch
+{
+public:
+	static constexpr size_t MaxMoves = 8;								// the maximum number of moves we transform in one batch
+
+	TransformBatch() noexcept : numMoves(0), nextMove(0), kinematicsStateBefore(0), isCoordinated(false), numBatches(0), numMovesBatched(0), numMovesTransformed(0), transformClocks(0) { }
+
+	void* operator new(size_t count) { return Tasks::AllocPermanent(count); }
+	void* operator new(size_t count, std::align_val_t align) { return Tasks::AllocPermanent(count, align); }
+	void operator delete(void* ptr) noexcept {}
+	void operator delete(void* ptr, std::align_val_t align) noexcept {}
+
+	// Get the motor positions for the oldest move in the queue, transforming a new batch of moves if necessary.
+	// If successful, set the coordinates of the move to the transformed coordinates and return the motor positions, else return nullptr.
+	const int32_t *GetMotorSteps(RawMove& move, RawMoveQueue& queue, const int32_t positionNow[]) noexcept;
+
+	void Clear() noexcept;
+	void Diagnostics(MessageType mtype) noexcept;
+
+private:
+	void Build(RawMoveQueue& queue, const int32_t positionNow[]) noexcept;
+
+	const RawMove *moves[MaxMoves];										// the queue slots of the moves we have transformed
+	float coords[MaxMoves][MaxAxes];									// the axis coordinates of those moves after the axis and bed transforms
+	int32_t motorSteps[MaxMoves][MaxAxes];								// the corresponding motor positions
+	size_t numMoves;													// how many moves are in the batch
+	size_t nextMove;													// the index of the next move that the Move task will take from the batch
+	uint32_t kinematicsStateBefore;										// the kinematics transform state before we converted the batch
+	bool isCoordinated;													// whether the moves in the batch are coordinated
+
+	uint32_t numBatches;												// how many batches we have built, for diagnostics
+	uint32_t numMovesBatched;											// how many moves we have taken from batches, for diagnostics
+	uint32_t numMovesTransformed;										// how many moves we have transformed in batches, for diagnostics
+	uint32_t transformClocks;											// the step clocks taken by the kinematics to transform them, for diagnostics
+};
+
+#endif
+
+#endif /* SRC_MOVEMENT_TRANSFORMBATCH_H_ */
@@ -334,6 +334,9 @@ ObjectModel::ObjectModel() noexcept
 ObjectExplorationContext::ObjectExplorationContext(const GCodeBuffer *_ecv_null gbp, bool wal, const char *reportFlags, unsigned int initialMaxDepth, size_t initialBufferOffset) noexcept
 	: startMillis(millis()), initialBufOffset(initialBufferOffset), maxDepth(initialMaxDepth), currentDepth(0), startElement(0), nextElement(-1), numIndicesProvided(0), numIndicesCounted(0),
 	  line(-1), column(-1), gb(gbp),
+#if SUPPORT_EXPRESSION_CACHE
+	  lookupCache(nullptr), lookupCacheSize(0), lookupCacheUsed(0),
+#endif
 	  shortForm(false), wantArrayLength(wal), wantExists(false),
 	  includeNonLive(true), includeImportant(false), includeNulls(false),
 	  excludeVerbose(true), excludeObsolete(true),
@@ -393,6 +396,9 @@ ObjectExplorationContext::ObjectExplorationContext(const GCodeBuffer *_ecv_null
 ObjectExplorationContext::ObjectExplorationContext(const GCodeBuffer *_ecv_null gbp, bool wal, bool wex, int p_line, int p_col) noexcept
 	: startMillis(millis()), initialBufOffset(0), maxDepth(99), currentDepth(0), startElement(0), nextElement(-1), numIndicesProvided(0), numIndicesCounted(0),
 	  line(p_line), column(p_col), gb(gbp),
+#if SUPPORT_EXPRESSION_CACHE
+	  lookupCache(nullptr), lookupCacheSize(0), lookupCacheUsed(0),
+#endif
 	  shortForm(false), wantArrayLength(wal), wantExists(wex),
 	  includeNonLive(true), includeImportant(false), includeNulls(false),
 	  excludeVerbose(false), excludeObsolete(false),
@@ -979,11 +985,43 @@ decrease(strlen(idString))	// recursion variant
 		classDescriptor = GetObjectModelClassDescriptor();
 	}
 
+#if SUPPORT_EXPRESSION_CACHE
+	// If we are evaluating a compiled expression, see whether we found the entry last time
+	ObjectModelLookupCacheEntry *_ecv_null const cacheEntry = context.GetNextLookupCacheEntry();
+	if (cacheEntry != nullptr)
+	{
+		if (cacheEntry->idString == idString && cacheEntry->startDescriptor == classDescriptor && cacheEntry->tableNumber == tableNumber)
+		{
+			const ObjectModelTableEntry * const e = cacheEntry->entry;
+			if (e->IsObsolete())
+			{
+				context.SetObsoleteFieldQueried();
+			}
+			idString = GetNextElement(idString);
+			const ExpressionValue val = e->func(this, context);
+			context.CheckStack(StackUsage::GetObjectValue_noTable);
+			return GetObjectValue(context, cacheEntry->foundDescriptor, val, idString);
+		}
+		cacheEntry->Clear();
+	}
+	const ObjectModelClassDescriptor * const startDescriptor = classDescriptor;
+#endif
+
 	while (classDescriptor != nullptr)
 	{
 		const ObjectModelTableEntry * const e = FindObjectModelTableEntry(classDescriptor, tableNumber, idString);
 		if (e != nullptr)
 		{
+#if SUPPORT_EXPRESSION_CACHE
+			if (cacheEntry != nullptr)
+			{
+				cacheEntry->idString = idString;
+				cacheEntry->startDescriptor = startDescriptor;
+				cacheEntry->foundDescriptor = classDescriptor;
+				cacheEntry->entry = e;
+				cacheEntry->tableNumber = tableNumber;
+			}
+#endif
 			if (e->IsObsolete())
 			{
 				context.SetObsoleteFieldQueried();
@@ -203,6 +203,24 @@ enum class ObjectModelEntryFlags : uint8_t
 	obsolete = 8				// entry is deprecated and should not be used any more
 };
 
+#if SUPPORT_EXPRESSION_CACHE
+
+struct ObjectModelClassDescriptor;
+
+// Record of where a table entry was found, used by compiled expressions to avoid searching the object model tables again for the same path
+struct ObjectModelLookupCacheEntry
+{
+	const char *_ecv_array _ecv_null idString;				// the ID string that was looked up, which is stored in the compiled expression
+	const ObjectModelClassDescriptor *_ecv_null startDescriptor;	// the class descriptor we started searching from
+	const ObjectModelClassDescriptor *_ecv_null foundDescriptor;	// the class descriptor whose table contains the entry
+	const ObjectModelTableEntry *_ecv_null entry;
+	uint8_t tableNumber;
+
+	void Clear() noexcept { idString = nullptr; }
+};
+
+#endif
+
 // Context passed to object model functions
 class ObjectExplorationContext
 {
@@ -243,6 +261,11 @@ public:
 	GCodeException ConstructParseException(const char *msg, const char *sparam) const noexcept;
 	void CheckStack(uint32_t calledFunctionStackUsage) const THROWS(GCodeException);
 
+#if SUPPORT_EXPRESSION_CACHE
+	void SetLookupCache(ObjectModelLookupCacheEntry *_ecv_array p, size_t n) noexcept { lookupCache = p; lookupCacheSize = n; }
+	ObjectModelLookupCacheEntry *_ecv_null GetNextLookupCacheEntry() noexcept { return (lookupCacheUsed < lookupCacheSize) ? &lookupCache[lookupCacheUsed++] : nullptr; }
+#endif
+
 private:
 	static constexpr size_t MaxIndices = 4;			// max depth of array nesting
 
@@ -258,6 +281,11 @@ private:
 	int line;
 	int column;
 	const GCodeBuffer *_ecv_null gb;
+#if SUPPORT_EXPRESSION_CACHE
+	ObjectModelLookupCacheEntry *_ecv_array _ecv_null lookupCache;	// where to record the table entries found, one per level of the lookup
+	size_t lookupCacheSize;
+	size_t lookupCacheUsed;
+#endif
 	unsigned int shortForm : 1,
 				wantArrayLength : 1,
 				wantExists : 1,
@@ -7,6 +7,13 @@
 
 #include "Variable.h"
 #include <Platform/OutputMemory.h>
+#include <Platform/RepRap.h>
+#include <Platform/Platform.h>
+#include <Movement/StepTimer.h>
+
+uint32_t VariableSet::numLookups = 0;
+uint32_t VariableSet::numEntriesExamined = 0;
+uint32_t VariableSet::lookupClocks = 0;
 
 Variable::Variable(const char *str, ExpressionValue pVal, int8_t pScope) noexcept : name(str), val(pVal), scope(pScope)
 {
@@ -18,38 +25,192 @@ Variable::~Variable()
 	val.Release();
 }
 
-Variable* VariableSet::Lookup(const char *str) noexcept
+// Hash a variable name using the FNV-1a algorithm
+/*static*/ uint32_t VariableSet::HashName(const char *_ecv_array str) noexcept
 {
-	LinkedVariable *lv;
-	for (lv = root; lv != nullptr; lv = lv->next)
+	uint32_t hash = 2166136261u;
+	while (*str != 0)
+	{
+		hash = (hash ^ (uint8_t)*str++) * 16777619u;
+	}
+	return hash;
+}
+
+// Find a variable. If there is more than one with the same name, which should not happen, return the most recently created one.
+VariableSet::LinkedVariable *_ecv_null VariableSet::Find(const char *_ecv_array str) const noexcept
+{
+	const uint32_t startTime = StepTimer::GetTimerTicks();
+	const uint32_t hash = HashName(str);
+	LinkedVariable *_ecv_null found = nullptr;
+	uint32_t numExamined = 0;
+	if (index != nullptr)
+	{
+		const size_t mask = indexSize - 1;
+		for (size_t i = hash & mask; index[i] != nullptr; i = (i + 1) & mask)
+		{
+			++numExamined;
+			if (index[i]->Matches(hash, str))
+			{
+				found = index[i];
+				break;
+			}
+		}
+	}
+	else
 	{
-		auto vname = lv->v.GetName();
-		if (strcmp(vname.Ptr(), str) == 0)
+		for (LinkedVariable *lv = root; lv != nullptr; lv = lv->next)
 		{
-			return &(lv->v);
+			++numExamined;
+			if (lv->Matches(hash, str))
+			{
+				found = lv;
+				break;
+			}
 		}
 	}
-	return nullptr;
+
+	++numLookups;
+	numEntriesExamined += numExamined;
+	lookupClocks += StepTimer::GetTimerTicks() - startTime;
+	return found;
+}
+
+Variable* VariableSet::Lookup(const char *str) noexcept
+{
+	LinkedVariable * const lv = Find(str);
+	return (lv == nullptr) ? nullptr : &(lv->v);
 }
 
 const Variable* VariableSet::Lookup(const char *str) const noexcept
 {
-	const LinkedVariable *lv;
-	for (lv = root; lv != nullptr; lv = lv->next)
+	const LinkedVariable * const lv = Find(str);
+	return (lv == nullptr) ? nullptr : &(lv->v);
+}
+
+// Add a variable to the hash table, which must have a free slot. If there is already a variable with the same name then replace it if 'replace' is true, else leave it.
+void VariableSet::AddToIndex(LinkedVariable *lv, bool replace) noexcept
+{
+	const size_t mask = indexSize - 1;
+	size_t i = lv->hash & mask;
+	while (index[i] != nullptr)
+	{
+		if (index[i]->hash == lv->hash)
+		{
+			// Copy the name so that we don't hold the heap lock while Matches takes it again
+			String<MaxVariableNameLength> vname;
+			vname.copy(lv->v.GetName().Ptr());
+			if (index[i]->Matches(lv->hash, vname.c_str()))
+			{
+				if (replace)
+				{
+					index[i] = lv;
+				}
+				return;
+			}
+		}
+		i = (i + 1) & mask;
+	}
+	index[i] = lv;
+}
+
+// Replace the hash table by one of the specified size holding all the variables, or delete it if the size is zero
+void VariableSet::RebuildIndex(size_t newSize) noexcept
+{
+	delete[] index;
+	index = nullptr;
+	indexSize = newSize;
+	if (newSize != 0)
+	{
+		index = new LinkedVariable *_ecv_null[newSize];
+		for (size_t i = 0; i < newSize; ++i)
+		{
+			index[i] = nullptr;
+		}
+
+		// The list is in newest-first order, so don't let older variables replace newer ones with the same name
+		for (LinkedVariable *lv = root; lv != nullptr; lv = lv->next)
+		{
+			AddToIndex(lv, false);
+		}
+	}
+}
+
+// Remove a variable that has already been unlinked from the list from the hash table, or delete the hash table if there are now few variables
+void VariableSet::RemoveFromIndex(LinkedVariable *lv) noexcept
+{
+	if (index == nullptr)
+	{
+		return;
+	}
+
+	// Free the table when there are only a few variables left. We wait until there are half as many as when we created it, so that a loop that
+	// repeatedly creates and removes a variable when there are about IndexThreshold of them doesn't allocate and free the table every time.
+	if (numVariables <= IndexThreshold/2)
+	{
+		RebuildIndex(0);
+		return;
+	}
+
+	const size_t mask = indexSize - 1;
+	size_t hole = lv->hash & mask;
+	while (index[hole] != lv)
+	{
+		if (index[hole] == nullptr)
+		{
+			return;											// not in the table, because a newer variable with the same name was in the table
+		}
+		hole = (hole + 1) & mask;
+	}
+
+	// Close the gap by moving back any later entries in the probe sequence that can be found from a slot at or before the hole.
+	// An entry can't move back if its home slot is cyclically after the hole, because then a lookup would no longer reach it.
+	for (size_t i = (hole + 1) & mask; index[i] != nullptr; i = (i + 1) & mask)
+	{
+		if (((i - (index[i]->hash & mask)) & mask) >= ((i - hole) & mask))
+		{
+			index[hole] = index[i];
+			hole = i;
+		}
+	}
+	index[hole] = nullptr;
+
+	// If an older variable with the same name is still in the list then it becomes visible again, so it needs to go into the table
+	for (LinkedVariable *older = root; older != nullptr; older = older->next)
 	{
-		auto vname = lv->v.GetName();
-		if (strcmp(vname.Ptr(), str) == 0)
+		if (older->hash == lv->hash)
 		{
-			return &(lv->v);
+			String<MaxVariableNameLength> vname;
+			vname.copy(lv->v.GetName().Ptr());
+			if (older->Matches(lv->hash, vname.c_str()))
+			{
+				AddToIndex(older, true);
+				break;
+			}
 		}
 	}
-	return nullptr;
 }
 
 void VariableSet::InsertNew(const char *str, ExpressionValue pVal, int8_t pScope) noexcept
 {
-	LinkedVariable * const toInsert = new LinkedVariable(str, pVal, pScope, root);
+	LinkedVariable * const toInsert = new LinkedVariable(str, HashName(str), pVal, pScope, root);
 	root = toInsert;
+	++numVariables;
+	if (index != nullptr)
+	{
+		// Keep the hash table no more than 3/4 full so that the probe sequences stay short
+		if (numVariables * 4 > indexSize * 3)
+		{
+			RebuildIndex(indexSize * 2);
+		}
+		else
+		{
+			AddToIndex(toInsert, true);
+		}
+	}
+	else if (numVariables > IndexThreshold)
+	{
+		RebuildIndex(MinIndexSize);
+	}
 }
 
 // Remove all variables with a scope greater than the parameter
@@ -70,6 +231,8 @@ void VariableSet::EndScope(uint8_t blockNesting) noexcept
 			{
 				prev->next = lv;
 			}
+			--numVariables;
+			RemoveFromIndex(temp);
 			delete temp;
 		}
 		else
@@ -82,11 +245,11 @@ void VariableSet::EndScope(uint8_t blockNesting) noexcept
 
 void VariableSet::Delete(const char *str) noexcept
 {
+	const uint32_t hash = HashName(str);
 	LinkedVariable *prev = nullptr;
 	for (LinkedVariable *lv = root; lv != nullptr; lv = lv->next)
 	{
-		auto vname = lv->v.GetName();
-		if (strcmp(vname.Ptr(), str) == 0)
+		if (lv->Matches(hash, str))
 		{
 			if (prev == nullptr)
 			{
@@ -96,6 +259,8 @@ void VariableSet::Delete(const char *str) noexcept
 			{
 				prev->next = lv->next;
 			}
+			--numVariables;
+			RemoveFromIndex(lv);
 			delete lv;
 			break;
 		}
@@ -111,6 +276,8 @@ void VariableSet::Clear() noexcept
 		root = lv->next;
 		delete lv;
 	}
+	numVariables = 0;
+	RebuildIndex(0);
 }
 
 VariableSet::~VariableSet()
@@ -123,7 +290,13 @@ void VariableSet::AssignFrom(VariableSet& other) noexcept
 {
 	Clear();
 	root = other.root;
+	index = other.index;
+	indexSize = other.indexSize;
+	numVariables = other.numVariables;
 	other.root = nullptr;
+	other.index = nullptr;
+	other.indexSize = 0;
+	other.numVariables = 0;
 }
 
 void VariableSet::IterateWhile(function_ref<bool(unsigned int, const Variable&) /*noexcept*/ > func) const noexcept
@@ -139,4 +312,14 @@ void VariableSet::IterateWhile(function_ref<bool(unsigned int, const Variable&)
 	}
 }
 
+/*static*/ void VariableSet::Diagnostics(MessageType mtype) noexcept
+{
+	const uint32_t locNumLookups = numLookups;
+	reprap.GetPlatform().MessageF(mtype, "Variable lookups %" PRIu32 ", entries examined per lookup %.2f, time per lookup %.2fus\n",
+									locNumLookups,
+									(double)((locNumLookups == 0) ? 0.0 : (float)numEntriesExamined/locNumLookups),
+									(double)((locNumLookups == 0) ? 0.0 : (float)lookupClocks * StepClocksToMillis * 1000.0/locNumLookups));
+	numLookups = numEntriesExamined = lookupClocks = 0;
+}
+
 // End
@@ -33,11 +33,15 @@ private:
 };
 
 // Class to represent a collection of variables.
-// For now this is just a linked list, but it could be changed to a hash table for faster lookup and insertion.
+// The variables are kept in a linked list with the most recently created one first, which is the order in which IterateWhile reports them.
+// Each list entry holds the hash of the variable name, so that a lookup only fetches and compares the names of variables whose hash matches.
+// When there are more than a few variables we also keep an open-addressed hash table of pointers to the list entries, so that looking up
+// a variable doesn't get slower as more global variables are created. Variables are removed from the table in place, because a macro that
+// creates local variables inside a loop ends their scope on every iteration.
 class VariableSet
 {
 public:
-	VariableSet() noexcept : root(nullptr) { }
+	VariableSet() noexcept : root(nullptr), index(nullptr), indexSize(0), numVariables(0) { }
 	~VariableSet();
 	VariableSet(const VariableSet&) = delete;
 	VariableSet& operator=(const VariableSet& other) = delete;
@@ -54,18 +58,41 @@ public:
 
 	void IterateWhile(function_ref<bool(unsigned int index, const Variable& v) /*noexcept*/ > func) const noexcept;
 
+	static void Diagnostics(MessageType mtype) noexcept;
+
 private:
+	static constexpr size_t IndexThreshold = 8;				// we create the hash table when there are more than this number of variables
+	static constexpr size_t MinIndexSize = 32;				// the initial size of the hash table, which must be a power of 2
+
 	struct LinkedVariable
 	{
 		DECLARE_FREELIST_NEW_DELETE(LinkedVariable)
 
-		LinkedVariable(const char *_ecv_array str, ExpressionValue pVal, int8_t pScope, LinkedVariable *p_next) : next(p_next), v(str, pVal, pScope) {}
+		LinkedVariable(const char *_ecv_array str, uint32_t p_hash, ExpressionValue pVal, int8_t pScope, LinkedVariable *p_next) : next(p_next), hash(p_hash), v(str, pVal, pScope) {}
+
+		bool Matches(uint32_t p_hash, const char *_ecv_array str) const noexcept { return hash == p_hash && strcmp(v.GetName().Ptr(), str) == 0; }
 
 		LinkedVariable * null next;
+		uint32_t hash;										// hash of the variable name
 		Variable v;
 	};
 
+	static uint32_t HashName(const char *_ecv_array str) noexcept;
+
+	LinkedVariable *_ecv_null Find(const char *_ecv_array str) const noexcept;
+	void AddToIndex(LinkedVariable *lv, bool replace) noexcept;
+	void RebuildIndex(size_t newSize) noexcept;
+	void RemoveFromIndex(LinkedVariable *lv) noexcept;
+
 	LinkedVariable * null root;
+	LinkedVariable *_ecv_null *_ecv_array _ecv_null index;	// open-addressed hash table using linear probing, or null if we don't have one
+	size_t indexSize;										// the number of slots in the hash table, zero or a power of 2
+	size_t numVariables;
+
+	// Lookup statistics for all variable sets, for diagnostics. These are not protected from concurrent updates, so they are approximate.
+	static uint32_t numLookups;
+	static uint32_t numEntriesExamined;
+	static uint32_t lookupClocks;
 };
 
 #endif /* SRC_GCODES_VARIABLE_H_ */
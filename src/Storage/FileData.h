@@ -145,6 +145,26 @@ public:
 		return not_null(f)->Length();
 	}
 
+#if SUPPORT_FILE_READ_AHEAD
+	bool StartReadAhead() noexcept
+	pre(IsLive())
+	{
+		return not_null(f)->StartReadAhead();
+	}
+
+	bool IsReadingAhead() const noexcept
+	pre(IsLive())
+	{
+		return not_null(f)->IsReadingAhead();
+	}
+
+	int GetReadAheadData(const char *_ecv_array& data) noexcept
+	pre(IsLive())
+	{
+		return not_null(f)->GetReadAheadData(data);
+	}
+#endif
+
 	// Move operator
 	void MoveFrom(FileData& other) noexcept
 	{
@@ -191,6 +191,12 @@ GCodeResult FileInfoParser::GetFileInfo(const char *filePath, GCodeFileInfo& inf
 					accumulatedSeekTime = accumulatedReadTime = accumulatedParseTime = 0;
 					fileOverlapLength = 0;
 					parseState = seeking;
+#if HAS_MASS_STORAGE && FF_USE_FASTSEEK
+					// We are going to seek backwards through the footer, so build a cluster map if we can. This follows the cluster chain once instead of on every backwards seek.
+					const uint32_t seekStartTime = millis();
+					(void)fileBeingParsed->EnableFastSeek();
+					accumulatedSeekTime += millis() - seekStartTime;
+#endif
 				}
 				else
 				{
@@ -212,9 +218,13 @@ GCodeResult FileInfoParser::GetFileInfo(const char *filePath, GCodeFileInfo& inf
 					// Seeking backwards over a cluster boundary, so in practice the seek will start from the start of the file
 					currentPos = 0;
 				}
-				// Seek at most 512 clusters at a time
+				// Seek at most 512 clusters at a time, unless we have a cluster map
 				const FilePosition maxSeekDistance = 512 * (FilePosition)clsize;
+# if FF_USE_FASTSEEK
+				const bool doFullSeek = fileBeingParsed->HasFastSeek() || (nextSeekPos <= currentPos + maxSeekDistance);
+# else
 				const bool doFullSeek = (nextSeekPos <= currentPos + maxSeekDistance);
+# endif
 				const FilePosition thisSeekPos = (doFullSeek) ? nextSeekPos : currentPos + maxSeekDistance;
 #elif HAS_EMBEDDED_FILES
 				const bool doFullSeek = true;
@@ -0,0 +1,327 @@
+/*
+ * FileReadAhead.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include "FileReadAhead.h"
+
+#if SUPPORT_FILE_READ_AHEAD
+
+#include "FileStore.h"
+#include "TaskPriorities.h"
+#include <Platform/RepRap.h>
+#include <Platform/Platform.h>
+#include <Movement/StepTimer.h>
+
+static_assert(FileReadAhead::BufferSize % 512 == 0, "Read-ahead buffer size must be a multiple of the sector size");
+
+constexpr size_t ReaderStackWords = 600;
+
+struct ReadAheadBuffer
+{
+	FilePosition startPos;										// the file position of the first byte in the buffer
+	size_t length;												// the number of bytes in the buffer
+	volatile bool full;											// true if the storage task has filled the buffer and the reader has not yet finished with it
+};
+
+# if SAME70
+alignas(4) static __nocache char bufferData[FileReadAhead::NumBuffers][FileReadAhead::BufferSize];
+# elif STM32H7
+alignas(4) static __nocache2 char bufferData[FileReadAhead::NumBuffers][FileReadAhead::BufferSize];
+# else
+alignas(4) static char bufferData[FileReadAhead::NumBuffers][FileReadAhead::BufferSize];
+# endif
+
+static TASKMEM Task<ReaderStackWords> ReaderTask;
+static Mutex fillMutex;											// held by the storage task while it is using the file and by the reader when it repositions the file
+static ReadAheadBuffer buffers[FileReadAhead::NumBuffers];
+static FileStore * volatile attachedFile = nullptr;
+static volatile TaskHandle waitingTask = nullptr;
+static size_t fillIndex = 0;									// the buffer that the storage task fills next
+static size_t readIndex = 0;									// the buffer that the reader takes data from next
+static FilePosition fillPos = 0;								// the file position that the storage task reads from next
+static FilePosition readPos = 0;								// the file position of the next byte to hand out
+static volatile bool endOfFile = false;
+static volatile FRESULT readStatus = FR_OK;
+
+// Statistics for the current or most recent file, reset when a file is attached
+static unsigned int buffersRead = 0;
+static unsigned int numStalls = 0;
+static uint32_t totalStallTicks = 0;
+static uint32_t longestStallTicks = 0;
+
+extern "C" [[noreturn]] void ReaderLoop(void *) noexcept
+{
+	FileReadAhead::Spin();
+}
+
+void FileReadAhead::Spin() noexcept
+{
+	for (;;)
+	{
+		if (!FillBuffer())
+		{
+			TaskBase::Take();
+		}
+	}
+}
+
+// Fill the next buffer if it is free, returning true if we filled it
+bool FileReadAhead::FillBuffer() noexcept
+{
+	MutexLocker lock(fillMutex);
+	FileStore * const f = attachedFile;
+	ReadAheadBuffer& b = buffers[fillIndex];
+	if (f == nullptr || endOfFile || readStatus != FR_OK || b.full)
+	{
+		return false;
+	}
+
+	// Only read as far as the next buffer boundary, so that all reads after the first one start on a sector boundary
+	const size_t bytesToRead = BufferSize - (size_t)(fillPos % BufferSize);
+	UINT bytesRead;
+	const FRESULT status = f_read(&f->file, bufferData[fillIndex], bytesToRead, &bytesRead);
+	TaskHandle t;
+	{
+		TaskCriticalSectionLocker lock2;
+		if (attachedFile != f)
+		{
+			// The file was abandoned while we were reading it, so the data is of no use and Abandon has already set the read status
+		}
+		else if (status == FR_OK)
+		{
+			b.startPos = fillPos;
+			b.length = bytesRead;
+			b.full = true;
+			fillPos += bytesRead;
+			endOfFile = (bytesRead < bytesToRead);
+			fillIndex = (fillIndex + 1) % NumBuffers;
+			++buffersRead;
+		}
+		else
+		{
+			readStatus = status;
+		}
+		t = waitingTask;
+	}
+	if (t != nullptr)
+	{
+		t->Give();
+	}
+	return status == FR_OK;
+}
+
+// Discard all buffered data. The caller must hold the fill mutex.
+static void DiscardBuffers() noexcept
+{
+	for (ReadAheadBuffer& b : buffers)
+	{
+		b.full = false;
+	}
+	fillIndex = readIndex = 0;
+	endOfFile = false;
+	readStatus = FR_OK;
+}
+
+// Wait until the buffer being read has data that has not been handed out yet.
+// Return the number of bytes available, or 0 at end of file, or -1 if there was a read error.
+static int WaitForData() noexcept
+{
+	for (;;)
+	{
+		ReadAheadBuffer& b = buffers[readIndex];
+		if (b.full)
+		{
+			const size_t offset = (size_t)(readPos - b.startPos);
+			if (offset < b.length)
+			{
+				return (int)(b.length - offset);
+			}
+
+			// We have handed out all of this buffer, so give it back to the storage task
+			b.full = false;
+			readIndex = (readIndex + 1) % FileReadAhead::NumBuffers;
+			ReaderTask.Give();
+			continue;
+		}
+
+		if (readStatus != FR_OK)
+		{
+			reprap.GetPlatform().MessageF(ErrorMessage, "Cannot read file, error code %d\n", (int)readStatus);
+			return -1;
+		}
+		if (endOfFile)
+		{
+			return 0;
+		}
+
+		// The storage task hasn't filled the buffer yet, so we have stalled
+		{
+			TaskCriticalSectionLocker lock;
+			if (b.full || endOfFile || readStatus != FR_OK)
+			{
+				continue;
+			}
+			waitingTask = TaskBase::GetCallerTaskHandle();
+		}
+		const uint32_t startTime = StepTimer::GetTimerTicks();
+		TaskBase::Take();										// no timeout, because a slow card can stall for a long time without failing, as a direct read would
+		waitingTask = nullptr;
+		const uint32_t stallTime = StepTimer::GetTimerTicks() - startTime;
+		++numStalls;
+		totalStallTicks += stallTime;
+		if (stallTime > longestStallTicks)
+		{
+			longestStallTicks = stallTime;
+		}
+	}
+}
+
+void FileReadAhead::Init() noexcept
+{
+	fillMutex.Create("ReadAhead");
+	ReaderTask.Create(ReaderLoop, "FSREAD", nullptr, TaskPriority::SpinPriority + 1);
+}
+
+// Start reading ahead on a file from its current position, returning true if successful.
+// This fails if we are already reading ahead on another file.
+bool FileReadAhead::Attach(FileStore *f) noexcept
+{
+	if (attachedFile != nullptr)
+	{
+		return attachedFile == f;
+	}
+
+	{
+		MutexLocker lock(fillMutex);
+		DiscardBuffers();
+		fillPos = readPos = f->file.fptr;
+		buffersRead = numStalls = 0;
+		totalStallTicks = longestStallTicks = 0;
+		attachedFile = f;
+	}
+	ReaderTask.Give();
+	return true;
+}
+
+// Stop reading ahead, leaving the file positioned at the next byte that would have been handed out
+void FileReadAhead::Detach(FileStore *f) noexcept
+{
+	if (attachedFile == f)
+	{
+		MutexLocker lock(fillMutex);
+		attachedFile = nullptr;
+		DiscardBuffers();
+		(void)f_lseek(&f->file, readPos);
+	}
+}
+
+// Stop reading ahead on a file that is being invalidated because its volume is being unmounted.
+// The caller holds the volume mutex and the storage task may be waiting for it while holding the fill mutex, so we mustn't take the fill mutex here.
+// Instead we make the storage task discard any data it is reading, and give any reader that is waiting a read error.
+// The buffers are discarded when the next file is attached.
+void FileReadAhead::Abandon(FileStore *f) noexcept
+{
+	TaskHandle t;
+	{
+		TaskCriticalSectionLocker lock;
+		if (attachedFile != f)
+		{
+			return;
+		}
+		attachedFile = nullptr;
+		readStatus = FR_INVALID_OBJECT;
+		t = waitingTask;
+	}
+	if (t != nullptr)
+	{
+		t->Give();
+	}
+}
+
+bool FileReadAhead::IsAttached(const FileStore *f) noexcept
+{
+	return attachedFile == f;
+}
+
+// Copy data from the read-ahead buffers. Used when something other than FileGCodeInput reads the file.
+int FileReadAhead::Read(char *_ecv_array buf, size_t nBytes) noexcept
+{
+	size_t bytesCopied = 0;
+	while (bytesCopied < nBytes)
+	{
+		const int bytesAvailable = WaitForData();
+		if (bytesAvailable < 0)
+		{
+			return -1;
+		}
+		if (bytesAvailable == 0)
+		{
+			break;
+		}
+		const ReadAheadBuffer& b = buffers[readIndex];
+		const size_t bytesToCopy = min<size_t>((size_t)bytesAvailable, nBytes - bytesCopied);
+		memcpy(buf + bytesCopied, bufferData[readIndex] + (readPos - b.startPos), bytesToCopy);
+		bytesCopied += bytesToCopy;
+		readPos += bytesToCopy;
+	}
+	return (int)bytesCopied;
+}
+
+// Hand out the unread data in the next buffer without copying it, returning the number of bytes, or 0 at end of file, or -1 if there was a read error.
+// The data remains valid until the next call to GetData, Read or Seek.
+int FileReadAhead::GetData(const char *_ecv_array& data) noexcept
+{
+	const int bytesAvailable = WaitForData();
+	if (bytesAvailable > 0)
+	{
+		data = bufferData[readIndex] + (readPos - buffers[readIndex].startPos);
+		readPos += (size_t)bytesAvailable;
+	}
+	return bytesAvailable;
+}
+
+bool FileReadAhead::Seek(FilePosition pos) noexcept
+{
+	bool ok;
+	{
+		MutexLocker lock(fillMutex);
+		FileStore * const f = attachedFile;
+		if (f == nullptr)
+		{
+			return false;
+		}
+
+		// If we are seeking within the buffer being read, which is what happens when FileGCodeInput gives back the data it hasn't used, just move the read position
+		const ReadAheadBuffer& b = buffers[readIndex];
+		if (b.full && pos >= b.startPos && pos <= b.startPos + b.length)
+		{
+			readPos = pos;
+			return true;
+		}
+
+		DiscardBuffers();
+		ok = (f_lseek(&f->file, pos) == FR_OK);
+		fillPos = readPos = f->file.fptr;
+	}
+	ReaderTask.Give();
+	return ok;
+}
+
+FilePosition FileReadAhead::Position() noexcept
+{
+	return readPos;
+}
+
+void FileReadAhead::Diagnostics(MessageType mtype) noexcept
+{
+	reprap.GetPlatform().MessageF(mtype, "File read-ahead %s: buffers read %u, stalls %u, total stall time %.1fms, longest %.1fms\n",
+									(attachedFile != nullptr) ? "active" : "idle", buffersRead, numStalls,
+									(double)((float)totalStallTicks * StepClocksToMillis), (double)((float)longestStallTicks * StepClocksToMillis));
+}
+
+#endif
+
+// End
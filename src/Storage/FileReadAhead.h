@@ -0,0 +1,55 @@
+/*
+ * FileReadAhead.h
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * This reads the file being printed ahead of the G-code parser so that the GCodes task does not have to wait for the SD card.
+ * A storage task keeps a small ring of multi-sector buffers filled. Each read after the first starts on a buffer boundary,
+ * so FatFS transfers whole sectors directly into the buffer instead of copying them through its sector window.
+ * Completed buffers are handed to FileGCodeInput, which passes the characters to the GCodeBuffer without copying them again.
+ *
+ * Only one file can be read ahead at a time. While it is attached, FileStore routes Read, Seek and Position for that file through here,
+ * so the position seen by the rest of the firmware is the position of the data handed out, not the position the storage task has read up to.
+ * The FIL object is only used by the storage task while it holds the fill mutex, so seeking and detaching take the mutex first.
+ * The storage task holds the fill mutex while FatFS takes the volume mutex, so a file being invalidated by an unmount, which already holds the volume mutex,
+ * is abandoned without taking the fill mutex.
+ */
+
+#ifndef SRC_STORAGE_FILEREADAHEAD_H_
+#define SRC_STORAGE_FILEREADAHEAD_H_
+
+#include <RepRapFirmware.h>
+
+#if SUPPORT_FILE_READ_AHEAD
+
+class FileStore;
+
+class FileReadAhead
+{
+public:
+	static constexpr size_t NumBuffers = 2;								// number of read-ahead buffers
+	static constexpr size_t BufferSize = 2048;							// size of each buffer, which must be a multiple of the sector size
+
+	static void Init() noexcept;
+	static bool Attach(FileStore *f) noexcept;							// start reading ahead on a file from its current position, returning true if successful
+	static void Detach(FileStore *f) noexcept;							// stop reading ahead and leave the file positioned where the reader has got to
+	static void Abandon(FileStore *f) noexcept;							// stop reading ahead on a file that is being invalidated, without waiting for the storage task
+	static bool IsAttached(const FileStore *f) noexcept;
+
+	static int Read(char *_ecv_array buf, size_t nBytes) noexcept;		// copy data from the read-ahead buffers, returning the number of bytes read or -1 if there was a read error
+	static int GetData(const char *_ecv_array& data) noexcept;			// hand out the unread data in the next buffer without copying it
+	static bool Seek(FilePosition pos) noexcept;
+	static FilePosition Position() noexcept;
+
+	static void Diagnostics(MessageType mtype) noexcept;
+
+	[[noreturn]] static void Spin() noexcept;							// the storage task loop
+
+private:
+	static bool FillBuffer() noexcept;
+};
+
+#endif
+
+#endif /* SRC_STORAGE_FILEREADAHEAD_H_ */
@@ -19,6 +19,12 @@
 # if HAS_WRITER_TASK
 #  include "TaskPriorities.h"
 # endif
+# if SUPPORT_FILE_READ_AHEAD
+#  include "FileReadAhead.h"
+# endif
+# if SUPPORT_MACRO_FILE_CACHE
+#  include "MacroFileCache.h"
+# endif
 #endif
 
 #if HAS_SBC_INTERFACE
@@ -47,7 +53,10 @@ void FileStore::Init() noexcept
 	handle = noFileHandle;
 	length = 0;
 #endif
-#if HAS_EMBEDDED_FILES || HAS_SBC_INTERFACE
+#if SUPPORT_MACRO_FILE_CACHE
+	cachedFile = nullptr;
+#endif
+#if HAS_EMBEDDED_FILES || HAS_SBC_INTERFACE || SUPPORT_MACRO_FILE_CACHE
 	offset = 0;
 #endif
 }
@@ -135,10 +144,37 @@ bool FileStore::Open(const char *_ecv_array filePath, OpenMode mode, uint32_t pr
 # endif
 # if HAS_MASS_STORAGE
 	{
-		const FRESULT openReturn = f_open(&file, filePath,
-											(mode == OpenMode::write || mode == OpenMode::writeWithCrc) ? FA_CREATE_ALWAYS | FA_WRITE
-												: (mode == OpenMode::append) ? FA_READ | FA_WRITE | FA_OPEN_ALWAYS | FA_OPEN_APPEND
-													: FA_OPEN_EXISTING | FA_READ);
+		FRESULT openReturn;
+#  if SUPPORT_MACRO_FILE_CACHE
+		// If we are opening a macro file, look for it in the cache first. This also gets the size and modification time so that we can cache it if we don't have it.
+		FILINFO info;
+		const bool useCache = (mode == OpenMode::readCached && MacroFileCache::IsEnabled());
+		openReturn = (useCache) ? MacroFileCache::Lookup(filePath, info, cachedFile) : FR_OK;
+		if (cachedFile != nullptr)
+		{
+			offset = 0;
+		}
+		else if (openReturn == FR_OK)
+#  endif
+		{
+			openReturn = f_open(&file, filePath,
+								(mode == OpenMode::write || mode == OpenMode::writeWithCrc) ? FA_CREATE_ALWAYS | FA_WRITE
+									: (mode == OpenMode::append) ? FA_READ | FA_WRITE | FA_OPEN_ALWAYS | FA_OPEN_APPEND
+										: FA_OPEN_EXISTING | FA_READ);
+#  if SUPPORT_MACRO_FILE_CACHE
+			if (openReturn == FR_OK && useCache)
+			{
+				// Try to read the whole file into the cache. If that works then we don't need the file to be open any more.
+				cachedFile = MacroFileCache::Add(filePath, info, file);
+				if (cachedFile != nullptr)
+				{
+					(void)f_close(&file);
+					offset = 0;
+				}
+			}
+#  endif
+		}
+
 		if (openReturn == FR_OK)
 		{
 			fileOpened = true;
@@ -252,6 +288,13 @@ bool FileStore::Seek(FilePosition pos) noexcept
 
 	case FileUseMode::readOnly:
 	case FileUseMode::readWrite:
+#if SUPPORT_MACRO_FILE_CACHE
+		if (cachedFile != nullptr)
+		{
+			offset = min<FilePosition>(pos, cachedFile->GetLength());
+			return true;
+		}
+#endif
 #if HAS_SBC_INTERFACE
 		if (reprap.UsingSbcInterface())
 		{
@@ -264,6 +307,12 @@ bool FileStore::Seek(FilePosition pos) noexcept
 		}
 #endif
 #if HAS_MASS_STORAGE
+# if SUPPORT_FILE_READ_AHEAD
+		if (FileReadAhead::IsAttached(this))
+		{
+			return FileReadAhead::Seek(pos);
+		}
+# endif
 		return f_lseek(&file, pos) == FR_OK;
 #elif HAS_EMBEDDED_FILES
 		offset = min<FilePosition>(pos, EmbeddedFiles::Length(fileIndex));
@@ -286,7 +335,19 @@ FilePosition FileStore::Position() const noexcept
 		return offset;
 	}
 #endif
+#if SUPPORT_MACRO_FILE_CACHE
+	if (cachedFile != nullptr)
+	{
+		return offset;
+	}
+#endif
 #if HAS_MASS_STORAGE
+# if SUPPORT_FILE_READ_AHEAD
+	if (FileReadAhead::IsAttached(this))
+	{
+		return FileReadAhead::Position();
+	}
+# endif
 	return (usageMode == FileUseMode::readOnly || usageMode == FileUseMode::readWrite) ? file.fptr : 0;
 #elif HAS_EMBEDDED_FILES
 	return offset;
@@ -310,6 +371,12 @@ FilePosition FileStore::Length() const noexcept
 			return length;
 		}
 #endif
+#if SUPPORT_MACRO_FILE_CACHE
+		if (cachedFile != nullptr)
+		{
+			return cachedFile->GetLength();
+		}
+#endif
 #if HAS_MASS_STORAGE
 		return f_size(&file);
 #elif HAS_EMBEDDED_FILES
@@ -402,6 +469,21 @@ int FileStore::Read(char *_ecv_array extBuf, size_t nBytes) noexcept
 		}
 #endif
 #if HAS_MASS_STORAGE
+# if SUPPORT_MACRO_FILE_CACHE
+		if (cachedFile != nullptr)
+		{
+			const size_t bytesToCopy = min<size_t>(nBytes, (size_t)(cachedFile->GetLength() - offset));
+			memcpy(extBuf, cachedFile->GetData() + offset, bytesToCopy);
+			offset += bytesToCopy;
+			return (int)bytesToCopy;
+		}
+# endif
+# if SUPPORT_FILE_READ_AHEAD
+		if (FileReadAhead::IsAttached(this))
+		{
+			return FileReadAhead::Read(extBuf, nBytes);
+		}
+# endif
 		{
 			UINT bytes_read;
 			const FRESULT readStatus = f_read(&file, extBuf, nBytes, &bytes_read);
@@ -494,6 +576,25 @@ bool FileStore::ForceClose() noexcept
 #endif
 
 #if HAS_MASS_STORAGE
+# if SUPPORT_MACRO_FILE_CACHE
+	if (cachedFile != nullptr)
+	{
+		MacroFileCache::Release(cachedFile);
+		cachedFile = nullptr;
+		offset = 0;
+		usageMode = FileUseMode::free;
+		closeRequested = false;
+		openCount = 0;
+		reprap.VolumesUpdated();
+		return ok;
+	}
+# endif
+# if SUPPORT_FILE_READ_AHEAD
+	FileReadAhead::Detach(this);
+# endif
+# if FF_USE_FASTSEEK
+	ReleaseClusterMap();
+# endif
 	const FRESULT fr = f_close(&file);
 	usageMode = FileUseMode::free;
 	closeRequested = false;
@@ -724,12 +825,18 @@ bool FileStore::Invalidate(const FATFS *fs, bool doClose) noexcept
 {
 	if (file.obj.fs == fs)
 	{
+#if SUPPORT_FILE_READ_AHEAD
+		FileReadAhead::Abandon(this);			// we hold the volume mutex, so we must not wait for the read-ahead task
+#endif
 		if (doClose)
 		{
 			(void)ForceClose();
 		}
 		else
 		{
+#if FF_USE_FASTSEEK
+			ReleaseClusterMap();
+#endif
 			file.obj.fs = nullptr;
 			if (writeBuffer != nullptr)
 			{
@@ -755,43 +862,178 @@ bool FileStore::IsSameFile(const FIL& otherFile) const noexcept
 	return file.obj.fs == otherFile.obj.fs && file.dir_sect == otherFile.dir_sect && file.dir_ptr == otherFile.dir_ptr;
 }
 
-uint32_t FileStore::ClusterSize() const noexcept
+#if SUPPORT_FILE_READ_AHEAD
+
+// Start reading this file ahead of the caller from the current position. Only one file can be read ahead at a time.
+bool FileStore::StartReadAhead() noexcept
 {
-	return (usageMode == FileUseMode::readOnly || usageMode == FileUseMode::readWrite) ? file.obj.fs->csize * 512u : 1;	// we divide by the cluster size so return 1 not 0 if there is an error
+# if HAS_SBC_INTERFACE
+	if (reprap.UsingSbcInterface())
+	{
+		return false;
+	}
+# endif
+# if SUPPORT_MACRO_FILE_CACHE
+	if (cachedFile != nullptr)
+	{
+		return false;													// the file isn't open, we are reading it from RAM
+	}
+# endif
+	return usageMode == FileUseMode::readOnly && FileReadAhead::Attach(this);
 }
 
-#endif	// HAS_MASS_STORAGE
-
-#if 0	// these are not currently used
+bool FileStore::IsReadingAhead() const noexcept
+{
+	return FileReadAhead::IsAttached(this);
+}
 
-bool FileStore::GoToEnd()
+// Get the next block of read-ahead data without copying it. The data remains valid until the next call to Read, Seek or GetReadAheadData.
+// Return the number of bytes, 0 at end of file, or -1 if a read error occurred.
+int FileStore::GetReadAheadData(const char *_ecv_array& data) noexcept
 {
-	return Seek(Length());
+	return FileReadAhead::GetData(data);
 }
 
-// Provide a cluster map for fast seeking. Needs _USE_FASTSEEK defined as 1 in conf_fatfs to make any difference.
-// The first element of the table must be set to the total number of 32-bit entries in the table before calling this.
-bool FileStore::SetClusterMap(uint32_t tbl[]) noexcept
+#endif
+
+#if FF_USE_FASTSEEK
+
+// Cluster link maps for fast seeking. A map needs two words per fragment of the file plus two more, so a map of N words can describe a file with up to (N - 2)/2 fragments.
+# if LPC17xx
+constexpr size_t NumClusterMaps = 1;
+constexpr size_t ClusterMapWords = 34;
+# else
+constexpr size_t NumClusterMaps = 2;								// enough for the file being printed and the file being parsed for file info
+constexpr size_t ClusterMapWords = 66;
+# endif
+
+static DWORD clusterMaps[NumClusterMaps][ClusterMapWords];
+static const FileStore *clusterMapOwners[NumClusterMaps] = { nullptr };
+static unsigned int numClusterMapsBuilt = 0;
+static unsigned int numClusterMapsTooSmall = 0;
+static uint32_t longestClusterMapBuildTime = 0;
+
+// Build a cluster map for a file opened for reading so that seeks don't have to follow the cluster chain from the start of the file.
+// Building the map follows the cluster chain once, which takes about as long as seeking to the end of the file.
+// Return true if the file has a map. Returns false if all the maps are in use or the file has too many fragments for the map, in which case seeking works as before.
+bool FileStore::EnableFastSeek() noexcept
 {
-	switch (usageMode)
+# if HAS_SBC_INTERFACE
+	if (reprap.UsingSbcInterface())
 	{
-	case FileUseMode::free:
-		INTERNAL_ERROR;
 		return false;
+	}
+# endif
+	if (usageMode != FileUseMode::readOnly)
+	{
+		return false;
+	}
+# if SUPPORT_MACRO_FILE_CACHE
+	if (cachedFile != nullptr)
+	{
+		return false;													// the file isn't open, we are reading it from RAM
+	}
+# endif
+	if (file.cltbl != nullptr)
+	{
+		return true;
+	}
+# if SUPPORT_FILE_READ_AHEAD
+	if (FileReadAhead::IsAttached(this))
+	{
+		return false;													// the read-ahead task may be using the file object
+	}
+# endif
 
-	case FileUseMode::readOnly:
-	case FileUseMode::readWrite:
+	size_t slot;
+	{
+		TaskCriticalSectionLocker lock;
+		slot = 0;
+		while (slot < NumClusterMaps && clusterMapOwners[slot] != nullptr)
 		{
-			file.cltbl = tbl;
-			const FRESULT ret = f_lseek(&file, CREATE_LINKMAP);
-//			debugPrintf("ret %d need %u\n", (int)ret, tbl[0]);
-			return ret == FR_OK;
+			++slot;
 		}
+		if (slot == NumClusterMaps)
+		{
+			return false;
+		}
+		clusterMapOwners[slot] = this;
+	}
 
-	case FileUseMode::invalidated:
-	default:
+	const uint32_t startTime = StepTimer::GetTimerTicks();
+	clusterMaps[slot][0] = ClusterMapWords;
+	file.cltbl = clusterMaps[slot];
+	const FRESULT rslt = f_lseek(&file, CREATE_LINKMAP);
+	const uint32_t buildTime = StepTimer::GetTimerTicks() - startTime;
+	if (buildTime > longestClusterMapBuildTime)
+	{
+		longestClusterMapBuildTime = buildTime;
+	}
+
+	if (rslt != FR_OK)
+	{
+		if (rslt == FR_NOT_ENOUGH_CORE)
+		{
+			++numClusterMapsTooSmall;
+		}
+		ReleaseClusterMap();
 		return false;
 	}
+	++numClusterMapsBuilt;
+	return true;
+}
+
+void FileStore::ReleaseClusterMap() noexcept
+{
+	if (file.cltbl != nullptr)
+	{
+		file.cltbl = nullptr;
+		TaskCriticalSectionLocker lock;
+		for (const FileStore *& owner : clusterMapOwners)
+		{
+			if (owner == this)
+			{
+				owner = nullptr;
+			}
+		}
+	}
+}
+
+/*static*/ void FileStore::FastSeekDiagnostics(MessageType mtype) noexcept
+{
+	unsigned int numInUse = 0;
+	for (const FileStore *owner : clusterMapOwners)
+	{
+		if (owner != nullptr)
+		{
+			++numInUse;
+		}
+	}
+	reprap.GetPlatform().MessageF(mtype, "Fast seek maps in use %u/%u, built %u, too fragmented %u, longest build time %.1fms\n",
+									numInUse, NumClusterMaps, numClusterMapsBuilt, numClusterMapsTooSmall, (double)((float)longestClusterMapBuildTime * StepClocksToMillis));
+	longestClusterMapBuildTime = 0;
+}
+
+#endif
+
+uint32_t FileStore::ClusterSize() const noexcept
+{
+#if SUPPORT_MACRO_FILE_CACHE
+	if (cachedFile != nullptr)
+	{
+		return 1;
+	}
+#endif
+	return (usageMode == FileUseMode::readOnly || usageMode == FileUseMode::readWrite) ? file.obj.fs->csize * 512u : 1;	// we divide by the cluster size so return 1 not 0 if there is an error
+}
+
+#endif	// HAS_MASS_STORAGE
+
+#if 0	// these are not currently used
+
+bool FileStore::GoToEnd()
+{
+	return Seek(Length());
 }
 
 #endif
@@ -15,6 +15,7 @@
 #endif
 class Platform;
 class FileWriteBuffer;
+class MacroFileCacheEntry;
 
 #if HAS_EMBEDDED_FILES
 typedef int32_t FileIndex;
@@ -25,6 +26,7 @@ typedef int32_t FileIndex;
 enum class OpenMode : uint8_t
 {
 	read,			// open an existing file for reading
+	readCached,		// as read but use the macro file cache if possible
 	write,			// write a file, replacing any existing file of the same name
 	writeWithCrc,	// as write but calculate the CRC as we go
 	append			// append to an existing file, or create a new file if it is not found
@@ -85,8 +87,16 @@ public:
 #if HAS_WRITER_TASK
 	friend void FileWriteBuffer::Spin();
 #endif
-# if 0	// not currently used
-	bool SetClusterMap(uint32_t[]) noexcept;					// Provide a cluster map for fast seeking
+# if SUPPORT_FILE_READ_AHEAD
+	friend class FileReadAhead;
+	bool StartReadAhead() noexcept;								// Start reading this file ahead of the caller, returning true if successful
+	bool IsReadingAhead() const noexcept;
+	int GetReadAheadData(const char *_ecv_array& data) noexcept;	// Get the next block of read-ahead data without copying it
+# endif
+# if FF_USE_FASTSEEK
+	bool EnableFastSeek() noexcept;								// Build a cluster map so that seeks don't have to follow the cluster chain
+	bool HasFastSeek() const noexcept { return file.cltbl != nullptr; }
+	static void FastSeekDiagnostics(MessageType mtype) noexcept;
 # endif
 #endif
 
@@ -108,6 +118,9 @@ private:
 #if HAS_MASS_STORAGE
     FIL file;
 	static uint32_t longestWriteTime;
+# if FF_USE_FASTSEEK
+	void ReleaseClusterMap() noexcept;
+# endif
 #endif
 
 #if HAS_SBC_INTERFACE
@@ -119,7 +132,11 @@ private:
 	FileIndex fileIndex;
 #endif
 
-#if HAS_EMBEDDED_FILES || HAS_SBC_INTERFACE
+#if SUPPORT_MACRO_FILE_CACHE
+	MacroFileCacheEntry *_ecv_null cachedFile;				// if not null then we are reading the contents of the file from the macro file cache
+#endif
+
+#if HAS_EMBEDDED_FILES || HAS_SBC_INTERFACE || SUPPORT_MACRO_FILE_CACHE
 	FilePosition offset;
 #endif
 
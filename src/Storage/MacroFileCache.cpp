@@ -0,0 +1,261 @@
+/*
+ * MacroFileCache.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ */
+
+#include "MacroFileCache.h"
+
+#if SUPPORT_MACRO_FILE_CACHE
+
+#include <Platform/RepRap.h>
+#include <Platform/Platform.h>
+#include <Platform/Tasks.h>
+#include <GCodes/GCodeBuffer/GCodeBuffer.h>
+
+constexpr size_t MaxMemoryLimit = 65536;
+constexpr ptrdiff_t MinNeverUsedRam = 4096;					// don't cache a file if that would leave less than this amount of never-used RAM
+
+static Mutex cacheMutex;
+
+// Static data
+MacroFileCacheEntry *_ecv_null MacroFileCache::entries = nullptr;
+size_t MacroFileCache::memoryLimit = MacroFileCache::DefaultMemoryLimit;
+size_t MacroFileCache::maxFileSize = MacroFileCache::DefaultMaxFileSize;
+size_t MacroFileCache::memoryUsed = 0;
+uint32_t MacroFileCache::useCounter = 0;
+unsigned int MacroFileCache::numHits = 0;
+unsigned int MacroFileCache::numMisses = 0;
+unsigned int MacroFileCache::numChanged = 0;
+unsigned int MacroFileCache::numNotCached = 0;
+
+// Skip any leading "0:" in a path, because the paths of files on the first volume may be given with or without it
+static const char *_ecv_array SkipVolumeZero(const char *_ecv_array path) noexcept
+{
+	return (path[0] == '0' && path[1] == ':') ? path + 2 : path;
+}
+
+// Return the amount of memory that an entry for the specified path and file length uses
+static size_t EntrySize(size_t pathLength, size_t fileLength) noexcept
+{
+	return sizeof(MacroFileCacheEntry) + pathLength + 1 + fileLength;
+}
+
+void MacroFileCache::Init() noexcept
+{
+	cacheMutex.Create("MacroCache");
+}
+
+/*static*/ void MacroFileCache::Free(MacroFileCacheEntry *entry) noexcept
+{
+	memoryUsed -= EntrySize(strlen(entry->storage), entry->length);
+	delete[] entry->storage;
+	delete entry;
+}
+
+/*static*/ void MacroFileCache::MarkStale(MacroFileCacheEntry *entry) noexcept
+{
+	MacroFileCacheEntry *_ecv_null *_ecv_null pp = &entries;
+	while (*pp != entry)
+	{
+		pp = &((*pp)->next);
+	}
+	*pp = entry->next;
+
+	if (entry->refCount == 0)
+	{
+		Free(entry);
+	}
+	else
+	{
+		entry->stale = true;
+	}
+}
+
+/*static*/ bool MacroFileCache::MakeRoom(size_t needed) noexcept
+{
+	while (memoryUsed + needed > memoryLimit)
+	{
+		// Find the least recently used entry that isn't being read
+		MacroFileCacheEntry *_ecv_null victim = nullptr;
+		for (MacroFileCacheEntry *e = entries; e != nullptr; e = e->next)
+		{
+			if (e->refCount == 0 && (victim == nullptr || e->lastUsed < victim->lastUsed))
+			{
+				victim = e;
+			}
+		}
+		if (victim == nullptr)
+		{
+			return false;
+		}
+		MarkStale(victim);
+	}
+	return true;
+}
+
+/*static*/ FRESULT MacroFileCache::Lookup(const char *_ecv_array path, FILINFO& info, MacroFileCacheEntry *_ecv_null& entry) noexcept
+{
+	entry = nullptr;
+	const FRESULT rslt = f_stat(path, &info);
+	if (rslt != FR_OK)
+	{
+		return rslt;
+	}
+
+	MutexLocker lock(cacheMutex);
+	const char *_ecv_array const key = SkipVolumeZero(path);
+	for (MacroFileCacheEntry *e = entries; e != nullptr; e = e->next)
+	{
+		if (StringEqualsIgnoreCase(SkipVolumeZero(e->storage), key))
+		{
+			if (e->length == info.fsize && e->fdate == info.fdate && e->ftime == info.ftime)
+			{
+				++numHits;
+				++e->refCount;
+				e->lastUsed = ++useCounter;
+				entry = e;
+				return FR_OK;
+			}
+
+			// The file has changed since we read it
+			++numChanged;
+			MarkStale(e);
+			break;
+		}
+	}
+	++numMisses;
+	return FR_OK;
+}
+
+/*static*/ MacroFileCacheEntry *_ecv_null MacroFileCache::Add(const char *_ecv_array path, const FILINFO& info, FIL& file) noexcept
+{
+	const size_t pathLength = strlen(path);
+	const size_t needed = EntrySize(pathLength, info.fsize);
+	MutexLocker lock(cacheMutex);
+	if (info.fsize > maxFileSize || needed > memoryLimit || Tasks::GetNeverUsedRam() < (ptrdiff_t)needed + MinNeverUsedRam || !MakeRoom(needed))
+	{
+		++numNotCached;
+		return nullptr;
+	}
+
+	char *_ecv_array const storage = new char[pathLength + 1 + info.fsize];
+	UINT bytesRead;
+	if (f_read(&file, storage + pathLength + 1, info.fsize, &bytesRead) != FR_OK || bytesRead != info.fsize)
+	{
+		delete[] storage;
+		(void)f_lseek(&file, 0);
+		++numNotCached;
+		return nullptr;
+	}
+
+	memcpy(storage, path, pathLength + 1);
+	MacroFileCacheEntry * const e = new MacroFileCacheEntry;
+	e->storage = storage;
+	e->data = storage + pathLength + 1;
+	e->length = info.fsize;
+	e->fdate = info.fdate;
+	e->ftime = info.ftime;
+	e->lastUsed = ++useCounter;
+	e->refCount = 1;
+	e->stale = false;
+	e->next = entries;
+	entries = e;
+	memoryUsed += needed;
+	return e;
+}
+
+/*static*/ void MacroFileCache::Release(MacroFileCacheEntry *entry) noexcept
+{
+	MutexLocker lock(cacheMutex);
+	--entry->refCount;
+	if (entry->refCount == 0)
+	{
+		if (entry->stale)
+		{
+			Free(entry);
+		}
+		else if (memoryUsed > memoryLimit)
+		{
+			MarkStale(entry);									// the memory limit was reduced while this entry was being read
+		}
+	}
+}
+
+// Forget any file whose path is 'path' or starts with 'path' followed by '/', because it may have been a directory
+/*static*/ void MacroFileCache::FileChanged(const char *_ecv_array path) noexcept
+{
+	const char *_ecv_array const key = SkipVolumeZero(path);
+	const size_t keyLength = strlen(key);
+	MutexLocker lock(cacheMutex);
+	MacroFileCacheEntry *_ecv_null e = entries;
+	while (e != nullptr)
+	{
+		MacroFileCacheEntry *_ecv_null const next = e->next;
+		const char *_ecv_array const entryPath = SkipVolumeZero(e->storage);
+		if (StringStartsWithIgnoreCase(entryPath, key) && (entryPath[keyLength] == 0 || entryPath[keyLength] == '/'))
+		{
+			++numChanged;
+			MarkStale(e);
+		}
+		e = next;
+	}
+}
+
+/*static*/ void MacroFileCache::Clear() noexcept
+{
+	MutexLocker lock(cacheMutex);
+	while (entries != nullptr)
+	{
+		MarkStale(entries);
+	}
+}
+
+// Process M473
+/*static*/ GCodeResult MacroFileCache::Configure(GCodeBuffer& gb, const StringRef& reply) THROWS(GCodeException)
+{
+	bool seen = false;
+	uint32_t limit = memoryLimit;
+	gb.TryGetLimitedUIValue('S', limit, seen, MaxMemoryLimit + 1);
+	uint32_t fileSize = maxFileSize;
+	gb.TryGetLimitedUIValue('F', fileSize, seen, MaxMemoryLimit + 1);
+	if (seen)
+	{
+		MutexLocker lock(cacheMutex);
+		memoryLimit = limit;
+		maxFileSize = fileSize;
+		(void)MakeRoom(0);
+		return GCodeResult::ok;
+	}
+
+	if (memoryLimit == 0)
+	{
+		reply.copy("Macro file cache is disabled");
+	}
+	else
+	{
+		unsigned int numFiles = 0;
+		{
+			MutexLocker lock(cacheMutex);
+			for (const MacroFileCacheEntry *e = entries; e != nullptr; e = e->next)
+			{
+				++numFiles;
+			}
+		}
+		reply.printf("Macro file cache holds %u files using %u of %u bytes, maximum file size %u bytes",
+						numFiles, (unsigned int)memoryUsed, (unsigned int)memoryLimit, (unsigned int)maxFileSize);
+	}
+	return GCodeResult::ok;
+}
+
+/*static*/ void MacroFileCache::Diagnostics(MessageType mtype) noexcept
+{
+	reprap.GetPlatform().MessageF(mtype, "Macro file cache: %u of %u bytes used, hits %u, misses %u, changed %u, not cached %u\n",
+									(unsigned int)memoryUsed, (unsigned int)memoryLimit, numHits, numMisses, numChanged, numNotCached);
+	numHits = numMisses = numChanged = numNotCached = 0;
+}
+
+#endif
+
+// End
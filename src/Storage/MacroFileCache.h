@@ -0,0 +1,94 @@
+/*
+ * MacroFileCache.h
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: agent
+ *
+ * Cache of the contents of small macro files in RAM.
+ * Macros such as daemon.g, the homing files and the tool change files are run over and over again, and each time they used to be opened and read from the SD card.
+ * When GCodes runs a macro it opens the file in OpenMode::readCached. FileStore then looks the file up here. If we hold its contents and the size and
+ * modification date and time that FatFS reports for it are the same as when we read it, the FileStore reads from the cached copy and the file is not opened.
+ * Otherwise the file is opened as usual and if it is small enough we read it into a new entry, replacing the least recently used entries if the memory cap is reached.
+ *
+ * FatFS only records the modification time to 2 seconds, so MassStorage also tells us when it writes, deletes or renames a file or directory.
+ * An entry that is being read by a FileStore is never freed or changed. If the file changes, the entry is marked stale and freed when the last reader closes it.
+ * The cache has its own mutex. If a caller also needs the file table mutex then it must take that mutex first. The cache may take a volume mutex by calling FatFS.
+ */
+
+#ifndef SRC_STORAGE_MACROFILECACHE_H_
+#define SRC_STORAGE_MACROFILECACHE_H_
+
+#include <RepRapFirmware.h>
+
+#if SUPPORT_MACRO_FILE_CACHE
+
+#include <Libraries/Fatfs/ff.h>
+#include <GCodes/GCodeException.h>
+
+class GCodeBuffer;
+
+class MacroFileCacheEntry
+{
+public:
+	const char *_ecv_array GetData() const noexcept { return data; }
+	FilePosition GetLength() const noexcept { return length; }
+
+private:
+	friend class MacroFileCache;
+
+	MacroFileCacheEntry *_ecv_null next;
+	char *_ecv_array storage;						// the path followed by its null terminator, then the contents of the file
+	const char *_ecv_array data;					// the contents of the file, which is part of the storage
+	FilePosition length;
+	uint32_t lastUsed;								// value of the use counter when this entry was last opened, for replacement
+	unsigned int refCount;							// the number of FileStore objects reading this entry
+	uint16_t fdate, ftime;							// the modification date and time of the file when we read it
+	bool stale;										// true if the file has changed since we read it
+};
+
+class MacroFileCache
+{
+public:
+	static constexpr size_t DefaultMaxFileSize = 4096;
+#if LPC17xx
+	static constexpr size_t DefaultMemoryLimit = 2048;
+#else
+	static constexpr size_t DefaultMemoryLimit = 8192;
+#endif
+
+	static void Init() noexcept;
+	static bool IsEnabled() noexcept { return memoryLimit != 0; }
+
+	// Get the details of a file. If the call succeeds and we hold the unchanged contents of the file, also return the entry with a reference to it taken.
+	static FRESULT Lookup(const char *_ecv_array path, FILINFO& info, MacroFileCacheEntry *_ecv_null& entry) noexcept;
+
+	// Try to read the whole of a file that has just been opened into a new entry. If we succeed then return the entry with a reference to it taken.
+	// If we don't then return null and leave the file positioned at the start.
+	static MacroFileCacheEntry *_ecv_null Add(const char *_ecv_array path, const FILINFO& info, FIL& file) noexcept;
+
+	static void Release(MacroFileCacheEntry *entry) noexcept;		// release a reference taken by Lookup or Add
+	static void FileChanged(const char *_ecv_array path) noexcept;	// called when a file or directory has been written, deleted or renamed
+	static void Clear() noexcept;									// forget all files, for example because a volume has been unmounted
+
+	static GCodeResult Configure(GCodeBuffer& gb, const StringRef& reply) THROWS(GCodeException);
+	static void Diagnostics(MessageType mtype) noexcept;
+
+private:
+	static void Free(MacroFileCacheEntry *entry) noexcept;			// free an entry that has been unlinked or is stale. The caller must hold the mutex.
+	static void MarkStale(MacroFileCacheEntry *entry) noexcept;	// remove an entry from the list and free it when it is no longer referenced. The caller must hold the mutex.
+	static bool MakeRoom(size_t needed) noexcept;					// free unreferenced entries until we have room for 'needed' more bytes. The caller must hold the mutex.
+
+	static MacroFileCacheEntry *_ecv_null entries;
+	static size_t memoryLimit;
+	static size_t maxFileSize;
+	static size_t memoryUsed;										// includes stale entries that are still referenced
+	static uint32_t useCounter;
+	static unsigned int numHits;
+	static unsigned int numMisses;
+	static unsigned int numChanged;
+	static unsigned int numNotCached;
+};
+
+#endif
+
+#endif /* SRC_STORAGE_MACROFILECACHE_H_ */
@@ -19,12 +19,21 @@ static_assert(FF_MAX_LFN >= MaxFilenameLength, "FF_MAX_LFN too small");
 # include <SBC/SbcInterface.h>
 #endif
 
+#if SUPPORT_FILE_READ_AHEAD
+# include "FileReadAhead.h"
+#endif
+
+#if SUPPORT_MACRO_FILE_CACHE
+# include "MacroFileCache.h"
+#endif
+
 #ifdef DUET3_MB6HC
 # include <GCodes/GCodeBuffer/GCodeBuffer.h>
 #endif
 
 // A note on using mutexes:
 // Each SD card volume has its own mutex. There is also one for the file table, and one for the find first/find next buffer.
+// The macro file cache has its own mutex, which must be taken after the file table mutex and before any volume mutex.
 // The FatFS subsystem locks and releases the appropriate volume mutex when it is called.
 // Any function that needs to acquire both the file table mutex and a volume mutex MUST take the file table mutex first, to avoid deadlocks.
 // Any function that needs to acquire both the find buffer mutex and a volume mutex MUST take the find buffer mutex first, to avoid deadlocks.
@@ -236,6 +245,9 @@ uint16_t MassStorage::GetVolumeSeq(unsigned int volume) noexcept
 // Return true if we did update the sequence number
 static bool VolumeUpdated(const char *path) noexcept
 {
+#if SUPPORT_MACRO_FILE_CACHE
+	MacroFileCache::FileChanged(path);
+#endif
 	if (!StringEndsWithIgnoreCase(path, ".part")
 #if HAS_SBC_INTERFACE
 		&& !reprap.UsingSbcInterface()
@@ -255,6 +267,9 @@ static bool VolumeUpdated(const char *path) noexcept
 // Unmount a file system returning the number of open files were invalidated
 static unsigned int InternalUnmount(size_t card, bool doClose) noexcept
 {
+#if SUPPORT_MACRO_FILE_CACHE
+	MacroFileCache::Clear();								// do this before we take the volume mutex
+#endif
 	SdCardInfo& inf = info[card];
 	MutexLocker lock1(fsMutex);
 	MutexLocker lock2(inf.volMutex);
@@ -353,6 +368,12 @@ void MassStorage::Init() noexcept
 #if HAS_WRITER_TASK
 	FileWriteBuffer::InitWriterTask();
 #endif
+#if SUPPORT_FILE_READ_AHEAD
+	FileReadAhead::Init();
+#endif
+#if SUPPORT_MACRO_FILE_CACHE
+	MacroFileCache::Init();
+#endif
 # if HAS_MASS_STORAGE
 	static const char * const VolMutexNames[] = { "SD0", "SD1" };
 	static_assert(ARRAY_SIZE(VolMutexNames) >= NumSdCards, "Incorrect VolMutexNames array");
@@ -903,6 +924,12 @@ bool MassStorage::Rename(const char *oldFilename, const char *newFilename, bool
 	{
 		(void)VolumeUpdated(newFilename);
 	}
+#if SUPPORT_MACRO_FILE_CACHE
+	else
+	{
+		MacroFileCache::FileChanged(newFilename);		// VolumeUpdated didn't do this for the new name
+	}
+#endif
 	return true;
 }
 #endif
@@ -1172,6 +1199,15 @@ void MassStorage::Diagnostics(MessageType mtype) noexcept
 	// Show the longest SD card write time
 	platform.MessageF(mtype, "SD card longest read time %.1fms, write time %.1fms, max retries %u\n",
 								(double)DiskioGetAndClearLongestReadTime(), (double)DiskioGetAndClearLongestWriteTime(), DiskioGetAndClearMaxRetryCount());
+#  if FF_USE_FASTSEEK
+	FileStore::FastSeekDiagnostics(mtype);
+#  endif
+#  if SUPPORT_FILE_READ_AHEAD
+	FileReadAhead::Diagnostics(mtype);
+#  endif
+#  if SUPPORT_MACRO_FILE_CACHE
+	MacroFileCache::Diagnostics(mtype);
+#  endif
 # endif
 }
 